@@ -0,0 +1,128 @@
+#ifndef _OS_H
+#define _OS_H
+
+// The threads of Haiku's <OS.h> that libsoftkm_core uses, over pthreads.
+// As on Haiku, a spawned thread waits for resume_thread() (or
+// wait_for_thread()) before it runs. Priorities are ignored.
+
+#include <SupportDefs.h>
+
+#include <pthread.h>
+
+#include <map>
+#include <mutex>
+
+typedef int32 thread_id;
+typedef int32 (*thread_func)(void* data);
+
+#define B_LOW_PRIORITY                  5
+#define B_NORMAL_PRIORITY               10
+#define B_DISPLAY_PRIORITY              15
+#define B_URGENT_DISPLAY_PRIORITY       20
+#define B_REAL_TIME_DISPLAY_PRIORITY    100
+
+#define B_OS_ERROR_BASE         (B_GENERAL_ERROR_BASE + 0x1000)
+#define B_BAD_THREAD_ID         (B_OS_ERROR_BASE + 0x100)
+
+namespace BPrivate {
+
+struct StubThread {
+    thread_func function;
+    void* data;
+    char name[16];
+    pthread_t thread;
+    bool started;
+    status_t result;
+};
+
+inline std::mutex& StubThreadLock()
+{
+    static std::mutex lock;
+    return lock;
+}
+
+inline std::map<thread_id, StubThread*>& StubThreads()
+{
+    static std::map<thread_id, StubThread*> threads;
+    return threads;
+}
+
+inline void* StubThreadEntry(void* data)
+{
+    StubThread* thread = (StubThread*)data;
+    thread->result = thread->function(thread->data);
+    return nullptr;
+}
+
+// Looks up id, starting it if it was not yet; the lock must be held
+inline StubThread* StubStartThread(thread_id id, status_t* status)
+{
+    std::map<thread_id, StubThread*>::iterator found = StubThreads().find(id);
+    if (found == StubThreads().end()) {
+        *status = B_BAD_THREAD_ID;
+        return nullptr;
+    }
+
+    StubThread* thread = found->second;
+    *status = B_OK;
+    if (!thread->started) {
+        if (pthread_create(&thread->thread, nullptr, StubThreadEntry,
+                thread) != 0) {
+            *status = B_NO_MEMORY;
+            return nullptr;
+        }
+        pthread_setname_np(thread->thread, thread->name);
+        thread->started = true;
+    }
+    return thread;
+}
+
+}   // namespace BPrivate
+
+inline thread_id spawn_thread(thread_func function, const char* name,
+    int32 priority, void* data)
+{
+    static thread_id sNextID = 1;
+
+    BPrivate::StubThread* thread = new BPrivate::StubThread;
+    thread->function = function;
+    thread->data = data;
+    strlcpy(thread->name, name != nullptr ? name : "thread",
+        sizeof(thread->name));
+    thread->started = false;
+    thread->result = B_OK;
+
+    std::lock_guard<std::mutex> _(BPrivate::StubThreadLock());
+    thread_id id = sNextID++;
+    BPrivate::StubThreads()[id] = thread;
+    return id;
+}
+
+inline status_t resume_thread(thread_id id)
+{
+    std::lock_guard<std::mutex> _(BPrivate::StubThreadLock());
+    status_t status;
+    BPrivate::StubStartThread(id, &status);
+    return status;
+}
+
+inline status_t wait_for_thread(thread_id id, status_t* result)
+{
+    BPrivate::StubThread* thread;
+    {
+        std::lock_guard<std::mutex> _(BPrivate::StubThreadLock());
+        status_t status;
+        thread = BPrivate::StubStartThread(id, &status);
+        if (thread == nullptr)
+            return status;
+        BPrivate::StubThreads().erase(id);
+    }
+
+    pthread_join(thread->thread, nullptr);
+    if (result != nullptr)
+        *result = thread->result;
+    delete thread;
+    return B_OK;
+}
+
+#endif // _OS_H
@@ -0,0 +1,75 @@
+#ifndef _SUPPORT_DEFS_H
+#define _SUPPORT_DEFS_H
+
+// The part of Haiku's <SupportDefs.h> and <Errors.h> that libsoftkm_core
+// uses, for building it elsewhere. Types and values match Haiku's.
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef int8_t int8;
+typedef uint8_t uint8;
+typedef int16_t int16;
+typedef uint16_t uint16;
+typedef int32_t int32;
+typedef uint32_t uint32;
+typedef int64_t int64;
+typedef uint64_t uint64;
+
+typedef int32 status_t;
+typedef int64 bigtime_t;
+
+#define B_GENERAL_ERROR_BASE    INT_MIN
+#define B_STORAGE_ERROR_BASE    (B_GENERAL_ERROR_BASE + 0x6000)
+
+#define B_OK                    ((status_t)0)
+#define B_ERROR                 (-1)
+#define B_NO_MEMORY             (B_GENERAL_ERROR_BASE + 0)
+#define B_IO_ERROR              (B_GENERAL_ERROR_BASE + 1)
+#define B_PERMISSION_DENIED     (B_GENERAL_ERROR_BASE + 2)
+#define B_BAD_INDEX             (B_GENERAL_ERROR_BASE + 3)
+#define B_BAD_TYPE              (B_GENERAL_ERROR_BASE + 4)
+#define B_BAD_VALUE             (B_GENERAL_ERROR_BASE + 5)
+#define B_MISMATCHED_VALUES     (B_GENERAL_ERROR_BASE + 6)
+#define B_NAME_NOT_FOUND        (B_GENERAL_ERROR_BASE + 7)
+#define B_NAME_IN_USE           (B_GENERAL_ERROR_BASE + 8)
+#define B_TIMED_OUT             (B_GENERAL_ERROR_BASE + 9)
+#define B_INTERRUPTED           (B_GENERAL_ERROR_BASE + 10)
+#define B_WOULD_BLOCK           (B_GENERAL_ERROR_BASE + 11)
+#define B_CANCELED              (B_GENERAL_ERROR_BASE + 12)
+#define B_NO_INIT               (B_GENERAL_ERROR_BASE + 13)
+#define B_BUSY                  (B_GENERAL_ERROR_BASE + 14)
+#define B_NOT_ALLOWED           (B_GENERAL_ERROR_BASE + 15)
+#define B_BAD_DATA              (B_GENERAL_ERROR_BASE + 16)
+
+#define B_FILE_ERROR            (B_STORAGE_ERROR_BASE + 0)
+#define B_FILE_EXISTS           (B_STORAGE_ERROR_BASE + 2)
+#define B_ENTRY_NOT_FOUND       (B_STORAGE_ERROR_BASE + 3)
+#define B_NAME_TOO_LONG         (B_STORAGE_ERROR_BASE + 4)
+#define B_NOT_A_DIRECTORY       (B_STORAGE_ERROR_BASE + 5)
+#define B_DIRECTORY_NOT_EMPTY   (B_STORAGE_ERROR_BASE + 6)
+#define B_DEVICE_FULL           (B_STORAGE_ERROR_BASE + 7)
+
+// errno values are negative on Haiku, and already status_t; not so here
+#define B_FROM_POSIX_ERROR(error)   (-(error))
+#define B_TO_POSIX_ERROR(error)     (-(error))
+
+// Haiku's libroot has it; glibc only from 2.38 on
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+static inline size_t
+strlcpy(char* dest, const char* source, size_t size)
+{
+    size_t length = strlen(source);
+    if (size > 0) {
+        size_t copy = length < size - 1 ? length : size - 1;
+        memcpy(dest, source, copy);
+        dest[copy] = '\0';
+    }
+    return length;
+}
+#endif
+
+#endif // _SUPPORT_DEFS_H
@@ -0,0 +1,54 @@
+#include "clipboard/ContentHash.h"
+
+#include "Test.h"
+
+#include <vector>
+
+static std::vector<uint8> Sample(size_t length)
+{
+    std::vector<uint8> data(length);
+    for (size_t i = 0; i < length; i++)
+        data[i] = (uint8)(i * 31 + (i >> 8));
+    return data;
+}
+
+TEST(HasherMatchesTheOneShotHashInPieces)
+{
+    std::vector<uint8> data = Sample(1000);
+    uint64 expected = ContentHash(data.data(), data.size());
+    CHECK(expected != ContentHash(data.data(), data.size() - 1));
+
+    // Pieces that do and do not end on a word
+    static const size_t kPieces[] = { 1, 3, 8, 5, 16, 0, 7, 13, 64 };
+    ContentHasher hasher(data.size());
+    size_t offset = 0;
+    for (size_t i = 0; offset < data.size(); i++) {
+        size_t length = kPieces[i % (sizeof(kPieces) / sizeof(kPieces[0]))];
+        if (length > data.size() - offset)
+            length = data.size() - offset;
+        hasher.Update(data.data() + offset, length);
+        offset += length;
+    }
+    CHECK(hasher.Final() == expected);
+
+    ContentHasher whole(data.size());
+    whole.Update(data.data(), data.size());
+    CHECK(whole.Final() == expected);
+}
+
+TEST(HasherResumesFromItsState)
+{
+    std::vector<uint8> data = Sample(999);
+    uint64 expected = ContentHash(data.data(), data.size());
+
+    ContentHasher first(data.size());
+    first.Update(data.data(), 512);
+    CHECK_EQUAL(first.Consumed(), 512u);
+
+    // Carried on by another hasher, as after a reconnect
+    ContentHasher second(data.size());
+    second.Restore(first.Consumed(), first.State());
+    second.Update(data.data() + 512, 100);
+    second.Update(data.data() + 612, data.size() - 612);
+    CHECK(second.Final() == expected);
+}
@@ -0,0 +1,181 @@
+#include "input/EdgeSwitchPolicy.h"
+#include "network/Protocol.h"
+
+#include "Test.h"
+
+// One client move: microseconds since the one before, the relative motion
+// and the modifiers held
+struct TrajectorySample {
+    bigtime_t delay;
+    float x;
+    float y;
+    uint32 modifiers;
+};
+
+// Pointer paths towards the right edge of a 1920x1080 screen as the Mac
+// client sends them, a flush every 16 ms or so with the jitter of its
+// timer; each starts from the point given to Replay()
+
+// A flick across the screen that decelerates into the edge
+static const TrajectorySample kFlick[] = {
+    { 16000, 96, 2, 0 }, { 16300, 131, 1, 0 }, { 15800, 142, 0, 0 },
+    { 16100, 128, -1, 0 }, { 16000, 97, 0, 0 }, { 16400, 61, 0, 0 },
+    { 15900, 32, 0, 0 }, { 16000, 14, 0, 0 }, { 16000, 5, 0, 0 },
+};
+
+// Someone carefully nudging the pointer up against the edge
+static const TrajectorySample kDrift[] = {
+    { 16000, 3, 0, 0 }, { 16200, 2, 0, 0 }, { 15900, 2, 1, 0 },
+    { 16000, 2, 0, 0 }, { 16100, 1, 0, 0 }, { 16000, 2, 0, 0 },
+    { 16000, 1, 0, 0 }, { 16300, 1, 0, 0 }, { 15800, 1, 0, 0 },
+    { 16000, 1, 0, 0 }, { 16000, 1, 0, 0 }, { 16100, 1, 0, 0 },
+    { 16000, 1, 0, 0 }, { 15900, 1, 0, 0 }, { 16000, 1, 0, 0 },
+    { 16000, 1, 0, 0 }, { 16200, 1, 0, 0 }, { 16000, 1, 0, 0 },
+    { 15800, 1, 0, 0 }, { 16000, 1, 0, 0 }, { 16000, 1, 0, 0 },
+    { 16100, 1, 0, 0 }, { 16000, 1, 0, 0 }, { 16000, 1, 0, 0 },
+    { 16000, 1, 0, 0 }, { 16000, 1, 0, 0 }, { 16100, 1, 0, 0 },
+    { 15900, 1, 0, 0 }, { 16000, 1, 0, 0 }, { 16000, 1, 0, 0 },
+};
+
+// A steady, unhurried push that keeps going past the edge
+static const TrajectorySample kPush[] = {
+    { 16000, 9, 0, 0 }, { 16000, 10, 0, 0 }, { 16100, 9, 0, 0 },
+    { 15900, 10, 0, 0 }, { 16000, 11, 0, 0 }, { 16000, 10, 0, 0 },
+    { 16200, 9, 0, 0 }, { 16000, 10, 0, 0 }, { 15800, 10, 0, 0 },
+    { 16000, 11, 0, 0 }, { 16000, 10, 0, 0 }, { 16000, 9, 0, 0 },
+    { 16100, 10, 0, 0 },
+};
+
+// Reaching for a scroll bar: touches the edge and comes back
+static const TrajectorySample kTouchAndBack[] = {
+    { 16000, 8, 0, 0 }, { 16000, 6, 0, 0 }, { 16000, 3, 0, 0 },
+    { 16000, 1, 0, 0 }, { 16000, 1, 0, 0 }, { 16000, 0, 2, 0 },
+    { 16000, 0, 3, 0 }, { 16000, 0, 2, 0 }, { 16000, -4, 1, 0 },
+    { 16000, -9, 0, 0 }, { 16000, -14, 0, 0 }, { 16000, -12, 0, 0 },
+};
+
+// Index of the first sample that switches and why; -1 and
+// EDGE_SWITCH_NONE if none does
+static EdgeSwitchReason Replay(EdgeSwitchPolicy& policy,
+    const TrajectorySample* samples, int32 count, float x, float y,
+    int32* index, uint32 extraModifiers = 0)
+{
+    // As InputCore does: the request is the clamped position plus the move
+    bigtime_t when = 1000000;
+    for (int32 i = 0; i < count; i++) {
+        when += samples[i].delay;
+        float requestedX = x + samples[i].x;
+        float requestedY = y + samples[i].y;
+        EdgeSwitchReason reason = policy.Update(when, requestedX, requestedY,
+            samples[i].modifiers | extraModifiers);
+        if (reason != EDGE_SWITCH_NONE) {
+            *index = i;
+            return reason;
+        }
+        x = requestedX < 0 ? 0 : (requestedX > 1919 ? 1919 : requestedX);
+        y = requestedY < 0 ? 0 : (requestedY > 1079 ? 1079 : requestedY);
+    }
+    *index = -1;
+    return EDGE_SWITCH_NONE;
+}
+
+#define REPLAY(policy, samples, x, y, index) \
+    Replay(policy, samples, sizeof(samples) / sizeof(samples[0]), x, y, index)
+
+static void RightEdge(EdgeSwitchPolicy& policy)
+{
+    policy.SetScreen(1920, 1080);
+    policy.SetEdges(1 << EDGE_RIGHT);
+}
+
+TEST(EdgeSwitchDefaultsMatchTheSettings)
+{
+    EdgeSwitchPolicy policy;
+    const EdgeSwitchConfig& config = policy.Config();
+    CHECK_EQUAL(config.dwellTime, 300000);
+    CHECK(config.pushThroughVelocity > 0);
+    CHECK(config.overshootDistance > 0);
+    CHECK(config.cornerSize > 0);
+    CHECK_EQUAL(config.bypassModifiers, 0u);
+}
+
+TEST(EdgeSwitchFlickSwitchesOnArrival)
+{
+    EdgeSwitchPolicy policy;
+    RightEdge(policy);
+    int32 index;
+    CHECK(REPLAY(policy, kFlick, 1230, 540, &index) == EDGE_SWITCH_VELOCITY);
+    // The move that reaches the edge, not a dwell later
+    CHECK_EQUAL(index, 6);
+}
+
+TEST(EdgeSwitchDriftWaitsForTheDwell)
+{
+    EdgeSwitchPolicy policy;
+    RightEdge(policy);
+    int32 index;
+    CHECK(REPLAY(policy, kDrift, 1900, 540, &index) == EDGE_SWITCH_DWELL);
+    CHECK(policy.Velocity() < policy.Config().pushThroughVelocity);
+    // At the edge from sample 8 (x 1915) on, 300 ms later
+    CHECK_EQUAL(index, 27);
+}
+
+TEST(EdgeSwitchPushSwitchesOnOvershoot)
+{
+    EdgeSwitchPolicy policy;
+    RightEdge(policy);
+    int32 index;
+    CHECK(REPLAY(policy, kPush, 1860, 540, &index) == EDGE_SWITCH_OVERSHOOT);
+    // 60 px past the edge, 112 ms after reaching it
+    CHECK_EQUAL(index, 12);
+
+    // Without the overshoot rule the same push has to dwell
+    EdgeSwitchConfig config = EdgeSwitchPolicy::kDefaultConfig;
+    config.overshootDistance = 0;
+    policy.SetConfig(config);
+    policy.Reset();
+    CHECK(REPLAY(policy, kPush, 1860, 540, &index) == EDGE_SWITCH_NONE);
+}
+
+TEST(EdgeSwitchTouchAndBackStays)
+{
+    EdgeSwitchPolicy policy;
+    RightEdge(policy);
+    int32 index;
+    CHECK(REPLAY(policy, kTouchAndBack, 1900, 540, &index)
+        == EDGE_SWITCH_NONE);
+    CHECK_EQUAL(policy.Edge(), -1);
+}
+
+TEST(EdgeSwitchCornersNeverSwitch)
+{
+    EdgeSwitchPolicy policy;
+    RightEdge(policy);
+    int32 index;
+    // The flick again, into the top right corner
+    CHECK(REPLAY(policy, kFlick, 1230, 8, &index) == EDGE_SWITCH_NONE);
+    CHECK(REPLAY(policy, kDrift, 1900, 1075, &index) == EDGE_SWITCH_NONE);
+}
+
+TEST(EdgeSwitchOnlyOverEdgesThatLeadSomewhere)
+{
+    EdgeSwitchPolicy policy;
+    policy.SetScreen(1920, 1080);
+    policy.SetEdges(1 << EDGE_LEFT);
+    int32 index;
+    CHECK(REPLAY(policy, kFlick, 1230, 540, &index) == EDGE_SWITCH_NONE);
+}
+
+TEST(EdgeSwitchBypassModifierSwitchesAtOnce)
+{
+    EdgeSwitchPolicy policy;
+    RightEdge(policy);
+    EdgeSwitchConfig config = EdgeSwitchPolicy::kDefaultConfig;
+    config.bypassModifiers = 0x01;
+    policy.SetConfig(config);
+
+    int32 index;
+    CHECK(Replay(policy, kDrift, sizeof(kDrift) / sizeof(kDrift[0]), 1900,
+        540, &index, 0x01) == EDGE_SWITCH_MODIFIER);
+    CHECK_EQUAL(index, 8);
+}
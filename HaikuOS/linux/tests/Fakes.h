@@ -0,0 +1,254 @@
+#ifndef SOFTKM_TEST_FAKES_H
+#define SOFTKM_TEST_FAKES_H
+
+// Stand-ins for the Platform.h interfaces that record what the core did
+// with them, and builders for wire messages.
+
+#include "network/InputDispatcher.h"
+#include "network/Protocol.h"
+#include "platform/Platform.h"
+
+#include <cstring>
+#include <vector>
+
+class FakeClock : public Clock {
+public:
+    FakeClock() : fNow(1000000) {}
+
+    virtual bigtime_t Now() { return fNow; }
+    void Set(bigtime_t now) { fNow = now; }
+    void Advance(bigtime_t by) { fNow += by; }
+
+private:
+    bigtime_t fNow;
+};
+
+class FakeScreen : public ScreenGeometry {
+public:
+    FakeScreen(float width = 1920, float height = 1080)
+        : fWidth(width), fHeight(height) {}
+
+    virtual void GetScreenSize(float* width, float* height)
+        { *width = fWidth; *height = fHeight; }
+
+private:
+    float fWidth;
+    float fHeight;
+};
+
+enum SinkEventType {
+    SINK_KEY_DOWN,
+    SINK_KEY_UP,
+    SINK_MOUSE_MOVED,
+    SINK_MOUSE_DOWN,
+    SINK_MOUSE_UP,
+    SINK_MOUSE_WHEEL
+};
+
+struct SinkEvent {
+    SinkEventType type;
+    uint32 key;
+    uint32 modifiers;
+    float x;                    // or the wheel's deltaX
+    float y;
+    uint32 buttons;
+    uint32 clicks;
+};
+
+// Keeps every event. The cursor follows the moves and SetCursor() unless
+// pinned, as by a game warping it back.
+class RecordingSink : public InjectionSink {
+public:
+    RecordingSink()
+        : fCursorX(0), fCursorY(0), fPinned(false) {}
+
+    std::vector<SinkEvent> events;
+
+    void Pin(float x, float y)
+        { fPinned = true; fCursorX = x; fCursorY = y; }
+    void Unpin() { fPinned = false; }
+    int32 Count(SinkEventType type) const
+    {
+        int32 count = 0;
+        for (size_t i = 0; i < events.size(); i++) {
+            if (events[i].type == type)
+                count++;
+        }
+        return count;
+    }
+
+    virtual bool KeyDown(bigtime_t eventStart, uint32 key,
+        uint32 modifiers, const char* bytes, uint8 numBytes)
+        { return Add(SINK_KEY_DOWN, key, modifiers, 0, 0, 0, 0); }
+    virtual bool KeyUp(bigtime_t eventStart, uint32 key, uint32 modifiers)
+        { return Add(SINK_KEY_UP, key, modifiers, 0, 0, 0, 0); }
+    virtual bool MouseMoved(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers)
+    {
+        SetCursor(x, y);
+        return Add(SINK_MOUSE_MOVED, 0, modifiers, x, y, buttons, 0);
+    }
+    virtual bool MouseDown(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers, uint32 clicks)
+        { return Add(SINK_MOUSE_DOWN, 0, modifiers, x, y, buttons, clicks); }
+    virtual bool MouseUp(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers)
+        { return Add(SINK_MOUSE_UP, 0, modifiers, x, y, buttons, 0); }
+    virtual bool MouseWheel(bigtime_t eventStart, float deltaX,
+        float deltaY, uint32 modifiers)
+        { return Add(SINK_MOUSE_WHEEL, 0, modifiers, deltaX, deltaY, 0, 0); }
+
+    virtual void SetCursor(float x, float y)
+    {
+        if (fPinned)
+            return;
+        fCursorX = x;
+        fCursorY = y;
+    }
+    virtual bool GetCursor(float* x, float* y)
+        { *x = fCursorX; *y = fCursorY; return true; }
+
+private:
+    bool Add(SinkEventType type, uint32 key, uint32 modifiers, float x,
+        float y, uint32 buttons, uint32 clicks)
+    {
+        SinkEvent event = { type, key, modifiers, x, y, buttons, clicks };
+        events.push_back(event);
+        return true;
+    }
+
+    float fCursorX;
+    float fCursorY;
+    bool fPinned;
+};
+
+class FakePeerLink : public PeerLink {
+public:
+    FakePeerLink()
+        : neighbours(0), forwardStatus(B_OK), switches(0), forwards(0),
+          lastEdge(-1), lastYRatio(-1) {}
+
+    uint32 neighbours;          // 1 << edge
+    status_t forwardStatus;     // what ForwardControl() returns
+
+    int32 switches;             // SendControlSwitch() calls
+    int32 forwards;             // ForwardControl() calls
+    int32 lastEdge;
+    float lastYRatio;
+
+    virtual bool HasNeighbour(uint8 edge) const
+        { return (neighbours & (1 << edge)) != 0; }
+    virtual void SendControlSwitch(uint8 direction, float yRatio)
+        { switches++; lastYRatio = yRatio; }
+    virtual status_t ForwardControl(uint8 edge, float yRatio)
+    {
+        forwards++;
+        lastEdge = edge;
+        lastYRatio = yRatio;
+        return forwardStatus;
+    }
+};
+
+struct HandledEvent {
+    uint8 type;                 // EVENT_KEY_DOWN ... EVENT_MOUSE_WHEEL
+    uint32 code;                // key code or buttons
+    uint32 modifiers;
+    float x;                    // or the wheel's deltaX
+    float y;
+    bool relative;
+    uint32 clicks;
+    int32 count;                // client moves in a relative one
+    std::vector<char> bytes;
+};
+
+class RecordingHandler : public InputEventHandler {
+public:
+    std::vector<HandledEvent> events;
+
+    virtual void InjectKeyDown(uint32 keyCode, uint32 modifiers,
+        const char* bytes, uint8 numBytes)
+        { Add(EVENT_KEY_DOWN, keyCode, modifiers, 0, 0, false, 0)
+            .bytes.assign(bytes, bytes + numBytes); }
+    virtual void InjectKeyUp(uint32 keyCode, uint32 modifiers)
+        { Add(EVENT_KEY_UP, keyCode, modifiers, 0, 0, false, 0); }
+    virtual void InjectMouseMove(float x, float y, bool relative,
+        uint32 modifiers)
+        { Add(EVENT_MOUSE_MOVE, 0, modifiers, x, y, relative, 0); }
+    virtual void InjectMouseDown(uint32 buttons, float x, float y,
+        uint32 modifiers, uint32 clicks)
+        { Add(EVENT_MOUSE_DOWN, buttons, modifiers, x, y, false, clicks); }
+    virtual void InjectMouseUp(uint32 buttons, float x, float y,
+        uint32 modifiers)
+        { Add(EVENT_MOUSE_UP, buttons, modifiers, x, y, false, 0); }
+    virtual void InjectMouseWheel(float deltaX, float deltaY,
+        uint32 modifiers)
+        { Add(EVENT_MOUSE_WHEEL, 0, modifiers, deltaX, deltaY, false, 0); }
+    virtual void InjectMouseMoves(float x, float y, int32 count,
+        uint32 modifiers)
+        { Add(EVENT_MOUSE_MOVE, 0, modifiers, x, y, true, 0).count = count; }
+
+private:
+    HandledEvent& Add(uint8 type, uint32 code, uint32 modifiers, float x,
+        float y, bool relative, uint32 clicks)
+    {
+        HandledEvent event;
+        event.type = type;
+        event.code = code;
+        event.modifiers = modifiers;
+        event.x = x;
+        event.y = y;
+        event.relative = relative;
+        event.clicks = clicks;
+        event.count = 1;
+        events.push_back(event);
+        return events.back();
+    }
+};
+
+// A framed message of type with payload, as a peer sends it
+inline std::vector<uint8> MakeMessage(uint8 type, const void* payload,
+    size_t length)
+{
+    std::vector<uint8> message(sizeof(ProtocolHeader) + length);
+    ProtocolHeader* header = (ProtocolHeader*)message.data();
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = type;
+    header->length = length;
+    if (length > 0)
+        memcpy(message.data() + sizeof(ProtocolHeader), payload, length);
+    return message;
+}
+
+inline std::vector<uint8> MakeKeyDown(uint32 keyCode, uint32 macModifiers,
+    const char* bytes = "")
+{
+    size_t numBytes = strlen(bytes);
+    std::vector<uint8> payload(sizeof(KeyEventPayload) + numBytes);
+    KeyEventPayload* key = (KeyEventPayload*)payload.data();
+    key->keyCode = keyCode;
+    key->modifiers = macModifiers;
+    key->numBytes = numBytes;
+    memcpy(payload.data() + sizeof(KeyEventPayload), bytes, numBytes);
+    return MakeMessage(EVENT_KEY_DOWN, payload.data(), payload.size());
+}
+
+inline std::vector<uint8> MakeMouseMove(float x, float y, bool relative,
+    uint32 macModifiers = 0)
+{
+    MouseMovePayload move = { x, y, (uint8)(relative ? 1 : 0),
+        macModifiers };
+    return MakeMessage(EVENT_MOUSE_MOVE, &move, sizeof(move));
+}
+
+// A bulk message of length bytes in all, header included, with a payload
+// that tells where each byte came from
+inline std::vector<uint8> MakeBulk(uint8 type, size_t length)
+{
+    std::vector<uint8> payload(length - sizeof(ProtocolHeader));
+    for (size_t i = 0; i < payload.size(); i++)
+        payload[i] = (uint8)(i * 7 + i / 251);
+    return MakeMessage(type, payload.data(), payload.size());
+}
+
+#endif // SOFTKM_TEST_FAKES_H
@@ -0,0 +1,246 @@
+#include "input/InputCore.h"
+#include "input/MotionPredictor.h"
+
+#include "Fakes.h"
+#include "Test.h"
+
+// A core with the fakes plugged in, active and its pointer mid-screen
+struct CoreFixture {
+    CoreFixture()
+        : core(&clock, &screen, &sink)
+    {
+        core.SetPeerLink(&link);
+        core.SetActive(true);
+        sink.events.clear();
+    }
+
+    // Switches on the dwell alone, whatever the approach
+    void DwellOnly()
+    {
+        EdgeSwitchConfig config = { 300000, 0, 0, 0, 0 };
+        core.SetEdgeSwitchConfig(config);
+    }
+
+    // A relative move every 16 ms, as the Mac client sends them
+    void Move(float x, float y, int32 count = 1)
+    {
+        for (int32 i = 0; i < count; i++) {
+            clock.Advance(16000);
+            core.InjectMouseMove(x, y, true, 0);
+        }
+    }
+
+    FakeClock clock;
+    FakeScreen screen;
+    RecordingSink sink;
+    FakePeerLink link;
+    InputCore core;
+};
+
+TEST(CoreIgnoresEventsWhileInactive)
+{
+    CoreFixture fixture;
+    fixture.core.SetActive(false);
+    fixture.core.InjectKeyDown(0x00, 0, "a", 1);
+    fixture.core.InjectMouseMove(10, 10, true, 0);
+    fixture.core.InjectMouseDown(1, 0, 0, 0, 1);
+    CHECK(fixture.sink.events.empty());
+}
+
+TEST(CoreEntersNearTheReturnEdge)
+{
+    CoreFixture fixture;
+    fixture.core.SetActive(false);
+    fixture.core.SetActive(true, 0.25f);
+    float x, y;
+    fixture.core.GetPosition(&x, &y);
+    CHECK_EQUAL(x, 50);
+    CHECK_CLOSE(y, 0.25 * 1079, 0.01);
+
+    fixture.core.SetActive(false);
+    fixture.core.SetActive(true, 0.5f, EDGE_BOTTOM);
+    fixture.core.GetPosition(&x, &y);
+    CHECK_EQUAL(x, 960);
+    CHECK_EQUAL(y, 1030);
+}
+
+TEST(CoreTranslatesKeys)
+{
+    CoreFixture fixture;
+    // A, and Left Command, which goes to Haiku's Left Alt
+    fixture.core.InjectKeyDown(0x00, 0, "a", 1);
+    fixture.core.InjectKeyDown(0x37, 0x02 | 0x4000, nullptr, 0);
+    fixture.core.InjectKeyUp(0x37, 0);
+
+    std::vector<SinkEvent>& events = fixture.sink.events;
+    CHECK_EQUAL(events.size(), 3u);
+    if (events.size() != 3)
+        return;
+    CHECK(events[0].type == SINK_KEY_DOWN);
+    CHECK_EQUAL(events[0].key, 0x3cu);
+    CHECK(events[1].type == SINK_KEY_DOWN);
+    CHECK_EQUAL(events[1].key, 0x5du);
+    CHECK_EQUAL(events[1].modifiers, 0x02u | 0x4000);
+    CHECK(events[2].type == SINK_KEY_UP);
+    CHECK_EQUAL(events[2].key, 0x5du);
+}
+
+TEST(CoreReportsUnknownKeys)
+{
+    struct Listener : InputCoreListener {
+        Listener() : unknown(0) {}
+        virtual void UnknownKeyCode(uint32 macKeyCode) { unknown++; }
+        int32 unknown;
+    } listener;
+
+    CoreFixture fixture;
+    fixture.core.SetListener(&listener);
+    fixture.core.InjectKeyDown(0xff, 0, nullptr, 0);
+    CHECK_EQUAL(listener.unknown, 1);
+    // Still goes through as is
+    CHECK_EQUAL(fixture.sink.events.size(), 1u);
+    CHECK_EQUAL(fixture.sink.events[0].key, 0xffu);
+}
+
+TEST(CoreReleaseAllLiftsKeysAndButtons)
+{
+    CoreFixture fixture;
+    fixture.core.InjectKeyDown(0x00, 0, "a", 1);
+    fixture.core.InjectKeyDown(0x38, 0x01, nullptr, 0);
+    fixture.core.InjectKeyDown(0x01, 0x01, "S", 1);
+    fixture.core.InjectKeyUp(0x01, 0x01);
+    fixture.core.InjectMouseDown(1, 0, 0, 0, 1);
+    fixture.sink.events.clear();
+
+    // The client vanished mid-chord; works while inactive
+    fixture.core.SetActive(false);
+    CHECK_EQUAL(fixture.core.ReleaseAll(), 2);
+    CHECK_EQUAL(fixture.sink.Count(SINK_KEY_UP), 2);
+    CHECK_EQUAL(fixture.sink.Count(SINK_MOUSE_UP), 1);
+    CHECK_EQUAL(fixture.core.Buttons(), 0u);
+
+    fixture.sink.events.clear();
+    CHECK_EQUAL(fixture.core.ReleaseAll(), 0);
+    CHECK(fixture.sink.events.empty());
+}
+
+TEST(CoreClampsThePointerToTheScreen)
+{
+    CoreFixture fixture;
+    fixture.Move(5000, -5000);
+    float x, y;
+    fixture.core.GetPosition(&x, &y);
+    CHECK_EQUAL(x, 1919);
+    CHECK_EQUAL(y, 0);
+    CHECK(fixture.sink.events.back().type == SINK_MOUSE_MOVED);
+    CHECK_EQUAL(fixture.sink.events.back().x, 1919);
+}
+
+TEST(CoreSwitchesBackOnceAfterTheDwell)
+{
+    CoreFixture fixture;
+    fixture.DwellOnly();
+    // Against the return edge on the left
+    fixture.Move(-100, 0);
+    fixture.Move(-1, 0, 17);
+    CHECK_EQUAL(fixture.link.switches, 0);
+    CHECK(fixture.core.IsActive());
+
+    // 300 ms after reaching it
+    fixture.Move(-1, 0, 2);
+    CHECK_EQUAL(fixture.link.switches, 1);
+    CHECK_CLOSE(fixture.link.lastYRatio, 0.5, 0.01);
+    CHECK(!fixture.core.IsActive());
+
+    // Further moves go nowhere
+    fixture.Move(-1, 0, 30);
+    CHECK_EQUAL(fixture.link.switches, 1);
+}
+
+TEST(CoreForwardsToANeighbour)
+{
+    CoreFixture fixture;
+    fixture.DwellOnly();
+    fixture.link.neighbours = 1 << EDGE_RIGHT;
+    fixture.link.forwardStatus = B_ERROR;
+
+    fixture.Move(2000, 0);
+    fixture.Move(1, 0, 19);
+    // Unreachable: stays here and tries again after another dwell
+    CHECK_EQUAL(fixture.link.forwards, 1);
+    CHECK_EQUAL(fixture.link.lastEdge, EDGE_RIGHT);
+    CHECK(fixture.core.IsActive());
+
+    fixture.link.forwardStatus = B_OK;
+    fixture.Move(1, 0, 20);
+    CHECK_EQUAL(fixture.link.forwards, 2);
+    CHECK_EQUAL(fixture.link.switches, 0);
+    CHECK(!fixture.core.IsActive());
+}
+
+TEST(CoreDetectsGameMode)
+{
+    CoreFixture fixture;
+    // A game keeps warping the cursor back to the middle
+    fixture.sink.Pin(960, 540);
+    fixture.Move(30, 20, 50);
+    CHECK(fixture.core.IsGameMode());
+
+    fixture.Move(7, -3);
+    CHECK_CLOSE(fixture.sink.events.back().x, 959.5 + 7, 0.01);
+    CHECK_CLOSE(fixture.sink.events.back().y, 539.5 - 3, 0.01);
+
+    fixture.core.InjectMouseDown(1, 0, 0, 0, 1);
+    CHECK(fixture.sink.events.back().type == SINK_MOUSE_DOWN);
+    CHECK_CLOSE(fixture.sink.events.back().x, 959.5, 0.01);
+}
+
+TEST(CoreLeavesGameModeWhenTheCursorMoves)
+{
+    CoreFixture fixture;
+    fixture.sink.Pin(960, 540);
+    fixture.Move(30, 20, 50);
+    CHECK(fixture.core.IsGameMode());
+
+    // Moves that no longer come back end it
+    fixture.sink.Unpin();
+    for (int32 i = 0; i < 50; i++)
+        fixture.Move(i % 2 == 0 ? 100 : -100, 0);
+    CHECK(!fixture.core.IsGameMode());
+}
+
+// A flick with acceleration and prediction both on, ending where it ends
+// without prediction once the offset has been taken back
+static float FlickWithPrediction(bool predict)
+{
+    CoreFixture fixture;
+    PointerAccelerationConfig acceleration
+        = { true, 1.0f, 1.0f, 400.0f, 1600.0f, 1.5f };
+    fixture.core.SetAccelerationConfig(acceleration);
+    MotionPredictor predictor(&fixture.clock, &fixture.core);
+    MotionPredictionConfig prediction = { predict, 100000, 48.0f };
+    predictor.SetConfig(prediction);
+    predictor.SetLookahead(50000);
+
+    for (int32 i = 0; i < 10; i++) {
+        fixture.clock.Advance(16000);
+        predictor.InjectMouseMoves(30, 0, 1, 0);
+    }
+    for (int32 i = 0; i < 20; i++) {
+        fixture.clock.Advance(16000);
+        predictor.Tick();
+    }
+
+    float x, y;
+    predictor.GetOffset(&x, &y);
+    CHECK_EQUAL(x, 0);
+    fixture.core.GetPosition(&x, &y);
+    return x;
+}
+
+TEST(CoreAcceleratesOnlyTheClientsMovesOfAPrediction)
+{
+    float plain = FlickWithPrediction(false);
+    CHECK(plain > 50 + 300 * 1.5f);
+    CHECK_CLOSE(FlickWithPrediction(true), plain, 1);
+}
@@ -0,0 +1,112 @@
+#include "Fakes.h"
+#include "Test.h"
+
+TEST(DispatchKeyDownDecodesBytesAndModifiers)
+{
+    RecordingHandler handler;
+    // Shift and Command on the Mac
+    std::vector<uint8> message = MakeKeyDown(0x00, 0x41, "A");
+    CHECK(DispatchInputEvent(message.data(), message.size(), &handler));
+
+    CHECK_EQUAL(handler.events.size(), 1u);
+    const HandledEvent& event = handler.events[0];
+    CHECK_EQUAL(event.type, EVENT_KEY_DOWN);
+    CHECK_EQUAL(event.code, 0x00u);
+    CHECK_EQUAL(event.modifiers, 0x01u | 0x1000 | 0x02 | 0x4000);
+    CHECK(event.bytes.size() == 1 && event.bytes[0] == 'A');
+}
+
+TEST(DispatchKeyDownClampsBytesToPayload)
+{
+    RecordingHandler handler;
+    std::vector<uint8> message = MakeKeyDown(0x01, 0, "ab");
+    // Claims more bytes than the message carries
+    ((KeyEventPayload*)(message.data() + sizeof(ProtocolHeader)))->numBytes
+        = 200;
+    CHECK(DispatchInputEvent(message.data(), message.size(), &handler));
+    CHECK_EQUAL(handler.events.size(), 1u);
+    CHECK_EQUAL(handler.events[0].bytes.size(), 2u);
+}
+
+TEST(DispatchKeyUpTakesEightBytes)
+{
+    RecordingHandler handler;
+    uint32 payload[2] = { 0x37, 0x04 };
+    std::vector<uint8> message
+        = MakeMessage(EVENT_KEY_UP, payload, sizeof(payload));
+    CHECK(DispatchInputEvent(message.data(), message.size(), &handler));
+    CHECK_EQUAL(handler.events.size(), 1u);
+    CHECK_EQUAL(handler.events[0].type, EVENT_KEY_UP);
+    CHECK_EQUAL(handler.events[0].code, 0x37u);
+    CHECK_EQUAL(handler.events[0].modifiers, 0x04u | 0x10000);
+}
+
+TEST(DispatchMouseEvents)
+{
+    RecordingHandler handler;
+
+    std::vector<uint8> move = MakeMouseMove(3, -4, true, 0x02);
+    CHECK(DispatchInputEvent(move.data(), move.size(), &handler));
+
+    MouseDownPayload down = { 1, 10, 20, 0, 2 };
+    std::vector<uint8> downMessage
+        = MakeMessage(EVENT_MOUSE_DOWN, &down, sizeof(down));
+    CHECK(DispatchInputEvent(downMessage.data(), downMessage.size(),
+        &handler));
+
+    MouseButtonPayload up = { 1, 10, 20, 0 };
+    std::vector<uint8> upMessage
+        = MakeMessage(EVENT_MOUSE_UP, &up, sizeof(up));
+    CHECK(DispatchInputEvent(upMessage.data(), upMessage.size(), &handler));
+
+    MouseWheelPayload wheel = { 0, -2, 0 };
+    std::vector<uint8> wheelMessage
+        = MakeMessage(EVENT_MOUSE_WHEEL, &wheel, sizeof(wheel));
+    CHECK(DispatchInputEvent(wheelMessage.data(), wheelMessage.size(),
+        &handler));
+
+    CHECK_EQUAL(handler.events.size(), 4u);
+    if (handler.events.size() != 4)
+        return;
+    CHECK_EQUAL(handler.events[0].type, EVENT_MOUSE_MOVE);
+    CHECK(handler.events[0].relative);
+    CHECK_EQUAL(handler.events[0].x, 3);
+    CHECK_EQUAL(handler.events[0].y, -4);
+    CHECK_EQUAL(handler.events[0].modifiers, 0x40u | 0x40000);
+    CHECK_EQUAL(handler.events[1].type, EVENT_MOUSE_DOWN);
+    CHECK_EQUAL(handler.events[1].clicks, 2u);
+    CHECK_EQUAL(handler.events[2].type, EVENT_MOUSE_UP);
+    CHECK_EQUAL(handler.events[2].code, 1u);
+    CHECK_EQUAL(handler.events[3].type, EVENT_MOUSE_WHEEL);
+    CHECK_EQUAL(handler.events[3].y, -2);
+}
+
+TEST(DispatchDropsShortPayloads)
+{
+    RecordingHandler handler;
+    uint32 keyCode = 0x00;
+    std::vector<uint8> message
+        = MakeMessage(EVENT_KEY_DOWN, &keyCode, sizeof(keyCode));
+    // Still an input event, but nothing to hand on
+    CHECK(DispatchInputEvent(message.data(), message.size(), &handler));
+    CHECK(handler.events.empty());
+}
+
+TEST(DispatchLeavesOtherTypesToTheCaller)
+{
+    RecordingHandler handler;
+    uint64 sent = 12345;
+    std::vector<uint8> heartbeat
+        = MakeMessage(EVENT_HEARTBEAT, &sent, sizeof(sent));
+    CHECK(!DispatchInputEvent(heartbeat.data(), heartbeat.size(), &handler));
+
+    ControlSwitchPayload control = { 0, 0.5f };
+    std::vector<uint8> controlSwitch
+        = MakeMessage(EVENT_CONTROL_SWITCH, &control, sizeof(control));
+    CHECK(!DispatchInputEvent(controlSwitch.data(), controlSwitch.size(),
+        &handler));
+
+    // Shorter than a header
+    CHECK(!DispatchInputEvent(heartbeat.data(), 3, &handler));
+    CHECK(handler.events.empty());
+}
@@ -0,0 +1,146 @@
+#include "clipboard/Lz4Block.h"
+
+#include "Test.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Text that compresses, with runs long enough for extended lengths, and a
+// stretch of noise that does not
+static std::vector<uint8> Sample(size_t length)
+{
+    std::vector<uint8> data(length);
+    uint32 seed = 12345;
+    for (size_t i = 0; i < length; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (i % 4096 < 1024)
+            data[i] = (uint8)(seed >> 16);
+        else if (i % 4096 < 2048)
+            data[i] = 'x';
+        else
+            data[i] = "the quick brown fox "[i % 20];
+    }
+    return data;
+}
+
+static std::vector<uint8> Compress(const std::vector<uint8>& data)
+{
+    std::vector<uint8> compressed(Lz4CompressBound(data.size()));
+    ssize_t length = Lz4Compress(data.data(), data.size(),
+        compressed.data(), compressed.size());
+    CHECK(length > 0);
+    compressed.resize(length > 0 ? length : 0);
+    return compressed;
+}
+
+static bool RoundTrips(const std::vector<uint8>& data)
+{
+    std::vector<uint8> compressed = Compress(data);
+    std::vector<uint8> decoded(data.size() + 1);
+    ssize_t length = Lz4Decompress(compressed.data(), compressed.size(),
+        decoded.data(), decoded.size());
+    return length == (ssize_t)data.size()
+        && memcmp(decoded.data(), data.data(), data.size()) == 0;
+}
+
+TEST(Lz4RoundTripsEmptyInput)
+{
+    std::vector<uint8> empty;
+    std::vector<uint8> compressed = Compress(empty);
+    CHECK_EQUAL(compressed.size(), 1u);
+    uint8 decoded[1];
+    CHECK_EQUAL(Lz4Decompress(compressed.data(), compressed.size(),
+        decoded, 0), 0);
+}
+
+TEST(Lz4RoundTripsShortInput)
+{
+    for (size_t length = 1; length <= 20; length++)
+        CHECK(RoundTrips(Sample(length)));
+
+    std::string text = "abcdabcdabcdabcdabcd";
+    CHECK(RoundTrips(std::vector<uint8>(text.begin(), text.end())));
+}
+
+TEST(Lz4RoundTripsLongInput)
+{
+    std::vector<uint8> data = Sample(300000);
+    CHECK(RoundTrips(data));
+    CHECK(Compress(data).size() < data.size() / 2);
+
+    // Noise alone comes out no larger than the bound
+    std::vector<uint8> noise(70000);
+    uint32 seed = 1;
+    for (size_t i = 0; i < noise.size(); i++) {
+        seed = seed * 1103515245 + 12345;
+        noise[i] = (uint8)(seed >> 16);
+    }
+    CHECK(RoundTrips(noise));
+}
+
+TEST(Lz4RejectsTruncatedInput)
+{
+    std::vector<uint8> data = Sample(20000);
+    std::vector<uint8> compressed = Compress(data);
+    std::vector<uint8> decoded(data.size());
+
+    // Short of its last literal
+    CHECK_EQUAL(Lz4Decompress(compressed.data(), compressed.size() - 1,
+        decoded.data(), decoded.size()), -1);
+
+    // Cut anywhere, never the whole of it and never out of bounds
+    for (size_t length = 1; length < compressed.size(); length++) {
+        ssize_t result = Lz4Decompress(compressed.data(), length,
+            decoded.data(), decoded.size());
+        CHECK(result < (ssize_t)data.size());
+    }
+
+    // A match offset with one of its two bytes missing
+    const uint8 block[] = { 0x14, 'a', 0x01 };
+    CHECK_EQUAL(Lz4Decompress(block, sizeof(block), decoded.data(),
+        decoded.size()), -1);
+}
+
+TEST(Lz4ChecksMatchOffsets)
+{
+    uint8 decoded[32];
+
+    // One literal, then a match overlapping it
+    const uint8 overlap[] = { 0x14, 'a', 0x01, 0x00 };
+    CHECK_EQUAL(Lz4Decompress(overlap, sizeof(overlap), decoded,
+        sizeof(decoded)), 9);
+    CHECK(memcmp(decoded, "aaaaaaaaa", 9) == 0);
+
+    const uint8 zero[] = { 0x14, 'a', 0x00, 0x00 };
+    CHECK_EQUAL(Lz4Decompress(zero, sizeof(zero), decoded,
+        sizeof(decoded)), -1);
+
+    // Before the start of the output
+    const uint8 before[] = { 0x14, 'a', 0x02, 0x00 };
+    CHECK_EQUAL(Lz4Decompress(before, sizeof(before), decoded,
+        sizeof(decoded)), -1);
+    const uint8 far[] = { 0x14, 'a', 0xff, 0xff };
+    CHECK_EQUAL(Lz4Decompress(far, sizeof(far), decoded,
+        sizeof(decoded)), -1);
+}
+
+TEST(Lz4RespectsTheDestinationSize)
+{
+    std::vector<uint8> data = Sample(20000);
+    std::vector<uint8> compressed = Compress(data);
+
+    std::vector<uint8> decoded(data.size() - 1);
+    CHECK_EQUAL(Lz4Decompress(compressed.data(), compressed.size(),
+        decoded.data(), decoded.size()), -1);
+
+    // The overlapping match of 8 does not fit after its literal
+    const uint8 overlap[] = { 0x14, 'a', 0x01, 0x00 };
+    CHECK_EQUAL(Lz4Decompress(overlap, sizeof(overlap), decoded.data(), 8),
+        -1);
+
+    std::vector<uint8> small(compressed.size() - 1);
+    CHECK_EQUAL(Lz4Compress(data.data(), data.size(), small.data(),
+        small.size()), -1);
+    CHECK_EQUAL(Lz4Compress(data.data(), 0, small.data(), 0), -1);
+}
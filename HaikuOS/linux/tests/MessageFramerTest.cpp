@@ -0,0 +1,169 @@
+#include "network/MessageFramer.h"
+#include "network/SendScheduler.h"
+
+#include "Fakes.h"
+#include "Test.h"
+
+// Copies bytes into framer in pieces of at most step
+static void Feed(MessageFramer& framer, const uint8* bytes, size_t length,
+    size_t step)
+{
+    while (length > 0) {
+        size_t available;
+        uint8* buffer = framer.ReceiveBuffer(&available, step);
+        size_t count = length < step ? length : step;
+        if (count > available)
+            count = available;
+        memcpy(buffer, bytes, count);
+        framer.Received(count);
+        bytes += count;
+        length -= count;
+    }
+}
+
+static void Feed(MessageFramer& framer, const std::vector<uint8>& bytes,
+    size_t step = 4096)
+{
+    Feed(framer, bytes.data(), bytes.size(), step);
+}
+
+TEST(FramerReassemblesMessageSentByteByByte)
+{
+    MessageFramer framer;
+    std::vector<uint8> message = MakeKeyDown(0x00, 0, "a");
+    const uint8* next;
+    size_t length;
+
+    for (size_t i = 0; i < message.size(); i++) {
+        CHECK(framer.NextMessage(&next, &length) == FRAME_NEED_MORE);
+        Feed(framer, message.data() + i, 1, 1);
+    }
+    CHECK(framer.NextMessage(&next, &length) == FRAME_MESSAGE);
+    CHECK_EQUAL(length, message.size());
+    CHECK(memcmp(next, message.data(), length) == 0);
+    CHECK(framer.NextMessage(&next, &length) == FRAME_NEED_MORE);
+    CHECK_EQUAL(framer.Buffered(), 0u);
+}
+
+TEST(FramerSplitsMessagesFromOneRead)
+{
+    MessageFramer framer;
+    std::vector<uint8> first = MakeMouseMove(1, 2, true);
+    std::vector<uint8> second = MakeKeyDown(0x01, 0);
+    std::vector<uint8> stream(first);
+    stream.insert(stream.end(), second.begin(), second.end());
+    Feed(framer, stream);
+
+    const uint8* next;
+    size_t length;
+    CHECK(framer.NextMessage(&next, &length) == FRAME_MESSAGE);
+    CHECK_EQUAL(length, first.size());
+    CHECK(framer.NextMessage(&next, &length) == FRAME_MESSAGE);
+    CHECK_EQUAL(length, second.size());
+    CHECK(memcmp(next, second.data(), length) == 0);
+    CHECK(framer.NextMessage(&next, &length) == FRAME_NEED_MORE);
+}
+
+TEST(FramerDropsGarbage)
+{
+    MessageFramer framer;
+    std::vector<uint8> message = MakeMouseMove(1, 2, true);
+    message[0] ^= 0xff;
+    Feed(framer, message);
+
+    const uint8* next;
+    size_t length;
+    CHECK(framer.NextMessage(&next, &length) == FRAME_BAD_MAGIC);
+    CHECK_EQUAL(framer.Buffered(), 0u);
+
+    // The stream picks up again with the next good message
+    Feed(framer, MakeMouseMove(1, 2, true));
+    CHECK(framer.NextMessage(&next, &length) == FRAME_MESSAGE);
+}
+
+TEST(FramerRefusesOversizedMessages)
+{
+    MessageFramer framer(1024);
+    ProtocolHeader header = { PROTOCOL_MAGIC, PROTOCOL_VERSION,
+        EVENT_CLIPBOARD_SYNC, 4096 };
+    Feed(framer, (const uint8*)&header, sizeof(header), sizeof(header));
+
+    const uint8* next;
+    size_t length;
+    CHECK(framer.NextMessage(&next, &length) == FRAME_TOO_LARGE);
+}
+
+TEST(FramerGrowsForLargeMessages)
+{
+    MessageFramer framer;
+    std::vector<uint8> message = MakeBulk(EVENT_CLIPBOARD_SYNC, 300000);
+    Feed(framer, message, 1500);
+
+    const uint8* next;
+    size_t length;
+    CHECK(framer.NextMessage(&next, &length) == FRAME_MESSAGE);
+    CHECK_EQUAL(length, message.size());
+    CHECK(memcmp(next, message.data(), length) == 0);
+}
+
+TEST(FramerReassemblesFragmentsAroundInput)
+{
+    SendScheduler scheduler;
+    scheduler.SetFragmenting(true);
+    std::vector<uint8> bulk = MakeBulk(EVENT_CLIPBOARD_SYNC, 50000);
+    std::vector<uint8> input = MakeMouseMove(5, 5, true);
+    scheduler.Enqueue(bulk.data(), bulk.size(), SEND_BULK);
+
+    // Input queued while the bulk message is going out
+    MessageFramer framer;
+    size_t length;
+    const uint8* bytes = scheduler.Peek(&length);
+    Feed(framer, bytes, length, length);
+    scheduler.Consume(length);
+    scheduler.Enqueue(input.data(), input.size(), SEND_INPUT);
+    while ((bytes = scheduler.Peek(&length)) != nullptr) {
+        Feed(framer, bytes, length, 1000);
+        scheduler.Consume(length);
+    }
+    CHECK(scheduler.CountFragments() > 2);
+
+    const uint8* next;
+    CHECK(framer.NextMessage(&next, &length) == FRAME_MESSAGE);
+    CHECK_EQUAL(length, input.size());
+    CHECK(framer.NextMessage(&next, &length) == FRAME_MESSAGE);
+    CHECK_EQUAL(length, bulk.size());
+    CHECK(length == bulk.size() && memcmp(next, bulk.data(), length) == 0);
+    CHECK(framer.NextMessage(&next, &length) == FRAME_NEED_MORE);
+}
+
+TEST(FramerDropsFragmentsOutOfOrder)
+{
+    SendScheduler scheduler;
+    scheduler.SetFragmenting(true);
+    std::vector<uint8> bulk = MakeBulk(EVENT_CLIPBOARD_SYNC, 3 * 8192);
+    scheduler.Enqueue(bulk.data(), bulk.size(), SEND_BULK);
+
+    std::vector<std::vector<uint8> > frames;
+    const uint8* bytes;
+    size_t length;
+    while ((bytes = scheduler.Peek(&length)) != nullptr) {
+        frames.push_back(std::vector<uint8>(bytes, bytes + length));
+        scheduler.Consume(length);
+    }
+    CHECK(frames.size() >= 3);
+
+    // The second piece goes missing
+    MessageFramer framer;
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (i != 1)
+            Feed(framer, frames[i]);
+    }
+    const uint8* next;
+    CHECK(framer.NextMessage(&next, &length) == FRAME_NEED_MORE);
+
+    // A whole one afterwards still comes through
+    for (size_t i = 0; i < frames.size(); i++)
+        Feed(framer, frames[i]);
+    CHECK(framer.NextMessage(&next, &length) == FRAME_MESSAGE);
+    CHECK_EQUAL(length, bulk.size());
+}
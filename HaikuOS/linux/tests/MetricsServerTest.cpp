@@ -0,0 +1,134 @@
+// A stand-in scraper for MetricsServer, over a Unix domain socket
+
+#include "metrics/MetricsServer.h"
+#include "platform/Platform.h"
+
+#include "Test.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <string>
+
+static std::string SocketPath()
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/softkm_metrics_test.%d", (int)getpid());
+    return path;
+}
+
+static int Connect(const std::string& path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strlcpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path));
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Everything the server sends until it closes, or what came within timeout
+static std::string ReadAll(int fd, int timeoutMs = 5000)
+{
+    std::string response;
+    char buffer[4096];
+    while (true) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, timeoutMs) <= 0)
+            break;
+        ssize_t bytesRead = recv(fd, buffer, sizeof(buffer), 0);
+        if (bytesRead <= 0)
+            break;
+        response.append(buffer, bytesRead);
+    }
+    return response;
+}
+
+static std::string Scrape(const std::string& path, const char* request)
+{
+    int fd = Connect(path);
+    if (fd < 0)
+        return std::string();
+    send(fd, request, strlen(request), 0);
+    std::string response = ReadAll(fd);
+    close(fd);
+    return response;
+}
+
+TEST(MetricsServerServesScrapes)
+{
+    std::string path = SocketPath();
+    MetricsServer server;
+    CHECK(server.StartUnix(path.c_str()) == B_OK);
+    CHECK(server.IsRunning());
+
+    std::string response = Scrape(path,
+        "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    CHECK(response.compare(0, 15, "HTTP/1.0 200 OK") == 0);
+    CHECK(response.find("softkm_inject_latency_seconds_bucket{le=\"+Inf\"}")
+        != std::string::npos);
+
+    // Content-Length matches the body
+    size_t bodyStart = response.find("\r\n\r\n");
+    size_t lengthAt = response.find("Content-Length: ");
+    CHECK(bodyStart != std::string::npos && lengthAt != std::string::npos);
+    if (bodyStart != std::string::npos && lengthAt != std::string::npos) {
+        CHECK_EQUAL((size_t)atol(response.c_str() + lengthAt + 16),
+            response.size() - bodyStart - 4);
+    }
+
+    response = Scrape(path, "GET /nothing HTTP/1.0\r\n\r\n");
+    CHECK(response.compare(0, 22, "HTTP/1.0 404 Not Found") == 0);
+
+    server.Stop();
+    CHECK(!server.IsRunning());
+    CHECK(access(path.c_str(), F_OK) != 0);
+}
+
+TEST(MetricsServerDropsStalledScrapers)
+{
+    std::string path = SocketPath();
+    MetricsServer server;
+    CHECK(server.StartUnix(path.c_str()) == B_OK);
+
+    // Trickles in a request that never ends: dropped at the deadline, not
+    // a second of waiting per byte
+    SystemClock clock;
+    bigtime_t start = clock.Now();
+    int stalled = Connect(path);
+    CHECK(stalled >= 0);
+    bool dropped = false;
+    for (int32 i = 0; i < 30 && !dropped; i++) {
+        if (send(stalled, "G", 1, MSG_NOSIGNAL) != 1)
+            break;
+        struct pollfd pfd = { stalled, POLLIN, 0 };
+        char byte;
+        if (poll(&pfd, 1, 200) > 0 && recv(stalled, &byte, 1, 0) <= 0)
+            dropped = true;
+    }
+    bigtime_t elapsed = clock.Now() - start;
+    CHECK(dropped);
+    CHECK(elapsed < MetricsServer::kRequestTimeout + 500000);
+    close(stalled);
+
+    // The next one is served
+    std::string response = Scrape(path, "GET / HTTP/1.0\r\n\r\n");
+    CHECK(response.compare(0, 15, "HTTP/1.0 200 OK") == 0);
+    server.Stop();
+}
+
+TEST(MetricsServerReportsErrors)
+{
+    MetricsServer server;
+    std::string longPath(200, 'x');
+    CHECK(server.StartUnix(longPath.c_str()) == B_NAME_TOO_LONG);
+    CHECK(server.StartUnix("/nonexistent/directory/socket")
+        == B_FROM_POSIX_ERROR(ENOENT));
+    CHECK(!server.IsRunning());
+}
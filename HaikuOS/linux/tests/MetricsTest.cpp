@@ -0,0 +1,73 @@
+#include "metrics/LatencyHistogram.h"
+#include "metrics/Metrics.h"
+
+#include "Test.h"
+
+#include <string>
+
+// Lines of text that start with prefix
+static int32 CountLines(const std::string& text, const char* prefix)
+{
+    int32 count = 0;
+    size_t length = strlen(prefix);
+    for (size_t start = 0; start < text.size();) {
+        if (text.compare(start, length, prefix) == 0)
+            count++;
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos)
+            break;
+        start = end + 1;
+    }
+    return count;
+}
+
+// The cumulative count on the bucket line for limit
+static long long BucketValue(const std::string& text, const char* limit)
+{
+    std::string line = std::string("softkm_inject_latency_seconds_bucket{le=\"")
+        + limit + "\"} ";
+    size_t found = text.find(line);
+    if (found == std::string::npos)
+        return -1;
+    return atoll(text.c_str() + found + line.size());
+}
+
+TEST(HistogramLimitsAreInclusive)
+{
+    CHECK_EQUAL(LatencyHistogram::BucketFor(0), 0);
+    CHECK_EQUAL(LatencyHistogram::BucketFor(1), 0);
+    CHECK_EQUAL(LatencyHistogram::BucketFor(2), 1);
+    CHECK_EQUAL(LatencyHistogram::BucketFor(3), 2);
+    CHECK_EQUAL(LatencyHistogram::BucketFor(1024), 10);
+    CHECK_EQUAL(LatencyHistogram::BucketFor(1025), 11);
+    CHECK_EQUAL(LatencyHistogram::BucketFor(-5), 0);
+    CHECK_EQUAL(LatencyHistogram::BucketFor((bigtime_t)1 << 40),
+        LatencyHistogram::kBucketCount - 1);
+
+    // Every value is at most the limit of its bucket, and above the one
+    // before
+    for (bigtime_t micros = 1; micros < 100000; micros += 37) {
+        int32 bucket = LatencyHistogram::BucketFor(micros);
+        CHECK(micros <= LatencyHistogram::BucketLimit(bucket));
+        CHECK(bucket == 0
+            || micros > LatencyHistogram::BucketLimit(bucket - 1));
+    }
+}
+
+TEST(PrometheusTextHasEveryBucket)
+{
+    std::string before = Metrics::PrometheusText();
+    CHECK_EQUAL(CountLines(before, "softkm_inject_latency_seconds_bucket{"),
+        LatencyHistogram::kBucketCount);
+
+    // 1024 us is counted at le 0.001024, not only above it
+    long long atLimit = BucketValue(before, "0.001024");
+    long long belowLimit = BucketValue(before, "0.000512");
+    Metrics::Observe(METRIC_HISTOGRAM_INJECT_LATENCY, 1024);
+    std::string after = Metrics::PrometheusText();
+    CHECK(atLimit >= 0);
+    CHECK_EQUAL(BucketValue(after, "0.001024"), atLimit + 1);
+    CHECK_EQUAL(BucketValue(after, "0.000512"), belowLimit);
+    CHECK_EQUAL(CountLines(after, "softkm_inject_latency_seconds_bucket{"),
+        LatencyHistogram::kBucketCount);
+}
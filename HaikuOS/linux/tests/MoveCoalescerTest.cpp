@@ -0,0 +1,72 @@
+#include "input/MoveCoalescer.h"
+#include "metrics/Metrics.h"
+
+#include "Fakes.h"
+#include "Test.h"
+
+TEST(CoalescerMergesAClump)
+{
+    FakeClock clock;
+    RecordingHandler handler;
+    MoveCoalescer coalescer(&clock, &handler);
+
+    for (int32 i = 0; i < 10; i++)
+        coalescer.InjectMouseMove(1.5f, -1, true, 0);
+    CHECK(handler.events.empty());
+    CHECK(coalescer.IsHolding());
+
+    coalescer.Flush();
+    CHECK_EQUAL(handler.events.size(), 1u);
+    CHECK_EQUAL(handler.events[0].x, 15);
+    CHECK_EQUAL(handler.events[0].y, -10);
+    CHECK_EQUAL(handler.events[0].count, 10);
+
+    // Nothing held, nothing to do
+    coalescer.Flush();
+    CHECK_EQUAL(handler.events.size(), 1u);
+}
+
+TEST(CoalescerCountsMergedMoves)
+{
+    FakeClock clock;
+    RecordingHandler handler;
+    MoveCoalescer coalescer(&clock, &handler);
+
+    // What the Deskbar replicant shows as "merged"
+    int64 merged = Metrics::CounterValue(METRIC_EVENTS_MERGED);
+    for (int32 i = 0; i < 10; i++)
+        coalescer.InjectMouseMove(1, 1, true, 0);
+    coalescer.Flush();
+    CHECK_EQUAL(Metrics::CounterValue(METRIC_EVENTS_MERGED), merged + 9);
+
+    // A lone move merges nothing
+    coalescer.InjectMouseMove(1, 1, true, 0);
+    coalescer.Flush();
+    CHECK_EQUAL(Metrics::CounterValue(METRIC_EVENTS_MERGED), merged + 9);
+}
+
+TEST(CoalescerFlushesBeforeOtherEvents)
+{
+    FakeClock clock;
+    RecordingHandler handler;
+    MoveCoalescer coalescer(&clock, &handler);
+
+    coalescer.InjectMouseMove(2, 0, true, 0);
+    coalescer.InjectMouseMove(2, 0, true, 0);
+    coalescer.InjectMouseDown(1, 0, 0, 0, 1);
+    // A modifier change splits the motion
+    coalescer.InjectMouseMove(3, 0, true, 0);
+    coalescer.InjectMouseMove(3, 0, true, 0x01);
+    coalescer.InjectMouseMove(100, 100, false, 0x01);
+
+    std::vector<HandledEvent>& events = handler.events;
+    CHECK_EQUAL(events.size(), 5u);
+    if (events.size() != 5)
+        return;
+    CHECK_EQUAL(events[0].x, 4);
+    CHECK_EQUAL(events[0].count, 2);
+    CHECK_EQUAL(events[1].type, EVENT_MOUSE_DOWN);
+    CHECK_EQUAL(events[2].count, 1);
+    CHECK_EQUAL(events[3].modifiers, 0x01u);
+    CHECK(!events[4].relative);
+}
@@ -0,0 +1,174 @@
+#include "input/PointerAccelerator.h"
+
+#include "Test.h"
+
+#include <algorithm>
+
+static const bigtime_t kStart = 1000000;
+
+static PointerAccelerationConfig Config(float sensitivity, float acceleration,
+    float threshold, float fullSpeed, float scale = 1)
+{
+    PointerAccelerationConfig config = { true, sensitivity, acceleration,
+        threshold, fullSpeed, scale };
+    return config;
+}
+
+TEST(AcceleratorPassesMovesThrough)
+{
+    PointerAccelerator accelerator;
+    // Off by default
+    float x = 3.3f, y = -1.2f;
+    accelerator.Apply(kStart, 1, &x, &y);
+    CHECK_EQUAL(x, 3.3f);
+    CHECK_EQUAL(y, -1.2f);
+
+    // On, without gain or scale
+    accelerator.SetConfig(Config(1, 0, 0, 0));
+    x = 5;
+    y = -7;
+    accelerator.Apply(kStart + 16000, 1, &x, &y);
+    CHECK_EQUAL(x, 5);
+    CHECK_EQUAL(y, -7);
+}
+
+TEST(AcceleratorCarriesSubPixelRemainders)
+{
+    PointerAccelerator accelerator;
+    accelerator.SetConfig(Config(1, 0, 0, 0));
+    float sum = 0;
+    bigtime_t when = kStart;
+    for (int32 i = 0; i < 100; i++) {
+        float x = 0.3f, y = 0;
+        accelerator.Apply(when += 16000, 1, &x, &y);
+        CHECK_EQUAL(x, floorf(x));
+        sum += x;
+    }
+    CHECK_CLOSE(sum, 30, 1);
+
+    // Slowed down to 0.8, 2 px moves come out as 2, 1, 2, 2, 1...
+    accelerator.SetConfig(Config(0.8f, 0, 0, 0));
+    accelerator.Reset();
+    float first = 2, second = 2, y = 0;
+    accelerator.Apply(when += 16000, 1, &first, &y);
+    accelerator.Apply(when += 16000, 1, &second, &y);
+    CHECK_EQUAL(first, 2);
+    CHECK_EQUAL(second, 1);
+}
+
+TEST(AcceleratorScalesToTheScreenWidths)
+{
+    PointerAccelerator accelerator;
+    accelerator.SetConfig(Config(1, 0, 0, 0, 0));
+    accelerator.SetScreens(1440, 2880);
+    CHECK_EQUAL(accelerator.Scale(), 2);
+    float x = 10, y = 4;
+    accelerator.Apply(kStart, 1, &x, &y);
+    CHECK_EQUAL(x, 20);
+    CHECK_EQUAL(y, 8);
+
+    // Unknown client screen
+    accelerator.SetScreens(0, 2880);
+    CHECK_EQUAL(accelerator.Scale(), 1);
+
+    // A configured scale wins
+    accelerator.SetConfig(Config(1, 0, 0, 0, 1.5f));
+    accelerator.SetScreens(1440, 2880);
+    CHECK_EQUAL(accelerator.Scale(), 1.5f);
+}
+
+TEST(AcceleratorCurveIsMonotonic)
+{
+    PointerAccelerator accelerator;
+    accelerator.SetConfig(Config(0.8f, 1.5f, 400, 1600));
+    CHECK_CLOSE(accelerator.Gain(0), 0.8, 1e-6);
+    CHECK_CLOSE(accelerator.Gain(400), 0.8, 1e-6);
+    CHECK_CLOSE(accelerator.Gain(1600), 2.0, 1e-5);
+    CHECK_CLOSE(accelerator.Gain(5000), 2.0, 1e-5);
+
+    // The table follows the smoothstep closely and never dips
+    float last = 0;
+    float worst = 0;
+    for (float speed = 0; speed < 3000; speed += 7) {
+        float gain = accelerator.Gain(speed);
+        CHECK(gain >= last - 1e-6f);
+        last = gain;
+
+        float t = speed < 400 ? 0 : std::min(1.0f, (speed - 400) / 1200);
+        float exact = 0.8f * (1 + 1.5f * t * t * (3 - 2 * t));
+        worst = std::max(worst, fabsf(gain - exact));
+    }
+    CHECK(worst < 0.002f);
+
+    // A full speed at the threshold is a step
+    accelerator.SetConfig(Config(1, 1, 500, 0));
+    CHECK(accelerator.Gain(490) < 1.01f);
+    CHECK(accelerator.Gain(501) > 1.99f);
+}
+
+TEST(AcceleratorRejectsNonFiniteSpeeds)
+{
+    PointerAccelerator accelerator;
+    accelerator.SetConfig(Config(0.5f, 3, 100, 200));
+    CHECK_EQUAL(accelerator.Gain(NAN), 0.5f);
+    CHECK_EQUAL(accelerator.Gain(INFINITY), 0.5f);
+    CHECK_EQUAL(accelerator.Gain(-5), 0.5f);
+
+    // Left alone, and the remainder is not poisoned
+    float x = NAN, y = 1;
+    accelerator.Apply(kStart, 1, &x, &y);
+    CHECK(std::isnan(x));
+    x = 4;
+    y = 0;
+    accelerator.Apply(kStart + 16000, 1, &x, &y);
+    CHECK_EQUAL(x, 8);
+}
+
+TEST(AcceleratorTimesSingleMovesByArrival)
+{
+    PointerAccelerator accelerator;
+    accelerator.SetConfig(Config(1, 1, 1000, 2000));
+
+    // 40 px 16 ms after the last move: 2500 px/s, full gain
+    bigtime_t when = kStart;
+    float x = 1, y = 0;
+    accelerator.Apply(when, 1, &x, &y);
+    x = 40;
+    accelerator.Apply(when += 16000, 1, &x, &y);
+    CHECK_EQUAL(x, 80);
+
+    // The same 40 px 40 ms later is 1000 px/s
+    x = 40;
+    accelerator.Apply(when += 40000, 1, &x, &y);
+    CHECK_EQUAL(x, 40);
+
+    // One bunched up by jitter is not taken as 40 times the speed
+    x = 4;
+    accelerator.Apply(when += 1000, 1, &x, &y);
+    CHECK_EQUAL(x, 4);
+}
+
+TEST(AcceleratorTimesClumpsByTheirMoves)
+{
+    PointerAccelerator accelerator;
+    accelerator.SetConfig(Config(1, 1, 1000, 2000));
+    bigtime_t when = kStart;
+    float x = 1, y = 0;
+    accelerator.Apply(when, 1, &x, &y);
+
+    // 100 px in 10 moves that came together after a 160 ms stall: 625 px/s,
+    // not the 6250 a single 16 ms move would be
+    x = 100;
+    accelerator.Apply(when += 160000, 10, &x, &y);
+    CHECK_EQUAL(x, 100);
+
+    // The same clump right behind the last move is no faster
+    x = 100;
+    accelerator.Apply(when += 1000, 10, &x, &y);
+    CHECK_EQUAL(x, 100);
+
+    // 300 px in 5 moves is 3750 px/s, however it arrived
+    x = 300;
+    accelerator.Apply(when += 2000, 5, &x, &y);
+    CHECK_EQUAL(x, 600);
+}
@@ -0,0 +1,118 @@
+#include "network/SendScheduler.h"
+
+#include "Fakes.h"
+#include "Test.h"
+
+// Type of the next frame, writing it out in full; 0 if nothing is queued
+static uint8 NextType(SendScheduler& scheduler, size_t* frameLength = nullptr)
+{
+    size_t length;
+    const uint8* bytes = scheduler.Peek(&length);
+    if (bytes == nullptr)
+        return 0;
+    if (frameLength != nullptr)
+        *frameLength = length;
+    scheduler.Consume(length);
+    return ((const ProtocolHeader*)bytes)->eventType;
+}
+
+TEST(SchedulerSendsInputBeforeBulk)
+{
+    SendScheduler scheduler;
+    std::vector<uint8> bulk = MakeBulk(EVENT_CLIPBOARD_SYNC, 1000);
+    std::vector<uint8> input = MakeMouseMove(1, 1, true);
+    scheduler.Enqueue(bulk.data(), bulk.size(), SEND_BULK);
+    scheduler.Enqueue(input.data(), input.size(), SEND_INPUT);
+    CHECK_EQUAL(scheduler.QueuedBytes(), bulk.size() + input.size());
+
+    CHECK_EQUAL(NextType(scheduler), EVENT_MOUSE_MOVE);
+    CHECK_EQUAL(NextType(scheduler), EVENT_CLIPBOARD_SYNC);
+    CHECK_EQUAL(NextType(scheduler), 0);
+    CHECK(scheduler.IsEmpty());
+}
+
+TEST(SchedulerFinishesAStartedFrame)
+{
+    SendScheduler scheduler;
+    std::vector<uint8> bulk = MakeBulk(EVENT_CLIPBOARD_SYNC, 1000);
+    std::vector<uint8> input = MakeMouseMove(1, 1, true);
+    scheduler.Enqueue(bulk.data(), bulk.size(), SEND_BULK);
+
+    size_t length;
+    scheduler.Peek(&length);
+    scheduler.Consume(100);
+    scheduler.Enqueue(input.data(), input.size(), SEND_INPUT);
+
+    // The rest of the bulk message, then the input
+    const uint8* bytes = scheduler.Peek(&length);
+    CHECK_EQUAL(length, bulk.size() - 100);
+    CHECK(bytes != nullptr && memcmp(bytes, bulk.data() + 100, length) == 0);
+    scheduler.Consume(length);
+    CHECK_EQUAL(NextType(scheduler), EVENT_MOUSE_MOVE);
+}
+
+TEST(SchedulerLetsInputOvertakeFragments)
+{
+    SendScheduler scheduler;
+    scheduler.SetFragmenting(true);
+    std::vector<uint8> bulk = MakeBulk(EVENT_CLIPBOARD_SYNC, 100000);
+    std::vector<uint8> input = MakeKeyDown(0x00, 0);
+    scheduler.Enqueue(bulk.data(), bulk.size(), SEND_BULK);
+
+    size_t length = 0;
+    CHECK_EQUAL(NextType(scheduler, &length), EVENT_BULK_FRAGMENT);
+    CHECK_EQUAL(length, sizeof(ProtocolHeader) + sizeof(BulkFragmentPayload)
+        + SendScheduler::kFragmentSize);
+
+    // Waits for one fragment at most
+    scheduler.Enqueue(input.data(), input.size(), SEND_INPUT);
+    CHECK_EQUAL(NextType(scheduler), EVENT_KEY_DOWN);
+
+    int32 fragments = 1;
+    while (NextType(scheduler) == EVENT_BULK_FRAGMENT)
+        fragments++;
+    CHECK_EQUAL(fragments, (int32)((bulk.size()
+        + SendScheduler::kFragmentSize - 1) / SendScheduler::kFragmentSize));
+    CHECK_EQUAL(scheduler.CountFragments(), fragments);
+    CHECK(scheduler.IsEmpty());
+}
+
+TEST(SchedulerSendsSmallBulkWhole)
+{
+    SendScheduler scheduler;
+    scheduler.SetFragmenting(true);
+    std::vector<uint8> bulk = MakeBulk(EVENT_CLIPBOARD_SYNC,
+        SendScheduler::kFragmentSize);
+    scheduler.Enqueue(bulk.data(), bulk.size(), SEND_BULK);
+    CHECK_EQUAL(NextType(scheduler), EVENT_CLIPBOARD_SYNC);
+    CHECK_EQUAL(scheduler.CountFragments(), 0);
+}
+
+TEST(SchedulerWithoutFragmentingYieldsBetweenMessages)
+{
+    SendScheduler scheduler;
+    std::vector<uint8> bulk = MakeBulk(EVENT_CLIPBOARD_SYNC, 100000);
+    std::vector<uint8> input = MakeMouseMove(1, 1, true);
+    scheduler.Enqueue(bulk.data(), bulk.size(), SEND_BULK);
+    scheduler.Enqueue(bulk.data(), bulk.size(), SEND_BULK);
+
+    size_t length = 0;
+    CHECK_EQUAL(NextType(scheduler, &length), EVENT_CLIPBOARD_SYNC);
+    CHECK_EQUAL(length, bulk.size());
+    scheduler.Enqueue(input.data(), input.size(), SEND_INPUT);
+    CHECK_EQUAL(NextType(scheduler), EVENT_MOUSE_MOVE);
+    CHECK_EQUAL(NextType(scheduler), EVENT_CLIPBOARD_SYNC);
+}
+
+TEST(SchedulerMakeEmpty)
+{
+    SendScheduler scheduler;
+    std::vector<uint8> input = MakeMouseMove(1, 1, true);
+    scheduler.Enqueue(input.data(), input.size(), SEND_INPUT);
+    scheduler.Enqueue(input.data(), 0, SEND_INPUT);
+    size_t length;
+    scheduler.Peek(&length);
+    scheduler.MakeEmpty();
+    CHECK(scheduler.IsEmpty());
+    CHECK(scheduler.Peek(&length) == nullptr);
+}
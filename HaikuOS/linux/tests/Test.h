@@ -0,0 +1,57 @@
+#ifndef SOFTKM_TEST_H
+#define SOFTKM_TEST_H
+
+// A minimal unit test harness for libsoftkm_core. TEST(name) defines a
+// test and registers it with the runner in TestMain.cpp; CHECK()s record
+// failures and go on, so one run shows everything that broke.
+//
+//   TEST(FramerSplitsMessages)
+//   {
+//       CHECK(framer.NextMessage(&message, &length) == FRAME_MESSAGE);
+//       CHECK_EQUAL(length, 12u);
+//   }
+
+#include <cmath>
+#include <cstdio>
+
+typedef void (*TestFunction)();
+
+void RegisterTest(const char* name, TestFunction function);
+void TestFailed(const char* file, int line, const char* expression);
+
+struct TestRegistration {
+    TestRegistration(const char* name, TestFunction function)
+        { RegisterTest(name, function); }
+};
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistration name##Registration(#name, name); \
+    static void name()
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) \
+            TestFailed(__FILE__, __LINE__, #expression); \
+    } while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+    do { \
+        if (!((actual) == (expected))) { \
+            TestFailed(__FILE__, __LINE__, #actual " == " #expected); \
+            fprintf(stderr, "    got %g, expected %g\n", \
+                (double)(actual), (double)(expected)); \
+        } \
+    } while (0)
+
+#define CHECK_CLOSE(actual, expected, tolerance) \
+    do { \
+        if (!(std::fabs((double)(actual) - (double)(expected)) \
+                <= (tolerance))) { \
+            TestFailed(__FILE__, __LINE__, #actual " ~ " #expected); \
+            fprintf(stderr, "    got %g, expected %g\n", \
+                (double)(actual), (double)(expected)); \
+        } \
+    } while (0)
+
+#endif // SOFTKM_TEST_H
@@ -0,0 +1,61 @@
+// Runs the tests registered with TEST(), in the order of the files on the
+// link line and of the tests within them.
+//
+//   softkm_tests [substring]       only the tests whose name contains it
+//
+// Exits 1 if any CHECK failed.
+
+#include "Test.h"
+
+#include <cstring>
+#include <vector>
+
+struct Test {
+    const char* name;
+    TestFunction function;
+};
+
+// Function-local, as registrations run before main() in any order
+static std::vector<Test>& Tests()
+{
+    static std::vector<Test> tests;
+    return tests;
+}
+
+static int sFailures;
+
+void RegisterTest(const char* name, TestFunction function)
+{
+    Test test = { name, function };
+    Tests().push_back(test);
+}
+
+void TestFailed(const char* file, int line, const char* expression)
+{
+    fprintf(stderr, "  %s:%d: CHECK(%s) failed\n", file, line, expression);
+    sFailures++;
+}
+
+int main(int argc, char** argv)
+{
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+
+    int run = 0;
+    int failed = 0;
+    std::vector<Test>& tests = Tests();
+    for (size_t i = 0; i < tests.size(); i++) {
+        if (filter != nullptr && strstr(tests[i].name, filter) == nullptr)
+            continue;
+
+        int failures = sFailures;
+        tests[i].function();
+        run++;
+        if (sFailures != failures) {
+            fprintf(stderr, "FAILED %s\n", tests[i].name);
+            failed++;
+        }
+    }
+
+    printf("%d tests, %d failed\n", run, failed);
+    return failed > 0 ? 1 : 0;
+}
@@ -5,30 +5,49 @@
 #include "network/NetworkServer.h"
 #include "input/InputInjector.h"
 #include "clipboard/ClipboardManager.h"
+#include "metrics/MetricsServer.h"
 #include "settings/Settings.h"
 #include "Logger.h"
 
 #include <cstdio>  // For fprintf, stderr
+#include <cstring>
 
 #include <Deskbar.h>
+#include <MessageRunner.h>
 #include <Roster.h>
 #include <Alert.h>
+#include <Clipboard.h>
 #include <AppFileInfo.h>
 #include <private/interface/AboutWindow.h>
 
 SoftKMApp* SoftKMApp::sInstance = nullptr;
 
+// Clients listed in metrics updates; more than this are not shown
+static const int32 kMaxListedClients = 8;
+
 SoftKMApp::SoftKMApp()
     : BApplication("application/x-vnd.softKM"),
       fNetworkServer(nullptr),
       fInputInjector(nullptr),
       fClipboardManager(nullptr),
+      fMetricsServer(nullptr),
       fSettingsWindow(nullptr),
       fLogWindow(nullptr),
-      fClientConnected(false)
+      fClientConnected(false),
+      fInputActive(false),
+      fLinkQuality(LINK_QUALITY_NONE),
+      fLogVisible(false),
+      fMetricsRunner(nullptr),
+      fLastMetricsTime(0),
+      fLastEventsReceived(0),
+      fLastEventsDropped(0),
+      fLastEventsMerged(0)
 {
     sInstance = this;
 
+    for (int32 i = 0; i < LatencyHistogram::kBucketCount; i++)
+        fLastLatencyBuckets[i] = 0;
+
     // Load settings
     Settings::Load();
 
@@ -40,6 +59,9 @@ SoftKMApp::SoftKMApp()
 
     // Create input injector
     fInputInjector = new InputInjector();
+    fInputInjector->SetEdgeSwitchConfig(Settings::GetEdgeSwitchConfig());
+    fInputInjector->SetAccelerationConfig(
+        Settings::GetPointerAcceleration());
 
     // Create clipboard manager
     fClipboardManager = new ClipboardManager();
@@ -52,12 +74,16 @@ SoftKMApp::SoftKMApp()
 
     // Connect clipboard manager to server for clipboard sync
     fNetworkServer->SetClipboardManager(fClipboardManager);
+    fClipboardManager->SetNetworkServer(fNetworkServer);
 }
 
 SoftKMApp::~SoftKMApp()
 {
+    be_clipboard->StopWatching(BMessenger(this));
+    delete fMetricsRunner;
     RemoveDeskbarReplicant();
 
+    delete fMetricsServer;
     delete fNetworkServer;
     delete fInputInjector;
     delete fClipboardManager;
@@ -79,6 +105,16 @@ void SoftKMApp::ReadyToRun()
 
     // Install Deskbar replicant
     InstallDeskbarReplicant();
+
+    StartMetricsServer();
+
+    // Clipboard changes are pushed as they happen, so switching never
+    // waits for a clipboard copy
+    be_clipboard->StartWatching(BMessenger(this));
+
+    // Sample link metrics once per second for the replicants
+    BMessage tick(MSG_METRICS_TICK);
+    fMetricsRunner = new BMessageRunner(BMessenger(this), &tick, 1000000);
 }
 
 void SoftKMApp::MessageReceived(BMessage* message)
@@ -115,28 +151,79 @@ void SoftKMApp::MessageReceived(BMessage* message)
             break;
         }
 
-        case MSG_QUERY_CONNECTION_STATUS:
+        case MSG_SUBSCRIBE_STATUS:
         {
-            BMessage reply(B_REPLY);
-            reply.AddBool("connected", fClientConnected);
-            message->SendReply(&reply);
+            BMessenger subscriber;
+            if (message->FindMessenger("target", &subscriber) == B_OK)
+                AddStatusSubscriber(subscriber);
+            break;
+        }
+
+        case MSG_UNSUBSCRIBE_STATUS:
+        {
+            BMessenger subscriber;
+            if (message->FindMessenger("target", &subscriber) == B_OK)
+                RemoveStatusSubscriber(subscriber);
             break;
         }
 
         case MSG_CLIENT_CONNECTED:
             SetClientConnected(true);
+            // Bring the new client up to date
+            fClipboardManager->PushClipboard(true);
+            break;
+
+        case B_CLIPBOARD_CHANGED:
+            fClipboardManager->ClipboardChanged();
             break;
 
         case MSG_CLIENT_DISCONNECTED:
             SetClientConnected(false);
             break;
 
+        case MSG_INPUT_ACTIVE_CHANGED:
+        {
+            bool active;
+            if (message->FindBool("active", &active) == B_OK
+                && active != fInputActive) {
+                fInputActive = active;
+                PushStatus();
+            }
+            break;
+        }
+
+        case MSG_LINK_QUALITY_CHANGED:
+        {
+            int32 quality;
+            if (message->FindInt32("quality", &quality) == B_OK
+                && quality != fLinkQuality) {
+                fLinkQuality = quality;
+                PushStatus();
+            }
+            break;
+        }
+
+        case MSG_LOG_VISIBILITY_CHANGED:
+        {
+            bool visible;
+            if (message->FindBool("visible", &visible) == B_OK
+                && visible != fLogVisible) {
+                fLogVisible = visible;
+                PushStatus();
+            }
+            break;
+        }
+
         case MSG_INPUT_EVENT:
             if (fInputInjector != nullptr) {
                 fInputInjector->ProcessEvent(message);
             }
             break;
 
+        case MSG_METRICS_TICK:
+            UpdateMetrics();
+            break;
+
         case MSG_INSTALL_REPLICANT:
             InstallDeskbarReplicant();
             break;
@@ -161,14 +248,175 @@ bool SoftKMApp::QuitRequested()
     }
 
     fNetworkServer->Stop();
+    if (fMetricsServer != nullptr)
+        fMetricsServer->Stop();
     RemoveDeskbarReplicant();
     return true;
 }
 
 void SoftKMApp::SetClientConnected(bool connected)
 {
+    if (fClientConnected == connected)
+        return;
+
     fClientConnected = connected;
-    // Status will be queried by deskbar replicant via MSG_QUERY_CONNECTION_STATUS
+    if (connected) {
+        // Assume a healthy link until heartbeats say otherwise
+        fLinkQuality = LINK_QUALITY_GOOD;
+    } else {
+        fInputActive = false;
+        fLinkQuality = LINK_QUALITY_NONE;
+    }
+
+    PushStatus();
+}
+
+void SoftKMApp::AddStatusSubscriber(const BMessenger& subscriber)
+{
+    if (!subscriber.IsValid())
+        return;
+
+    for (size_t i = 0; i < fStatusSubscribers.size(); i++) {
+        if (fStatusSubscribers[i] == subscriber)
+            return;
+    }
+
+    fStatusSubscribers.push_back(subscriber);
+
+    // Bring the new subscriber up to date right away
+    PushStatus(fStatusSubscribers.back());
+}
+
+void SoftKMApp::RemoveStatusSubscriber(const BMessenger& subscriber)
+{
+    for (size_t i = 0; i < fStatusSubscribers.size(); i++) {
+        if (fStatusSubscribers[i] == subscriber) {
+            fStatusSubscribers.erase(fStatusSubscribers.begin() + i);
+            return;
+        }
+    }
+}
+
+// What a subscriber is told; the one place status fields are added
+void SoftKMApp::BuildStatus(BMessage* status) const
+{
+    status->what = MSG_CONNECTION_STATUS;
+    status->AddBool("connected", fClientConnected);
+    status->AddBool("active", fInputActive);
+    status->AddInt32("quality", fLinkQuality);
+    status->AddBool("logVisible", fLogVisible);
+}
+
+void SoftKMApp::PushStatus()
+{
+    BMessage status;
+    BuildStatus(&status);
+
+    PushToSubscribers(&status);
+}
+
+void SoftKMApp::PushStatus(BMessenger& subscriber)
+{
+    BMessage status;
+    BuildStatus(&status);
+
+    // Zero timeout: never block the app on a busy Deskbar
+    subscriber.SendMessage(&status, (BHandler*)NULL, 0);
+}
+
+void SoftKMApp::PushToSubscribers(BMessage* message)
+{
+    // Drop subscribers whose replicant has gone away
+    size_t i = 0;
+    while (i < fStatusSubscribers.size()) {
+        if (!fStatusSubscribers[i].IsValid()) {
+            fStatusSubscribers.erase(fStatusSubscribers.begin() + i);
+            continue;
+        }
+        fStatusSubscribers[i].SendMessage(message, (BHandler*)NULL, 0);
+        i++;
+    }
+}
+
+void SoftKMApp::UpdateMetrics()
+{
+    bigtime_t now = system_time();
+    bigtime_t elapsed = now - fLastMetricsTime;
+    fLastMetricsTime = now;
+
+    if (!fClientConnected || fNetworkServer == nullptr
+        || fInputInjector == nullptr)
+        return;
+
+    NetworkMetrics network;
+    fNetworkServer->GetMetrics(&network);
+    InjectorMetrics injector;
+    fInputInjector->GetMetrics(&injector);
+
+    // Per-interval deltas so the replicant sees current, not lifetime, values
+    int64 intervalBuckets[LatencyHistogram::kBucketCount];
+    for (int32 i = 0; i < LatencyHistogram::kBucketCount; i++) {
+        intervalBuckets[i] = injector.latencyBuckets[i] - fLastLatencyBuckets[i];
+        fLastLatencyBuckets[i] = injector.latencyBuckets[i];
+    }
+
+    float eventsPerSecond = 0;
+    if (elapsed > 0) {
+        eventsPerSecond = (network.eventsReceived - fLastEventsReceived)
+            * 1000000.0f / elapsed;
+    }
+
+    BMessage update(MSG_METRICS_UPDATE);
+    update.AddFloat("eventsPerSecond", eventsPerSecond);
+    update.AddInt64("roundTripTime", network.roundTripTime);
+    update.AddInt64("injectLatencyP99",
+        LatencyHistogram::Percentile(intervalBuckets, 0.99f));
+    update.AddInt64("dropped", injector.eventsDropped - fLastEventsDropped);
+    update.AddInt64("merged", injector.eventsMerged - fLastEventsMerged);
+
+    // One entry per connected client in each of the client fields
+    ClientStats clients[kMaxListedClients];
+    int32 clientCount = fNetworkServer->GetClientStats(clients,
+        kMaxListedClients);
+    for (int32 i = 0; i < clientCount; i++) {
+        update.AddString("clientAddress", clients[i].address);
+        update.AddBool("clientOwner", clients[i].owner);
+        update.AddInt64("clientEvents", clients[i].eventsAccepted);
+        update.AddInt64("clientRejected", clients[i].eventsRejected);
+        update.AddInt64("clientRoundTripTime", clients[i].roundTripTime);
+        update.AddInt32("clientTakeovers", clients[i].takeovers);
+    }
+
+    fLastEventsReceived = network.eventsReceived;
+    fLastEventsDropped = injector.eventsDropped;
+    fLastEventsMerged = injector.eventsMerged;
+
+    PushToSubscribers(&update);
+}
+
+void SoftKMApp::StartMetricsServer()
+{
+    uint16 port = Settings::GetMetricsPort();
+    const char* socketPath = Settings::GetMetricsSocketPath();
+    if (port == 0 && socketPath[0] == '\0')
+        return;
+
+    fMetricsServer = new MetricsServer();
+
+    status_t result = socketPath[0] != '\0'
+        ? fMetricsServer->StartUnix(socketPath)
+        : fMetricsServer->StartTcp(port);
+    if (result != B_OK) {
+        LOG("Metrics endpoint disabled: %s", strerror(result));
+        delete fMetricsServer;
+        fMetricsServer = nullptr;
+        return;
+    }
+
+    if (socketPath[0] != '\0')
+        LOG("Metrics endpoint listening on unix:%s", socketPath);
+    else
+        LOG("Metrics endpoint listening on http://127.0.0.1:%d/metrics", port);
 }
 
 void SoftKMApp::InstallDeskbarReplicant()
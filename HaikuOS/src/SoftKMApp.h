@@ -4,11 +4,17 @@
 #include <Application.h>
 #include <Messenger.h>
 
+#include <vector>
+
+#include "metrics/LatencyHistogram.h"
+
 class NetworkServer;
 class InputInjector;
 class ClipboardManager;
 class SettingsWindow;
 class LogWindow;
+class MetricsServer;
+class BMessageRunner;
 
 // Application messages
 enum {
@@ -18,14 +24,28 @@ enum {
     MSG_QUERY_LOG_VISIBLE = 'qlog',
     MSG_SHOW_ABOUT = 'sabt',
     MSG_CONNECTION_STATUS = 'csts',
-    MSG_QUERY_CONNECTION_STATUS = 'qcst',
+    MSG_SUBSCRIBE_STATUS = 'ssub',
+    MSG_UNSUBSCRIBE_STATUS = 'usub',
     MSG_CLIENT_CONNECTED = 'ccon',
     MSG_CLIENT_DISCONNECTED = 'cdis',
+    MSG_INPUT_ACTIVE_CHANGED = 'iact',
+    MSG_LINK_QUALITY_CHANGED = 'lqch',
+    MSG_LOG_VISIBILITY_CHANGED = 'lvis',
+    MSG_METRICS_TICK = 'mtik',
+    MSG_METRICS_UPDATE = 'mupd',
     MSG_INPUT_EVENT = 'inev',
     MSG_INSTALL_REPLICANT = 'irep',
     MSG_QUIT_REQUESTED = 'quit'
 };
 
+// Link quality as judged from heartbeat regularity
+enum LinkQuality {
+    LINK_QUALITY_NONE = 0,  // No client connected
+    LINK_QUALITY_POOR,
+    LINK_QUALITY_FAIR,
+    LINK_QUALITY_GOOD
+};
+
 class SoftKMApp : public BApplication {
 public:
     SoftKMApp();
@@ -46,13 +66,36 @@ private:
     void ShowSettingsWindow();
     void ShowLogWindow();
     void ShowAbout();
+    void StartMetricsServer();
+
+    // Status push to subscribed Deskbar replicants
+    void AddStatusSubscriber(const BMessenger& subscriber);
+    void RemoveStatusSubscriber(const BMessenger& subscriber);
+    void BuildStatus(BMessage* status) const;
+    void PushStatus();
+    void PushStatus(BMessenger& subscriber);
+    void PushToSubscribers(BMessage* message);
+    void UpdateMetrics();
 
     NetworkServer* fNetworkServer;
     InputInjector* fInputInjector;
     ClipboardManager* fClipboardManager;
+    MetricsServer* fMetricsServer;
     SettingsWindow* fSettingsWindow;
     LogWindow* fLogWindow;
     bool fClientConnected;
+    bool fInputActive;
+    int32 fLinkQuality;
+    bool fLogVisible;
+    std::vector<BMessenger> fStatusSubscribers;
+
+    // Link metrics, sampled once per tick and pushed to subscribers
+    BMessageRunner* fMetricsRunner;
+    bigtime_t fLastMetricsTime;
+    int64 fLastEventsReceived;
+    int64 fLastEventsDropped;
+    int64 fLastEventsMerged;
+    int64 fLastLatencyBuckets[LatencyHistogram::kBucketCount];
 
     static SoftKMApp* sInstance;
 };
@@ -1,24 +1,42 @@
 #include "ClipboardManager.h"
+#include "ContentHash.h"
+#include "Lz4Block.h"
+#include "../metrics/Metrics.h"
+#include "../network/NetworkServer.h"
+#include "../network/Protocol.h"
 #include "../Logger.h"
 
+#include <Autolock.h>
 #include <Clipboard.h>
 #include <Message.h>
+#include <OS.h>
 #include <String.h>
 
 #include <cstring>
 
 ClipboardManager::ClipboardManager()
-    : fNetworkServer(nullptr)
+    : fNetworkServer(nullptr),
+      fSyncedCount(0),
+      fLastSentHash(0),
+      fLastReceivedHash(0),
+      fLock("clipboard transfer"),
+      fIncomingFormat(-1)
 {
+    for (int32 i = 0; i < ClipboardManifest::kMaxFormats; i++) {
+        fFetched[i] = nullptr;
+        fFetchedLength[i] = 0;
+    }
 }
 
 ClipboardManager::~ClipboardManager()
 {
+    CancelFetch();
 }
 
-uint8* ClipboardManager::GetClipboardForSync(uint32* outLength)
+uint8* ClipboardManager::GetClipboardForSync(uint32* outLength, uint64* outHash)
 {
     *outLength = 0;
+    *outHash = 0;
 
     if (!be_clipboard->Lock()) {
         LOG("ClipboardManager: Failed to lock clipboard");
@@ -57,38 +75,339 @@ uint8* ClipboardManager::GetClipboardForSync(uint32* outLength)
     uint8* buffer = new uint8[textLength];
     memcpy(buffer, textData, textLength);
     *outLength = (uint32)textLength;
+    *outHash = ContentHash(buffer, textLength);
 
     LOG("ClipboardManager: Got clipboard for sync: %lu bytes", *outLength);
     return buffer;
 }
 
-void ClipboardManager::SetClipboardFromSync(uint8 contentType, const uint8* data, uint32 length)
+bool ClipboardManager::NeedsSync(uint64 hash)
 {
-    if (contentType != 0x00) {
+    if ((int64)hash == atomic_get64(&fLastSentHash)
+        || (int64)hash == atomic_get64(&fLastReceivedHash)) {
+        Metrics::Count(METRIC_CLIPBOARD_DEDUP_OUT_HITS);
+        return false;
+    }
+
+    Metrics::Count(METRIC_CLIPBOARD_DEDUP_OUT_MISSES);
+    return true;
+}
+
+void ClipboardManager::MarkSent(uint64 hash)
+{
+    atomic_set64(&fLastSentHash, hash);
+}
+
+void ClipboardManager::SetClipboardFromSync(uint8 contentType, const uint8* data,
+    uint32 length, const uint64* hash)
+{
+    bool compressed = (contentType & CLIPBOARD_COMPRESSED) != 0;
+    if ((contentType & ~CLIPBOARD_COMPRESSED) != 0x00) {
         LOG("ClipboardManager: Unsupported content type: %d", contentType);
         return;
     }
 
-    if (length > kMaxClipboardSize) {
-        LOG("ClipboardManager: Received clipboard too large: %lu bytes", length);
+    // Compressed content starts with its original length, and always comes
+    // with its hash so that content we already hold is never decoded
+    uint32 contentLength = length;
+    if (compressed) {
+        if (length < sizeof(uint32) || hash == nullptr) {
+            LOG("ClipboardManager: Malformed compressed clipboard");
+            return;
+        }
+        memcpy(&contentLength, data, sizeof(uint32));
+    }
+
+    if (contentLength > kMaxClipboardSize) {
+        LOG("ClipboardManager: Received clipboard too large: %lu bytes",
+            contentLength);
         return;
     }
 
+    uint64 receivedHash = hash != nullptr ? *hash : ContentHash(data, length);
+    atomic_set64(&fLastReceivedHash, receivedHash);
+
     if (!be_clipboard->Lock()) {
         LOG("ClipboardManager: Failed to lock clipboard for writing");
         return;
     }
 
+    // Recommitting identical content would wake every clipboard watcher
+    BMessage* clip = be_clipboard->Data();
+    const void* current;
+    ssize_t currentLength;
+    if (clip != nullptr
+        && clip->FindData("text/plain", B_MIME_TYPE, &current,
+            &currentLength) == B_OK
+        && (uint32)currentLength == contentLength
+        && ContentHash(current, currentLength) == receivedHash) {
+        be_clipboard->Unlock();
+        Metrics::Count(METRIC_CLIPBOARD_DEDUP_IN_HITS);
+        LOG("ClipboardManager: Clipboard from macOS unchanged, not committed");
+        return;
+    }
+    Metrics::Count(METRIC_CLIPBOARD_DEDUP_IN_MISSES);
+
+    // Decoded straight from the received message into the one buffer the
+    // content needs
+    uint8* decoded = nullptr;
+    if (compressed) {
+        decoded = new uint8[contentLength];
+        if (Lz4Decompress(data + sizeof(uint32), length - sizeof(uint32),
+                decoded, contentLength) != (ssize_t)contentLength) {
+            be_clipboard->Unlock();
+            delete[] decoded;
+            LOG("ClipboardManager: Corrupt compressed clipboard");
+            return;
+        }
+        data = decoded;
+    }
+
     be_clipboard->Clear();
 
-    BMessage* clip = be_clipboard->Data();
+    clip = be_clipboard->Data();
     if (clip != nullptr) {
-        clip->AddData("text/plain", B_MIME_TYPE, data, length);
+        clip->AddData("text/plain", B_MIME_TYPE, data, contentLength);
         be_clipboard->Commit();
-        LOG("ClipboardManager: Clipboard updated from macOS: %lu bytes", length);
+        fSyncedCount = be_clipboard->SystemCount();
+        LOG("ClipboardManager: Clipboard updated from macOS: %lu bytes (%lu on the wire)",
+            contentLength, length);
     } else {
         LOG("ClipboardManager: Failed to get clipboard data message");
     }
 
     be_clipboard->Unlock();
+    delete[] decoded;
+}
+
+void ClipboardManager::ClipboardChanged()
+{
+    // Do not echo what the client just sent us back to it
+    if (!be_clipboard->Lock())
+        return;
+    bool fromSync = be_clipboard->SystemCount() == fSyncedCount;
+    be_clipboard->Unlock();
+
+    if (fromSync)
+        return;
+
+    // What was copied here is newer than anything still being fetched
+    {
+        BAutolock lock(fLock);
+        if (fIncoming.CountFormats() > 0) {
+            LOG("ClipboardManager: Local copy, cancelling fetch from macOS");
+            CancelFetch();
+        }
+    }
+
+    PushClipboard();
+}
+
+void ClipboardManager::PushClipboard(bool force)
+{
+    if (fNetworkServer != nullptr && fNetworkServer->HasClient())
+        fNetworkServer->SendClipboardSync(force);
+}
+
+bool ClipboardManager::BuildManifest(ClipboardManifest* manifest)
+{
+    if (!DescribeClipboard(manifest))
+        return false;
+
+    BAutolock lock(fLock);
+    fServedManifest = *manifest;
+    return true;
+}
+
+ssize_t ClipboardManager::ReadFormat(uint32 generation, uint8 format,
+    uint32 offset, uint8* buffer, uint32 length)
+{
+    char mimeType[sizeof(ClipboardFormatEntry::mimeType)];
+    {
+        BAutolock lock(fLock);
+        const ClipboardFormatEntry* entry = fServedManifest.FormatAt(format);
+        if (generation != fServedManifest.Generation() || entry == nullptr)
+            return -1;
+        strcpy(mimeType, entry->mimeType);
+    }
+
+    if (!be_clipboard->Lock())
+        return -1;
+
+    // Each chunk is copied from the clipboard itself; nothing is kept for
+    // a fetch that is never finished
+    ssize_t result = -1;
+    BMessage* clip = be_clipboard->Data();
+    const void* data;
+    ssize_t size;
+    if (be_clipboard->SystemCount() == generation && clip != nullptr
+        && clip->FindData(mimeType, B_MIME_TYPE, &data, &size) == B_OK
+        && offset <= (uint32)size) {
+        result = (uint32)size - offset < length ? (uint32)size - offset : length;
+        memcpy(buffer, (const uint8*)data + offset, result);
+    }
+
+    be_clipboard->Unlock();
+    return result;
+}
+
+void ClipboardManager::ManifestReceived(const ClipboardManifest& manifest)
+{
+    atomic_set64(&fLastReceivedHash, manifest.Hash());
+
+    ClipboardManifest current;
+    if (DescribeClipboard(&current) && current.Hash() == manifest.Hash()) {
+        Metrics::Count(METRIC_CLIPBOARD_DEDUP_IN_HITS);
+        LOG("ClipboardManager: Clipboard from macOS unchanged, not fetched");
+        return;
+    }
+    Metrics::Count(METRIC_CLIPBOARD_DEDUP_IN_MISSES);
+
+    BAutolock lock(fLock);
+
+    CancelFetch();
+    fIncoming = manifest;
+    LOG("ClipboardManager: macOS offers %ld formats, fetching",
+        fIncoming.CountFormats());
+    FetchNextFormat();
+}
+
+void ClipboardManager::ChunkReceived(const ClipboardChunkPayload& chunk,
+    const uint8* data)
+{
+    BAutolock lock(fLock);
+
+    if (!fFetch.IsActive() || chunk.generation != fFetch.Generation())
+        return;
+
+    if (chunk.status != CLIPBOARD_CHUNK_OK) {
+        LOG("ClipboardManager: macOS clipboard changed during fetch");
+        CancelFetch();
+        return;
+    }
+
+    if (fFetch.AddChunk(chunk.generation, chunk.format, chunk.offset, data,
+            chunk.length) != B_OK) {
+        if (!fFetch.IsActive()) {
+            LOG("ClipboardManager: Bad clipboard chunk, fetch cancelled");
+            CancelFetch();
+        }
+        return;
+    }
+    Metrics::Count(METRIC_CLIPBOARD_BYTES_IN, chunk.length);
+
+    if (fFetch.IsComplete()) {
+        fFetched[fIncomingFormat] = fFetch.Detach(
+            &fFetchedLength[fIncomingFormat]);
+        FetchNextFormat();
+    } else
+        RequestChunks();
+}
+
+void ClipboardManager::FetchSourceGone()
+{
+    BAutolock lock(fLock);
+    CancelFetch();
+}
+
+bool ClipboardManager::DescribeClipboard(ClipboardManifest* manifest)
+{
+    if (!be_clipboard->Lock())
+        return false;
+
+    manifest->MakeEmpty(be_clipboard->SystemCount());
+
+    // Every MIME-typed field is a format, in the order the app added them
+    BMessage* clip = be_clipboard->Data();
+    char* name;
+    type_code type;
+    for (int32 i = 0; clip != nullptr
+            && clip->GetInfo(B_MIME_TYPE, i, &name, &type) == B_OK; i++) {
+        const void* data;
+        ssize_t size;
+        if (clip->FindData(name, B_MIME_TYPE, &data, &size) != B_OK)
+            continue;
+        if (manifest->AddFormat(name, size, ContentHash(data, size)) != B_OK)
+            LOG("ClipboardManager: Format %s not announced", name);
+    }
+
+    be_clipboard->Unlock();
+    return manifest->CountFormats() > 0;
+}
+
+void ClipboardManager::FetchNextFormat()
+{
+    while (++fIncomingFormat < fIncoming.CountFormats()) {
+        const ClipboardFormatEntry* entry = fIncoming.FormatAt(fIncomingFormat);
+        if (entry->size > kMaxFetchSize) {
+            LOG("ClipboardManager: Not fetching %s, %lu bytes", entry->mimeType,
+                entry->size);
+            continue;
+        }
+
+        if (fFetch.Start(fIncoming.Generation(), fIncomingFormat,
+                entry->size) != B_OK)
+            continue;
+
+        if (!fFetch.IsComplete()) {
+            RequestChunks();
+            return;
+        }
+        fFetched[fIncomingFormat] = fFetch.Detach(
+            &fFetchedLength[fIncomingFormat]);
+    }
+
+    CommitFetched();
+}
+
+void ClipboardManager::RequestChunks()
+{
+    uint32 offset;
+    uint32 length;
+    while (fFetch.NextRequest(&offset, &length)) {
+        fNetworkServer->SendClipboardFetch(fFetch.Generation(), fFetch.Format(),
+            offset, length);
+    }
+}
+
+void ClipboardManager::CommitFetched()
+{
+    int32 fetched = 0;
+    for (int32 i = 0; i < fIncoming.CountFormats(); i++) {
+        if (fFetched[i] != nullptr)
+            fetched++;
+    }
+
+    if (fetched > 0 && be_clipboard->Lock()) {
+        be_clipboard->Clear();
+
+        BMessage* clip = be_clipboard->Data();
+        if (clip != nullptr) {
+            for (int32 i = 0; i < fIncoming.CountFormats(); i++) {
+                if (fFetched[i] != nullptr) {
+                    clip->AddData(fIncoming.FormatAt(i)->mimeType, B_MIME_TYPE,
+                        fFetched[i], fFetchedLength[i]);
+                }
+            }
+            be_clipboard->Commit();
+            fSyncedCount = be_clipboard->SystemCount();
+            LOG("ClipboardManager: Clipboard updated from macOS: %ld formats",
+                fetched);
+        }
+        be_clipboard->Unlock();
+    }
+
+    CancelFetch();
+}
+
+void ClipboardManager::CancelFetch()
+{
+    fFetch.Cancel();
+    for (int32 i = 0; i < ClipboardManifest::kMaxFormats; i++) {
+        delete[] fFetched[i];
+        fFetched[i] = nullptr;
+        fFetchedLength[i] = 0;
+    }
+    fIncoming.MakeEmpty(0);
+    fIncomingFormat = -1;
 }
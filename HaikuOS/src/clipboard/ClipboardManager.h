@@ -1,8 +1,11 @@
 #ifndef CLIPBOARD_MANAGER_H
 #define CLIPBOARD_MANAGER_H
 
+#include <Locker.h>
 #include <SupportDefs.h>
 
+#include "ClipboardTransfer.h"
+
 class NetworkServer;
 
 class ClipboardManager {
@@ -12,17 +15,73 @@ public:
 
     // Get clipboard data for syncing (returns nullptr if empty/too large)
     // Caller owns the returned buffer and must delete[] it
-    uint8* GetClipboardForSync(uint32* outLength);
+    uint8* GetClipboardForSync(uint32* outLength, uint64* outHash);
+
+    // Whether content with this hash still has to be sent, i.e. it is
+    // neither what we sent last nor what the client sent us last
+    bool NeedsSync(uint64 hash);
+    void MarkSent(uint64 hash);
+
+    // Set clipboard from received sync data; hash may be nullptr if the
+    // client did not send one. Identical content is not recommitted;
+    // CLIPBOARD_COMPRESSED content is decoded here.
+    void SetClipboardFromSync(uint8 contentType, const uint8* data, uint32 length,
+        const uint64* hash);
 
-    // Set clipboard from received sync data
-    void SetClipboardFromSync(uint8 contentType, const uint8* data, uint32 length);
+    // B_CLIPBOARD_CHANGED, on the app thread: pushes the new content to
+    // the client unless it is the one we just committed from a sync
+    void ClipboardChanged();
+
+    // force sends even content the client is believed to have, e.g. to a
+    // client that just connected
+    void PushClipboard(bool force = false);
 
     void SetNetworkServer(NetworkServer* server) { fNetworkServer = server; }
 
+    // Lazy clipboard, for clients with CAPABILITY_CLIPBOARD_MANIFEST.
+    // Describes the clipboard and remembers it for ReadFormat(); false if
+    // there is nothing to announce.
+    bool BuildManifest(ClipboardManifest* manifest);
+    // Serves a CLIPBOARD_FETCH straight from the clipboard; -1 if that
+    // content was replaced since
+    ssize_t ReadFormat(uint32 generation, uint8 format, uint32 offset,
+        uint8* buffer, uint32 length);
+
+    // From the client, on the server thread. Haiku has no way to supply
+    // data only once a paste asks for it, so the formats are pulled in the
+    // background right away and committed together. A newer manifest or a
+    // local copy cancels what is still being fetched.
+    void ManifestReceived(const ClipboardManifest& manifest);
+    void ChunkReceived(const ClipboardChunkPayload& chunk, const uint8* data);
+    // The client that sent the manifest went away
+    void FetchSourceGone();
+
 private:
+    bool DescribeClipboard(ClipboardManifest* manifest);
+    void FetchNextFormat();
+    void RequestChunks();
+    void CommitFetched();
+    void CancelFetch();
+
     NetworkServer* fNetworkServer;
+    uint32 fSyncedCount;    // clipboard SystemCount() of our last commit
+
+    // ContentHash() of the last content each way, 0 = none
+    int64 fLastSentHash;
+    int64 fLastReceivedHash;
+
+    // Guards the lazy transfer state below
+    BLocker fLock;
+    ClipboardManifest fServedManifest;      // last one announced
+    ClipboardManifest fIncoming;            // being fetched, if any
+    int32 fIncomingFormat;
+    ClipboardFetch fFetch;
+    uint8* fFetched[ClipboardManifest::kMaxFormats];
+    uint32 fFetchedLength[ClipboardManifest::kMaxFormats];
 
     static const uint32 kMaxClipboardSize = 1048576;  // 1MB
+    // Per format of the lazy clipboard; larger ones are not fetched
+    static const uint32 kMaxFetchSize = 16 * 1048576;
 };
 
 #endif // CLIPBOARD_MANAGER_H
@@ -0,0 +1,175 @@
+#include "ClipboardTransfer.h"
+#include "ContentHash.h"
+
+#include <cstring>
+#include <new>
+
+ClipboardManifest::ClipboardManifest()
+    : fGeneration(0),
+      fCount(0)
+{
+}
+
+void ClipboardManifest::MakeEmpty(uint32 generation)
+{
+    fGeneration = generation;
+    fCount = 0;
+}
+
+status_t ClipboardManifest::AddFormat(const char* mimeType, uint32 size,
+    uint64 hash)
+{
+    if (fCount == kMaxFormats)
+        return B_NO_MEMORY;
+
+    ClipboardFormatEntry& entry = fFormats[fCount];
+    if (strlen(mimeType) >= sizeof(entry.mimeType))
+        return B_BAD_VALUE;
+
+    memset(entry.mimeType, 0, sizeof(entry.mimeType));
+    strcpy(entry.mimeType, mimeType);
+    entry.size = size;
+    entry.hash = hash;
+    fCount++;
+    return B_OK;
+}
+
+const ClipboardFormatEntry* ClipboardManifest::FormatAt(int32 index) const
+{
+    if (index < 0 || index >= fCount)
+        return nullptr;
+    return &fFormats[index];
+}
+
+int32 ClipboardManifest::IndexOf(const char* mimeType) const
+{
+    for (int32 i = 0; i < fCount; i++) {
+        if (strcmp(fFormats[i].mimeType, mimeType) == 0)
+            return i;
+    }
+    return -1;
+}
+
+uint64 ClipboardManifest::Hash() const
+{
+    return ContentHash(fFormats, fCount * sizeof(ClipboardFormatEntry));
+}
+
+size_t ClipboardManifest::FlattenedSize() const
+{
+    return sizeof(ClipboardManifestPayload)
+        + fCount * sizeof(ClipboardFormatEntry);
+}
+
+void ClipboardManifest::Flatten(uint8* buffer) const
+{
+    ClipboardManifestPayload* payload = (ClipboardManifestPayload*)buffer;
+    payload->generation = fGeneration;
+    payload->formatCount = (uint8)fCount;
+    memcpy(buffer + sizeof(ClipboardManifestPayload), fFormats,
+        fCount * sizeof(ClipboardFormatEntry));
+}
+
+status_t ClipboardManifest::Unflatten(const uint8* buffer, size_t length)
+{
+    if (length < sizeof(ClipboardManifestPayload))
+        return B_BAD_VALUE;
+
+    const ClipboardManifestPayload* payload
+        = (const ClipboardManifestPayload*)buffer;
+    if (payload->formatCount > kMaxFormats
+        || length < sizeof(ClipboardManifestPayload)
+            + payload->formatCount * sizeof(ClipboardFormatEntry))
+        return B_BAD_VALUE;
+
+    fGeneration = payload->generation;
+    fCount = payload->formatCount;
+    memcpy(fFormats, buffer + sizeof(ClipboardManifestPayload),
+        fCount * sizeof(ClipboardFormatEntry));
+
+    // Never trust the peer to terminate its strings
+    for (int32 i = 0; i < fCount; i++)
+        fFormats[i].mimeType[sizeof(fFormats[i].mimeType) - 1] = '\0';
+    return B_OK;
+}
+
+ClipboardFetch::ClipboardFetch()
+    : fData(nullptr),
+      fSize(0),
+      fRequested(0),
+      fReceived(0),
+      fGeneration(0),
+      fFormat(0)
+{
+}
+
+ClipboardFetch::~ClipboardFetch()
+{
+    Cancel();
+}
+
+status_t ClipboardFetch::Start(uint32 generation, uint8 format, uint32 size)
+{
+    Cancel();
+
+    // One byte for empty formats, so that IsActive() holds
+    fData = new(std::nothrow) uint8[size > 0 ? size : 1];
+    if (fData == nullptr)
+        return B_NO_MEMORY;
+
+    fSize = size;
+    fRequested = 0;
+    fReceived = 0;
+    fGeneration = generation;
+    fFormat = format;
+    return B_OK;
+}
+
+void ClipboardFetch::Cancel()
+{
+    delete[] fData;
+    fData = nullptr;
+    fSize = 0;
+}
+
+bool ClipboardFetch::NextRequest(uint32* offset, uint32* length)
+{
+    if (!IsActive() || fRequested == fSize
+        || fRequested - fReceived >= kWindow * kChunkSize)
+        return false;
+
+    *offset = fRequested;
+    *length = fSize - fRequested < kChunkSize ? fSize - fRequested : kChunkSize;
+    fRequested += *length;
+    return true;
+}
+
+status_t ClipboardFetch::AddChunk(uint32 generation, uint8 format,
+    uint32 offset, const uint8* data, uint32 length)
+{
+    if (!IsActive() || generation != fGeneration || format != fFormat)
+        return B_BAD_VALUE;
+
+    // Chunks come back in the order they were asked for
+    if (offset != fReceived || length > fRequested - fReceived
+        || (length == 0 && fReceived < fSize)) {
+        Cancel();
+        return B_BAD_VALUE;
+    }
+
+    memcpy(fData + offset, data, length);
+    fReceived += length;
+    return B_OK;
+}
+
+uint8* ClipboardFetch::Detach(uint32* size)
+{
+    if (!IsComplete())
+        return nullptr;
+
+    uint8* data = fData;
+    *size = fSize;
+    fData = nullptr;
+    fSize = 0;
+    return data;
+}
@@ -0,0 +1,82 @@
+#ifndef CLIPBOARD_TRANSFER_H
+#define CLIPBOARD_TRANSFER_H
+
+#include <SupportDefs.h>
+
+#include <stddef.h>
+
+#include "../network/Protocol.h"
+
+// The formats one side's clipboard holds, as sent in CLIPBOARD_MANIFEST.
+// Plain C++, no Be API dependencies.
+class ClipboardManifest {
+public:
+    static const int32 kMaxFormats = 8;
+
+    ClipboardManifest();
+
+    void MakeEmpty(uint32 generation);
+    status_t AddFormat(const char* mimeType, uint32 size, uint64 hash);
+
+    uint32 Generation() const { return fGeneration; }
+    int32 CountFormats() const { return fCount; }
+    const ClipboardFormatEntry* FormatAt(int32 index) const;
+    int32 IndexOf(const char* mimeType) const;
+
+    // Over all formats but not the generation, so that the same content
+    // announced twice compares equal
+    uint64 Hash() const;
+
+    // The CLIPBOARD_MANIFEST payload
+    size_t FlattenedSize() const;
+    void Flatten(uint8* buffer) const;
+    status_t Unflatten(const uint8* buffer, size_t length);
+
+private:
+    uint32 fGeneration;
+    int32 fCount;
+    ClipboardFormatEntry fFormats[kMaxFormats];
+};
+
+// Receiving end of one format: hands out the CLIPBOARD_FETCH requests to
+// make, never more than kWindow chunks ahead of what arrived, and puts the
+// chunks together in a buffer of the announced size.
+class ClipboardFetch {
+public:
+    static const uint32 kChunkSize = 16384;
+    static const uint32 kWindow = 4;
+
+    ClipboardFetch();
+    ~ClipboardFetch();
+
+    status_t Start(uint32 generation, uint8 format, uint32 size);
+    void Cancel();
+
+    bool IsActive() const { return fData != nullptr; }
+    bool IsComplete() const { return IsActive() && fReceived == fSize; }
+    uint32 Generation() const { return fGeneration; }
+    uint8 Format() const { return fFormat; }
+    uint32 Received() const { return fReceived; }
+
+    // The next request to send; false while the window is full or all of
+    // the format was asked for
+    bool NextRequest(uint32* offset, uint32* length);
+
+    // B_BAD_VALUE for chunks of another fetch, which are ignored, and for
+    // ones out of order, which end this fetch
+    status_t AddChunk(uint32 generation, uint8 format, uint32 offset,
+        const uint8* data, uint32 length);
+
+    // Hands over the completed data, to be delete[]d by the caller
+    uint8* Detach(uint32* size);
+
+private:
+    uint8* fData;
+    uint32 fSize;
+    uint32 fRequested;
+    uint32 fReceived;
+    uint32 fGeneration;
+    uint8 fFormat;
+};
+
+#endif // CLIPBOARD_TRANSFER_H
@@ -0,0 +1,87 @@
+#include "ContentHash.h"
+
+#include <cstring>
+
+static const uint64 kPrime1 = 0x9E3779B185EBCA87ULL;
+static const uint64 kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64 kPrime3 = 0x165667B19E3779F9ULL;
+
+static inline uint64 RotateLeft(uint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Words are read in host order; both ends are little-endian, as the rest
+// of the protocol assumes
+static inline uint64 MixWord(uint64 hash, const uint8* bytes)
+{
+    uint64 word;
+    memcpy(&word, bytes, sizeof(word));
+    hash ^= word * kPrime2;
+    return RotateLeft(hash, 31) * kPrime1;
+}
+
+uint64 ContentHash(const void* data, size_t length)
+{
+    ContentHasher hasher(length);
+    hasher.Update(data, length);
+    return hasher.Final();
+}
+
+ContentHasher::ContentHasher(uint64 length)
+    : fHash(kPrime3 ^ (length * kPrime1)),
+      fConsumed(0),
+      fPendingLength(0)
+{
+}
+
+void ContentHasher::Update(const void* data, size_t length)
+{
+    const uint8* bytes = (const uint8*)data;
+    fConsumed += length;
+
+    if (fPendingLength > 0) {
+        size_t count = sizeof(fPending) - fPendingLength;
+        if (count > length)
+            count = length;
+        memcpy(fPending + fPendingLength, bytes, count);
+        fPendingLength += count;
+        bytes += count;
+        length -= count;
+        if (fPendingLength < sizeof(fPending))
+            return;
+        fHash = MixWord(fHash, fPending);
+        fPendingLength = 0;
+    }
+
+    size_t offset = 0;
+    for (; offset + 8 <= length; offset += 8)
+        fHash = MixWord(fHash, bytes + offset);
+
+    fPendingLength = length - offset;
+    if (fPendingLength > 0)
+        memcpy(fPending, bytes + offset, fPendingLength);
+}
+
+uint64 ContentHasher::Final()
+{
+    uint64 hash = fHash;
+    for (size_t i = 0; i < fPendingLength; i++) {
+        hash ^= fPending[i] * kPrime3;
+        hash = RotateLeft(hash, 11) * kPrime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= kPrime2;
+    hash ^= hash >> 29;
+    hash *= kPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+void ContentHasher::Restore(uint64 consumed, uint64 state)
+{
+    fHash = state;
+    fConsumed = consumed;
+    fPendingLength = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <SupportDefs.h>
+
+#include <stddef.h>
+
+// Fast non-cryptographic 64-bit hash of clipboard content, 8 bytes per
+// step. Carried in CLIPBOARD_SYNC, so the macOS client implements the
+// same function (ClipboardManager.contentHash); change both or neither.
+uint64 ContentHash(const void* data, size_t length);
+
+// The same hash over data that comes in pieces, such as a file being
+// received. The total length is part of the hash, so it has to be known
+// up front.
+class ContentHasher {
+public:
+    ContentHasher(uint64 length);
+
+    void Update(const void* data, size_t length);
+    uint64 Final();
+
+    // To carry on with a stream later. Only meaningful at a multiple of
+    // 8 bytes, where nothing is held back for the next Update().
+    uint64 Consumed() const { return fConsumed; }
+    uint64 State() const { return fHash; }
+    void Restore(uint64 consumed, uint64 state);
+
+private:
+    uint64 fHash;
+    uint64 fConsumed;
+    uint8 fPending[8];      // the start of an incomplete word
+    size_t fPendingLength;
+};
+
+#endif // CONTENT_HASH_H
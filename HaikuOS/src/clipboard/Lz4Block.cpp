@@ -0,0 +1,191 @@
+#include "Lz4Block.h"
+
+#include <cstring>
+
+static const size_t kMinMatch = 4;
+static const size_t kLastLiterals = 5;      // block must end in literals
+static const size_t kMatchStartLimit = 12;  // last match starts this far from the end
+static const size_t kMaxOffset = 65535;
+static const int kHashBits = 12;
+
+static inline uint32 Read32(const uint8* p)
+{
+    uint32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32 Hash(uint32 sequence)
+{
+    return (sequence * 2654435761U) >> (32 - kHashBits);
+}
+
+// Token nibble extension: 255s, then the remainder
+static inline bool WriteLength(uint8*& op, const uint8* end, size_t length)
+{
+    for (; length >= 255; length -= 255) {
+        if (op >= end)
+            return false;
+        *op++ = 255;
+    }
+    if (op >= end)
+        return false;
+    *op++ = (uint8)length;
+    return true;
+}
+
+static inline bool ReadLength(const uint8*& ip, const uint8* end,
+    size_t* length)
+{
+    uint8 byte;
+    do {
+        if (ip >= end)
+            return false;
+        byte = *ip++;
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+size_t Lz4CompressBound(size_t length)
+{
+    return length + length / 255 + 16;
+}
+
+ssize_t Lz4Compress(const void* src, size_t srcLength, void* dst,
+    size_t dstCapacity)
+{
+    const uint8* base = (const uint8*)src;
+    const uint8* ip = base;
+    const uint8* anchor = base;
+    const uint8* srcEnd = base + srcLength;
+    uint8* op = (uint8*)dst;
+    uint8* dstEnd = op + dstCapacity;
+
+    if (srcLength > kMatchStartLimit) {
+        uint32 table[1 << kHashBits];
+        memset(table, 0, sizeof(table));
+
+        const uint8* matchLimit = srcEnd - kLastLiterals;
+        const uint8* startLimit = srcEnd - kMatchStartLimit;
+        uint32 misses = 0;
+
+        while (ip < startLimit) {
+            uint32 sequence = Read32(ip);
+            uint32 hash = Hash(sequence);
+            const uint8* match = base + table[hash];
+            table[hash] = (uint32)(ip - base);
+
+            if (match >= ip || (size_t)(ip - match) > kMaxOffset
+                || Read32(match) != sequence) {
+                // Skip faster through data that does not compress
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+
+            // Grow the match backwards into pending literals, then forwards
+            while (ip > anchor && match > base && ip[-1] == match[-1]) {
+                ip--;
+                match--;
+            }
+            const uint8* matchEnd = ip + kMinMatch;
+            const uint8* ref = match + kMinMatch;
+            while (matchEnd < matchLimit && *matchEnd == *ref) {
+                matchEnd++;
+                ref++;
+            }
+
+            size_t literals = ip - anchor;
+            size_t matchLength = matchEnd - ip - kMinMatch;
+            if (op >= dstEnd)
+                return -1;
+            uint8* token = op++;
+            *token = (uint8)((literals < 15 ? literals : 15) << 4
+                | (matchLength < 15 ? matchLength : 15));
+
+            if (literals >= 15 && !WriteLength(op, dstEnd, literals - 15))
+                return -1;
+            if ((size_t)(dstEnd - op) < literals + 2)
+                return -1;
+            memcpy(op, anchor, literals);
+            op += literals;
+
+            size_t offset = ip - match;
+            *op++ = (uint8)offset;
+            *op++ = (uint8)(offset >> 8);
+
+            if (matchLength >= 15 && !WriteLength(op, dstEnd, matchLength - 15))
+                return -1;
+
+            ip = anchor = matchEnd;
+        }
+    }
+
+    // Whatever is left goes out as literals
+    size_t literals = srcEnd - anchor;
+    if (op >= dstEnd)
+        return -1;
+    *op++ = (uint8)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15 && !WriteLength(op, dstEnd, literals - 15))
+        return -1;
+    if ((size_t)(dstEnd - op) < literals)
+        return -1;
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - (uint8*)dst;
+}
+
+ssize_t Lz4Decompress(const void* src, size_t srcLength, void* dst,
+    size_t dstCapacity)
+{
+    const uint8* ip = (const uint8*)src;
+    const uint8* srcEnd = ip + srcLength;
+    uint8* start = (uint8*)dst;
+    uint8* op = start;
+    uint8* dstEnd = start + dstCapacity;
+
+    while (ip < srcEnd) {
+        uint8 token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !ReadLength(ip, srcEnd, &literals))
+            return -1;
+        if (literals > (size_t)(srcEnd - ip) || literals > (size_t)(dstEnd - op))
+            return -1;
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        // The last sequence has no match
+        if (ip == srcEnd)
+            break;
+
+        if (srcEnd - ip < 2)
+            return -1;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - start))
+            return -1;
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(ip, srcEnd, &matchLength))
+            return -1;
+        matchLength += kMinMatch;
+        if (matchLength > (size_t)(dstEnd - op))
+            return -1;
+
+        // Overlapping copies repeat the last offset bytes, so go bytewise
+        const uint8* match = op - offset;
+        if (offset >= matchLength)
+            memcpy(op, match, matchLength);
+        else {
+            for (size_t i = 0; i < matchLength; i++)
+                op[i] = match[i];
+        }
+        op += matchLength;
+    }
+
+    return op - start;
+}
@@ -0,0 +1,24 @@
+#ifndef LZ4_BLOCK_H
+#define LZ4_BLOCK_H
+
+#include <SupportDefs.h>
+
+#include <stddef.h>
+
+// LZ4 block format (no frame), the same bytes Apple's COMPRESSION_LZ4_RAW
+// reads and writes, so the macOS client needs no codec of its own.
+// Plain C++, no allocation: both directions work on caller buffers.
+
+// Worst-case compressed size of length input bytes
+size_t Lz4CompressBound(size_t length);
+
+// Returns the compressed size, or -1 if it would not fit dstCapacity
+ssize_t Lz4Compress(const void* src, size_t srcLength, void* dst,
+    size_t dstCapacity);
+
+// Decodes straight into dst; returns the decoded size, or -1 on malformed
+// input or if the output would exceed dstCapacity
+ssize_t Lz4Decompress(const void* src, size_t srcLength, void* dst,
+    size_t dstCapacity);
+
+#endif // LZ4_BLOCK_H
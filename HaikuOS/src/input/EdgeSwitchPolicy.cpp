@@ -0,0 +1,180 @@
+#include "EdgeSwitchPolicy.h"
+#include "../network/Protocol.h"
+
+#include <math.h>
+
+const float EdgeSwitchPolicy::kEdgeThreshold = 5.0f;
+
+const EdgeSwitchConfig EdgeSwitchPolicy::kDefaultConfig = {
+    300000,     // dwell 300ms for slow approaches
+    1200.0f,    // px/s into the edge switches at once
+    60.0f,      // px pushed past the edge switches
+    16.0f,      // corners never switch
+    0           // no bypass modifier
+};
+
+// Time constant of the velocity smoothing; long enough to ride out the
+// jitter of 1 kHz mice, short enough that the flick reaching the edge
+// still counts
+static const float kVelocitySmoothing = 0.016f;
+// Slower than this, in px/s, is standing still. Left alone, the smoothed
+// velocity of a pointer at rest (or pinned by a game) decays into
+// denormals, which make every later update several times slower.
+static const float kVelocityFloor = 0.001f;
+
+EdgeSwitchPolicy::EdgeSwitchPolicy()
+    : fConfig(kDefaultConfig),
+      fWidth(0),
+      fHeight(0),
+      fEdgeMask(0)
+{
+    Reset();
+}
+
+void EdgeSwitchPolicy::SetScreen(float width, float height)
+{
+    fWidth = width;
+    fHeight = height;
+}
+
+void EdgeSwitchPolicy::Reset()
+{
+    fHasSample = false;
+    fLastTime = 0;
+    fLastX = 0;
+    fLastY = 0;
+    fVelocityX = 0;
+    fVelocityY = 0;
+    fEdge = -1;
+    fEdgeSince = 0;
+    fOvershoot = 0;
+}
+
+EdgeSwitchReason EdgeSwitchPolicy::Update(bigtime_t when, float x, float y,
+    uint32 modifiers)
+{
+    // Motion is measured from where the pointer really was, so pushing
+    // against the border still has a velocity into it
+    if (fHasSample && when > fLastTime) {
+        float elapsed = (when - fLastTime) / 1000000.0f;
+        float weight = elapsed / (elapsed + kVelocitySmoothing);
+        fVelocityX += weight * ((x - fLastX) / elapsed - fVelocityX);
+        fVelocityY += weight * ((y - fLastY) / elapsed - fVelocityY);
+        if (fabsf(fVelocityX) < kVelocityFloor)
+            fVelocityX = 0;
+        if (fabsf(fVelocityY) < kVelocityFloor)
+            fVelocityY = 0;
+    }
+
+    float clampedX = x < 0 ? 0 : (x > fWidth - 1 ? fWidth - 1 : x);
+    float clampedY = y < 0 ? 0 : (y > fHeight - 1 ? fHeight - 1 : y);
+    fHasSample = true;
+    fLastTime = when;
+    fLastX = clampedX;
+    fLastY = clampedY;
+
+    int32 edge = EdgeAt(clampedX, clampedY);
+    if (edge < 0 || InCorner(edge, clampedX, clampedY)) {
+        fEdge = -1;
+        fOvershoot = 0;
+        return EDGE_SWITCH_NONE;
+    }
+
+    if (edge != fEdge) {
+        fEdge = edge;
+        fEdgeSince = when;
+        fOvershoot = 0;
+    }
+    fOvershoot += Overshoot(edge, x, y);
+
+    if ((modifiers & fConfig.bypassModifiers) != 0)
+        return EDGE_SWITCH_MODIFIER;
+    if (fConfig.pushThroughVelocity > 0
+        && Velocity() >= fConfig.pushThroughVelocity)
+        return EDGE_SWITCH_VELOCITY;
+    if (fConfig.overshootDistance > 0
+        && fOvershoot >= fConfig.overshootDistance)
+        return EDGE_SWITCH_OVERSHOOT;
+    if (when - fEdgeSince >= fConfig.dwellTime)
+        return EDGE_SWITCH_DWELL;
+
+    return EDGE_SWITCH_NONE;
+}
+
+float EdgeSwitchPolicy::Velocity() const
+{
+    switch (fEdge) {
+        case EDGE_LEFT:
+            return -fVelocityX;
+        case EDGE_RIGHT:
+            return fVelocityX;
+        case EDGE_TOP:
+            return -fVelocityY;
+        case EDGE_BOTTOM:
+            return fVelocityY;
+        default:
+            return 0;
+    }
+}
+
+const char* EdgeSwitchPolicy::ReasonName(EdgeSwitchReason reason)
+{
+    switch (reason) {
+        case EDGE_SWITCH_DWELL:
+            return "dwell";
+        case EDGE_SWITCH_VELOCITY:
+            return "velocity";
+        case EDGE_SWITCH_OVERSHOOT:
+            return "overshoot";
+        case EDGE_SWITCH_MODIFIER:
+            return "modifier";
+        default:
+            return "none";
+    }
+}
+
+int32 EdgeSwitchPolicy::EdgeAt(float x, float y) const
+{
+    if ((fEdgeMask & (1 << EDGE_LEFT)) != 0 && x <= kEdgeThreshold)
+        return EDGE_LEFT;
+    if ((fEdgeMask & (1 << EDGE_RIGHT)) != 0 && x >= fWidth - kEdgeThreshold)
+        return EDGE_RIGHT;
+    if ((fEdgeMask & (1 << EDGE_TOP)) != 0 && y <= kEdgeThreshold)
+        return EDGE_TOP;
+    if ((fEdgeMask & (1 << EDGE_BOTTOM)) != 0
+        && y >= fHeight - kEdgeThreshold)
+        return EDGE_BOTTOM;
+    return -1;
+}
+
+bool EdgeSwitchPolicy::InCorner(int32 edge, float x, float y) const
+{
+    if (fConfig.cornerSize <= 0)
+        return false;
+
+    // Position along the edge
+    float along = edge == EDGE_LEFT || edge == EDGE_RIGHT ? y : x;
+    float length = edge == EDGE_LEFT || edge == EDGE_RIGHT ? fHeight : fWidth;
+    return along < fConfig.cornerSize
+        || along > length - 1 - fConfig.cornerSize;
+}
+
+float EdgeSwitchPolicy::Overshoot(int32 edge, float x, float y) const
+{
+    float beyond = 0;
+    switch (edge) {
+        case EDGE_LEFT:
+            beyond = -x;
+            break;
+        case EDGE_RIGHT:
+            beyond = x - (fWidth - 1);
+            break;
+        case EDGE_TOP:
+            beyond = -y;
+            break;
+        case EDGE_BOTTOM:
+            beyond = y - (fHeight - 1);
+            break;
+    }
+    return beyond > 0 ? beyond : 0;
+}
@@ -0,0 +1,79 @@
+#ifndef EDGE_SWITCH_POLICY_H
+#define EDGE_SWITCH_POLICY_H
+
+#include <SupportDefs.h>
+
+// Tunables of EdgeSwitchPolicy; apart from the dwell, a zero turns the
+// respective rule off
+struct EdgeSwitchConfig {
+    bigtime_t dwellTime;            // time at the edge for slow approaches, 0 = none
+    float pushThroughVelocity;      // px/s into the edge that switch at once
+    float overshootDistance;        // px pushed past the edge that switch
+    float cornerSize;               // px at both ends of an edge that never switch
+    uint32 bypassModifiers;         // any of these held switches at once
+};
+
+enum EdgeSwitchReason {
+    EDGE_SWITCH_NONE = 0,
+    EDGE_SWITCH_DWELL,
+    EDGE_SWITCH_VELOCITY,
+    EDGE_SWITCH_OVERSHOOT,
+    EDGE_SWITCH_MODIFIER
+};
+
+// Decides when the pointer resting against a screen edge should leave for
+// the machine beyond it. A fast, deliberate crossing switches on the event
+// that reaches the edge; a slow drift still has to dwell, and the corners
+// (hot spots of their own) never switch. Plain C++, fed one pointer sample
+// per move so it can be replayed off-target.
+class EdgeSwitchPolicy {
+public:
+    static const float kEdgeThreshold;  // px from the border counted as "at"
+    static const EdgeSwitchConfig kDefaultConfig;   // also Settings' defaults
+
+    EdgeSwitchPolicy();
+
+    void SetConfig(const EdgeSwitchConfig& config) { fConfig = config; }
+    const EdgeSwitchConfig& Config() const { return fConfig; }
+    void SetDwellTime(bigtime_t dwellTime) { fConfig.dwellTime = dwellTime; }
+
+    // Edges that lead somewhere, as 1 << SwitchEdge bits
+    void SetScreen(float width, float height);
+    void SetEdges(uint32 edgeMask) { fEdgeMask = edgeMask; }
+
+    // Forget motion history, e.g. after the pointer was warped
+    void Reset();
+
+    // x, y is where the pointer was asked to go and may lie off screen.
+    // Returns why to switch over Edge() now, EDGE_SWITCH_NONE to stay.
+    EdgeSwitchReason Update(bigtime_t when, float x, float y,
+        uint32 modifiers);
+
+    int32 Edge() const { return fEdge; }    // -1 while not at an edge
+    float Velocity() const;                 // px/s into Edge()
+
+    static const char* ReasonName(EdgeSwitchReason reason);
+
+private:
+    int32 EdgeAt(float x, float y) const;
+    bool InCorner(int32 edge, float x, float y) const;
+    float Overshoot(int32 edge, float x, float y) const;
+
+    EdgeSwitchConfig fConfig;
+    float fWidth;
+    float fHeight;
+    uint32 fEdgeMask;
+
+    bool fHasSample;
+    bigtime_t fLastTime;
+    float fLastX;
+    float fLastY;
+    float fVelocityX;           // smoothed px/s
+    float fVelocityY;
+
+    int32 fEdge;
+    bigtime_t fEdgeSince;
+    float fOvershoot;
+};
+
+#endif // EDGE_SWITCH_POLICY_H
@@ -0,0 +1,402 @@
+#include "InputCore.h"
+#include "KeyMap.h"
+#include "../network/Protocol.h"
+
+#include <cstring>
+
+InputCore::InputCore(Clock* clock, ScreenGeometry* screen, InjectionSink* sink)
+    : fClock(clock),
+      fScreen(screen),
+      fSink(sink),
+      fPeerLink(nullptr),
+      fListener(nullptr),
+      fCurrentButtons(0),
+      fCurrentModifiers(0),
+      fActive(false),
+      fReturnEdge(EDGE_LEFT),  // default: left edge returns to Mac
+      fClientScreenWidth(0),
+      fCursorHistoryIndex(0),
+      fCursorHistoryCount(0),
+      fAutoGameMode(false),
+      fMovementSampleCount(0)
+{
+    // Initialize mouse position to center of screen
+    float width, height;
+    fScreen->GetScreenSize(&width, &height);
+    fMouseX = (width - 1) / 2;
+    fMouseY = (height - 1) / 2;
+
+    memset(fHeldKeys, 0, sizeof(fHeldKeys));
+}
+
+void InputCore::GetPosition(float* x, float* y) const
+{
+    *x = fMouseX;
+    *y = fMouseY;
+}
+
+void InputCore::SetActive(bool active, float yRatio, int32 entryEdge)
+{
+    if (fActive == active)
+        return;
+
+    fActive = active;
+    if (fListener != nullptr)
+        fListener->ActiveChanged(active);
+
+    if (!active)
+        return;
+
+    // Position mouse near the return edge (where user is coming from)
+    // but not too close to trigger immediate switch back (50px from edge)
+    // Use yRatio for smooth vertical transition (0.0 = top, 1.0 = bottom)
+    float screenWidth, screenHeight;
+    fScreen->GetScreenSize(&screenWidth, &screenHeight);
+
+    float startX, startY;
+    const float kEdgeOffset = 50.0f;  // 50 pixels from edge
+
+    // yRatio is 0.0 = top, 1.0 = bottom - matches Haiku's coordinate system
+    // Clamp to 0.0-1.0
+    if (yRatio < 0.0f) yRatio = 0.0f;
+    if (yRatio > 1.0f) yRatio = 1.0f;
+    float convertedY = yRatio * (screenHeight - 1);
+
+    // Position based on return edge (opposite of where Mac is), or
+    // the edge of the neighbour that handed control back
+    switch (entryEdge >= 0 ? entryEdge : fReturnEdge) {
+        case EDGE_LEFT:
+            // Mac is on right, user enters from right, position near left edge
+            startX = kEdgeOffset;
+            startY = convertedY;
+            break;
+        case EDGE_RIGHT:
+            // Mac is on left, user enters from left, position near right edge
+            startX = screenWidth - kEdgeOffset;
+            startY = convertedY;
+            break;
+        case EDGE_TOP:
+            // Mac is below, user enters from bottom, position near top edge
+            startX = screenWidth / 2;
+            startY = kEdgeOffset;
+            break;
+        case EDGE_BOTTOM:
+            // Mac is above, user enters from top, position near bottom edge
+            startX = screenWidth / 2;
+            startY = screenHeight - kEdgeOffset;
+            break;
+        default:
+            startX = kEdgeOffset;
+            startY = convertedY;
+            break;
+    }
+
+    // Clamp to screen bounds
+    if (startX < 0) startX = 0;
+    if (startX > screenWidth - 1) startX = screenWidth - 1;
+    if (startY < 0) startY = 0;
+    if (startY > screenHeight - 1) startY = screenHeight - 1;
+
+    fMouseX = startX;
+    fMouseY = startY;
+    fSink->SetCursor(fMouseX, fMouseY);
+
+    // Reset edge detection state, the pointer was warped
+    fSwitchPolicy.Reset();
+    fAccelerator.Reset();
+}
+
+void InputCore::UpdateMousePosition(float x, float y, bool relative)
+{
+    float width, height;
+    fScreen->GetScreenSize(&width, &height);
+
+    if (relative) {
+        fMouseX += x;
+        fMouseY += y;
+    } else {
+        fMouseX = x;
+        fMouseY = y;
+    }
+
+    // Clamp to screen bounds
+    if (fMouseX < 0) fMouseX = 0;
+    if (fMouseY < 0) fMouseY = 0;
+    if (fMouseX > width - 1) fMouseX = width - 1;
+    if (fMouseY > height - 1) fMouseY = height - 1;
+}
+
+void InputCore::InjectKeyDown(uint32 keyCode, uint32 modifiers,
+    const char* bytes, uint8 numBytes)
+{
+    if (!fActive)
+        return;
+
+    bigtime_t eventStart = fClock->Now();
+    uint32 haikuKey;
+    if (!TranslateKeyCode(keyCode, &haikuKey) && fListener != nullptr)
+        fListener->UnknownKeyCode(keyCode);
+    fCurrentModifiers = modifiers;
+    if (haikuKey < kMaxHeldKey)
+        fHeldKeys[haikuKey / 32] |= 1UL << (haikuKey % 32);
+
+    fSink->KeyDown(eventStart, haikuKey, modifiers, bytes, numBytes);
+}
+
+void InputCore::InjectKeyUp(uint32 keyCode, uint32 modifiers)
+{
+    if (!fActive)
+        return;
+
+    bigtime_t eventStart = fClock->Now();
+    uint32 haikuKey;
+    if (!TranslateKeyCode(keyCode, &haikuKey) && fListener != nullptr)
+        fListener->UnknownKeyCode(keyCode);
+    fCurrentModifiers = modifiers;
+    if (haikuKey < kMaxHeldKey)
+        fHeldKeys[haikuKey / 32] &= ~(1UL << (haikuKey % 32));
+
+    fSink->KeyUp(eventStart, haikuKey, modifiers);
+}
+
+int32 InputCore::ReleaseAll()
+{
+    // Runs when the client vanished, so it must work regardless of fActive
+    bigtime_t eventStart = fClock->Now();
+    int32 released = 0;
+
+    for (uint32 key = 0; key < kMaxHeldKey; key++) {
+        if ((fHeldKeys[key / 32] & (1UL << (key % 32))) == 0)
+            continue;
+
+        fSink->KeyUp(eventStart, key, 0);
+        released++;
+    }
+    memset(fHeldKeys, 0, sizeof(fHeldKeys));
+
+    if (fCurrentButtons != 0) {
+        fSink->MouseUp(eventStart, fMouseX, fMouseY, 0, 0);
+        fCurrentButtons = 0;
+    }
+
+    fCurrentModifiers = 0;
+    return released;
+}
+
+void InputCore::UpdateGameModeDetection()
+{
+    // Sample actual cursor position
+    float actualX, actualY;
+    if (!fSink->GetCursor(&actualX, &actualY))
+        return;
+
+    // Add to history
+    fCursorHistoryX[fCursorHistoryIndex] = actualX;
+    fCursorHistoryY[fCursorHistoryIndex] = actualY;
+    fCursorHistoryIndex = (fCursorHistoryIndex + 1) % kGameModeHistorySize;
+    if (fCursorHistoryCount < kGameModeHistorySize)
+        fCursorHistoryCount++;
+
+    // Need enough samples to detect pattern
+    if (fCursorHistoryCount < kGameModeHistorySize)
+        return;
+
+    // Calculate bounding box of recent cursor positions
+    float minX = fCursorHistoryX[0], maxX = fCursorHistoryX[0];
+    float minY = fCursorHistoryY[0], maxY = fCursorHistoryY[0];
+    for (int i = 1; i < fCursorHistoryCount; i++) {
+        if (fCursorHistoryX[i] < minX) minX = fCursorHistoryX[i];
+        if (fCursorHistoryX[i] > maxX) maxX = fCursorHistoryX[i];
+        if (fCursorHistoryY[i] < minY) minY = fCursorHistoryY[i];
+        if (fCursorHistoryY[i] > maxY) maxY = fCursorHistoryY[i];
+    }
+
+    float totalSpread = (maxX - minX) + (maxY - minY);
+
+    // If cursor stays in a very small area despite movement, it's being warped (game mode)
+    // Threshold: 20 pixels total spread means game is warping cursor back
+    const float kGameModeThreshold = 20.0f;
+    // For normal mode, expect more spread: 50+ pixels
+    const float kNormalModeThreshold = 50.0f;
+
+    bool gameMode = fAutoGameMode;
+    if (totalSpread < kGameModeThreshold) {
+        // Very low spread = game mode (cursor being warped)
+        gameMode = true;
+    } else if (totalSpread > kNormalModeThreshold) {
+        // High spread = normal mode (cursor moving freely)
+        gameMode = false;
+    }
+    // Between thresholds = keep current mode (hysteresis)
+
+    if (gameMode != fAutoGameMode) {
+        fAutoGameMode = gameMode;
+        if (fListener != nullptr)
+            fListener->GameModeChanged(gameMode, totalSpread);
+    }
+}
+
+void InputCore::InjectMouseMove(float x, float y, bool relative, uint32 modifiers)
+{
+    MouseMoved(x, y, relative, 1, modifiers);
+}
+
+void InputCore::InjectMouseMoves(float x, float y, int32 count,
+    uint32 modifiers)
+{
+    MouseMoved(x, y, true, count, modifiers);
+}
+
+// count: moves of the client in a relative one
+void InputCore::MouseMoved(float x, float y, bool relative, int32 count,
+    uint32 modifiers)
+{
+    if (!fActive)
+        return;
+
+    bigtime_t eventStart = fClock->Now();
+    fCurrentModifiers = modifiers;
+
+    // Sample for game mode detection every N movements
+    fMovementSampleCount++;
+    if (fMovementSampleCount >= 5) {
+        fMovementSampleCount = 0;
+        UpdateGameModeDetection();
+    }
+
+    float screenWidth, screenHeight;
+    fScreen->GetScreenSize(&screenWidth, &screenHeight);
+
+    float sendX, sendY;
+    float requestedX = fMouseX;  // unclamped, for edge switching
+    float requestedY = fMouseY;
+
+    if (fAutoGameMode && relative) {
+        // Game mode: SDL games expect delta from window center
+        // Send screen_center + delta, let SDL handle cursor
+        sendX = (screenWidth - 1) / 2 + x;
+        sendY = (screenHeight - 1) / 2 + y;
+    } else {
+        // Normal mode: track absolute position
+        if (relative) {
+            // In this screen's px before anything looks at the move
+            fAccelerator.SetScreens(fClientScreenWidth, screenWidth);
+            fAccelerator.Apply(eventStart, count, &x, &y);
+            requestedX = fMouseX + x;
+            requestedY = fMouseY + y;
+        } else {
+            requestedX = x;
+            requestedY = y;
+        }
+        UpdateMousePosition(x, y, relative);
+        sendX = fMouseX;
+        sendY = fMouseY;
+
+        // Update system cursor position
+        if (fCurrentButtons == 0)
+            fSink->SetCursor(fMouseX, fMouseY);
+    }
+
+    // B_MOUSE_MOVED for applications
+    fSink->MouseMoved(eventStart, sendX, sendY, fCurrentButtons,
+        modifiers);
+
+    // Edge switching: the return edge switches back to macOS, any other
+    // edge with a neighbour configured forwards control to that server.
+    // The policy decides when, from how the pointer arrives there.
+    uint32 edgeMask = 1 << fReturnEdge;
+    if (fPeerLink != nullptr) {
+        for (uint8 edge = EDGE_RIGHT; edge <= EDGE_BOTTOM; edge++) {
+            if (fPeerLink->HasNeighbour(edge))
+                edgeMask |= 1 << edge;
+        }
+    }
+    fSwitchPolicy.SetScreen(screenWidth, screenHeight);
+    fSwitchPolicy.SetEdges(edgeMask);
+
+    int32 previousEdge = fSwitchPolicy.Edge();
+    EdgeSwitchReason reason = fSwitchPolicy.Update(eventStart, requestedX,
+        requestedY, modifiers);
+    int32 edge = fSwitchPolicy.Edge();
+    if (edge != previousEdge && fListener != nullptr)
+        fListener->EdgeChanged(edge, previousEdge, fSwitchPolicy.Velocity());
+
+    if (reason == EDGE_SWITCH_NONE || fPeerLink == nullptr)
+        return;
+
+    // Calculate yRatio (0.0 = top, 1.0 = bottom)
+    float yRatio = fMouseY / (screenHeight - 1);
+    if (yRatio < 0.0f) yRatio = 0.0f;
+    if (yRatio > 1.0f) yRatio = 1.0f;
+
+    fSwitchPolicy.Reset();
+    if (edge == fReturnEdge) {
+        // The clipboard is already there, see ClipboardManager
+        if (fListener != nullptr)
+            fListener->EdgeSwitched(edge, reason, yRatio);
+        fPeerLink->SendControlSwitch(1, yRatio);  // 1 = toMac
+        SetActive(false);
+    } else if (fPeerLink->ForwardControl(edge, yRatio) == B_OK) {
+        if (fListener != nullptr)
+            fListener->EdgeSwitched(edge, reason, yRatio);
+        SetActive(false);
+    }
+    // Otherwise the neighbour is unreachable, try again after another dwell
+}
+
+void InputCore::ClickPosition(float* x, float* y)
+{
+    if (fAutoGameMode) {
+        // Game mode: use screen center (SDL expects cursor at center)
+        float width, height;
+        fScreen->GetScreenSize(&width, &height);
+        *x = (width - 1) / 2;
+        *y = (height - 1) / 2;
+    } else {
+        *x = fMouseX;
+        *y = fMouseY;
+    }
+}
+
+void InputCore::InjectMouseDown(uint32 buttons, float x, float y,
+    uint32 modifiers, uint32 clicks)
+{
+    if (!fActive)
+        return;
+
+    bigtime_t eventStart = fClock->Now();
+    fCurrentButtons |= buttons;
+    fCurrentModifiers = modifiers;
+
+    float clickX, clickY;
+    ClickPosition(&clickX, &clickY);
+    // Use macOS click count directly
+    fSink->MouseDown(eventStart, clickX, clickY, fCurrentButtons,
+        modifiers, clicks);
+}
+
+void InputCore::InjectMouseUp(uint32 buttons, float x, float y,
+    uint32 modifiers)
+{
+    if (!fActive)
+        return;
+
+    bigtime_t eventStart = fClock->Now();
+    fCurrentButtons &= ~buttons;
+    fCurrentModifiers = modifiers;
+
+    float clickX, clickY;
+    ClickPosition(&clickX, &clickY);
+    fSink->MouseUp(eventStart, clickX, clickY, fCurrentButtons,
+        modifiers);
+}
+
+void InputCore::InjectMouseWheel(float deltaX, float deltaY, uint32 modifiers)
+{
+    if (!fActive)
+        return;
+
+    bigtime_t eventStart = fClock->Now();
+    fCurrentModifiers = modifiers;
+    fSink->MouseWheel(eventStart, deltaX, deltaY, modifiers);
+}
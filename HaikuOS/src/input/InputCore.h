@@ -0,0 +1,118 @@
+#ifndef INPUT_CORE_H
+#define INPUT_CORE_H
+
+#include <SupportDefs.h>
+
+#include "EdgeSwitchPolicy.h"
+#include "PointerAccelerator.h"
+#include "../network/InputDispatcher.h"
+#include "../platform/Platform.h"
+
+// Haiku key codes tracked as held down, see InputCore::ReleaseAll()
+static const uint32 kMaxHeldKey = 256;
+
+// Number of samples for game mode detection
+static const int kGameModeHistorySize = 10;
+
+// What InputCore did, for logging and notifications. Made on the thread
+// that feeds it events.
+class InputCoreListener {
+public:
+    virtual ~InputCoreListener() {}
+
+    virtual void ActiveChanged(bool active) {}
+    virtual void UnknownKeyCode(uint32 macKeyCode) {}
+    // spread: px the sampled cursor moved over the last samples
+    virtual void GameModeChanged(bool gameMode, float spread) {}
+    // edge is -1 once the pointer left previousEdge without switching
+    virtual void EdgeChanged(int32 edge, int32 previousEdge,
+        float velocity) {}
+    // Control went to the client (the return edge) or a neighbour
+    virtual void EdgeSwitched(int32 edge, EdgeSwitchReason reason,
+        float yRatio) {}
+};
+
+// Everything between a decoded input event and the injection sink: the
+// pointer position, held keys and buttons, key translation, auto game
+// mode and edge switching. Reaches the system only through the Platform
+// interfaces, so it runs and can be profiled off-target.
+class InputCore : public InputEventHandler {
+public:
+    InputCore(Clock* clock, ScreenGeometry* screen, InjectionSink* sink);
+
+    void SetListener(InputCoreListener* listener) { fListener = listener; }
+    void SetPeerLink(PeerLink* link) { fPeerLink = link; }
+
+    // InputEventHandler; ignored while inactive
+    virtual void InjectKeyDown(uint32 keyCode, uint32 modifiers,
+        const char* bytes, uint8 numBytes);
+    virtual void InjectKeyUp(uint32 keyCode, uint32 modifiers);
+    virtual void InjectMouseMove(float x, float y, bool relative,
+        uint32 modifiers);
+    virtual void InjectMouseDown(uint32 buttons, float x, float y,
+        uint32 modifiers, uint32 clicks);
+    virtual void InjectMouseUp(uint32 buttons, float x, float y,
+        uint32 modifiers);
+    virtual void InjectMouseWheel(float deltaX, float deltaY,
+        uint32 modifiers);
+    virtual void InjectMouseMoves(float x, float y, int32 count,
+        uint32 modifiers);
+
+    // Lift every key and button still held down, e.g. when the client
+    // disappears mid-chord. Works even while inactive. Returns the number
+    // of keys released.
+    int32 ReleaseAll();
+
+    // yRatio: 0.0 = top, 1.0 = bottom. The cursor appears near entryEdge,
+    // by default the return edge (where the client's screen is).
+    void SetActive(bool active, float yRatio = 0.5f, int32 entryEdge = -1);
+    bool IsActive() const { return fActive; }
+
+    void SetDwellTime(bigtime_t dwellTime) { fSwitchPolicy.SetDwellTime(dwellTime); }
+    void SetEdgeSwitchConfig(const EdgeSwitchConfig& config) { fSwitchPolicy.SetConfig(config); }
+    void SetReturnEdge(uint8 edge) { fReturnEdge = edge; }
+    uint8 GetReturnEdge() const { return fReturnEdge; }
+
+    // Relative moves are accelerated and scaled by this, outside game mode
+    void SetAccelerationConfig(const PointerAccelerationConfig& config) { fAccelerator.SetConfig(config); }
+    // The client's screen, for scaling moves to this one
+    void SetClientScreenWidth(float width) { fClientScreenWidth = width; }
+
+    bool IsGameMode() const { return fAutoGameMode; }
+    uint32 Buttons() const { return fCurrentButtons; }
+    void GetPosition(float* x, float* y) const;
+
+private:
+    void MouseMoved(float x, float y, bool relative, int32 count,
+        uint32 modifiers);
+    void UpdateMousePosition(float x, float y, bool relative);
+    void UpdateGameModeDetection();
+    void ClickPosition(float* x, float* y);
+
+    Clock* fClock;
+    ScreenGeometry* fScreen;
+    InjectionSink* fSink;
+    PeerLink* fPeerLink;
+    InputCoreListener* fListener;
+
+    float fMouseX;
+    float fMouseY;
+    uint32 fCurrentButtons;
+    uint32 fCurrentModifiers;
+    uint32 fHeldKeys[kMaxHeldKey / 32];
+    bool fActive;
+    EdgeSwitchPolicy fSwitchPolicy;  // when leaving over an edge switches
+    uint8 fReturnEdge;  // Which edge triggers return to Mac (0=right, 1=left, 2=top, 3=bottom)
+    PointerAccelerator fAccelerator;  // client moves to screen px
+    float fClientScreenWidth;  // 0 until the client told
+
+    // Auto game mode detection
+    float fCursorHistoryX[kGameModeHistorySize];
+    float fCursorHistoryY[kGameModeHistorySize];
+    int fCursorHistoryIndex;
+    int fCursorHistoryCount;
+    bool fAutoGameMode;
+    int fMovementSampleCount;
+};
+
+#endif // INPUT_CORE_H
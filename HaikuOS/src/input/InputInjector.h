@@ -2,74 +2,106 @@
 #define INPUT_INJECTOR_H
 
 #include <SupportDefs.h>
-#include <Point.h>
 #include <OS.h>
 
+#include "InputCore.h"
+#include "../metrics/Metrics.h"
+#include "../network/InputDispatcher.h"
+#include "../platform/Platform.h"
+
 class BMessage;
 class NetworkServer;
 
-// Number of samples for game mode detection
-static const int kGameModeHistorySize = 10;
+// Cumulative injection counters, see InputInjector::GetMetrics()
+struct InjectorMetrics {
+    int64 eventsInjected;   // delivered to an input_server add-on
+    int64 eventsDropped;    // add-on missing or write_port failed
+    int64 eventsMerged;     // moves folded into one by MoveCoalescer
+    int64 latencyBuckets[LatencyHistogram::kBucketCount];
+};
 
-class InputInjector {
+// Haiku's side of InputCore: delivers its events to the input_server
+// add-ons over their ports, takes the screen size from BScreen, moves
+// the system cursor and logs what the core reports.
+class InputInjector : public InputEventHandler, private InjectionSink,
+    private ScreenGeometry, private InputCoreListener {
 public:
     InputInjector();
     ~InputInjector();
 
-    void InjectKeyDown(uint32 keyCode, uint32 modifiers,
+    // InputEventHandler, on to InputCore
+    virtual void InjectKeyDown(uint32 keyCode, uint32 modifiers,
         const char* bytes, uint8 numBytes);
-    void InjectKeyUp(uint32 keyCode, uint32 modifiers);
-
-    void InjectMouseMove(float x, float y, bool relative, uint32 modifiers);
-    void InjectMouseDown(uint32 buttons, float x, float y, uint32 modifiers, uint32 clicks);
-    void InjectMouseUp(uint32 buttons, float x, float y, uint32 modifiers);
-    void InjectMouseWheel(float deltaX, float deltaY, uint32 modifiers);
+    virtual void InjectKeyUp(uint32 keyCode, uint32 modifiers);
+    virtual void InjectMouseMove(float x, float y, bool relative, uint32 modifiers);
+    virtual void InjectMouseDown(uint32 buttons, float x, float y, uint32 modifiers, uint32 clicks);
+    virtual void InjectMouseUp(uint32 buttons, float x, float y, uint32 modifiers);
+    virtual void InjectMouseWheel(float deltaX, float deltaY, uint32 modifiers);
+    virtual void InjectMouseMoves(float x, float y, int32 count, uint32 modifiers);
 
     void InjectTeamMonitor();
 
+    // Lift every key and button still held down, e.g. when the client
+    // disappears mid-chord. Works even while inactive.
+    void ReleaseAll();
+
     void ProcessEvent(BMessage* message);
 
-    void SetActive(bool active, float yRatio = 0.5f);  // yRatio: 0.0 = top, 1.0 = bottom
-    bool IsActive() const { return fActive; }
+    // yRatio: 0.0 = top, 1.0 = bottom. The cursor appears near entryEdge,
+    // by default the return edge (where the client's screen is).
+    void SetActive(bool active, float yRatio = 0.5f, int32 entryEdge = -1);
+    bool IsActive() const { return fCore.IsActive(); }
+    bool IsGameMode() const { return fCore.IsGameMode(); }
 
-    void SetNetworkServer(NetworkServer* server) { fNetworkServer = server; }
-    void SetDwellTime(float seconds) { fDwellTime = (bigtime_t)(seconds * 1000000); }
-    void SetReturnEdge(uint8 edge) { fReturnEdge = edge; }
-    uint8 GetReturnEdge() const { return fReturnEdge; }
+    void SetNetworkServer(NetworkServer* server);
+    void SetDwellTime(float seconds) { fCore.SetDwellTime((bigtime_t)(seconds * 1000000)); }
+    void SetEdgeSwitchConfig(const EdgeSwitchConfig& config) { fCore.SetEdgeSwitchConfig(config); }
+    void SetReturnEdge(uint8 edge) { fCore.SetReturnEdge(edge); }
+    uint8 GetReturnEdge() const { return fCore.GetReturnEdge(); }
+    void SetAccelerationConfig(const PointerAccelerationConfig& config) { fCore.SetAccelerationConfig(config); }
+    void SetClientScreenWidth(float width) { fCore.SetClientScreenWidth(width); }
+
+    // Snapshot of counters; safe to call from any thread
+    void GetMetrics(InjectorMetrics* metrics);
 
 private:
-    uint32 TranslateKeyCode(uint32 macKeyCode);
-    void UpdateMousePosition(float x, float y, bool relative);
-    bool SendToKeyboardAddon(BMessage* msg);
-    bool SendToMouseAddon(BMessage* msg);
+    // InjectionSink
+    virtual bool KeyDown(bigtime_t eventStart, uint32 key,
+        uint32 modifiers, const char* bytes, uint8 numBytes);
+    virtual bool KeyUp(bigtime_t eventStart, uint32 key,
+        uint32 modifiers);
+    virtual bool MouseMoved(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers);
+    virtual bool MouseDown(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers, uint32 clicks);
+    virtual bool MouseUp(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers);
+    virtual bool MouseWheel(bigtime_t eventStart, float deltaX,
+        float deltaY, uint32 modifiers);
+    virtual void SetCursor(float x, float y);
+    virtual bool GetCursor(float* x, float* y);
+
+    // ScreenGeometry
+    virtual void GetScreenSize(float* width, float* height);
+
+    // InputCoreListener
+    virtual void ActiveChanged(bool active);
+    virtual void UnknownKeyCode(uint32 macKeyCode);
+    virtual void GameModeChanged(bool gameMode, float spread);
+    virtual void EdgeChanged(int32 edge, int32 previousEdge, float velocity);
+    virtual void EdgeSwitched(int32 edge, EdgeSwitchReason reason,
+        float yRatio);
+
+    bool SendToKeyboardAddon(BMessage* msg, bigtime_t eventStart);
+    bool SendToMouseAddon(BMessage* msg, bigtime_t eventStart);
+    void RecordInjection(bigtime_t eventStart, bool delivered);
     port_id FindKeyboardPort();
     port_id FindMousePort();
 
-    BPoint fMousePosition;
-    uint32 fCurrentButtons;
-    uint32 fCurrentModifiers;
-    bool fActive;
+    SystemClock fClock;
+    InputCore fCore;
     port_id fKeyboardPort;
     port_id fMousePort;
-    NetworkServer* fNetworkServer;
-    bigtime_t fEdgeDwellStart;
-    bigtime_t fDwellTime;  // configurable dwell time in microseconds
-    bool fAtReturnEdge;
-    uint8 fReturnEdge;  // Which edge triggers return to Mac (0=right, 1=left, 2=top, 3=bottom)
-
-    // Double-click tracking
-    bigtime_t fLastClickTime;
-    BPoint fLastClickPosition;
-    int32 fClickCount;
-    uint32 fLastClickButtons;
-
-    // Auto game mode detection
-    void UpdateGameModeDetection();
-    BPoint fCursorHistory[kGameModeHistorySize];
-    int fCursorHistoryIndex;
-    int fCursorHistoryCount;
-    bool fAutoGameMode;
-    int fMovementSampleCount;
 };
 
 #endif // INPUT_INJECTOR_H
@@ -0,0 +1,138 @@
+#include "KeyMap.h"
+
+#include <stddef.h>
+
+// macOS to Haiku keycode mapping table
+// macOS virtual key codes -> Haiku key codes
+static const struct KeyMapping {
+    uint32 macKey;
+    uint32 haikuKey;
+} kKeyMap[] = {
+    // Letters
+    { 0x00, 0x3c },  // A
+    { 0x01, 0x3d },  // S (SDL expects 0x3d)
+    { 0x02, 0x3e },  // D
+    { 0x03, 0x3d },  // F
+    { 0x04, 0x4d },  // H
+    { 0x05, 0x3f },  // G
+    { 0x06, 0x4f },  // Z
+    { 0x07, 0x51 },  // X
+    { 0x08, 0x52 },  // C
+    { 0x09, 0x4e },  // V
+    { 0x0B, 0x40 },  // B
+    { 0x0C, 0x29 },  // Q
+    { 0x0D, 0x28 },  // W (SDL expects 0x28)
+    { 0x0E, 0x2b },  // E
+    { 0x0F, 0x2c },  // R
+    { 0x10, 0x2e },  // Y
+    { 0x11, 0x2d },  // T
+    { 0x12, 0x12 },  // 1
+    { 0x13, 0x13 },  // 2
+    { 0x14, 0x14 },  // 3
+    { 0x15, 0x15 },  // 4
+    { 0x17, 0x16 },  // 5
+    { 0x16, 0x17 },  // 6
+    { 0x1A, 0x18 },  // 7
+    { 0x1C, 0x19 },  // 8
+    { 0x19, 0x1a },  // 9
+    { 0x1D, 0x1b },  // 0
+    { 0x1B, 0x1c },  // -
+    { 0x18, 0x1d },  // =
+    { 0x1E, 0x46 },  // ]
+    { 0x1F, 0x41 },  // O
+    { 0x20, 0x2f },  // U
+    { 0x21, 0x45 },  // [
+    { 0x22, 0x30 },  // I
+    { 0x23, 0x42 },  // P
+    { 0x25, 0x53 },  // L
+    { 0x26, 0x31 },  // J
+    { 0x27, 0x54 },  // '
+    { 0x28, 0x43 },  // K
+    { 0x29, 0x55 },  // ;
+    { 0x2A, 0x47 },  // backslash
+    { 0x2B, 0x56 },  // ,
+    { 0x2C, 0x2c },  // / (was 0x57, but SDL uses 0x57 for UP arrow)
+    { 0x2D, 0x44 },  // N
+    { 0x2E, 0x58 },  // M
+    { 0x2F, 0x59 },  // .
+    { 0x32, 0x11 },  // `
+
+    // Special keys
+    { 0x24, 0x47 },  // Return
+    { 0x30, 0x26 },  // Tab
+    { 0x31, 0x5e },  // Space
+    { 0x33, 0x1e },  // Backspace
+    { 0x35, 0x01 },  // Escape
+    { 0x36, 0x5f },  // Right Command -> Right Alt (B_COMMAND_KEY)
+    { 0x37, 0x5d },  // Left Command -> Left Alt (B_COMMAND_KEY)
+    { 0x38, 0x4b },  // Left Shift
+    { 0x39, 0x3b },  // Caps Lock
+    { 0x3A, 0x66 },  // Left Option -> Left Win (B_OPTION_KEY)
+    { 0x3B, 0x5c },  // Left Control
+    { 0x3C, 0x56 },  // Right Shift
+    { 0x3D, 0x67 },  // Right Option -> Right Win (B_OPTION_KEY)
+    { 0x3E, 0x60 },  // Right Control
+    { 0x3F, 0x68 },  // Function
+
+    // Function keys
+    { 0x7A, 0x02 },  // F1
+    { 0x78, 0x03 },  // F2
+    { 0x63, 0x04 },  // F3
+    { 0x76, 0x05 },  // F4
+    { 0x60, 0x06 },  // F5
+    { 0x61, 0x07 },  // F6
+    { 0x62, 0x08 },  // F7
+    { 0x64, 0x09 },  // F8
+    { 0x65, 0x0a },  // F9
+    { 0x6D, 0x0b },  // F10
+    { 0x67, 0x0c },  // F11
+    { 0x6F, 0x0d },  // F12
+
+    // Arrow keys (using dedicated keycodes to avoid collisions)
+    { 0x7B, 0x61 },  // Left Arrow
+    { 0x7C, 0x63 },  // Right Arrow
+    { 0x7D, 0x62 },  // Down Arrow (was 0x57, collided with /)
+    { 0x7E, 0x57 },  // Up Arrow (SDL expects 0x57)
+
+    // Navigation keys
+    { 0x73, 0x20 },  // Home
+    { 0x77, 0x35 },  // End
+    { 0x74, 0x21 },  // Page Up
+    { 0x79, 0x36 },  // Page Down
+    { 0x75, 0x34 },  // Delete (forward delete)
+
+    // Numpad
+    { 0x52, 0x64 },  // Numpad 0
+    { 0x53, 0x58 },  // Numpad 1
+    { 0x54, 0x59 },  // Numpad 2
+    { 0x55, 0x5a },  // Numpad 3
+    { 0x56, 0x48 },  // Numpad 4
+    { 0x57, 0x49 },  // Numpad 5
+    { 0x58, 0x4a },  // Numpad 6
+    { 0x59, 0x37 },  // Numpad 7
+    { 0x5B, 0x38 },  // Numpad 8
+    { 0x5C, 0x39 },  // Numpad 9
+    { 0x41, 0x65 },  // Numpad .
+    { 0x43, 0x24 },  // Numpad *
+    { 0x45, 0x3a },  // Numpad +
+    { 0x47, 0x22 },  // Numpad Clear
+    { 0x4B, 0x25 },  // Numpad /
+    { 0x4C, 0x5b },  // Numpad Enter
+    { 0x4E, 0x25 },  // Numpad -
+};
+
+static const size_t kKeyMapSize = sizeof(kKeyMap) / sizeof(kKeyMap[0]);
+
+bool TranslateKeyCode(uint32 macKeyCode, uint32* haikuKeyCode)
+{
+    for (size_t i = 0; i < kKeyMapSize; i++) {
+        if (kKeyMap[i].macKey == macKeyCode) {
+            *haikuKeyCode = kKeyMap[i].haikuKey;
+            return true;
+        }
+    }
+
+    // Pass unknown codes through as they are
+    *haikuKeyCode = macKeyCode;
+    return false;
+}
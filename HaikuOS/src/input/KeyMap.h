@@ -0,0 +1,10 @@
+#ifndef KEY_MAP_H
+#define KEY_MAP_H
+
+#include <SupportDefs.h>
+
+// Sets *haikuKeyCode to the Haiku key for a macOS virtual key code.
+// Returns false, passing the code through unchanged, if it has none.
+bool TranslateKeyCode(uint32 macKeyCode, uint32* haikuKeyCode);
+
+#endif // KEY_MAP_H
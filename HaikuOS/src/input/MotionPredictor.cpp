@@ -0,0 +1,238 @@
+#include "MotionPredictor.h"
+
+#include <math.h>
+
+// Longer gaps are the user holding still; the next move starts afresh
+static const bigtime_t kPauseGap = 100000;
+// With no move for this long the hand has probably stopped
+static const bigtime_t kStaleAfter = 40000;
+// After a button comes up, so a double click lands where the first did
+static const bigtime_t kButtonHoldOff = 200000;
+// How fast a hand changes speed (px²/s³) and how noisy the moves are
+// (px²); tuned with PredictionEval against recorded traces
+static const double kProcessNoise = 4.0e6;
+static const double kMeasurementNoise = 4.0;
+// Speed is unknown when motion starts
+static const double kInitialVelocityVariance = 1.0e6;
+// Part of the offset each Tick() takes back once stale
+static const float kDecay = 0.5f;
+// Less than this left of the offset is taken back at once
+static const float kSnap = 0.5f;
+
+void MotionPredictor::Axis::Reset()
+{
+    position = 0;
+    velocity = 0;
+    p00 = kMeasurementNoise;
+    p01 = 0;
+    p11 = kInitialVelocityVariance;
+}
+
+void MotionPredictor::Axis::Predict(double dt)
+{
+    position += velocity * dt;
+    p00 += dt * (2 * p01 + dt * p11) + kProcessNoise * dt * dt * dt / 3;
+    p01 += dt * p11 + kProcessNoise * dt * dt / 2;
+    p11 += kProcessNoise * dt;
+}
+
+void MotionPredictor::Axis::Update(double measured)
+{
+    double gainPosition = p00 / (p00 + kMeasurementNoise);
+    double gainVelocity = p01 / (p00 + kMeasurementNoise);
+    double error = measured - position;
+    position += gainPosition * error;
+    velocity += gainVelocity * error;
+    p11 -= gainVelocity * p01;
+    p00 *= 1 - gainPosition;
+    p01 *= 1 - gainPosition;
+}
+
+MotionPredictor::MotionPredictor(Clock* clock, InputEventHandler* target)
+    : fClock(clock),
+      fTarget(target),
+      fEnabled(false),
+      fMaxLookahead(0),
+      fMaxOffset(0),
+      fLookahead(0),
+      fSuppressed(false),
+      fTruthX(0),
+      fTruthY(0),
+      fLastArrival(0),
+      fOffsetX(0),
+      fOffsetY(0),
+      fModifiers(0),
+      fButtons(0),
+      fHoldOffUntil(0)
+{
+    fX.Reset();
+    fY.Reset();
+}
+
+void MotionPredictor::SetConfig(const MotionPredictionConfig& config)
+{
+    if (!config.enabled)
+        Flush();
+
+    fEnabled = config.enabled;
+    fMaxLookahead = config.maxLookahead;
+    fMaxOffset = config.maxOffset;
+    SetLookahead(fLookahead);
+}
+
+void MotionPredictor::SetLookahead(bigtime_t lookahead)
+{
+    fLookahead = lookahead < fMaxLookahead ? lookahead : fMaxLookahead;
+}
+
+void MotionPredictor::SetSuppressed(bool suppressed)
+{
+    fSuppressed = suppressed;
+}
+
+void MotionPredictor::Tick()
+{
+    if (fOffsetX == 0 && fOffsetY == 0)
+        return;
+
+    bigtime_t now = fClock->Now();
+    if (IsActive(now) && now - fLastArrival < kStaleAfter)
+        return;
+
+    float offsetX = fOffsetX * kDecay;
+    float offsetY = fOffsetY * kDecay;
+    if (fabsf(offsetX) < kSnap && fabsf(offsetY) < kSnap) {
+        offsetX = 0;
+        offsetY = 0;
+    }
+    EmitWithOffset(0, 0, offsetX, offsetY);
+}
+
+void MotionPredictor::Flush()
+{
+    EmitWithOffset(0, 0, 0, 0);
+}
+
+void MotionPredictor::Reset()
+{
+    fX.Reset();
+    fY.Reset();
+    fTruthX = 0;
+    fTruthY = 0;
+    fLastArrival = 0;
+    fOffsetX = 0;
+    fOffsetY = 0;
+    fButtons = 0;
+    fHoldOffUntil = 0;
+}
+
+void MotionPredictor::InjectKeyDown(uint32 keyCode, uint32 modifiers,
+    const char* bytes, uint8 numBytes)
+{
+    fTarget->InjectKeyDown(keyCode, modifiers, bytes, numBytes);
+}
+
+void MotionPredictor::InjectKeyUp(uint32 keyCode, uint32 modifiers)
+{
+    fTarget->InjectKeyUp(keyCode, modifiers);
+}
+
+void MotionPredictor::InjectMouseMove(float x, float y, bool relative,
+    uint32 modifiers)
+{
+    if (!relative) {
+        Flush();
+        fTarget->InjectMouseMove(x, y, false, modifiers);
+        return;
+    }
+
+    InjectMouseMoves(x, y, 1, modifiers);
+}
+
+void MotionPredictor::InjectMouseMoves(float x, float y, int32 count,
+    uint32 modifiers)
+{
+    if (!fEnabled) {
+        Flush();
+        fTarget->InjectMouseMoves(x, y, count, modifiers);
+        return;
+    }
+
+    bigtime_t now = fClock->Now();
+    if (fLastArrival == 0 || now - fLastArrival > kPauseGap) {
+        fX.Reset();
+        fY.Reset();
+        fTruthX = 0;
+        fTruthY = 0;
+    } else {
+        double dt = (now - fLastArrival) / 1000000.0;
+        fX.Predict(dt);
+        fY.Predict(dt);
+    }
+    fLastArrival = now;
+    fTruthX += x;
+    fTruthY += y;
+    fX.Update(fTruthX);
+    fY.Update(fTruthY);
+    fModifiers = modifiers;
+
+    float targetX = 0;
+    float targetY = 0;
+    if (IsActive(now)) {
+        double lookahead = fLookahead / 1000000.0;
+        targetX = (float)(fX.velocity * lookahead);
+        targetY = (float)(fY.velocity * lookahead);
+        float length = sqrtf(targetX * targetX + targetY * targetY);
+        if (length > fMaxOffset) {
+            targetX *= fMaxOffset / length;
+            targetY *= fMaxOffset / length;
+        }
+    }
+    EmitWithOffset(x, y, targetX, targetY, count);
+}
+
+void MotionPredictor::InjectMouseDown(uint32 buttons, float x, float y,
+    uint32 modifiers, uint32 clicks)
+{
+    Flush();
+    fButtons |= buttons;
+    fTarget->InjectMouseDown(buttons, x, y, modifiers, clicks);
+}
+
+void MotionPredictor::InjectMouseUp(uint32 buttons, float x, float y,
+    uint32 modifiers)
+{
+    Flush();
+    fButtons &= ~buttons;
+    fHoldOffUntil = fClock->Now() + kButtonHoldOff;
+    fTarget->InjectMouseUp(buttons, x, y, modifiers);
+}
+
+void MotionPredictor::InjectMouseWheel(float deltaX, float deltaY,
+    uint32 modifiers)
+{
+    fTarget->InjectMouseWheel(deltaX, deltaY, modifiers);
+}
+
+bool MotionPredictor::IsActive(bigtime_t now) const
+{
+    return fEnabled && !fSuppressed && fLookahead > 0 && fButtons == 0
+        && now >= fHoldOffUntil;
+}
+
+// Injects the move x, y, count of the client's, then whatever it takes to
+// go from the current offset to the new one as a move of no client moves,
+// so the gain curve downstream leaves the offset alone
+void MotionPredictor::EmitWithOffset(float x, float y, float offsetX,
+    float offsetY, int32 count)
+{
+    float deltaX = offsetX - fOffsetX;
+    float deltaY = offsetY - fOffsetY;
+    fOffsetX = offsetX;
+    fOffsetY = offsetY;
+
+    if (x != 0 || y != 0)
+        fTarget->InjectMouseMoves(x, y, count, fModifiers);
+    if (deltaX != 0 || deltaY != 0)
+        fTarget->InjectMouseMoves(deltaX, deltaY, 0, fModifiers);
+}
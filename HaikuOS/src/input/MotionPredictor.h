@@ -0,0 +1,106 @@
+#ifndef MOTION_PREDICTOR_H
+#define MOTION_PREDICTOR_H
+
+#include <SupportDefs.h>
+
+#include "../network/InputDispatcher.h"
+#include "../platform/Platform.h"
+
+struct MotionPredictionConfig {
+    bool enabled;
+    bigtime_t maxLookahead;     // never predicts further ahead than this
+    float maxOffset;            // px the pointer may run ahead
+};
+
+// Optional prediction of relative motion, last before the injector. On a
+// long link the pointer trails the hand by the one-way latency; the
+// predictor runs a constant-velocity Kalman filter per axis over the
+// moves and shows the pointer where it will be that much later. Each move
+// goes in as itself followed by the change of the predicted offset, so
+// the pointer is corrected a little with every real move instead of
+// jumping, and the offset decays once moves stop coming. The change goes
+// in as a move of no client moves (a count of 0), which acceleration only
+// scales, so the offset is taken back exactly as far as it was given.
+//
+// Precision matters more than latency around clicks and drags, so the
+// offset is taken back before a button goes down and stays off while one
+// is held and shortly after; SetSuppressed() does the same for game mode.
+// Keys and the wheel go straight through, absolute moves take the offset
+// back first. Disabled, everything goes straight through.
+class MotionPredictor : public InputEventHandler {
+public:
+    MotionPredictor(Clock* clock, InputEventHandler* target);
+
+    void SetConfig(const MotionPredictionConfig& config);
+    bool IsEnabled() const { return fEnabled; }
+    // The one-way latency to hide, as measured; capped by the config
+    void SetLookahead(bigtime_t lookahead);
+    bigtime_t Lookahead() const { return fLookahead; }
+    // No prediction while set, e.g. in game mode
+    void SetSuppressed(bool suppressed);
+
+    // Decays the offset once moves stopped; call about once per frame
+    void Tick();
+    // Takes the pointer back to where the client put it
+    void Flush();
+    // Forgets the motion so far, e.g. when its client is gone; the offset
+    // already shown stays
+    void Reset();
+
+    void GetOffset(float* x, float* y) const
+        { *x = fOffsetX; *y = fOffsetY; }
+
+    // InputEventHandler
+    virtual void InjectKeyDown(uint32 keyCode, uint32 modifiers,
+        const char* bytes, uint8 numBytes);
+    virtual void InjectKeyUp(uint32 keyCode, uint32 modifiers);
+    virtual void InjectMouseMove(float x, float y, bool relative,
+        uint32 modifiers);
+    virtual void InjectMouseDown(uint32 buttons, float x, float y,
+        uint32 modifiers, uint32 clicks);
+    virtual void InjectMouseUp(uint32 buttons, float x, float y,
+        uint32 modifiers);
+    virtual void InjectMouseWheel(float deltaX, float deltaY,
+        uint32 modifiers);
+    virtual void InjectMouseMoves(float x, float y, int32 count,
+        uint32 modifiers);
+
+private:
+    // Position and velocity along one axis, with their covariance
+    struct Axis {
+        void Reset();
+        void Predict(double dt);
+        void Update(double measured);
+
+        double position;        // px since the motion started
+        double velocity;        // px/s
+        double p00, p01, p11;
+    };
+
+    bool IsActive(bigtime_t now) const;
+    void EmitWithOffset(float x, float y, float offsetX, float offsetY,
+        int32 count = 1);
+
+    Clock* fClock;
+    InputEventHandler* fTarget;
+
+    bool fEnabled;
+    bigtime_t fMaxLookahead;
+    float fMaxOffset;
+    bigtime_t fLookahead;
+    bool fSuppressed;
+
+    Axis fX;
+    Axis fY;
+    double fTruthX;             // where the client's moves add up to
+    double fTruthY;
+    bigtime_t fLastArrival;     // 0: no motion to go on
+
+    float fOffsetX;             // shown ahead of the truth
+    float fOffsetY;
+    uint32 fModifiers;
+    uint32 fButtons;
+    bigtime_t fHoldOffUntil;    // after a button came up
+};
+
+#endif // MOTION_PREDICTOR_H
@@ -0,0 +1,88 @@
+#include "MoveCoalescer.h"
+#include "../metrics/Metrics.h"
+
+MoveCoalescer::MoveCoalescer(Clock* clock, InputEventHandler* target)
+    : fClock(clock),
+      fTarget(target),
+      fDeltaX(0),
+      fDeltaY(0),
+      fModifiers(0),
+      fHeld(0),
+      fHeldSince(0)
+{
+}
+
+void MoveCoalescer::Flush()
+{
+    if (fHeld == 0)
+        return;
+
+    if (fHeld > 1)
+        Metrics::Count(METRIC_EVENTS_MERGED, fHeld - 1);
+    Metrics::SetGauge(METRIC_GAUGE_MOTION_BACKLOG_AGE,
+        fClock->Now() - fHeldSince);
+
+    // Reset first: the target may switch control and come back here
+    float deltaX = fDeltaX;
+    float deltaY = fDeltaY;
+    int32 held = fHeld;
+    fDeltaX = 0;
+    fDeltaY = 0;
+    fHeld = 0;
+    fTarget->InjectMouseMoves(deltaX, deltaY, held, fModifiers);
+}
+
+void MoveCoalescer::InjectKeyDown(uint32 keyCode, uint32 modifiers,
+    const char* bytes, uint8 numBytes)
+{
+    Flush();
+    fTarget->InjectKeyDown(keyCode, modifiers, bytes, numBytes);
+}
+
+void MoveCoalescer::InjectKeyUp(uint32 keyCode, uint32 modifiers)
+{
+    Flush();
+    fTarget->InjectKeyUp(keyCode, modifiers);
+}
+
+void MoveCoalescer::InjectMouseMove(float x, float y, bool relative,
+    uint32 modifiers)
+{
+    if (!relative) {
+        Flush();
+        fTarget->InjectMouseMove(x, y, false, modifiers);
+        return;
+    }
+
+    // A modifier change is seen by applications as its own event
+    if (fHeld > 0 && modifiers != fModifiers)
+        Flush();
+
+    if (fHeld == 0)
+        fHeldSince = fClock->Now();
+    fDeltaX += x;
+    fDeltaY += y;
+    fModifiers = modifiers;
+    fHeld++;
+}
+
+void MoveCoalescer::InjectMouseDown(uint32 buttons, float x, float y,
+    uint32 modifiers, uint32 clicks)
+{
+    Flush();
+    fTarget->InjectMouseDown(buttons, x, y, modifiers, clicks);
+}
+
+void MoveCoalescer::InjectMouseUp(uint32 buttons, float x, float y,
+    uint32 modifiers)
+{
+    Flush();
+    fTarget->InjectMouseUp(buttons, x, y, modifiers);
+}
+
+void MoveCoalescer::InjectMouseWheel(float deltaX, float deltaY,
+    uint32 modifiers)
+{
+    Flush();
+    fTarget->InjectMouseWheel(deltaX, deltaY, modifiers);
+}
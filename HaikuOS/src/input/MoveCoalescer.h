@@ -0,0 +1,53 @@
+#ifndef MOVE_COALESCER_H
+#define MOVE_COALESCER_H
+
+#include <SupportDefs.h>
+
+#include "../network/InputDispatcher.h"
+#include "../platform/Platform.h"
+
+// Sits between DispatchInputEvent() and the handler that injects. Relative
+// moves are held and summed until Flush(), which the server calls once the
+// messages of a read are handed out: after a stall, a clump of moves that
+// arrived together goes in as one move to where the pointer is by now,
+// instead of replaying the old path late. Without a backlog a read holds
+// a single move, and nothing waits.
+//
+// Every other event flushes first, so clicks, keys and whatever the
+// caller does between messages land after the motion before them. The sum
+// stays in floats, the sub-pixel part of each move is kept. The merged
+// move goes in through InjectMouseMoves() with the number of moves in it,
+// so whatever measures speed downstream knows how long it took the hand.
+class MoveCoalescer : public InputEventHandler {
+public:
+    MoveCoalescer(Clock* clock, InputEventHandler* target);
+
+    // Injects the held moves as one, if any
+    void Flush();
+    bool IsHolding() const { return fHeld > 0; }
+
+    // InputEventHandler
+    virtual void InjectKeyDown(uint32 keyCode, uint32 modifiers,
+        const char* bytes, uint8 numBytes);
+    virtual void InjectKeyUp(uint32 keyCode, uint32 modifiers);
+    virtual void InjectMouseMove(float x, float y, bool relative,
+        uint32 modifiers);
+    virtual void InjectMouseDown(uint32 buttons, float x, float y,
+        uint32 modifiers, uint32 clicks);
+    virtual void InjectMouseUp(uint32 buttons, float x, float y,
+        uint32 modifiers);
+    virtual void InjectMouseWheel(float deltaX, float deltaY,
+        uint32 modifiers);
+
+private:
+    Clock* fClock;
+    InputEventHandler* fTarget;
+
+    float fDeltaX;
+    float fDeltaY;
+    uint32 fModifiers;
+    int32 fHeld;                // moves summed in fDelta
+    bigtime_t fHeldSince;       // when the first of them came
+};
+
+#endif // MOVE_COALESCER_H
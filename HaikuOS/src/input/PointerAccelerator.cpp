@@ -0,0 +1,128 @@
+#include "PointerAccelerator.h"
+
+#include <math.h>
+
+// The Mac client sends a move every 16 ms while the pointer moves; the
+// first move after a pause, and each move of a merged clump, is taken to
+// have been that long in the making
+static const bigtime_t kSendInterval = 16000;
+static const bigtime_t kPauseGap = 100000;
+// Single moves closer together than this were bunched up by jitter, the
+// hand was not that fast
+static const bigtime_t kMinInterval = 8000;
+
+PointerAccelerator::PointerAccelerator()
+    : fClientWidth(0),
+      fScreenWidth(0),
+      fScale(1)
+{
+    fConfig.enabled = false;
+    fConfig.sensitivity = 1;
+    fConfig.acceleration = 0;
+    fConfig.threshold = 0;
+    fConfig.fullSpeed = 0;
+    fConfig.scale = 1;
+
+    SetConfig(fConfig);
+    Reset();
+}
+
+void PointerAccelerator::SetConfig(const PointerAccelerationConfig& config)
+{
+    fConfig = config;
+
+    // Smoothstep from the threshold to full speed; a full speed at or
+    // below the threshold makes it a step
+    float top = fConfig.fullSpeed > fConfig.threshold
+        ? fConfig.fullSpeed : fConfig.threshold;
+    fTableStep = (top > 0 ? top : 1) / kAccelerationTableSize;
+    for (int i = 0; i <= kAccelerationTableSize; i++) {
+        float speed = i * fTableStep;
+        float ramp;
+        if (speed < fConfig.threshold)
+            ramp = 0;
+        else if (fConfig.fullSpeed <= fConfig.threshold)
+            ramp = 1;
+        else {
+            float t = (speed - fConfig.threshold)
+                / (fConfig.fullSpeed - fConfig.threshold);
+            if (t > 1)
+                t = 1;
+            ramp = t * t * (3 - 2 * t);
+        }
+        fTable[i] = fConfig.sensitivity * (1 + fConfig.acceleration * ramp);
+    }
+
+    UpdateScale();
+}
+
+void PointerAccelerator::SetScreens(float clientWidth, float screenWidth)
+{
+    fClientWidth = clientWidth;
+    fScreenWidth = screenWidth;
+    UpdateScale();
+}
+
+void PointerAccelerator::Apply(bigtime_t when, int32 count, float* x,
+    float* y)
+{
+    if (!fConfig.enabled || !isfinite(*x) || !isfinite(*y))
+        return;
+
+    // A move none of the client's is scaled, but neither timed nor given
+    // the gain
+    float gain = fScale;
+    if (count > 0) {
+        // Moves that arrived together say nothing by their arrival times,
+        // so a clump is timed by how many moves the client sent for it
+        bigtime_t elapsed = when - fLastTime;
+        if (count > 1)
+            elapsed = count * kSendInterval;
+        else if (fLastTime == 0 || elapsed > kPauseGap)
+            elapsed = kSendInterval;
+        else if (elapsed < kMinInterval)
+            elapsed = kMinInterval;
+        fLastTime = when;
+
+        float speed = sqrtf(*x * *x + *y * *y) * 1000000.0f / elapsed;
+        gain *= Gain(speed);
+    }
+
+    float moveX = *x * gain + fRemainderX;
+    float moveY = *y * gain + fRemainderY;
+    *x = roundf(moveX);
+    *y = roundf(moveY);
+    fRemainderX = moveX - *x;
+    fRemainderY = moveY - *y;
+}
+
+void PointerAccelerator::Reset()
+{
+    fLastTime = 0;
+    fRemainderX = 0;
+    fRemainderY = 0;
+}
+
+float PointerAccelerator::Gain(float speed) const
+{
+    if (!isfinite(speed) || speed <= 0)
+        return fTable[0];
+
+    float position = speed / fTableStep;
+    if (position >= kAccelerationTableSize)
+        return fTable[kAccelerationTableSize];
+
+    int index = (int)position;
+    float fraction = position - index;
+    return fTable[index] + (fTable[index + 1] - fTable[index]) * fraction;
+}
+
+void PointerAccelerator::UpdateScale()
+{
+    if (fConfig.scale > 0)
+        fScale = fConfig.scale;
+    else if (fClientWidth > 0 && fScreenWidth > 0)
+        fScale = fScreenWidth / fClientWidth;
+    else
+        fScale = 1;
+}
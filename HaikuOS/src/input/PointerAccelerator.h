@@ -0,0 +1,66 @@
+#ifndef POINTER_ACCELERATOR_H
+#define POINTER_ACCELERATOR_H
+
+#include <SupportDefs.h>
+
+// Steps of the gain curve's table, up to the config's fullSpeed
+static const int kAccelerationTableSize = 64;
+
+// Tunables of PointerAccelerator. Speeds are in the client's px/s, as the
+// moves come in.
+struct PointerAccelerationConfig {
+    bool enabled;
+    float sensitivity;      // gain of slow moves, 1 = as sent
+    float acceleration;     // fast moves get up to (1 + this) times that
+    float threshold;        // px/s where the extra gain starts
+    float fullSpeed;        // px/s where all of it applies
+    float scale;            // screen px per client px; 0 = the ratio of
+                            // the screens' widths
+};
+
+// Turns the client's relative moves into this screen's pixels. The gain
+// follows the speed of the hand along a curve precomputed into a table
+// when the config changes, and everything is scaled to this screen's
+// resolution, so a flick crosses the same part of the screen on both
+// machines. Moves come out in whole pixels; the fraction left over is
+// carried into the next move, so slow motion still adds up. Plain C++,
+// fed one move at a time so it can be replayed off-target.
+class PointerAccelerator {
+public:
+    PointerAccelerator();
+
+    void SetConfig(const PointerAccelerationConfig& config);
+    const PointerAccelerationConfig& Config() const { return fConfig; }
+    // For a scale of 0; either width 0 leaves moves unscaled
+    void SetScreens(float clientWidth, float screenWidth);
+
+    // Rewrites the move x, y that came in at when, count moves of the
+    // client merged into one (see MoveCoalescer). A count of 0 is a move
+    // none of the client's, e.g. MotionPredictor taking back its offset,
+    // and gets the scale alone. Moves that are not finite are left alone.
+    void Apply(bigtime_t when, int32 count, float* x, float* y);
+    // Forget the speed and remainder, e.g. after the pointer was warped
+    void Reset();
+
+    // Gain at a speed in px/s, without the scale; that of standing still
+    // for speeds that are not finite
+    float Gain(float speed) const;
+    float Scale() const { return fScale; }
+
+private:
+    void UpdateScale();
+
+    PointerAccelerationConfig fConfig;
+    float fClientWidth;
+    float fScreenWidth;
+    float fScale;
+
+    float fTable[kAccelerationTableSize + 1];
+    float fTableStep;           // px/s between entries
+
+    bigtime_t fLastTime;        // 0: no move to measure speed from
+    float fRemainderX;
+    float fRemainderY;
+};
+
+#endif // POINTER_ACCELERATOR_H
@@ -0,0 +1,209 @@
+#include "PointerPacer.h"
+#include "../metrics/Metrics.h"
+
+#include <algorithm>
+
+// The Mac client coalesces its moves on a 16 ms timer
+static const bigtime_t kInitialInterval = 16000;
+// Longer gaps are the user holding still, not jitter
+static const bigtime_t kPauseGap = 100000;
+// More ahead of playback than this and something is off; catch up
+static const size_t kMaxSamples = 64;
+// Used when neither the settings nor the screen tell
+static const float kDefaultRefreshRate = 60.0f;
+
+PointerPacer::PointerPacer(Clock* clock, InputEventHandler* target)
+    : fClock(clock),
+      fTarget(target),
+      fEnabled(false),
+      fFramePeriod((bigtime_t)(1000000 / kDefaultRefreshRate)),
+      fMinDelay(0),
+      fMaxDelay(0),
+      fEmittedX(0),
+      fEmittedY(0),
+      fModifiers(0),
+      fPlayout(0),
+      fLastArrival(0),
+      fInterval(kInitialInterval),
+      fJitter(0),
+      fDelay(0)
+{
+}
+
+void PointerPacer::SetConfig(const PointerPacingConfig& config,
+    float refreshRate)
+{
+    if (!config.enabled)
+        Flush();
+
+    fEnabled = config.enabled;
+    float rate = config.refreshRate > 0 ? config.refreshRate : refreshRate;
+    if (rate <= 0)
+        rate = kDefaultRefreshRate;
+    fFramePeriod = (bigtime_t)(1000000 / rate);
+    fMinDelay = config.minDelay;
+    fMaxDelay = std::max(config.maxDelay, config.minDelay);
+    fDelay = fEnabled ? std::max(fMinDelay, std::min(kInitialInterval,
+        fMaxDelay)) : 0;
+    Metrics::SetGauge(METRIC_GAUGE_POINTER_PACING_DELAY, fDelay);
+}
+
+void PointerPacer::Tick()
+{
+    if (fSamples.empty())
+        return;
+
+    // Playback never goes backwards, even when the delay grows
+    fPlayout = std::max(fClock->Now() - fDelay, fPlayout);
+    while (fSamples.size() >= 2 && fSamples[1].when <= fPlayout)
+        fSamples.pop_front();
+
+    if (fSamples.size() == 1) {
+        // Caught up; the next move starts a new stretch from here
+        EmitTo(fSamples[0].x, fSamples[0].y);
+        Reset();
+        return;
+    }
+
+    const Sample& from = fSamples[0];
+    const Sample& to = fSamples[1];
+    float fraction = 0;
+    if (fPlayout > from.when) {
+        fraction = (float)(fPlayout - from.when)
+            / (float)(to.when - from.when);
+    }
+    EmitTo(from.x + (to.x - from.x) * fraction,
+        from.y + (to.y - from.y) * fraction);
+}
+
+void PointerPacer::Flush()
+{
+    if (fSamples.empty())
+        return;
+
+    EmitTo(fSamples.back().x, fSamples.back().y);
+    Reset();
+}
+
+void PointerPacer::Reset()
+{
+    fSamples.clear();
+    fEmittedX = 0;
+    fEmittedY = 0;
+}
+
+void PointerPacer::InjectKeyDown(uint32 keyCode, uint32 modifiers,
+    const char* bytes, uint8 numBytes)
+{
+    fTarget->InjectKeyDown(keyCode, modifiers, bytes, numBytes);
+}
+
+void PointerPacer::InjectKeyUp(uint32 keyCode, uint32 modifiers)
+{
+    fTarget->InjectKeyUp(keyCode, modifiers);
+}
+
+void PointerPacer::InjectMouseMove(float x, float y, bool relative,
+    uint32 modifiers)
+{
+    if (!fEnabled || !relative) {
+        Flush();
+        fTarget->InjectMouseMove(x, y, relative, modifiers);
+        return;
+    }
+
+    if (!fSamples.empty() && modifiers != fModifiers)
+        Flush();
+    if (fSamples.size() >= kMaxSamples)
+        Flush();
+    fModifiers = modifiers;
+
+    bigtime_t now = fClock->Now();
+    UpdateDelay(now);
+
+    Sample sample;
+    if (fSamples.empty()) {
+        // From rest: ramp up over one interval, starting where the
+        // pointer is, and leave the whole delay as room for the next move
+        Sample start = { std::max(now - fInterval, fPlayout), 0, 0 };
+        fSamples.push_back(start);
+        sample.when = std::max(now, start.when);
+    } else {
+        // Evenly after the last one, but never later than it came in nor
+        // so early that playback would already be past it
+        const Sample& last = fSamples.back();
+        sample.when = std::min(last.when + fInterval, now);
+        sample.when = std::max(sample.when,
+            std::max(now - fDelay, last.when));
+    }
+    sample.x = fSamples.back().x + x;
+    sample.y = fSamples.back().y + y;
+    fSamples.push_back(sample);
+}
+
+void PointerPacer::InjectMouseDown(uint32 buttons, float x, float y,
+    uint32 modifiers, uint32 clicks)
+{
+    Flush();
+    fTarget->InjectMouseDown(buttons, x, y, modifiers, clicks);
+}
+
+void PointerPacer::InjectMouseUp(uint32 buttons, float x, float y,
+    uint32 modifiers)
+{
+    Flush();
+    fTarget->InjectMouseUp(buttons, x, y, modifiers);
+}
+
+void PointerPacer::InjectMouseWheel(float deltaX, float deltaY,
+    uint32 modifiers)
+{
+    Flush();
+    fTarget->InjectMouseWheel(deltaX, deltaY, modifiers);
+}
+
+void PointerPacer::InjectMouseMoves(float x, float y, int32 count,
+    uint32 modifiers)
+{
+    if (!fEnabled) {
+        Flush();
+        fTarget->InjectMouseMoves(x, y, count, modifiers);
+        return;
+    }
+
+    // Played back at the display's pace, which is what gets timed then
+    InjectMouseMove(x, y, true, modifiers);
+}
+
+void PointerPacer::EmitTo(float x, float y)
+{
+    float deltaX = x - fEmittedX;
+    float deltaY = y - fEmittedY;
+    if (deltaX == 0 && deltaY == 0)
+        return;
+
+    fEmittedX = x;
+    fEmittedY = y;
+    fTarget->InjectMouseMove(deltaX, deltaY, true, fModifiers);
+}
+
+// Mean deviation of the arrival gaps from the send interval, smoothed by
+// 1/16 like RTP's interarrival jitter; four of them cover all but the
+// rare late move
+void PointerPacer::UpdateDelay(bigtime_t now)
+{
+    if (fLastArrival > 0) {
+        bigtime_t gap = now - fLastArrival;
+        if (gap < kPauseGap) {
+            fInterval += (gap - fInterval) / 16;
+            bigtime_t deviation = gap > fInterval
+                ? gap - fInterval : fInterval - gap;
+            fJitter += (deviation - fJitter) / 16;
+        }
+    }
+    fLastArrival = now;
+
+    bigtime_t delay = fInterval + 4 * fJitter;
+    fDelay = std::max(fMinDelay, std::min(delay, fMaxDelay));
+    Metrics::SetGauge(METRIC_GAUGE_POINTER_PACING_DELAY, fDelay);
+}
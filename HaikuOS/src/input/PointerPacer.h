@@ -0,0 +1,95 @@
+#ifndef POINTER_PACER_H
+#define POINTER_PACER_H
+
+#include <SupportDefs.h>
+
+#include <deque>
+
+#include "../network/InputDispatcher.h"
+#include "../platform/Platform.h"
+
+struct PointerPacingConfig {
+    bool enabled;
+    bigtime_t minDelay;     // the jitter buffer is never shorter,
+    bigtime_t maxDelay;     // nor longer than this
+    float refreshRate;      // Hz to inject at; 0 = the screen's
+};
+
+// Optional pacing of relative motion, between the MoveCoalescer and the
+// injector. Moves arrive with the network's jitter; injected as they land
+// the pointer stutters even at a good average rate. The pacer lays the
+// moves out on an even timeline at the client's send interval, plays that
+// back a small delay behind and, on each Tick() at the display's refresh
+// rate, injects where the pointer is along it, interpolated between
+// moves. The delay follows the arrival jitter (as RTP receivers estimate
+// it) within the configured bounds.
+//
+// Keys go straight through. Buttons, the wheel and absolute moves flush
+// the buffered motion first, so they land where the pointer is meant to
+// be; callers do the same with Flush() before anything else that depends
+// on the position. Disabled, everything goes straight through.
+class PointerPacer : public InputEventHandler {
+public:
+    PointerPacer(Clock* clock, InputEventHandler* target);
+
+    // refreshRate: the screen's, used if config.refreshRate is 0
+    void SetConfig(const PointerPacingConfig& config, float refreshRate);
+    bool IsEnabled() const { return fEnabled; }
+    // How often Tick() wants to be called
+    bigtime_t FramePeriod() const { return fFramePeriod; }
+    bigtime_t Delay() const { return fDelay; }
+
+    // Injects the motion due by now
+    void Tick();
+    // Injects all buffered motion at once
+    void Flush();
+    // Forgets buffered motion, e.g. when its client is gone
+    void Reset();
+
+    // InputEventHandler
+    virtual void InjectKeyDown(uint32 keyCode, uint32 modifiers,
+        const char* bytes, uint8 numBytes);
+    virtual void InjectKeyUp(uint32 keyCode, uint32 modifiers);
+    virtual void InjectMouseMove(float x, float y, bool relative,
+        uint32 modifiers);
+    virtual void InjectMouseDown(uint32 buttons, float x, float y,
+        uint32 modifiers, uint32 clicks);
+    virtual void InjectMouseUp(uint32 buttons, float x, float y,
+        uint32 modifiers);
+    virtual void InjectMouseWheel(float deltaX, float deltaY,
+        uint32 modifiers);
+    virtual void InjectMouseMoves(float x, float y, int32 count,
+        uint32 modifiers);
+
+private:
+    // The pointer's path relative to where the buffer last ran empty
+    struct Sample {
+        bigtime_t when;     // on the evened-out timeline
+        float x;
+        float y;
+    };
+
+    void EmitTo(float x, float y);
+    void UpdateDelay(bigtime_t now);
+
+    Clock* fClock;
+    InputEventHandler* fTarget;
+
+    bool fEnabled;
+    bigtime_t fFramePeriod;
+    bigtime_t fMinDelay;
+    bigtime_t fMaxDelay;
+
+    std::deque<Sample> fSamples;    // the first is the last one passed
+    float fEmittedX;
+    float fEmittedY;
+    uint32 fModifiers;
+    bigtime_t fPlayout;             // how far playback got
+
+    bigtime_t fLastArrival;
+    bigtime_t fInterval;            // client's send interval, estimated
+    bigtime_t fJitter;              // mean deviation from it
+    bigtime_t fDelay;
+};
+
+#endif // POINTER_PACER_H
@@ -0,0 +1,60 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <SupportDefs.h>
+
+// Power-of-two microsecond bucketing shared by all latency histograms.
+// Bucket 0 counts up to 1us, bucket i counts (2^(i-1), 2^i] us: each
+// limit is inclusive, as Prometheus' le is.
+class LatencyHistogram {
+public:
+    static const int32 kBucketCount = 32;
+
+    static int32 BucketFor(bigtime_t micros)
+    {
+        int32 bucket = 0;
+        for (bigtime_t rest = micros - 1; rest > 0
+                && bucket < kBucketCount - 1; rest >>= 1)
+            bucket++;
+        return bucket;
+    }
+
+    // Inclusive upper bound of a bucket in microseconds
+    static bigtime_t BucketLimit(int32 bucket)
+    {
+        return (bigtime_t)1 << bucket;
+    }
+
+    // Estimate a percentile (0.0 - 1.0) from bucket counts, interpolating
+    // linearly inside the bucket that contains it.
+    static bigtime_t Percentile(const int64* buckets, float percentile)
+    {
+        int64 total = 0;
+        for (int32 i = 0; i < kBucketCount; i++)
+            total += buckets[i];
+        if (total == 0)
+            return 0;
+
+        int64 rank = (int64)(percentile * total + 0.5f);
+        if (rank < 1)
+            rank = 1;
+
+        int64 seen = 0;
+        for (int32 i = 0; i < kBucketCount; i++) {
+            if (buckets[i] == 0)
+                continue;
+            if (seen + buckets[i] >= rank) {
+                if (i == 0)
+                    return 0;
+                bigtime_t low = BucketLimit(i - 1);
+                bigtime_t high = BucketLimit(i);
+                float fraction = (float)(rank - seen) / buckets[i];
+                return low + (bigtime_t)((high - low) * fraction);
+            }
+            seen += buckets[i];
+        }
+        return BucketLimit(kBucketCount - 1);
+    }
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,337 @@
+#include "Metrics.h"
+#include "../network/Protocol.h"
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+// One per thread. Only the owning thread writes, so increments are a
+// relaxed load/store pair instead of a locked read-modify-write. The
+// alignment keeps two threads' shards off the same cache line.
+struct alignas(64) MetricsShard {
+    std::atomic<int64> counters[METRIC_COUNTER_COUNT];
+    std::atomic<int64> events[256];
+    std::atomic<int64> histograms[METRIC_HISTOGRAM_COUNT]
+        [LatencyHistogram::kBucketCount];
+    std::atomic<int64> histogramSums[METRIC_HISTOGRAM_COUNT];
+
+    std::atomic<bool> inUse;
+    MetricsShard* next;
+};
+
+std::mutex sShardLock;
+MetricsShard* sShards = nullptr;
+std::atomic<int64> sGauges[METRIC_GAUGE_COUNT];
+
+MetricsShard* AcquireShard()
+{
+    std::lock_guard<std::mutex> lock(sShardLock);
+
+    // Reuse a shard left behind by an exited thread; its totals stay
+    // valid because counters only ever grow.
+    for (MetricsShard* shard = sShards; shard != nullptr; shard = shard->next) {
+        if (!shard->inUse.load(std::memory_order_relaxed)) {
+            shard->inUse.store(true, std::memory_order_relaxed);
+            return shard;
+        }
+    }
+
+    MetricsShard* shard = new MetricsShard;
+    memset((void*)shard, 0, sizeof(MetricsShard));
+    shard->inUse.store(true, std::memory_order_relaxed);
+    shard->next = sShards;
+    sShards = shard;
+    return shard;
+}
+
+// Hands the shard back when its thread exits
+struct ShardHolder {
+    MetricsShard* shard;
+
+    ShardHolder() : shard(AcquireShard()) {}
+    ~ShardHolder() { shard->inUse.store(false, std::memory_order_relaxed); }
+};
+
+inline MetricsShard* LocalShard()
+{
+    static thread_local ShardHolder holder;
+    return holder.shard;
+}
+
+inline void Add(std::atomic<int64>& value, int64 amount)
+{
+    value.store(value.load(std::memory_order_relaxed) + amount,
+        std::memory_order_relaxed);
+}
+
+struct CounterInfo {
+    const char* name;
+    const char* help;
+    const char* labels;
+};
+
+// Indexed by MetricCounter; entries sharing a name are emitted together
+const CounterInfo kCounterInfo[METRIC_COUNTER_COUNT] = {
+    { "softkm_bytes_received_total", "Bytes read from client sockets.", "" },
+    { "softkm_bytes_sent_total", "Bytes written to client sockets.", "" },
+    { "softkm_connections_total", "Client connections accepted.", "" },
+    { "softkm_reconnects_total",
+        "Client connections accepted after the first one.", "" },
+    { "softkm_events_injected_total",
+        "Events delivered to an input_server add-on.", "" },
+    { "softkm_events_dropped_total",
+        "Events that could not be delivered to an add-on.", "" },
+    { "softkm_events_merged_total",
+        "Events folded into a later event before injection. Over the "
+        "mouse moves received, the motion coalescing ratio.", "" },
+    { "softkm_events_rejected_total",
+        "Input events from clients that did not own input.", "" },
+    { "softkm_events_relayed_total",
+        "Input events forwarded to a neighbour server.", "" },
+    { "softkm_addon_write_failures_total",
+        "Failed writes to an input_server add-on port.", "" },
+    { "softkm_clipboard_bytes_total", "Clipboard payload bytes synced.",
+        "direction=\"in\"" },
+    { "softkm_clipboard_bytes_total", "Clipboard payload bytes synced.",
+        "direction=\"out\"" },
+    { "softkm_clipboard_dedup_total",
+        "Clipboard syncs checked against the peer's content hash.",
+        "direction=\"out\",result=\"hit\"" },
+    { "softkm_clipboard_dedup_total",
+        "Clipboard syncs checked against the peer's content hash.",
+        "direction=\"out\",result=\"miss\"" },
+    { "softkm_clipboard_dedup_total",
+        "Clipboard syncs checked against the peer's content hash.",
+        "direction=\"in\",result=\"hit\"" },
+    { "softkm_clipboard_dedup_total",
+        "Clipboard syncs checked against the peer's content hash.",
+        "direction=\"in\",result=\"miss\"" },
+    { "softkm_file_bytes_received_total",
+        "File data received from dragged files.", "" },
+    { "softkm_files_received_total",
+        "Dragged files received and verified.", "" },
+};
+
+struct GaugeInfo {
+    const char* name;
+    const char* help;
+    const char* labels;
+};
+
+const GaugeInfo kGaugeInfo[METRIC_GAUGE_COUNT] = {
+    { "softkm_clients_connected", "Currently connected clients.", "" },
+    { "softkm_receive_queue_bytes",
+        "Bytes buffered but not yet framed into messages.", "" },
+    { "softkm_addon_port_queue_depth",
+        "Messages waiting in an input_server add-on port.",
+        "addon=\"keyboard\"" },
+    { "softkm_addon_port_queue_depth",
+        "Messages waiting in an input_server add-on port.",
+        "addon=\"mouse\"" },
+    { "softkm_motion_backlog_age_microseconds",
+        "How long the oldest of the last relative moves injected together "
+        "was held.", "" },
+    { "softkm_pointer_pacing_delay_microseconds",
+        "Delay of the pointer pacing buffer; 0 while pacing is off.", "" },
+};
+
+const char* kHistogramNames[METRIC_HISTOGRAM_COUNT] = {
+    "softkm_inject_latency_seconds",
+};
+
+const char* kHistogramHelp[METRIC_HISTOGRAM_COUNT] = {
+    "Time from decoding an input event to handing it to the add-on.",
+};
+
+void AppendFormat(std::string& out, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void AppendFormat(std::string& out, const char* format, ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out += line;
+}
+
+void AppendHeader(std::string& out, const char* name, const char* help,
+    const char* type)
+{
+    AppendFormat(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void AppendSample(std::string& out, const char* name, const char* labels,
+    int64 value)
+{
+    if (labels[0] != '\0')
+        AppendFormat(out, "%s{%s} %lld\n", name, labels, (long long)value);
+    else
+        AppendFormat(out, "%s %lld\n", name, (long long)value);
+}
+
+} // namespace
+
+void Metrics::Count(MetricCounter counter, int64 amount)
+{
+    Add(LocalShard()->counters[counter], amount);
+}
+
+void Metrics::CountEvent(uint8 eventType)
+{
+    Add(LocalShard()->events[eventType], 1);
+}
+
+void Metrics::Observe(MetricHistogram histogram, bigtime_t micros)
+{
+    MetricsShard* shard = LocalShard();
+    Add(shard->histograms[histogram][LatencyHistogram::BucketFor(micros)], 1);
+    Add(shard->histogramSums[histogram], micros);
+}
+
+void Metrics::SetGauge(MetricGauge gauge, int64 value)
+{
+    sGauges[gauge].store(value, std::memory_order_relaxed);
+}
+
+void Metrics::GetSnapshot(MetricsSnapshot* snapshot)
+{
+    memset(snapshot, 0, sizeof(MetricsSnapshot));
+
+    std::lock_guard<std::mutex> lock(sShardLock);
+    for (MetricsShard* shard = sShards; shard != nullptr; shard = shard->next) {
+        for (int32 i = 0; i < METRIC_COUNTER_COUNT; i++)
+            snapshot->counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+        for (int32 i = 0; i < 256; i++)
+            snapshot->events[i] += shard->events[i].load(std::memory_order_relaxed);
+        for (int32 h = 0; h < METRIC_HISTOGRAM_COUNT; h++) {
+            for (int32 i = 0; i < LatencyHistogram::kBucketCount; i++) {
+                snapshot->histograms[h][i]
+                    += shard->histograms[h][i].load(std::memory_order_relaxed);
+            }
+            snapshot->histogramSums[h]
+                += shard->histogramSums[h].load(std::memory_order_relaxed);
+        }
+    }
+
+    for (int32 i = 0; i < METRIC_GAUGE_COUNT; i++)
+        snapshot->gauges[i] = sGauges[i].load(std::memory_order_relaxed);
+}
+
+int64 Metrics::CounterValue(MetricCounter counter)
+{
+    int64 total = 0;
+
+    std::lock_guard<std::mutex> lock(sShardLock);
+    for (MetricsShard* shard = sShards; shard != nullptr; shard = shard->next)
+        total += shard->counters[counter].load(std::memory_order_relaxed);
+    return total;
+}
+
+int64 Metrics::EventTotal()
+{
+    int64 total = 0;
+
+    std::lock_guard<std::mutex> lock(sShardLock);
+    for (MetricsShard* shard = sShards; shard != nullptr; shard = shard->next) {
+        for (int32 i = 0; i < 256; i++)
+            total += shard->events[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void Metrics::HistogramBuckets(MetricHistogram histogram, int64* buckets)
+{
+    for (int32 i = 0; i < LatencyHistogram::kBucketCount; i++)
+        buckets[i] = 0;
+
+    std::lock_guard<std::mutex> lock(sShardLock);
+    for (MetricsShard* shard = sShards; shard != nullptr; shard = shard->next) {
+        for (int32 i = 0; i < LatencyHistogram::kBucketCount; i++)
+            buckets[i] += shard->histograms[histogram][i].load(std::memory_order_relaxed);
+    }
+}
+
+std::string Metrics::PrometheusText()
+{
+    MetricsSnapshot* snapshot = new MetricsSnapshot;
+    GetSnapshot(snapshot);
+
+    std::string out;
+    out.reserve(8192);
+
+    // Events by type
+    AppendHeader(out, "softkm_events_received_total",
+        "Protocol messages received, by event type.", "counter");
+    for (int32 type = 0; type < 256; type++) {
+        const char* name = EventTypeName((uint8)type);
+        bool known = strcmp(name, "unknown") != 0;
+        if (!known || snapshot->events[type] == 0)
+            continue;
+        AppendFormat(out, "softkm_events_received_total{type=\"%s\"} %lld\n",
+            name, (long long)snapshot->events[type]);
+    }
+    int64 unknownEvents = 0;
+    for (int32 type = 0; type < 256; type++) {
+        if (strcmp(EventTypeName((uint8)type), "unknown") == 0)
+            unknownEvents += snapshot->events[type];
+    }
+    AppendFormat(out, "softkm_events_received_total{type=\"unknown\"} %lld\n",
+        (long long)unknownEvents);
+
+    // Plain counters; a family is announced once even if it spans entries
+    for (int32 i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        const CounterInfo& info = kCounterInfo[i];
+        if (i == 0 || strcmp(kCounterInfo[i - 1].name, info.name) != 0)
+            AppendHeader(out, info.name, info.help, "counter");
+        AppendSample(out, info.name, info.labels, snapshot->counters[i]);
+    }
+
+    for (int32 i = 0; i < METRIC_GAUGE_COUNT; i++) {
+        const GaugeInfo& info = kGaugeInfo[i];
+        if (i == 0 || strcmp(kGaugeInfo[i - 1].name, info.name) != 0)
+            AppendHeader(out, info.name, info.help, "gauge");
+        AppendSample(out, info.name, info.labels, snapshot->gauges[i]);
+    }
+
+    for (int32 h = 0; h < METRIC_HISTOGRAM_COUNT; h++) {
+        const char* name = kHistogramNames[h];
+        const int64* buckets = snapshot->histograms[h];
+
+        AppendHeader(out, name, kHistogramHelp[h], "histogram");
+        // Every bucket, every time: the set of series must not change
+        // between scrapes. Limits are whole microseconds, so six decimals
+        // print them exactly.
+        int64 cumulative = 0;
+        for (int32 i = 0; i < LatencyHistogram::kBucketCount - 1; i++) {
+            cumulative += buckets[i];
+            AppendFormat(out, "%s_bucket{le=\"%.6f\"} %lld\n", name,
+                LatencyHistogram::BucketLimit(i) / 1000000.0,
+                (long long)cumulative);
+        }
+        cumulative += buckets[LatencyHistogram::kBucketCount - 1];
+        AppendFormat(out, "%s_bucket{le=\"+Inf\"} %lld\n", name,
+            (long long)cumulative);
+        AppendFormat(out, "%s_sum %g\n", name,
+            snapshot->histogramSums[h] / 1000000.0);
+        AppendFormat(out, "%s_count %lld\n", name, (long long)cumulative);
+
+        // Precomputed quantiles for dashboards without histogram_quantile()
+        AppendFormat(out, "# HELP %s_quantile Estimated latency quantiles.\n"
+            "# TYPE %s_quantile gauge\n", name, name);
+        static const float kQuantiles[] = { 0.5f, 0.9f, 0.99f, 0.999f };
+        for (size_t q = 0; q < sizeof(kQuantiles) / sizeof(kQuantiles[0]); q++) {
+            AppendFormat(out, "%s_quantile{quantile=\"%g\"} %g\n", name,
+                kQuantiles[q],
+                LatencyHistogram::Percentile(buckets, kQuantiles[q]) / 1000000.0);
+        }
+    }
+
+    delete snapshot;
+    return out;
+}
@@ -0,0 +1,80 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <SupportDefs.h>
+
+#include <string>
+
+#include "LatencyHistogram.h"
+
+// Pipeline counters. Each thread increments its own cache-line aligned
+// shard without atomics on the hot path; shards are only summed when a
+// snapshot is taken (scrape or Deskbar tick). Plain C++ with no Be API
+// dependencies so it can be exercised off-target.
+
+enum MetricCounter {
+    METRIC_BYTES_IN = 0,
+    METRIC_BYTES_OUT,
+    METRIC_CONNECTIONS,
+    METRIC_RECONNECTS,
+    METRIC_EVENTS_INJECTED,
+    METRIC_EVENTS_DROPPED,
+    METRIC_EVENTS_MERGED,
+    METRIC_EVENTS_REJECTED,
+    METRIC_EVENTS_RELAYED,
+    METRIC_ADDON_WRITE_FAILURES,
+    METRIC_CLIPBOARD_BYTES_IN,
+    METRIC_CLIPBOARD_BYTES_OUT,
+    METRIC_CLIPBOARD_DEDUP_OUT_HITS,
+    METRIC_CLIPBOARD_DEDUP_OUT_MISSES,
+    METRIC_CLIPBOARD_DEDUP_IN_HITS,
+    METRIC_CLIPBOARD_DEDUP_IN_MISSES,
+    METRIC_FILE_BYTES_IN,
+    METRIC_FILES_RECEIVED,
+    METRIC_COUNTER_COUNT
+};
+
+enum MetricGauge {
+    METRIC_GAUGE_CLIENTS = 0,
+    METRIC_GAUGE_RECEIVE_QUEUE_BYTES,
+    METRIC_GAUGE_KEYBOARD_PORT_QUEUE,
+    METRIC_GAUGE_MOUSE_PORT_QUEUE,
+    METRIC_GAUGE_MOTION_BACKLOG_AGE,
+    METRIC_GAUGE_POINTER_PACING_DELAY,
+    METRIC_GAUGE_COUNT
+};
+
+enum MetricHistogram {
+    METRIC_HISTOGRAM_INJECT_LATENCY = 0,
+    METRIC_HISTOGRAM_COUNT
+};
+
+struct MetricsSnapshot {
+    int64 counters[METRIC_COUNTER_COUNT];
+    int64 events[256];      // messages received, by protocol event type
+    int64 gauges[METRIC_GAUGE_COUNT];
+    int64 histograms[METRIC_HISTOGRAM_COUNT][LatencyHistogram::kBucketCount];
+    int64 histogramSums[METRIC_HISTOGRAM_COUNT];    // microseconds
+};
+
+class Metrics {
+public:
+    // Hot path, owning thread only touches its own shard
+    static void Count(MetricCounter counter, int64 amount = 1);
+    static void CountEvent(uint8 eventType);
+    static void Observe(MetricHistogram histogram, bigtime_t micros);
+
+    // Gauges are last-writer-wins and shared by all threads
+    static void SetGauge(MetricGauge gauge, int64 value);
+
+    // Aggregation, walks all shards
+    static void GetSnapshot(MetricsSnapshot* snapshot);
+    static int64 CounterValue(MetricCounter counter);
+    static int64 EventTotal();
+    static void HistogramBuckets(MetricHistogram histogram, int64* buckets);
+
+    // Prometheus text exposition format (version 0.0.4)
+    static std::string PrometheusText();
+};
+
+#endif // METRICS_H
@@ -0,0 +1,256 @@
+#include "MetricsServer.h"
+#include "Metrics.h"
+#include "../platform/Platform.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// How often the accept loop wakes up to notice Stop()
+static const int kPollIntervalMs = 250;
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+static SystemClock sClock;
+
+// Waits for events on socket until deadline; false once it passed
+static bool WaitFor(int socket, short events, bigtime_t deadline)
+{
+    while (true) {
+        bigtime_t remaining = deadline - sClock.Now();
+        if (remaining <= 0)
+            return false;
+
+        struct pollfd pfd;
+        pfd.fd = socket;
+        pfd.events = events;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, (int)((remaining + 999) / 1000));
+        if (ready > 0)
+            return true;
+        if (ready < 0 && errno != EINTR)
+            return false;
+    }
+}
+
+MetricsServer::MetricsServer()
+    : fSocket(-1),
+      fThread(-1),
+      fRunning(false)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    Stop();
+}
+
+status_t MetricsServer::StartTcp(uint16 port)
+{
+    if (fRunning)
+        return B_OK;
+
+    // Never expose metrics beyond this machine
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    status_t status = Listen((struct sockaddr*)&addr, sizeof(addr));
+    if (status != B_OK)
+        return status;
+
+    return StartThread();
+}
+
+status_t MetricsServer::StartUnix(const char* path)
+{
+    if (fRunning)
+        return B_OK;
+
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return B_NAME_TOO_LONG;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    // Remove a stale socket left behind by a previous run
+    unlink(path);
+
+    status_t status = Listen((struct sockaddr*)&addr, sizeof(addr));
+    if (status != B_OK)
+        return status;
+
+    fUnixPath = path;
+    return StartThread();
+}
+
+status_t MetricsServer::Listen(const struct sockaddr* address, size_t length)
+{
+    fSocket = socket(address->sa_family, SOCK_STREAM, 0);
+    if (fSocket < 0)
+        return B_FROM_POSIX_ERROR(errno);
+
+    int opt = 1;
+    if (address->sa_family == AF_INET)
+        setsockopt(fSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    if (bind(fSocket, address, length) < 0 || listen(fSocket, 4) < 0) {
+        status_t error = B_FROM_POSIX_ERROR(errno);
+        close(fSocket);
+        fSocket = -1;
+        return error;
+    }
+    return B_OK;
+}
+
+status_t MetricsServer::StartThread()
+{
+    fRunning = true;
+    fThread = spawn_thread(ServerThreadFunc, "softKM metrics",
+        B_LOW_PRIORITY, this);
+    if (fThread < 0) {
+        status_t error = fThread;
+        fRunning = false;
+        fThread = -1;
+        close(fSocket);
+        fSocket = -1;
+        return error;
+    }
+
+    resume_thread(fThread);
+    return B_OK;
+}
+
+void MetricsServer::Stop()
+{
+    fRunning = false;
+    if (fThread >= 0) {
+        status_t result;
+        wait_for_thread(fThread, &result);
+        fThread = -1;
+    }
+
+    if (fSocket >= 0) {
+        close(fSocket);
+        fSocket = -1;
+    }
+
+    if (!fUnixPath.empty()) {
+        unlink(fUnixPath.c_str());
+        fUnixPath.clear();
+    }
+}
+
+int32 MetricsServer::ServerThreadFunc(void* data)
+{
+    ((MetricsServer*)data)->Run();
+    return 0;
+}
+
+void MetricsServer::Run()
+{
+    while (fRunning) {
+        struct pollfd pfd;
+        pfd.fd = fSocket;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        int ready = poll(&pfd, 1, kPollIntervalMs);
+        if (ready <= 0)
+            continue;
+
+        int clientSocket = accept(fSocket, nullptr, nullptr);
+        if (clientSocket < 0)
+            continue;
+
+        // Never blocks past the deadline, see ServeClient()
+        int flags = fcntl(clientSocket, F_GETFL, 0);
+        if (flags >= 0)
+            fcntl(clientSocket, F_SETFL, flags | O_NONBLOCK);
+
+        ServeClient(clientSocket);
+        close(clientSocket);
+    }
+}
+
+void MetricsServer::ServeClient(int clientSocket)
+{
+    // One deadline for all of it: a scraper trickling in its request or
+    // not reading the response is dropped as soon as it runs out
+    bigtime_t deadline = sClock.Now() + kRequestTimeout;
+
+    // Read until the end of the request headers; the body is ignored
+    char request[2048];
+    size_t length = 0;
+    while (length < sizeof(request) - 1) {
+        if (!WaitFor(clientSocket, POLLIN, deadline))
+            return;
+
+        ssize_t bytesRead = recv(clientSocket, request + length,
+            sizeof(request) - 1 - length, 0);
+        if (bytesRead < 0 && (errno == EINTR || errno == EAGAIN
+                || errno == EWOULDBLOCK))
+            continue;
+        if (bytesRead <= 0)
+            return;
+        length += bytesRead;
+        request[length] = '\0';
+
+        if (strstr(request, "\r\n\r\n") != nullptr
+            || strstr(request, "\n\n") != nullptr)
+            break;
+    }
+    request[length] = '\0';
+
+    std::string body;
+    const char* status;
+    const char* contentType = "text/plain; version=0.0.4; charset=utf-8";
+    if (strncmp(request, "GET /metrics ", 13) == 0
+        || strncmp(request, "GET / ", 6) == 0) {
+        status = "200 OK";
+        body = Metrics::PrometheusText();
+    } else {
+        status = "404 Not Found";
+        body = "Try GET /metrics\n";
+    }
+
+    char header[256];
+    int headerLength = snprintf(header, sizeof(header),
+        "HTTP/1.0 %s\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %lu\r\n"
+        "Connection: close\r\n"
+        "\r\n", status, contentType, (unsigned long)body.size());
+
+    std::string response(header, headerLength);
+    response += body;
+
+    size_t sent = 0;
+    while (sent < response.size()) {
+        if (!WaitFor(clientSocket, POLLOUT, deadline))
+            return;
+
+        ssize_t result = send(clientSocket, response.data() + sent,
+            response.size() - sent, kSendFlags);
+        if (result < 0 && (errno == EINTR || errno == EAGAIN
+                || errno == EWOULDBLOCK))
+            continue;
+        if (result <= 0)
+            return;
+        sent += result;
+    }
+}
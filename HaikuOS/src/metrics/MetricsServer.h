@@ -0,0 +1,41 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <OS.h>
+#include <SupportDefs.h>
+
+#include <string>
+
+// Optional scrape endpoint serving Metrics::PrometheusText() over HTTP,
+// either on a loopback TCP port or on a Unix domain socket. Scrapers are
+// served one at a time, each within kRequestTimeout, so a stuck one
+// cannot hold the endpoint. Only POSIX sockets, so it is part of
+// libsoftkm_core; errors come back as status_t for the caller to report.
+class MetricsServer {
+public:
+    // For the whole request and response of one scraper
+    static const bigtime_t kRequestTimeout = 1000000;
+
+    MetricsServer();
+    ~MetricsServer();
+
+    status_t StartTcp(uint16 port);     // binds 127.0.0.1 only
+    status_t StartUnix(const char* path);
+    void Stop();
+
+    bool IsRunning() const { return fRunning; }
+
+private:
+    status_t Listen(const struct sockaddr* address, size_t length);
+    status_t StartThread();
+    static int32 ServerThreadFunc(void* data);
+    void Run();
+    void ServeClient(int clientSocket);
+
+    int fSocket;
+    std::string fUnixPath;
+    thread_id fThread;
+    volatile bool fRunning;
+};
+
+#endif // METRICS_SERVER_H
@@ -0,0 +1,45 @@
+#include "ControlArbiter.h"
+#include "Protocol.h"
+
+ControlArbiter::ControlArbiter()
+    : fOwner(-1),
+      fHandovers(0)
+{
+}
+
+int32 ControlArbiter::TakeControl(int32 client)
+{
+    int32 previous = fOwner;
+    if (previous == client)
+        return -1;
+
+    fOwner = client;
+    if (previous >= 0)
+        fHandovers++;
+    return previous;
+}
+
+bool ControlArbiter::ReleaseControl(int32 client)
+{
+    if (client < 0 || client != fOwner)
+        return false;
+
+    fOwner = -1;
+    return true;
+}
+
+bool ControlArbiter::IsInputEvent(uint8 eventType)
+{
+    switch (eventType) {
+        case EVENT_KEY_DOWN:
+        case EVENT_KEY_UP:
+        case EVENT_MOUSE_MOVE:
+        case EVENT_MOUSE_DOWN:
+        case EVENT_MOUSE_UP:
+        case EVENT_MOUSE_WHEEL:
+        case EVENT_TEAM_MONITOR:
+            return true;
+        default:
+            return false;
+    }
+}
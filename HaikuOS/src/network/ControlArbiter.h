@@ -0,0 +1,39 @@
+#ifndef CONTROL_ARBITER_H
+#define CONTROL_ARBITER_H
+
+#include <SupportDefs.h>
+
+// Decides which of several connected clients owns Haiku's input. A client
+// takes ownership with CONTROL_SWITCH toHaiku and gives it up with
+// CONTROL_SWITCH toMac (or by disconnecting); taking over from another
+// client needs no extra round trip. Input events from anyone but the
+// owner are rejected before they are decoded. Plain C++, callers
+// serialize changes.
+class ControlArbiter {
+public:
+    ControlArbiter();
+
+    int32 Owner() const { return fOwner; }
+    bool HasOwner() const { return fOwner >= 0; }
+    int32 CountHandovers() const { return fHandovers; }
+
+    // Cheap enough to run on every message
+    bool Accepts(int32 client, uint8 eventType) const
+    {
+        return !IsInputEvent(eventType) || client == fOwner;
+    }
+
+    // Returns the client that lost ownership to this one, -1 if none
+    int32 TakeControl(int32 client);
+
+    // Returns true if client was the owner
+    bool ReleaseControl(int32 client);
+
+    static bool IsInputEvent(uint8 eventType);
+
+private:
+    volatile int32 fOwner;      // -1 while Haiku's own devices are in charge
+    int32 fHandovers;
+};
+
+#endif // CONTROL_ARBITER_H
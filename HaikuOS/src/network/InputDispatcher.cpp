@@ -0,0 +1,84 @@
+#include "InputDispatcher.h"
+#include "Protocol.h"
+
+bool DispatchInputEvent(const uint8* message, size_t length,
+    InputEventHandler* handler)
+{
+    if (length < sizeof(ProtocolHeader))
+        return false;
+
+    const ProtocolHeader* header = (const ProtocolHeader*)message;
+    const uint8* payload = message + sizeof(ProtocolHeader);
+
+    switch (header->eventType) {
+        case EVENT_KEY_DOWN:
+        {
+            // KEY_DOWN has: keyCode(4) + modifiers(4) + numBytes(1) + bytes
+            if (header->length >= sizeof(KeyEventPayload)) {
+                const KeyEventPayload* keyPayload = (const KeyEventPayload*)payload;
+                // The UTF-8 bytes follow the fixed part
+                const char* bytes = (const char*)(payload + sizeof(KeyEventPayload));
+                uint8 numBytes = keyPayload->numBytes;
+                if (numBytes > header->length - sizeof(KeyEventPayload))
+                    numBytes = header->length - sizeof(KeyEventPayload);
+                handler->InjectKeyDown(keyPayload->keyCode,
+                    MapModifiers(keyPayload->modifiers), bytes, numBytes);
+            }
+            return true;
+        }
+
+        case EVENT_KEY_UP:
+        {
+            // KEY_UP only has: keyCode(4) + modifiers(4) = 8 bytes (no numBytes field)
+            if (header->length >= 8) {
+                const uint32* data = (const uint32*)payload;
+                handler->InjectKeyUp(data[0], MapModifiers(data[1]));
+            }
+            return true;
+        }
+
+        case EVENT_MOUSE_MOVE:
+        {
+            if (header->length >= sizeof(MouseMovePayload)) {
+                const MouseMovePayload* movePayload = (const MouseMovePayload*)payload;
+                handler->InjectMouseMove(movePayload->x, movePayload->y,
+                    movePayload->relative != 0, MapModifiers(movePayload->modifiers));
+            }
+            return true;
+        }
+
+        case EVENT_MOUSE_DOWN:
+        {
+            if (header->length >= sizeof(MouseDownPayload)) {
+                const MouseDownPayload* btnPayload = (const MouseDownPayload*)payload;
+                handler->InjectMouseDown(btnPayload->buttons,
+                    btnPayload->x, btnPayload->y, MapModifiers(btnPayload->modifiers),
+                    btnPayload->clicks);
+            }
+            return true;
+        }
+
+        case EVENT_MOUSE_UP:
+        {
+            if (header->length >= sizeof(MouseButtonPayload)) {
+                const MouseButtonPayload* btnPayload = (const MouseButtonPayload*)payload;
+                handler->InjectMouseUp(btnPayload->buttons,
+                    btnPayload->x, btnPayload->y, MapModifiers(btnPayload->modifiers));
+            }
+            return true;
+        }
+
+        case EVENT_MOUSE_WHEEL:
+        {
+            if (header->length >= sizeof(MouseWheelPayload)) {
+                const MouseWheelPayload* wheelPayload = (const MouseWheelPayload*)payload;
+                handler->InjectMouseWheel(wheelPayload->deltaX,
+                    wheelPayload->deltaY, MapModifiers(wheelPayload->modifiers));
+            }
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
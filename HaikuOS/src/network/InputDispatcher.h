@@ -0,0 +1,41 @@
+#ifndef INPUT_DISPATCHER_H
+#define INPUT_DISPATCHER_H
+
+#include <SupportDefs.h>
+
+#include <stddef.h>
+
+// Receives the input events of the wire protocol, decoded. Key codes are
+// still macOS ones, modifiers are already Haiku's (see MapModifiers()).
+class InputEventHandler {
+public:
+    virtual ~InputEventHandler() {}
+
+    virtual void InjectKeyDown(uint32 keyCode, uint32 modifiers,
+        const char* bytes, uint8 numBytes) = 0;
+    virtual void InjectKeyUp(uint32 keyCode, uint32 modifiers) = 0;
+    virtual void InjectMouseMove(float x, float y, bool relative,
+        uint32 modifiers) = 0;
+    virtual void InjectMouseDown(uint32 buttons, float x, float y,
+        uint32 modifiers, uint32 clicks) = 0;
+    virtual void InjectMouseUp(uint32 buttons, float x, float y,
+        uint32 modifiers) = 0;
+    virtual void InjectMouseWheel(float deltaX, float deltaY,
+        uint32 modifiers) = 0;
+
+    // count relative moves of the client merged into one, see
+    // MoveCoalescer; 0 for a move that is none of the client's, such as
+    // MotionPredictor's corrections. Handlers that time moves override
+    // it; by default it is a single move.
+    virtual void InjectMouseMoves(float x, float y, int32 count,
+        uint32 modifiers)
+        { InjectMouseMove(x, y, true, modifiers); }
+};
+
+// Decodes one framed message of an input event type (KEY_DOWN through
+// MOUSE_WHEEL) and hands it to handler. Returns false, calling nothing,
+// for any other type; a payload too short for its type is dropped.
+bool DispatchInputEvent(const uint8* message, size_t length,
+    InputEventHandler* handler);
+
+#endif // INPUT_DISPATCHER_H
@@ -0,0 +1,133 @@
+#include "MessageFramer.h"
+#include "Protocol.h"
+
+#include <cstring>
+
+MessageFramer::MessageFramer(size_t maxMessageSize)
+    : fStart(0),
+      fEnd(0),
+      fMaxMessageSize(maxMessageSize),
+      fAssembled(0)
+{
+}
+
+uint8* MessageFramer::ReceiveBuffer(size_t* available, size_t minimum)
+{
+    // Move the unconsumed tail to the front before growing
+    if (fStart > 0) {
+        if (fEnd > fStart)
+            memmove(fBuffer.data(), fBuffer.data() + fStart, fEnd - fStart);
+        fEnd -= fStart;
+        fStart = 0;
+    }
+
+    // Make room for the rest of a known-length message in one go
+    size_t wanted = fEnd + minimum;
+    if (fEnd >= sizeof(ProtocolHeader)) {
+        const ProtocolHeader* header = (const ProtocolHeader*)fBuffer.data();
+        size_t messageSize = sizeof(ProtocolHeader) + header->length;
+        if (header->length <= fMaxMessageSize && messageSize > wanted)
+            wanted = messageSize;
+    }
+    if (fBuffer.size() < wanted)
+        fBuffer.resize(wanted);
+
+    *available = fBuffer.size() - fEnd;
+    return fBuffer.data() + fEnd;
+}
+
+void MessageFramer::Received(size_t bytes)
+{
+    fEnd += bytes;
+}
+
+FrameResult MessageFramer::NextMessage(const uint8** message, size_t* length)
+{
+    while (true) {
+        size_t buffered = fEnd - fStart;
+        if (buffered < sizeof(ProtocolHeader))
+            return FRAME_NEED_MORE;
+
+        const ProtocolHeader* header
+            = (const ProtocolHeader*)(fBuffer.data() + fStart);
+        if (header->magic != PROTOCOL_MAGIC) {
+            Reset();
+            return FRAME_BAD_MAGIC;
+        }
+        if (header->length > fMaxMessageSize)
+            return FRAME_TOO_LARGE;
+
+        size_t messageSize = sizeof(ProtocolHeader) + header->length;
+        if (buffered < messageSize)
+            return FRAME_NEED_MORE;
+
+        const uint8* frame = fBuffer.data() + fStart;
+        fStart += messageSize;
+        if (fStart == fEnd)
+            fStart = fEnd = 0;
+
+        if (header->eventType != EVENT_BULK_FRAGMENT) {
+            *message = frame;
+            *length = messageSize;
+            return FRAME_MESSAGE;
+        }
+        if (AddFragment(frame, messageSize, message, length))
+            return FRAME_MESSAGE;
+    }
+}
+
+void MessageFramer::Reset()
+{
+    fStart = fEnd = 0;
+    fAssembly.clear();
+    fAssembled = 0;
+}
+
+bool MessageFramer::AddFragment(const uint8* frame, size_t frameLength,
+    const uint8** message, size_t* length)
+{
+    if (frameLength < sizeof(ProtocolHeader) + sizeof(BulkFragmentPayload))
+        return false;
+
+    const BulkFragmentPayload* fragment
+        = (const BulkFragmentPayload*)(frame + sizeof(ProtocolHeader));
+    const uint8* bytes = (const uint8*)(fragment + 1);
+    size_t count = frameLength - sizeof(ProtocolHeader)
+        - sizeof(BulkFragmentPayload);
+
+    // The first piece sizes the buffer; a piece out of order drops the
+    // message, the ones after it are then dropped until the next first one
+    if (fragment->offset == 0) {
+        if (fragment->messageLength < sizeof(ProtocolHeader)
+            || fragment->messageLength
+                > sizeof(ProtocolHeader) + fMaxMessageSize) {
+            fAssembly.clear();
+            return false;
+        }
+        fAssembly.resize(fragment->messageLength);
+        fAssembled = 0;
+    }
+
+    if (fragment->offset != fAssembled
+        || fragment->messageLength != fAssembly.size()
+        || count > fAssembly.size() - fAssembled) {
+        fAssembly.clear();
+        fAssembled = 0;
+        return false;
+    }
+
+    memcpy(fAssembly.data() + fAssembled, bytes, count);
+    fAssembled += count;
+    if (fAssembled < fAssembly.size())
+        return false;
+
+    fAssembled = 0;
+    const ProtocolHeader* header = (const ProtocolHeader*)fAssembly.data();
+    if (header->magic != PROTOCOL_MAGIC
+        || sizeof(ProtocolHeader) + header->length != fAssembly.size())
+        return false;
+
+    *message = fAssembly.data();
+    *length = fAssembly.size();
+    return true;
+}
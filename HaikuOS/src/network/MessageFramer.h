@@ -0,0 +1,51 @@
+#ifndef MESSAGE_FRAMER_H
+#define MESSAGE_FRAMER_H
+
+#include <SupportDefs.h>
+
+#include <vector>
+
+// Largest message accepted from a peer; clipboard payloads are the only
+// ones that come anywhere near this
+static const size_t kMaxMessageSize = 16 * 1024 * 1024;
+
+enum FrameResult {
+    FRAME_MESSAGE = 0,      // a complete message was returned
+    FRAME_NEED_MORE,        // wait for more bytes
+    FRAME_BAD_MAGIC,        // garbage in the stream, buffered bytes dropped
+    FRAME_TOO_LARGE         // length field beyond kMaxMessageSize
+};
+
+// Reassembles protocol messages from one connection's byte stream. The
+// buffer grows for large messages instead of capping them at a fixed
+// size. BULK_FRAGMENT pieces are put back together here, so callers only
+// ever see whole messages. Plain C++, no Be API.
+class MessageFramer {
+public:
+    MessageFramer(size_t maxMessageSize = kMaxMessageSize);
+
+    // Room for the next recv(); always at least minimum bytes
+    uint8* ReceiveBuffer(size_t* available, size_t minimum = 4096);
+    void Received(size_t bytes);
+
+    // Hands out the next complete message. It stays valid until the next
+    // ReceiveBuffer() call.
+    FrameResult NextMessage(const uint8** message, size_t* length);
+
+    size_t Buffered() const { return fEnd - fStart; }
+    void Reset();
+
+private:
+    bool AddFragment(const uint8* frame, size_t frameLength,
+        const uint8** message, size_t* length);
+
+    std::vector<uint8> fBuffer;
+    size_t fStart;
+    size_t fEnd;
+    size_t fMaxMessageSize;
+
+    std::vector<uint8> fAssembly;   // fragmented message being received
+    size_t fAssembled;
+};
+
+#endif // MESSAGE_FRAMER_H
@@ -1,11 +1,18 @@
 #include "NetworkServer.h"
+#include "InputDispatcher.h"
 #include "Protocol.h"
 #include "../input/InputInjector.h"
 #include "../clipboard/ClipboardManager.h"
+#include "../clipboard/Lz4Block.h"
+#include "../metrics/Metrics.h"
+#include "../settings/Settings.h"
 #include "../SoftKMApp.h"
 #include "../Logger.h"
 
+#include <Autolock.h>
+#include <FindDirectory.h>
 #include <Messenger.h>
+#include <Path.h>
 #include <Screen.h>
 
 #include <sys/socket.h>
@@ -17,15 +24,61 @@
 #include <cstdio>
 #include <cerrno>
 
+// A client that sends nothing for this long is considered gone. The macOS
+// client heartbeats every 5 seconds.
+static const bigtime_t kClientTimeout = 12000000;
+// Clients that echo our once-per-second heartbeat probes can be given up
+// on much sooner.
+static const bigtime_t kEchoingClientTimeout = 3000000;
+// How long held input and settings are kept for a client that dropped
+// and may come back with its session token
+static const bigtime_t kResumeGraceWindow = 3000000;
+// Wake-up interval of the server loop, bounds how late a parked session
+// is released
+static const bigtime_t kPulseInterval = 250000;
+// Leave room for a reconnect to queue up while a dead connection is
+// being torn down
+static const int kListenBacklog = 8;
+// How often a neighbour name that did not resolve is looked up again
+static const bigtime_t kResolveRetryInterval = 5000000;
+// Heartbeats to every client, for RTT and for the shorter idle timeout
+static const bigtime_t kHeartbeatProbeInterval = 1000000;
+// Announced in SESSION_ACCEPT
+static const uint32 kServerCapabilities = CAPABILITY_CLIPBOARD_LZ4
+    | CAPABILITY_CLIPBOARD_MANIFEST | CAPABILITY_BULK_FRAGMENTS
+    | CAPABILITY_FILE_TRANSFER;
+// Keeps the kernel from holding more than a few milliseconds of bulk data
+// ahead of input; the loop's scheduler decides what goes first
+static const int kSendBufferSize = 16384;
+// Largest CLIPBOARD_CHUNK served, whatever the client asks for
+static const uint32 kMaxClipboardChunk = 65536;
+
 NetworkServer::NetworkServer(uint16 port, InputInjector* injector)
     : fPort(port),
       fInputInjector(injector),
+      fPredictor(&fClock, injector),
+      fPacer(&fClock, &fPredictor),
+      fCoalescer(&fClock, &fPacer),
       fClipboardManager(nullptr),
-      fServerSocket(-1),
-      fClientSocket(-1),
-      fListenThread(-1),
-      fClientThread(-1),
+      fLoop(this),
+      fServerThread(-1),
+      fResolverThread(-1),
       fRunning(false),
+      fStateLock("softKM server state"),
+      fClientCount(0),
+      fNewestClient(-1),
+      fSession(kResumeGraceWindow),
+      fRelayTarget(-1),
+      fManifestClient(-1),
+      fFileSink(this),
+      fMessageCount(0),
+      fLastStatsTime(0),
+      fLastHeartbeatProbe(0),
+      fHeartbeatQuality(LINK_QUALITY_NONE),
+      fRoundTripQuality(LINK_QUALITY_NONE),
+      fLinkQuality(LINK_QUALITY_NONE),
+      fRoundTripTime(0),
+      fConnectionCount(0),
       fLocalWidth(0),
       fLocalHeight(0),
       fRemoteWidth(0),
@@ -37,6 +90,14 @@ NetworkServer::NetworkServer(uint16 port, InputInjector* injector)
     fLocalWidth = frame.Width() + 1;
     fLocalHeight = frame.Height() + 1;
     LOG("Local screen size: %.0fx%.0f", fLocalWidth, fLocalHeight);
+
+    for (int32 edge = 0; edge < kEdgeCount; edge++) {
+        fNeighbours[edge][0] = '\0';
+        fNeighbourResolved[edge] = false;
+        fRelayClients[edge] = -1;
+    }
+
+    fLoop.SetRecorder(&fRecorder);
 }
 
 NetworkServer::~NetworkServer()
@@ -49,53 +110,34 @@ status_t NetworkServer::Start()
     if (fRunning)
         return B_OK;
 
-    // Create server socket
-    fServerSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (fServerSocket < 0) {
-        LOG("Failed to create socket: %s", strerror(errno));
-        return B_ERROR;
-    }
-
-    // Allow address reuse
-    int opt = 1;
-    setsockopt(fServerSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    // Bind to port
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(fPort);
-
-    if (bind(fServerSocket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        LOG("Failed to bind to port %d: %s", fPort, strerror(errno));
-        close(fServerSocket);
-        fServerSocket = -1;
-        return B_ERROR;
-    }
-
-    // Listen for connections
-    if (listen(fServerSocket, 1) < 0) {
-        LOG("Failed to listen: %s", strerror(errno));
-        close(fServerSocket);
-        fServerSocket = -1;
+    if (fLoop.Listen(fPort, kListenBacklog) != B_OK) {
+        LOG("Failed to listen on port %d: %s", fPort, strerror(errno));
         return B_ERROR;
     }
 
+    LoadNeighbours();
+    SetUpPacing();
+    if (Settings::GetCapturePath()[0] != '\0')
+        StartCapture(Settings::GetCapturePath());
     fRunning = true;
 
-    // Start listen thread
-    fListenThread = spawn_thread(ListenThreadFunc, "softKM listener",
+    // One thread serves the listening socket and every client
+    fServerThread = spawn_thread(ServerThreadFunc, "softKM server",
         B_NORMAL_PRIORITY, this);
 
-    if (fListenThread < 0) {
+    if (fServerThread < 0) {
         fRunning = false;
-        close(fServerSocket);
-        fServerSocket = -1;
         return B_ERROR;
     }
 
-    resume_thread(fListenThread);
+    resume_thread(fServerThread);
+
+    // Looked up off the loop thread, which must never block on a name
+    // service; without it control just never crosses to a neighbour
+    fResolverThread = spawn_thread(ResolverThreadFunc, "softKM resolver",
+        B_LOW_PRIORITY, this);
+    if (fResolverThread >= 0)
+        resume_thread(fResolverThread);
 
     LOG("Server listening on port %d", fPort);
     return B_OK;
@@ -105,178 +147,314 @@ void NetworkServer::Stop()
 {
     fRunning = false;
 
-    // Close client socket
-    if (fClientSocket >= 0) {
-        close(fClientSocket);
-        fClientSocket = -1;
-    }
-
-    // Close server socket
-    if (fServerSocket >= 0) {
-        close(fServerSocket);
-        fServerSocket = -1;
+    // The loop closes every client on its way out
+    if (fServerThread >= 0) {
+        fLoop.Quit();
+        status_t result;
+        wait_for_thread(fServerThread, &result);
+        fServerThread = -1;
     }
 
-    // Wait for threads
-    if (fListenThread >= 0) {
+    // Notices fRunning between lookups
+    if (fResolverThread >= 0) {
         status_t result;
-        wait_for_thread(fListenThread, &result);
-        fListenThread = -1;
+        wait_for_thread(fResolverThread, &result);
+        fResolverThread = -1;
     }
 
-    if (fClientThread >= 0) {
-        status_t result;
-        wait_for_thread(fClientThread, &result);
-        fClientThread = -1;
+    // After the loop, so the capture ends with the disconnects
+    StopCapture();
+
+    // Nobody is coming back for a parked session any more
+    BAutolock lock(fStateLock);
+    if (fSession.IsParked()) {
+        ReleaseInputState();
+        fSession.End();
     }
 }
 
-int32 NetworkServer::ListenThreadFunc(void* data)
+status_t NetworkServer::StartCapture(const char* path)
 {
-    NetworkServer* server = (NetworkServer*)data;
-    server->AcceptConnections();
-    return 0;
+    status_t status = fRecorder.Open(path);
+    if (status != B_OK) {
+        LOG("Cannot capture to %s: %s", path, strerror(status));
+        return status;
+    }
+
+    LOG("Capturing the incoming stream to %s", path);
+    return B_OK;
 }
 
-void NetworkServer::AcceptConnections()
+void NetworkServer::StopCapture()
 {
-    while (fRunning) {
-        struct sockaddr_in clientAddr;
-        socklen_t clientLen = sizeof(clientAddr);
+    bool overflowed = fRecorder.Overflowed();
+    if (!fRecorder.IsOpen() && !overflowed)
+        return;
 
-        int clientSocket = accept(fServerSocket,
-            (struct sockaddr*)&clientAddr, &clientLen);
+    fRecorder.Close();
+    if (overflowed)
+        LOG("Capture stopped early, the disk could not keep up");
+    else
+        LOG("Capture stopped");
+}
 
-        if (clientSocket < 0) {
-            if (fRunning) {
-                LOG("Accept failed: %s", strerror(errno));
-            }
-            continue;
-        }
+void NetworkServer::SetUpPacing()
+{
+    // The refresh rate of the current mode, for ticking once per frame
+    float refreshRate = 0;
+    display_mode mode;
+    if (BScreen().GetMode(&mode) == B_OK && mode.timing.h_total > 0
+        && mode.timing.v_total > 0) {
+        refreshRate = mode.timing.pixel_clock * 1000.0f
+            / ((float)mode.timing.h_total * mode.timing.v_total);
+    }
 
-        // Close existing client connection
-        if (fClientSocket >= 0) {
-            close(fClientSocket);
-            if (fClientThread >= 0) {
-                status_t result;
-                wait_for_thread(fClientThread, &result);
-            }
-        }
+    fPacer.SetConfig(Settings::GetPointerPacing(), refreshRate);
+    if (fPacer.IsEnabled()) {
+        LOG("Pointer pacing on: %.1f Hz, %.1f-%.1f ms buffer",
+            1000000.0 / fPacer.FramePeriod(),
+            Settings::GetPointerPacing().minDelay / 1000.0,
+            Settings::GetPointerPacing().maxDelay / 1000.0);
+    }
 
-        fClientSocket = clientSocket;
+    fPredictor.SetConfig(Settings::GetMotionPrediction());
+    if (fPredictor.IsEnabled()) {
+        LOG("Pointer prediction on: up to %.1f ms, %.0f px ahead",
+            Settings::GetMotionPrediction().maxLookahead / 1000.0,
+            Settings::GetMotionPrediction().maxOffset);
+    }
+}
 
-        // Set TCP_NODELAY for low latency
-        int opt = 1;
-        setsockopt(fClientSocket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+int32 NetworkServer::ServerThreadFunc(void* data)
+{
+    NetworkServer* server = (NetworkServer*)data;
+    // Paced and predicted motion is injected from Pulse(), once per frame
+    bool perFrame = server->fPacer.IsEnabled()
+        || server->fPredictor.IsEnabled();
+    server->fLoop.SetPulseInterval(perFrame
+        ? server->fPacer.FramePeriod() : kPulseInterval);
+    server->fLoop.Run();
+    return 0;
+}
 
-        // Set receive low water mark to 1 byte for immediate delivery
-        int lowat = 1;
-        setsockopt(fClientSocket, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat));
+void NetworkServer::ClientConnected(int32 client, int socket,
+    const char* address)
+{
+    int32 edge = RelayEdge(client);
+    if (edge >= 0) {
+        // We are the client here; the neighbour's heartbeats keep it alive
+        LOG("Connected to %s neighbour %s", Topology::EdgeName(edge), address);
+        SetLivenessOptions(socket);
+        fLoop.SetIdleTimeout(client, kClientTimeout);
+        return;
+    }
 
-        // Set small receive buffer to reduce latency
-        int rcvbuf = 8192;
-        setsockopt(fClientSocket, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    LOG("Client %ld connected from %s", client, address);
 
-        LOG("Socket options set: TCP_NODELAY, SO_RCVLOWAT=1, SO_RCVBUF=%d", rcvbuf);
+    // Set receive low water mark to 1 byte for immediate delivery
+    int lowat = 1;
+    setsockopt(socket, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat));
 
-        LOG("Client connected from %s:%d",
-            inet_ntoa(clientAddr.sin_addr), ntohs(clientAddr.sin_port));
+    // Set small receive buffer to reduce latency
+    int rcvbuf = 8192;
+    setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
 
-        // Notify app of connection
-        BMessenger messenger(be_app);
-        messenger.SendMessage(MSG_CLIENT_CONNECTED);
+    int sndbuf = kSendBufferSize;
+    setsockopt(socket, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
 
-        // Send our screen info to macOS
-        SendScreenInfo();
+    SetLivenessOptions(socket);
+    fLoop.SetIdleTimeout(client, kClientTimeout);
 
-        // Start client handling thread
-        fClientThread = spawn_thread(ClientThreadFunc, "softKM client",
-            B_NORMAL_PRIORITY, this);
+    // Other clients stay connected; who owns input is decided by
+    // CONTROL_SWITCH, see HandleControlSwitch()
+    ClientState state;
+    memset(&state, 0, sizeof(state));
+    strlcpy(state.address, address, sizeof(state.address));
+    state.connectedSince = system_time();
+    state.lastHeartbeat = state.connectedSince;
 
-        if (fClientThread >= 0) {
-            resume_thread(fClientThread);
-        }
+    int32 count;
+    {
+        BAutolock lock(fStateLock);
+        fClients[client] = state;
+        count = fClients.size();
+        fClientCount = count;
+    }
+    fNewestClient = client;
+
+    Metrics::Count(METRIC_CONNECTIONS);
+    if (fConnectionCount++ > 0)
+        Metrics::Count(METRIC_RECONNECTS);
+    Metrics::SetGauge(METRIC_GAUGE_CLIENTS, count);
+
+    if (PrimaryClient() == client) {
+        fHeartbeatQuality = LINK_QUALITY_GOOD;
+        fRoundTripQuality = LINK_QUALITY_GOOD;
+        fLinkQuality = LINK_QUALITY_GOOD;
+        atomic_set64(&fRoundTripTime, 0);
     }
-}
 
-int32 NetworkServer::ClientThreadFunc(void* data)
-{
-    NetworkServer* server = (NetworkServer*)data;
-    server->HandleClient(server->fClientSocket);
-    return 0;
+    // Notify app of connection
+    BMessenger messenger(be_app);
+    messenger.SendMessage(MSG_CLIENT_CONNECTED);
+
+    // Send our screen info to macOS
+    SendScreenInfo(client);
 }
 
-void NetworkServer::HandleClient(int clientSocket)
+void NetworkServer::MessageReceived(int32 client, const uint8* message,
+    size_t length)
 {
-    uint8 buffer[4096];
-    size_t bufferOffset = 0;
-    int recvCount = 0;
-    int msgCount = 0;
-    bigtime_t lastLogTime = system_time();
+    std::map<int32, ClientState>::iterator it = fClients.find(client);
+    if (it == fClients.end()) {
+        if (RelayEdge(client) >= 0)
+            RelayMessageReceived(client, message, length);
+        return;
+    }
 
-    while (fRunning && clientSocket >= 0) {
-        ssize_t bytesRead = recv(clientSocket, buffer + bufferOffset,
-            sizeof(buffer) - bufferOffset, 0);
+    ClientState& state = it->second;
+    uint8 eventType = ((const ProtocolHeader*)message)->eventType;
 
-        if (bytesRead <= 0) {
-            if (bytesRead < 0 && errno == EINTR) {
-                continue;
-            }
-            break;  // Connection closed or error
-        }
+    fMessageCount++;
+    state.bytesReceived += length;
+    Metrics::Count(METRIC_BYTES_IN, length);
+    Metrics::CountEvent(eventType);
 
-        recvCount++;
-        bufferOffset += bytesRead;
-
-        // Log receive stats every second
-        bigtime_t now = system_time();
-        if (now - lastLogTime >= 1000000) {
-            LOG("Recv stats: %d recv calls, %d messages in last %.1fs",
-                recvCount, msgCount, (now - lastLogTime) / 1000000.0);
-            recvCount = 0;
-            msgCount = 0;
-            lastLogTime = now;
+    // Input from anyone but the owner stops here, before it is decoded
+    if (!fArbiter.Accepts(client, eventType)) {
+        state.eventsRejected++;
+        Metrics::Count(METRIC_EVENTS_REJECTED);
+        return;
+    }
+
+    state.eventsAccepted++;
+
+    // While a neighbour has control, the owner's input goes there as is,
+    // straight from the receive buffer
+    if (fRelayTarget >= 0 && ControlArbiter::IsInputEvent(eventType)) {
+        if (fLoop.Send(fRelayTarget, message, length) == B_OK) {
+            Metrics::Count(METRIC_BYTES_OUT, length);
+            Metrics::Count(METRIC_EVENTS_RELAYED);
         }
+        return;
+    }
 
-        // Process complete messages
-        while (bufferOffset >= sizeof(ProtocolHeader)) {
-            msgCount++;
-            ProtocolHeader* header = (ProtocolHeader*)buffer;
+    ProcessMessage(client, message, length);
+}
 
-            // Validate magic
-            if (header->magic != PROTOCOL_MAGIC) {
-                LOG("Invalid magic: 0x%04X", header->magic);
-                bufferOffset = 0;  // Reset buffer
-                break;
-            }
+void NetworkServer::ClientDisconnected(int32 client, const char* reason)
+{
+    if (RelayEdge(client) >= 0) {
+        RelayDisconnected(client, reason);
+        return;
+    }
 
-            // Check if we have the complete message
-            size_t messageSize = sizeof(ProtocolHeader) + header->length;
-            if (bufferOffset < messageSize) {
-                break;  // Wait for more data
-            }
+    LOG("Client %ld disconnected (%s)", client, reason);
 
-            // Process the message
-            ProcessMessage(buffer, messageSize);
+    // Keep held input for an owner that can resume, otherwise release it
+    // right away
+    OwnerGone(client);
 
-            // Remove processed message from buffer
-            if (bufferOffset > messageSize) {
-                memmove(buffer, buffer + messageSize, bufferOffset - messageSize);
-            }
-            bufferOffset -= messageSize;
-        }
+    if (fManifestClient == client) {
+        fManifestClient = -1;
+        if (fClipboardManager != nullptr)
+            fClipboardManager->FetchSourceGone();
     }
 
-    // Client disconnected
-    LOG("Client disconnected");
+    // Kept for when the client offers the file again
+    fFileSink.ClientGone(client);
+
+    int32 count;
+    {
+        BAutolock lock(fStateLock);
+        fClients.erase(client);
+        count = fClients.size();
+        fClientCount = count;
+    }
+    if (fNewestClient == client)
+        fNewestClient = fClients.empty() ? -1 : fClients.rbegin()->first;
+
+    Metrics::SetGauge(METRIC_GAUGE_CLIENTS, count);
+    if (count > 0)
+        return;
 
     BMessenger messenger(be_app);
     messenger.SendMessage(MSG_CLIENT_DISCONNECTED);
 
-    fClientSocket = -1;
+    Metrics::SetGauge(METRIC_GAUGE_RECEIVE_QUEUE_BYTES, 0);
+}
+
+void NetworkServer::ReceiveDone(int32 client)
+{
+    fCoalescer.Flush();
+}
+
+void NetworkServer::Pulse(bigtime_t now)
+{
+    fPacer.Tick();
+    // Half the primary client's last round trip is how far behind the
+    // pointer is; 0 until one is measured, which keeps prediction off
+    fPredictor.SetLookahead(atomic_get64(&fRoundTripTime) / 2);
+    fPredictor.SetSuppressed(fInputInjector->IsGameMode());
+    fPredictor.Tick();
+
+    ExpireParkedSession();
+
+    if (fRecorder.Overflowed())
+        StopCapture();
+
+    bigtime_t time = system_time();
+    if (time - fLastHeartbeatProbe >= kHeartbeatProbeInterval) {
+        SendHeartbeats();
+        fLastHeartbeatProbe = time;
+    }
+    CheckHeartbeatAge(time);
+
+    int32 client = PrimaryClient();
+    if (client >= 0)
+        Metrics::SetGauge(METRIC_GAUGE_RECEIVE_QUEUE_BYTES,
+            fLoop.BufferedBytes(client));
+
+    // Log receive stats every second
+    if (time - fLastStatsTime >= 1000000) {
+        if (fMessageCount > 0) {
+            LOG("Recv stats: %ld messages in last %.1fs", fMessageCount,
+                (time - fLastStatsTime) / 1000000.0);
+        }
+        fMessageCount = 0;
+        fLastStatsTime = time;
+    }
 }
 
-void NetworkServer::ProcessMessage(const uint8* data, size_t length)
+void NetworkServer::SetLivenessOptions(int socket)
+{
+    // Let the kernel notice a vanished peer even while we have nothing to
+    // send; the server loop's idle timeout covers the common case.
+    int opt = 1;
+    setsockopt(socket, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt));
+
+#ifdef TCP_KEEPIDLE
+    int idle = 5;
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+#endif
+#ifdef TCP_KEEPINTVL
+    int interval = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+#endif
+#ifdef TCP_KEEPCNT
+    int count = 3;
+    setsockopt(socket, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+#ifdef TCP_USER_TIMEOUT
+    // Fail writes that stay unacknowledged instead of retrying for minutes
+    unsigned int userTimeout = (unsigned int)(kClientTimeout / 1000);
+    setsockopt(socket, IPPROTO_TCP, TCP_USER_TIMEOUT, &userTimeout,
+        sizeof(userTimeout));
+#endif
+}
+
+void NetworkServer::ProcessMessage(int32 client, const uint8* data,
+    size_t length)
 {
     if (length < sizeof(ProtocolHeader))
         return;
@@ -297,82 +475,22 @@ void NetworkServer::ProcessMessage(const uint8* data, size_t length)
         LOG("Received: HEARTBEAT");
     }
 
-    switch (header->eventType) {
-        case EVENT_KEY_DOWN:
-        {
-            // KEY_DOWN has: keyCode(4) + modifiers(4) + numBytes(1) + bytes
-            if (header->length >= sizeof(KeyEventPayload)) {
-                const KeyEventPayload* keyPayload = (const KeyEventPayload*)payload;
-                // Get the UTF-8 bytes following the fixed part
-                const char* bytes = (const char*)(payload + sizeof(KeyEventPayload));
-                // Log the received bytes for debugging
-                char bytesHex[64] = {0};
-                for (int i = 0; i < keyPayload->numBytes && i < 10; i++) {
-                    snprintf(bytesHex + i*3, 4, "%02X ", (uint8)bytes[i]);
-                }
-                LOG("KEY_DOWN: macKey=0x%02X macMods=0x%02X numBytes=%d bytes=[%s]",
-                    keyPayload->keyCode, keyPayload->modifiers, keyPayload->numBytes, bytesHex);
-                fInputInjector->InjectKeyDown(keyPayload->keyCode,
-                    MapModifiers(keyPayload->modifiers),
-                    bytes, keyPayload->numBytes);
-            }
-            break;
-        }
-
-        case EVENT_KEY_UP:
-        {
-            // KEY_UP only has: keyCode(4) + modifiers(4) = 8 bytes (no numBytes field)
-            if (header->length >= 8) {
-                const uint32* data = (const uint32*)payload;
-                uint32 keyCode = data[0];
-                uint32 modifiers = data[1];
-                LOG("KEY_UP: macKey=0x%02X macMods=0x%02X", keyCode, modifiers);
-                fInputInjector->InjectKeyUp(keyCode, MapModifiers(modifiers));
-            }
-            break;
-        }
-
-        case EVENT_MOUSE_MOVE:
-        {
-            if (header->length >= sizeof(MouseMovePayload)) {
-                const MouseMovePayload* movePayload = (const MouseMovePayload*)payload;
-                fInputInjector->InjectMouseMove(movePayload->x, movePayload->y,
-                    movePayload->relative != 0, MapModifiers(movePayload->modifiers));
-            }
-            break;
-        }
-
-        case EVENT_MOUSE_DOWN:
-        {
-            if (header->length >= sizeof(MouseDownPayload)) {
-                const MouseDownPayload* btnPayload = (const MouseDownPayload*)payload;
-                fInputInjector->InjectMouseDown(btnPayload->buttons,
-                    btnPayload->x, btnPayload->y, MapModifiers(btnPayload->modifiers),
-                    btnPayload->clicks);
-            }
-            break;
-        }
-
-        case EVENT_MOUSE_UP:
-        {
-            if (header->length >= sizeof(MouseButtonPayload)) {
-                const MouseButtonPayload* btnPayload = (const MouseButtonPayload*)payload;
-                fInputInjector->InjectMouseUp(btnPayload->buttons,
-                    btnPayload->x, btnPayload->y, MapModifiers(btnPayload->modifiers));
-            }
-            break;
-        }
+    // Input events go on to the injector, relative moves merged while
+    // more of them are queued in the same read
+    if (DispatchInputEvent(data, length, &fCoalescer))
+        return;
 
-        case EVENT_MOUSE_WHEEL:
-        {
-            if (header->length >= sizeof(MouseWheelPayload)) {
-                const MouseWheelPayload* wheelPayload = (const MouseWheelPayload*)payload;
-                fInputInjector->InjectMouseWheel(wheelPayload->deltaX,
-                    wheelPayload->deltaY, MapModifiers(wheelPayload->modifiers));
-            }
-            break;
-        }
+    // Whatever this does happens after the motion that came before it.
+    // Paced and predicted motion is only caught up for what depends on
+    // where the pointer is; doing it for every heartbeat made it jump.
+    fCoalescer.Flush();
+    if (header->eventType == EVENT_CONTROL_SWITCH
+        || header->eventType == EVENT_SCREEN_INFO) {
+        fPacer.Flush();
+        fPredictor.Flush();
+    }
 
+    switch (header->eventType) {
         case EVENT_CONTROL_SWITCH:
         {
             if (header->length >= 1) {  // At minimum, direction byte
@@ -387,7 +505,7 @@ void NetworkServer::ProcessMessage(const uint8* data, size_t length)
                     if (yRatio > 1.0f) yRatio = 1.0f;
                     if (yRatio < 0.0f) yRatio = 0.0f;
                 }
-                fInputInjector->SetActive(toHaiku, yRatio);
+                HandleControlSwitch(client, toHaiku, yRatio);
             }
             break;
         }
@@ -398,6 +516,7 @@ void NetworkServer::ProcessMessage(const uint8* data, size_t length)
                 const ScreenInfoPayload* screenPayload = (const ScreenInfoPayload*)payload;
                 fRemoteWidth = screenPayload->width;
                 fRemoteHeight = screenPayload->height;
+                fInputInjector->SetClientScreenWidth(fRemoteWidth);
                 LOG("Remote (macOS) screen size: %.0fx%.0f", fRemoteWidth, fRemoteHeight);
             }
             break;
@@ -433,12 +552,27 @@ void NetworkServer::ProcessMessage(const uint8* data, size_t length)
             break;
         }
 
+        case EVENT_SESSION_HELLO:
+        {
+            uint64 token = 0;
+            uint32 capabilities = 0;
+            if (header->length >= sizeof(SessionHelloPayload))
+                token = ((const SessionHelloPayload*)payload)->token;
+            if (header->length >= sizeof(SessionHelloPayload) + sizeof(uint32)) {
+                memcpy(&capabilities, payload + sizeof(SessionHelloPayload),
+                    sizeof(capabilities));
+            }
+            HandleSessionHello(client, token, capabilities);
+            break;
+        }
+
         case EVENT_HEARTBEAT:
-            SendHeartbeatAck();
+            SendHeartbeatAck(client);
+            UpdateLinkQuality(client);
             break;
 
         case EVENT_HEARTBEAT_ACK:
-            // Ignore
+            HandleHeartbeatAck(client);
             break;
 
         case EVENT_TEAM_MONITOR:
@@ -453,9 +587,22 @@ void NetworkServer::ProcessMessage(const uint8* data, size_t length)
                 const ClipboardSyncPayload* clipPayload = (const ClipboardSyncPayload*)payload;
                 if (header->length >= sizeof(ClipboardSyncPayload) + clipPayload->dataLength) {
                     const uint8* clipData = payload + sizeof(ClipboardSyncPayload);
+                    Metrics::Count(METRIC_CLIPBOARD_BYTES_IN, clipPayload->dataLength);
+
+                    // Content hash trailer, absent from older clients
+                    uint64 hash;
+                    const uint64* hashPointer = nullptr;
+                    if (header->length >= sizeof(ClipboardSyncPayload)
+                            + clipPayload->dataLength + sizeof(uint64)) {
+                        memcpy(&hash, clipData + clipPayload->dataLength,
+                            sizeof(hash));
+                        hashPointer = &hash;
+                    }
+
                     if (fClipboardManager != nullptr) {
                         fClipboardManager->SetClipboardFromSync(
-                            clipPayload->contentType, clipData, clipPayload->dataLength);
+                            clipPayload->contentType, clipData, clipPayload->dataLength,
+                            hashPointer);
                     }
                 } else {
                     LOG("CLIPBOARD_SYNC: incomplete data (expected %lu, got %u)",
@@ -465,31 +612,372 @@ void NetworkServer::ProcessMessage(const uint8* data, size_t length)
             break;
         }
 
+        case EVENT_CLIPBOARD_MANIFEST:
+        {
+            ClipboardManifest manifest;
+            if (manifest.Unflatten(payload, header->length) != B_OK) {
+                LOG("CLIPBOARD_MANIFEST: malformed");
+                break;
+            }
+            fManifestClient = client;
+            if (fClipboardManager != nullptr)
+                fClipboardManager->ManifestReceived(manifest);
+            break;
+        }
+
+        case EVENT_CLIPBOARD_FETCH:
+            if (header->length >= sizeof(ClipboardFetchPayload))
+                HandleClipboardFetch(client, (const ClipboardFetchPayload*)payload);
+            break;
+
+        case EVENT_CLIPBOARD_CHUNK:
+        {
+            const ClipboardChunkPayload* chunk
+                = (const ClipboardChunkPayload*)payload;
+            if (header->length < sizeof(ClipboardChunkPayload)
+                || header->length - sizeof(ClipboardChunkPayload) < chunk->length) {
+                LOG("CLIPBOARD_CHUNK: incomplete");
+                break;
+            }
+            if (client == fManifestClient && fClipboardManager != nullptr) {
+                fClipboardManager->ChunkReceived(*chunk,
+                    payload + sizeof(ClipboardChunkPayload));
+            }
+            break;
+        }
+
+        case EVENT_FILE_OFFER:
+        {
+            const FileOfferPayload* offer = (const FileOfferPayload*)payload;
+            if (header->length < sizeof(FileOfferPayload)
+                || header->length - sizeof(FileOfferPayload) < offer->nameLength) {
+                LOG("FILE_OFFER: incomplete");
+                break;
+            }
+            char name[256];
+            memcpy(name, offer + 1, offer->nameLength);
+            name[offer->nameLength] = '\0';
+            HandleFileOffer(client, offer, name);
+            break;
+        }
+
+        case EVENT_FILE_DATA:
+        {
+            const FileDataPayload* fileData = (const FileDataPayload*)payload;
+            if (header->length < sizeof(FileDataPayload)
+                || header->length - sizeof(FileDataPayload) < fileData->length) {
+                LOG("FILE_DATA: incomplete");
+                break;
+            }
+            if (fFileSink.Write(client, fileData->transferId, fileData->offset,
+                    fileData + 1, fileData->length) != B_OK)
+                LOG("FILE_DATA: client sent past its window");
+            Metrics::Count(METRIC_FILE_BYTES_IN, fileData->length);
+            break;
+        }
+
         default:
             LOG("Unknown event type: 0x%02X", header->eventType);
             break;
     }
 }
 
-void NetworkServer::SendHeartbeatAck()
+ssize_t NetworkServer::SendBuffer(int32 client, const void* data,
+    size_t length, SendPriority priority)
 {
-    if (fClientSocket < 0)
-        return;
+    // Never blocks; what the socket does not take now is queued by the loop
+    if (client < 0 || fLoop.Send(client, data, length, priority) != B_OK)
+        return -1;
 
+    Metrics::Count(METRIC_BYTES_OUT, length);
+    return length;
+}
+
+void NetworkServer::SendHeartbeatAck(int32 client)
+{
     ProtocolHeader header;
     header.magic = PROTOCOL_MAGIC;
     header.version = PROTOCOL_VERSION;
     header.eventType = EVENT_HEARTBEAT_ACK;
     header.length = 0;
 
-    send(fClientSocket, &header, sizeof(header), 0);
+    SendBuffer(client, &header, sizeof(header));
+}
+
+void NetworkServer::SendHeartbeats()
+{
+    ProtocolHeader header;
+    header.magic = PROTOCOL_MAGIC;
+    header.version = PROTOCOL_VERSION;
+    header.eventType = EVENT_HEARTBEAT;
+    header.length = 0;
+
+    // RTT is measured when a client echoes it back as HEARTBEAT_ACK
+    bigtime_t now = system_time();
+    for (std::map<int32, ClientState>::iterator it = fClients.begin();
+            it != fClients.end(); ++it) {
+        it->second.heartbeatSent = now;
+        SendBuffer(it->first, &header, sizeof(header));
+    }
+}
+
+void NetworkServer::GetMetrics(NetworkMetrics* metrics)
+{
+    metrics->eventsReceived = Metrics::EventTotal();
+    metrics->bytesReceived = Metrics::CounterValue(METRIC_BYTES_IN);
+    metrics->roundTripTime = atomic_get64(&fRoundTripTime);
+}
+
+int32 NetworkServer::GetClientStats(ClientStats* stats, int32 maxCount)
+{
+    BAutolock lock(fStateLock);
+
+    int32 owner = fArbiter.Owner();
+    int32 count = 0;
+    for (std::map<int32, ClientState>::iterator it = fClients.begin();
+            it != fClients.end() && count < maxCount; ++it) {
+        const ClientState& state = it->second;
+        ClientStats& entry = stats[count++];
+        entry.id = it->first;
+        strlcpy(entry.address, state.address, sizeof(entry.address));
+        entry.owner = it->first == owner;
+        entry.connectedSince = state.connectedSince;
+        entry.roundTripTime = state.roundTripTime;
+        entry.bytesReceived = state.bytesReceived;
+        entry.eventsAccepted = state.eventsAccepted;
+        entry.eventsRejected = state.eventsRejected;
+        entry.takeovers = state.takeovers;
+    }
+    return count;
+}
+
+int32 NetworkServer::PrimaryClient() const
+{
+    int32 owner = fArbiter.Owner();
+    return owner >= 0 ? owner : fNewestClient;
+}
+
+void NetworkServer::UpdateLinkQuality(int32 client)
+{
+    std::map<int32, ClientState>::iterator it = fClients.find(client);
+    if (it == fClients.end())
+        return;
+
+    bigtime_t now = system_time();
+    bigtime_t gap = now - it->second.lastHeartbeat;
+    it->second.lastHeartbeat = now;
+
+    if (client != PrimaryClient())
+        return;
+
+    SetHeartbeatQuality(HeartbeatQuality(gap), gap);
+}
+
+void NetworkServer::CheckHeartbeatAge(bigtime_t now)
+{
+    std::map<int32, ClientState>::iterator it = fClients.find(PrimaryClient());
+    if (it == fClients.end())
+        return;
+
+    // A link that went silent never acks, so the age of the last
+    // heartbeat has to bring it down; only its next heartbeat lifts it
+    bigtime_t age = now - it->second.lastHeartbeat;
+    int32 quality = HeartbeatQuality(age);
+    if (quality < fHeartbeatQuality)
+        SetHeartbeatQuality(quality, age);
+}
+
+int32 NetworkServer::HeartbeatQuality(bigtime_t gap)
+{
+    // The client sends a heartbeat every 5 seconds; late ones mean a
+    // congested or flaky link.
+    if (gap <= 6000000)
+        return LINK_QUALITY_GOOD;
+    if (gap <= 10000000)
+        return LINK_QUALITY_FAIR;
+    return LINK_QUALITY_POOR;
+}
+
+void NetworkServer::SetHeartbeatQuality(int32 quality, bigtime_t gap)
+{
+    if (quality != fHeartbeatQuality) {
+        LOG("Heartbeat gap %.1fs, link quality %ld", gap / 1000000.0, quality);
+        fHeartbeatQuality = quality;
+    }
+
+    SetLinkQuality(min_c(quality, fRoundTripQuality));
+}
+
+void NetworkServer::HandleHeartbeatAck(int32 client)
+{
+    std::map<int32, ClientState>::iterator it = fClients.find(client);
+    if (it == fClients.end() || it->second.heartbeatSent == 0)
+        return;
+
+    bigtime_t rtt = system_time() - it->second.heartbeatSent;
+    it->second.heartbeatSent = 0;
+    it->second.roundTripTime = rtt;
+
+    // A client that echoes our probes can be given up on much sooner
+    fLoop.SetIdleTimeout(client, kEchoingClientTimeout);
+
+    if (client != PrimaryClient())
+        return;
+
+    atomic_set64(&fRoundTripTime, rtt);
+
+    int32 quality;
+    if (rtt <= 30000)
+        quality = LINK_QUALITY_GOOD;
+    else if (rtt <= 150000)
+        quality = LINK_QUALITY_FAIR;
+    else
+        quality = LINK_QUALITY_POOR;
+
+    // A link is only as good as its worst indicator
+    fRoundTripQuality = quality;
+    SetLinkQuality(min_c(quality, fHeartbeatQuality));
+}
+
+void NetworkServer::SetLinkQuality(int32 quality)
+{
+    if (quality == fLinkQuality)
+        return;
+
+    fLinkQuality = quality;
+
+    BMessage msg(MSG_LINK_QUALITY_CHANGED);
+    msg.AddInt32("quality", quality);
+    BMessenger(be_app).SendMessage(&msg);
 }
 
-void NetworkServer::SendScreenInfo()
+void NetworkServer::HandleControlSwitch(int32 client, bool toHaiku,
+    float yRatio)
 {
-    if (fClientSocket < 0)
+    BAutolock lock(fStateLock);
+
+    // Any change of who has control here takes it back from a neighbour
+    if (toHaiku || client == fArbiter.Owner())
+        EndRelay();
+
+    if (!toHaiku) {
+        // Only the owner can hand control back; a stale switch from a
+        // client that already lost it must not deactivate the new owner
+        if (fArbiter.ReleaseControl(client)) {
+            fInputInjector->ReleaseAll();
+            fInputInjector->SetActive(false);
+        }
         return;
+    }
+
+    int32 previous = fArbiter.TakeControl(client);
+    if (previous >= 0) {
+        // One-message handover: keys and buttons the previous owner held
+        // are lifted, and it is told that control went elsewhere
+        LOG("Client %ld takes control from client %ld", client, previous);
+        fInputInjector->ReleaseAll();
+        SendControlSwitchTo(previous, 1, 0.5f);
+        fClients[client].takeovers++;
+    } else if (fSession.IsParked()) {
+        LOG("Client %ld takes control from a parked session", client);
+        fInputInjector->ReleaseAll();
+        fSession.End();
+    }
+
+    fInputInjector->SetActive(true, yRatio);
+}
+
+void NetworkServer::HandleSessionHello(int32 client, uint64 token,
+    uint32 capabilities)
+{
+    BAutolock lock(fStateLock);
+
+    ClientState& state = fClients[client];
+    state.sessionResumable = true;
+    state.capabilities = capabilities;
+    fLoop.SetFragmenting(client,
+        (capabilities & CAPABILITY_BULK_FRAGMENTS) != 0);
+
+    // Only the session that owned input is ever parked; resuming it hands
+    // ownership straight back with held input intact
+    bool resumed = fSession.Resume(token, system_time());
+    if (resumed) {
+        state.sessionToken = token;
+        fArbiter.TakeControl(client);
+        LOG("Client %ld resumed its session, keeping held input (active=%d)",
+            client, fInputInjector->IsActive());
+    } else
+        state.sessionToken = ResumableSession::NewToken();
+
+    SendSessionAccept(client, state.sessionToken, resumed);
+}
 
+void NetworkServer::SendSessionAccept(int32 client, uint64 token, bool resumed)
+{
+    uint8 buffer[sizeof(ProtocolHeader) + sizeof(SessionAcceptPayload)
+        + sizeof(uint32)];
+    ProtocolHeader* header = (ProtocolHeader*)buffer;
+    SessionAcceptPayload* payload
+        = (SessionAcceptPayload*)(buffer + sizeof(ProtocolHeader));
+
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = EVENT_SESSION_ACCEPT;
+    header->length = sizeof(SessionAcceptPayload) + sizeof(uint32);
+
+    payload->token = token;
+    payload->resumed = resumed ? 1 : 0;
+    payload->active = fInputInjector->IsActive() ? 1 : 0;
+
+    uint32 capabilities = kServerCapabilities;
+    memcpy(payload + 1, &capabilities, sizeof(capabilities));
+
+    SendBuffer(client, buffer, sizeof(buffer));
+}
+
+void NetworkServer::OwnerGone(int32 client)
+{
+    BAutolock lock(fStateLock);
+
+    // Clients that never owned input hold nothing
+    if (!fArbiter.ReleaseControl(client))
+        return;
+
+    EndRelay();
+    fPacer.Reset();
+    fPredictor.Reset();
+
+    std::map<int32, ClientState>::iterator state = fClients.find(client);
+    if (fRunning && state != fClients.end() && state->second.sessionResumable) {
+        LOG("Parking session for %.1fs", kResumeGraceWindow / 1000000.0);
+        fSession.Park(state->second.sessionToken, system_time());
+        return;
+    }
+
+    // Never leave keys or buttons held down, or Haiku waiting for input,
+    // on behalf of a client that is gone
+    ReleaseInputState();
+}
+
+void NetworkServer::ExpireParkedSession()
+{
+    BAutolock lock(fStateLock);
+
+    if (fSession.ParkExpired(system_time())) {
+        LOG("Parked session expired - releasing held input");
+        ReleaseInputState();
+        fSession.End();
+    }
+}
+
+void NetworkServer::ReleaseInputState()
+{
+    fInputInjector->ReleaseAll();
+    fInputInjector->SetActive(false);
+}
+
+void NetworkServer::SendScreenInfo(int32 client)
+{
     LOG("Sending screen info: %.0fx%.0f", fLocalWidth, fLocalHeight);
 
     uint8 buffer[sizeof(ProtocolHeader) + sizeof(ScreenInfoPayload)];
@@ -504,15 +992,27 @@ void NetworkServer::SendScreenInfo()
     payload->width = fLocalWidth;
     payload->height = fLocalHeight;
 
-    send(fClientSocket, buffer, sizeof(buffer), 0);
+    SendBuffer(client, buffer, sizeof(buffer));
 }
 
 void NetworkServer::SendControlSwitch(uint8 direction, float yRatio)
 {
-    if (fClientSocket < 0)
+    BAutolock lock(fStateLock);
+
+    int32 owner = fArbiter.Owner();
+    if (owner < 0)
         return;
 
-    LOG("Sending CONTROL_SWITCH direction=%d yRatio=%.2f", direction, yRatio);
+    SendControlSwitchTo(owner, direction, yRatio);
+    if (direction == 1)
+        fArbiter.ReleaseControl(owner);
+}
+
+void NetworkServer::SendControlSwitchTo(int32 client, uint8 direction,
+    float yRatio)
+{
+    LOG("Sending CONTROL_SWITCH to client %ld direction=%d yRatio=%.2f",
+        client, direction, yRatio);
 
     uint8 buffer[sizeof(ProtocolHeader) + sizeof(ControlSwitchPayload)];
     ProtocolHeader* header = (ProtocolHeader*)buffer;
@@ -526,38 +1026,453 @@ void NetworkServer::SendControlSwitch(uint8 direction, float yRatio)
     payload->direction = direction;
     payload->yRatio = yRatio;
 
-    send(fClientSocket, buffer, sizeof(buffer), 0);
+    SendBuffer(client, buffer, sizeof(buffer));
 }
 
-void NetworkServer::SendClipboardSync()
+void NetworkServer::SendClipboardSync(bool force)
 {
-    if (fClientSocket < 0 || fClipboardManager == nullptr)
+    // The clipboard goes to the client owning input, else the newest one.
+    // Called from the app thread whenever the clipboard changes, never
+    // from the switch itself.
+    int32 client;
+    uint32 capabilities = 0;
+    {
+        BAutolock lock(fStateLock);
+        client = PrimaryClient();
+        std::map<int32, ClientState>::iterator state = fClients.find(client);
+        if (state != fClients.end())
+            capabilities = state->second.capabilities;
+    }
+    if (client < 0 || fClipboardManager == nullptr)
+        return;
+
+    if ((capabilities & CAPABILITY_CLIPBOARD_MANIFEST) != 0) {
+        SendClipboardManifest(client, force);
         return;
+    }
 
     uint32 dataLength = 0;
-    uint8* clipData = fClipboardManager->GetClipboardForSync(&dataLength);
+    uint64 hash = 0;
+    uint8* clipData = fClipboardManager->GetClipboardForSync(&dataLength, &hash);
     if (clipData == nullptr || dataLength == 0)
         return;
 
-    LOG("Sending clipboard to macOS: %lu bytes", dataLength);
+    if (!force && !fClipboardManager->NeedsSync(hash)) {
+        LOG("Clipboard unchanged, not sent");
+        delete[] clipData;
+        return;
+    }
 
-    size_t totalSize = sizeof(ProtocolHeader) + sizeof(ClipboardSyncPayload) + dataLength;
-    uint8* buffer = new uint8[totalSize];
+    bool compress = (capabilities & CAPABILITY_CLIPBOARD_LZ4) != 0
+        && dataLength >= CLIPBOARD_COMPRESS_THRESHOLD;
+
+    // Compressed content is encoded straight into the message; the buffer
+    // is sized for either form
+    size_t bodySize = compress
+        ? sizeof(uint32) + Lz4CompressBound(dataLength) : dataLength;
+    size_t bufferSize = sizeof(ProtocolHeader) + sizeof(ClipboardSyncPayload)
+        + bodySize + sizeof(hash);
+    uint8* buffer = new uint8[bufferSize];
+    uint8* data = buffer + sizeof(ProtocolHeader) + sizeof(ClipboardSyncPayload);
+
+    uint8 contentType = 0x00;  // plain text
+    uint32 wireLength = dataLength;
+    if (compress) {
+        ssize_t compressed = Lz4Compress(clipData, dataLength,
+            data + sizeof(uint32), bodySize - sizeof(uint32));
+        if (compressed > 0 && compressed + sizeof(uint32) < dataLength) {
+            memcpy(data, &dataLength, sizeof(uint32));
+            contentType |= CLIPBOARD_COMPRESSED;
+            wireLength = compressed + sizeof(uint32);
+        }
+    }
+    if ((contentType & CLIPBOARD_COMPRESSED) == 0)
+        memcpy(data, clipData, dataLength);
+    memcpy(data + wireLength, &hash, sizeof(hash));
+
+    LOG("Sending clipboard to macOS: %lu bytes (%lu on the wire)", dataLength,
+        wireLength);
 
     ProtocolHeader* header = (ProtocolHeader*)buffer;
     header->magic = PROTOCOL_MAGIC;
     header->version = PROTOCOL_VERSION;
     header->eventType = EVENT_CLIPBOARD_SYNC;
-    header->length = sizeof(ClipboardSyncPayload) + dataLength;
+    header->length = sizeof(ClipboardSyncPayload) + wireLength + sizeof(hash);
 
     ClipboardSyncPayload* payload = (ClipboardSyncPayload*)(buffer + sizeof(ProtocolHeader));
-    payload->contentType = 0x00;  // plain text
-    payload->dataLength = dataLength;
+    payload->contentType = contentType;
+    payload->dataLength = wireLength;
 
-    memcpy(buffer + sizeof(ProtocolHeader) + sizeof(ClipboardSyncPayload), clipData, dataLength);
-
-    send(fClientSocket, buffer, totalSize, 0);
+    size_t totalSize = sizeof(ProtocolHeader) + header->length;
+    if (SendBuffer(client, buffer, totalSize, SEND_BULK) > 0) {
+        Metrics::Count(METRIC_CLIPBOARD_BYTES_OUT, wireLength);
+        fClipboardManager->MarkSent(hash);
+    }
 
     delete[] buffer;
     delete[] clipData;
 }
+
+void NetworkServer::SendClipboardManifest(int32 client, bool force)
+{
+    ClipboardManifest manifest;
+    if (!fClipboardManager->BuildManifest(&manifest))
+        return;
+
+    if (!force && !fClipboardManager->NeedsSync(manifest.Hash())) {
+        LOG("Clipboard unchanged, not announced");
+        return;
+    }
+
+    size_t totalSize = sizeof(ProtocolHeader) + manifest.FlattenedSize();
+    uint8* buffer = new uint8[totalSize];
+
+    ProtocolHeader* header = (ProtocolHeader*)buffer;
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = EVENT_CLIPBOARD_MANIFEST;
+    header->length = manifest.FlattenedSize();
+    manifest.Flatten(buffer + sizeof(ProtocolHeader));
+
+    LOG("Announcing %ld clipboard formats to macOS", manifest.CountFormats());
+    if (SendBuffer(client, buffer, totalSize, SEND_BULK) > 0)
+        fClipboardManager->MarkSent(manifest.Hash());
+
+    delete[] buffer;
+}
+
+void NetworkServer::SendClipboardFetch(uint32 generation, uint8 format,
+    uint32 offset, uint32 length)
+{
+    uint8 buffer[sizeof(ProtocolHeader) + sizeof(ClipboardFetchPayload)];
+    ProtocolHeader* header = (ProtocolHeader*)buffer;
+    ClipboardFetchPayload* payload
+        = (ClipboardFetchPayload*)(buffer + sizeof(ProtocolHeader));
+
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = EVENT_CLIPBOARD_FETCH;
+    header->length = sizeof(ClipboardFetchPayload);
+
+    payload->generation = generation;
+    payload->format = format;
+    payload->offset = offset;
+    payload->length = length;
+
+    SendBuffer(fManifestClient, buffer, sizeof(buffer));
+}
+
+void NetworkServer::HandleClipboardFetch(int32 client,
+    const ClipboardFetchPayload* fetch)
+{
+    if (fClipboardManager == nullptr)
+        return;
+
+    uint32 length = fetch->length < kMaxClipboardChunk
+        ? fetch->length : kMaxClipboardChunk;
+    size_t bufferSize = sizeof(ProtocolHeader) + sizeof(ClipboardChunkPayload)
+        + length;
+    uint8* buffer = new uint8[bufferSize];
+    ProtocolHeader* header = (ProtocolHeader*)buffer;
+    ClipboardChunkPayload* chunk
+        = (ClipboardChunkPayload*)(buffer + sizeof(ProtocolHeader));
+
+    // Read straight into the outgoing message
+    ssize_t copied = fClipboardManager->ReadFormat(fetch->generation,
+        fetch->format, fetch->offset, (uint8*)(chunk + 1), length);
+
+    chunk->generation = fetch->generation;
+    chunk->format = fetch->format;
+    chunk->status = copied >= 0 ? CLIPBOARD_CHUNK_OK : CLIPBOARD_CHUNK_GONE;
+    chunk->offset = fetch->offset;
+    chunk->length = copied >= 0 ? copied : 0;
+
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = EVENT_CLIPBOARD_CHUNK;
+    header->length = sizeof(ClipboardChunkPayload) + chunk->length;
+
+    if (SendBuffer(client, buffer, sizeof(ProtocolHeader) + header->length,
+            SEND_BULK) > 0)
+        Metrics::Count(METRIC_CLIPBOARD_BYTES_OUT, chunk->length);
+
+    delete[] buffer;
+}
+
+void NetworkServer::HandleFileOffer(int32 client,
+    const FileOfferPayload* offer, const char* name)
+{
+    BPath directory;
+    if (Settings::GetReceiveDirectory()[0] != '\0')
+        directory.SetTo(Settings::GetReceiveDirectory());
+    else
+        find_directory(B_DESKTOP_DIRECTORY, &directory);
+
+    if (directory.InitCheck() != B_OK) {
+        LOG("FILE_OFFER: no directory to receive \"%s\" in", name);
+        SendFileAccept(client, offer->transferId, FILE_REFUSED, 0);
+        return;
+    }
+
+    LOG("Offered \"%s\", %llu bytes", name, (unsigned long long)offer->size);
+    fFileSink.Offer(client, directory.Path(), offer->transferId, name,
+        offer->size, offer->hash);
+}
+
+void NetworkServer::FileAccepted(int32 client, uint32 transferId,
+    uint8 status, uint64 offset)
+{
+    if (status != FILE_OK)
+        LOG("File transfer %lu refused", (unsigned long)transferId);
+    SendFileAccept(client, transferId, status, offset);
+}
+
+void NetworkServer::FileDone(int32 client, uint32 transferId, uint8 status,
+    const char* path)
+{
+    if (status == FILE_OK) {
+        LOG("Received file %s", path);
+        Metrics::Count(METRIC_FILES_RECEIVED);
+    } else if (status == FILE_CORRUPT) {
+        LOG("Received file does not match its checksum, discarded");
+    } else {
+        LOG("File transfer %lu failed, kept for a resume",
+            (unsigned long)transferId);
+    }
+    SendFileDone(client, transferId, status);
+}
+
+void NetworkServer::SendFileAccept(int32 client, uint32 transferId,
+    uint8 status, uint64 offset)
+{
+    uint8 buffer[sizeof(ProtocolHeader) + sizeof(FileAcceptPayload)];
+    ProtocolHeader* header = (ProtocolHeader*)buffer;
+    FileAcceptPayload* payload
+        = (FileAcceptPayload*)(buffer + sizeof(ProtocolHeader));
+
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = EVENT_FILE_ACCEPT;
+    header->length = sizeof(FileAcceptPayload);
+
+    payload->transferId = transferId;
+    payload->status = status;
+    payload->offset = offset;
+
+    SendBuffer(client, buffer, sizeof(buffer));
+}
+
+void NetworkServer::SendFileDone(int32 client, uint32 transferId,
+    uint8 status)
+{
+    uint8 buffer[sizeof(ProtocolHeader) + sizeof(FileDonePayload)];
+    ProtocolHeader* header = (ProtocolHeader*)buffer;
+    FileDonePayload* payload
+        = (FileDonePayload*)(buffer + sizeof(ProtocolHeader));
+
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = EVENT_FILE_DONE;
+    header->length = sizeof(FileDonePayload);
+
+    payload->transferId = transferId;
+    payload->status = status;
+
+    SendBuffer(client, buffer, sizeof(buffer));
+}
+
+bool NetworkServer::HasNeighbour(uint8 edge) const
+{
+    return edge < kEdgeCount && fNeighbours[edge][0] != '\0';
+}
+
+status_t NetworkServer::ForwardControl(uint8 edge, float yRatio)
+{
+    BAutolock lock(fStateLock);
+
+    if (!HasNeighbour(edge) || !fArbiter.HasOwner())
+        return B_ERROR;
+
+    // The connection is kept once made, so later crossings cost nothing
+    // extra; until it is up the loop queues what is sent
+    if (fRelayClients[edge] < 0) {
+        if (!fNeighbourResolved[edge]) {
+            LOG("Cannot reach %s neighbour %s, its name is not resolved",
+                Topology::EdgeName(edge), fNeighbours[edge]);
+            return B_ERROR;
+        }
+
+        int32 relay = fLoop.Connect(fNeighbourAddresses[edge]);
+        if (relay < 0) {
+            LOG("Cannot reach %s neighbour %s", Topology::EdgeName(edge),
+                fNeighbours[edge]);
+            return B_ERROR;
+        }
+        fRelayClients[edge] = relay;
+    }
+
+    LOG("Forwarding control to %s neighbour %s", Topology::EdgeName(edge),
+        fNeighbours[edge]);
+    fRelayTarget = fRelayClients[edge];
+    SendControlSwitchTo(fRelayTarget, 0, yRatio);
+    return B_OK;
+}
+
+void NetworkServer::LoadNeighbours()
+{
+    char hostName[Topology::kMaxNameLength];
+    if (Topology::LocalHostName(hostName, sizeof(hostName)) != B_OK)
+        return;
+
+    const Topology& topology = Settings::GetTopology();
+    for (int32 edge = 0; edge < kEdgeCount; edge++) {
+        const char* neighbour = topology.NeighbourOf(hostName, edge);
+        strlcpy(fNeighbours[edge], neighbour != nullptr ? neighbour : "",
+            sizeof(fNeighbours[edge]));
+        fNeighbourResolved[edge] = false;
+        if (neighbour == nullptr)
+            continue;
+
+        char host[Topology::kMaxAddressLength];
+        uint16 port;
+        if (Topology::ParseAddress(neighbour, fPort, host, sizeof(host),
+                &port) != B_OK) {
+            LOG("Bad neighbour address '%s'", neighbour);
+            fNeighbours[edge][0] = '\0';
+            continue;
+        }
+
+        LOG("%s neighbour of %s: %s", Topology::EdgeName(edge), hostName,
+            neighbour);
+    }
+}
+
+int32 NetworkServer::ResolverThreadFunc(void* data)
+{
+    ((NetworkServer*)data)->ResolveNeighbours();
+    return 0;
+}
+
+void NetworkServer::ResolveNeighbours()
+{
+    // fNeighbours is only written before the threads start
+    bool reported[kEdgeCount] = {};
+    while (fRunning) {
+        bool pending = false;
+        for (int32 edge = 0; edge < kEdgeCount && fRunning; edge++) {
+            if (!HasNeighbour(edge))
+                continue;
+            {
+                BAutolock lock(fStateLock);
+                if (fNeighbourResolved[edge])
+                    continue;
+            }
+
+            char host[Topology::kMaxAddressLength];
+            uint16 port;
+            Topology::ParseAddress(fNeighbours[edge], fPort, host,
+                sizeof(host), &port);
+
+            struct sockaddr_in address;
+            if (ServerLoop::Resolve(host, port, &address) != B_OK) {
+                // A neighbour that is not up yet may well be unknown, too
+                if (!reported[edge]) {
+                    LOG("Cannot resolve %s neighbour %s, retrying",
+                        Topology::EdgeName(edge), fNeighbours[edge]);
+                    reported[edge] = true;
+                }
+                pending = true;
+                continue;
+            }
+
+            BAutolock lock(fStateLock);
+            fNeighbourAddresses[edge] = address;
+            fNeighbourResolved[edge] = true;
+            LOG("%s neighbour %s is at %s", Topology::EdgeName(edge),
+                fNeighbours[edge], inet_ntoa(address.sin_addr));
+        }
+
+        if (!pending)
+            return;
+
+        for (bigtime_t waited = 0; fRunning && waited < kResolveRetryInterval;
+                waited += kPulseInterval)
+            snooze(kPulseInterval);
+    }
+}
+
+int32 NetworkServer::RelayEdge(int32 client) const
+{
+    for (int32 edge = 0; edge < kEdgeCount; edge++) {
+        if (fRelayClients[edge] == client)
+            return edge;
+    }
+    return -1;
+}
+
+void NetworkServer::RelayMessageReceived(int32 relay, const uint8* message,
+    size_t length)
+{
+    const ProtocolHeader* header = (const ProtocolHeader*)message;
+    const uint8* payload = message + sizeof(ProtocolHeader);
+
+    switch (header->eventType) {
+        case EVENT_HEARTBEAT:
+            // Answering keeps the neighbour from dropping us as idle
+            SendHeartbeatAck(relay);
+            break;
+
+        case EVENT_CONTROL_SWITCH:
+        {
+            // The neighbour's return edge faces us: control comes back
+            // here, entering over the edge the neighbour is on
+            if (header->length < sizeof(ControlSwitchPayload)
+                || ((const ControlSwitchPayload*)payload)->direction != 1)
+                break;
+
+            BAutolock lock(fStateLock);
+            if (relay != fRelayTarget)
+                break;
+
+            fRelayTarget = -1;
+            float yRatio = ((const ControlSwitchPayload*)payload)->yRatio;
+            LOG("%s neighbour hands control back",
+                Topology::EdgeName(RelayEdge(relay)));
+            if (fArbiter.HasOwner())
+                fInputInjector->SetActive(true, yRatio, RelayEdge(relay));
+            break;
+        }
+
+        default:
+            // Screen info, session accept and the like are of no use to
+            // a relay
+            break;
+    }
+}
+
+void NetworkServer::RelayDisconnected(int32 relay, const char* reason)
+{
+    BAutolock lock(fStateLock);
+
+    int32 edge = RelayEdge(relay);
+    LOG("Lost %s neighbour (%s)", Topology::EdgeName(edge), reason);
+    fRelayClients[edge] = -1;
+
+    if (relay != fRelayTarget)
+        return;
+
+    // Do not leave the user stranded on a machine that is gone
+    fRelayTarget = -1;
+    if (fRunning && fArbiter.HasOwner())
+        fInputInjector->SetActive(true, 0.5f, edge);
+}
+
+void NetworkServer::EndRelay()
+{
+    if (fRelayTarget < 0)
+        return;
+
+    // The neighbour lifts whatever it still holds for us
+    SendControlSwitchTo(fRelayTarget, 1, 0.5f);
+    fRelayTarget = -1;
+}
@@ -1,13 +1,51 @@
 #ifndef NETWORK_SERVER_H
 #define NETWORK_SERVER_H
 
+#include <Locker.h>
 #include <OS.h>
 #include <SupportDefs.h>
 
+#include <netinet/in.h>
+
+#include <map>
+
+#include "ControlArbiter.h"
+#include "Protocol.h"
+#include "ResumableSession.h"
+#include "ServerLoop.h"
+#include "WireCapture.h"
+#include "../input/MotionPredictor.h"
+#include "../input/MoveCoalescer.h"
+#include "../input/PointerPacer.h"
+#include "../platform/Platform.h"
+#include "../settings/Topology.h"
+#include "../transfer/FileSink.h"
+
 class InputInjector;
 class ClipboardManager;
 
-class NetworkServer {
+// Cumulative connection counters, see NetworkServer::GetMetrics()
+struct NetworkMetrics {
+    int64 eventsReceived;
+    int64 bytesReceived;
+    bigtime_t roundTripTime;    // last heartbeat RTT, 0 if not measured yet
+};
+
+// Per-client view, see NetworkServer::GetClientStats()
+struct ClientStats {
+    int32 id;
+    char address[64];
+    bool owner;                 // currently owns Haiku's input
+    bigtime_t connectedSince;
+    bigtime_t roundTripTime;
+    int64 bytesReceived;
+    int64 eventsAccepted;
+    int64 eventsRejected;       // input sent while another client owned it
+    int32 takeovers;            // times it took control from another client
+};
+
+class NetworkServer : public ServerLoopListener, public FileSinkListener,
+    public PeerLink {
 public:
     NetworkServer(uint16 port, InputInjector* injector);
     ~NetworkServer();
@@ -16,38 +54,168 @@ public:
     void Stop();
 
     bool IsRunning() const { return fRunning; }
-    bool HasClient() const { return fClientSocket >= 0; }
+    bool HasClient() const { return fClientCount > 0; }
+
+    // Goes to the client that owns input; toMac also ends its ownership
+    virtual void SendControlSwitch(uint8 direction, float yRatio = 0.5f);  // 0=toHaiku, 1=toMac; yRatio: 0=top, 1=bottom
+    // Skipped if the client already has this content, unless forced
+    void SendClipboardSync(bool force = false);
+    // Pulls part of a format from the client whose manifest is fetched
+    void SendClipboardFetch(uint32 generation, uint8 format, uint32 offset,
+        uint32 length);
+
+    // Multi-host rows: leaving this screen over an edge with a neighbour
+    // hands control to the softKM server there; the owner's input is then
+    // relayed to it until it hands control back. Server thread only.
+    virtual bool HasNeighbour(uint8 edge) const;
+    virtual status_t ForwardControl(uint8 edge, float yRatio);
 
-    void SendControlSwitch(uint8 direction, float yRatio = 0.5f);  // 0=toHaiku, 1=toMac; yRatio: 0=top, 1=bottom
-    void SendScreenInfo();
-    void SendClipboardSync();
+    // Snapshot of counters; safe to call from any thread
+    void GetMetrics(NetworkMetrics* metrics);
+    int32 GetClientStats(ClientStats* stats, int32 maxCount);
 
     void SetClipboardManager(ClipboardManager* manager) { fClipboardManager = manager; }
 
+    // Records every connection's incoming bytes, with receive times, to
+    // path for tools/replay; appends if it already holds a capture. Safe
+    // from any thread.
+    status_t StartCapture(const char* path);
+    void StopCapture();
+    bool IsCapturing() const { return fRecorder.IsOpen(); }
+
     // Screen dimensions
     float GetLocalWidth() const { return fLocalWidth; }
     float GetLocalHeight() const { return fLocalHeight; }
     float GetRemoteWidth() const { return fRemoteWidth; }
     float GetRemoteHeight() const { return fRemoteHeight; }
 
+    // ServerLoopListener, called on the server thread
+    virtual void ClientConnected(int32 client, int socket, const char* address);
+    virtual void MessageReceived(int32 client, const uint8* message,
+        size_t length);
+    virtual void ClientDisconnected(int32 client, const char* reason);
+    virtual void ReceiveDone(int32 client);
+    virtual void Pulse(bigtime_t now);
+
+    // FileSinkListener, called on the file sink's thread
+    virtual void FileAccepted(int32 client, uint32 transferId, uint8 status,
+        uint64 offset);
+    virtual void FileDone(int32 client, uint32 transferId, uint8 status,
+        const char* path);
+
 private:
-    static int32 ListenThreadFunc(void* data);
-    static int32 ClientThreadFunc(void* data);
+    // Per-connection state. Added and removed on the server thread under
+    // fStateLock; the server thread reads and updates fields without it.
+    struct ClientState {
+        char address[64];
+        bool sessionResumable;
+        uint64 sessionToken;
+        uint32 capabilities;        // SessionCapability bits from its hello
+        bigtime_t connectedSince;
+        bigtime_t lastHeartbeat;
+        bigtime_t heartbeatSent;
+        bigtime_t roundTripTime;
+        int64 bytesReceived;
+        int64 eventsAccepted;
+        int64 eventsRejected;
+        int32 takeovers;
+    };
+
+    static const int32 kEdgeCount = 4;
+
+    static int32 ServerThreadFunc(void* data);
 
-    void AcceptConnections();
-    void HandleClient(int clientSocket);
-    void ProcessMessage(const uint8* data, size_t length);
-    void SendHeartbeatAck();
+    void SetLivenessOptions(int socket);
+    void ProcessMessage(int32 client, const uint8* data, size_t length);
+    void HandleControlSwitch(int32 client, bool toHaiku, float yRatio);
+    void HandleSessionHello(int32 client, uint64 token, uint32 capabilities);
+    void SendSessionAccept(int32 client, uint64 token, bool resumed);
+    void OwnerGone(int32 client);
+    void ExpireParkedSession();
+    void ReleaseInputState();
+    void SendScreenInfo(int32 client);
+    void SendControlSwitchTo(int32 client, uint8 direction, float yRatio);
+    void SendClipboardManifest(int32 client, bool force);
+    void HandleClipboardFetch(int32 client, const ClipboardFetchPayload* fetch);
+    void HandleFileOffer(int32 client, const FileOfferPayload* offer,
+        const char* name);
+    void SendFileAccept(int32 client, uint32 transferId, uint8 status,
+        uint64 offset);
+    void SendFileDone(int32 client, uint32 transferId, uint8 status);
+    void SendHeartbeats();
+    void SendHeartbeatAck(int32 client);
+    void HandleHeartbeatAck(int32 client);
+    void UpdateLinkQuality(int32 client);
+    void CheckHeartbeatAge(bigtime_t now);
+    static int32 HeartbeatQuality(bigtime_t gap);
+    void SetHeartbeatQuality(int32 quality, bigtime_t gap);
+    void SetLinkQuality(int32 quality);
+    int32 PrimaryClient() const;
+    void LoadNeighbours();
+    static int32 ResolverThreadFunc(void* data);
+    void ResolveNeighbours();
+    void SetUpPacing();
+    int32 RelayEdge(int32 client) const;
+    void RelayMessageReceived(int32 relay, const uint8* message, size_t length);
+    void RelayDisconnected(int32 relay, const char* reason);
+    void EndRelay();
+    ssize_t SendBuffer(int32 client, const void* data, size_t length,
+        SendPriority priority = SEND_INPUT);
 
     uint16 fPort;
     InputInjector* fInputInjector;
+    // Input goes through all three to fInputInjector. The coalescer
+    // never holds moves past the end of a read; the pacer, when enabled,
+    // holds them for a few ms and the predictor runs the pointer ahead,
+    // both ticked from Pulse().
+    SystemClock fClock;
+    MotionPredictor fPredictor;
+    PointerPacer fPacer;
+    MoveCoalescer fCoalescer;
     ClipboardManager* fClipboardManager;
-    int fServerSocket;
-    int fClientSocket;
-    thread_id fListenThread;
-    thread_id fClientThread;
+    ServerLoop fLoop;
+    thread_id fServerThread;
+    thread_id fResolverThread;
     volatile bool fRunning;
 
+    // Guards fClients membership, fArbiter and fSession, and the release
+    // of held input on behalf of a client that is gone
+    BLocker fStateLock;
+    std::map<int32, ClientState> fClients;
+    volatile int32 fClientCount;
+    int32 fNewestClient;
+    ControlArbiter fArbiter;
+    ResumableSession fSession;
+
+    // Outgoing connections to neighbour servers, by edge, -1 while not
+    // connected. fRelayTarget is the one control was forwarded to. The
+    // resolver thread fills in the addresses under fStateLock.
+    char fNeighbours[kEdgeCount][Topology::kMaxAddressLength];
+    struct sockaddr_in fNeighbourAddresses[kEdgeCount];
+    bool fNeighbourResolved[kEdgeCount];
+    int32 fRelayClients[kEdgeCount];
+    int32 fRelayTarget;
+
+    // Sender of the clipboard manifest being fetched, server thread only
+    int32 fManifestClient;
+
+    // Writes dragged files to disk off the server thread
+    FileSink fFileSink;
+
+    WireRecorder fRecorder;
+
+    int32 fMessageCount;
+    bigtime_t fLastStatsTime;
+    bigtime_t fLastHeartbeatProbe;
+
+    // Link quality of the primary client (the owner, else the newest)
+    int32 fHeartbeatQuality;
+    int32 fRoundTripQuality;
+    int32 fLinkQuality;
+
+    int64 fRoundTripTime;
+    int32 fConnectionCount;
+
     // Screen dimensions
     float fLocalWidth;
     float fLocalHeight;
@@ -1,4 +1,33 @@
 #include "Protocol.h"
 
-// This file can contain protocol utility functions if needed
-// Currently, all protocol functionality is in the header as inline functions
+// Protocol utility functions that are too large to inline in the header
+
+const char* EventTypeName(uint8 eventType)
+{
+    switch (eventType) {
+        case EVENT_KEY_DOWN:        return "key_down";
+        case EVENT_KEY_UP:          return "key_up";
+        case EVENT_MOUSE_MOVE:      return "mouse_move";
+        case EVENT_MOUSE_DOWN:      return "mouse_down";
+        case EVENT_MOUSE_UP:        return "mouse_up";
+        case EVENT_MOUSE_WHEEL:     return "mouse_wheel";
+        case EVENT_CONTROL_SWITCH:  return "control_switch";
+        case EVENT_SCREEN_INFO:     return "screen_info";
+        case EVENT_SETTINGS_SYNC:   return "settings_sync";
+        case EVENT_TEAM_MONITOR:    return "team_monitor";
+        case EVENT_CLIPBOARD_SYNC:  return "clipboard_sync";
+        case EVENT_SESSION_HELLO:   return "session_hello";
+        case EVENT_SESSION_ACCEPT:  return "session_accept";
+        case EVENT_CLIPBOARD_MANIFEST: return "clipboard_manifest";
+        case EVENT_CLIPBOARD_FETCH: return "clipboard_fetch";
+        case EVENT_CLIPBOARD_CHUNK: return "clipboard_chunk";
+        case EVENT_BULK_FRAGMENT:   return "bulk_fragment";
+        case EVENT_FILE_OFFER:      return "file_offer";
+        case EVENT_FILE_ACCEPT:     return "file_accept";
+        case EVENT_FILE_DATA:       return "file_data";
+        case EVENT_FILE_DONE:       return "file_done";
+        case EVENT_HEARTBEAT:       return "heartbeat";
+        case EVENT_HEARTBEAT_ACK:   return "heartbeat_ack";
+        default:                    return "unknown";
+    }
+}
@@ -20,6 +20,16 @@ enum EventType {
     EVENT_SETTINGS_SYNC = 0x12,
     EVENT_TEAM_MONITOR  = 0x13,
     EVENT_CLIPBOARD_SYNC = 0x14,
+    EVENT_SESSION_HELLO = 0x15,
+    EVENT_SESSION_ACCEPT = 0x16,
+    EVENT_CLIPBOARD_MANIFEST = 0x17,
+    EVENT_CLIPBOARD_FETCH = 0x18,
+    EVENT_CLIPBOARD_CHUNK = 0x19,
+    EVENT_BULK_FRAGMENT = 0x1A,
+    EVENT_FILE_OFFER    = 0x1B,
+    EVENT_FILE_ACCEPT   = 0x1C,
+    EVENT_FILE_DATA     = 0x1D,
+    EVENT_FILE_DONE     = 0x1E,
     EVENT_HEARTBEAT     = 0xF0,
     EVENT_HEARTBEAT_ACK = 0xF1
 };
@@ -86,11 +96,134 @@ struct SettingsSyncPayload {
 } __attribute__((packed));
 
 struct ClipboardSyncPayload {
-    uint8   contentType;     // 0x00 = plain text (UTF-8)
+    uint8   contentType;     // 0x00 = plain text (UTF-8), | CLIPBOARD_COMPRESSED
     uint32  dataLength;      // Length of clipboard data following this header
     // followed by: uint8 data[dataLength]
+    // then, if the message is long enough: uint64 ContentHash() of data.
+    // Receivers that already hold that content skip the commit.
 } __attribute__((packed));
 
+// contentType flag: data is the uint32 original length followed by an LZ4
+// block (see Lz4Block.h); the hash is still that of the original content.
+// Only sent to peers that announced CAPABILITY_CLIPBOARD_LZ4.
+#define CLIPBOARD_COMPRESSED            0x80
+#define CLIPBOARD_COMPRESS_THRESHOLD    4096    // smaller content goes as is
+
+// First message of a connection from clients that support resumption.
+// Clients that never send it get a fresh session on their first event.
+struct SessionHelloPayload {
+    uint64  token;           // Token from a previous SESSION_ACCEPT, 0 = new
+    // then, from newer clients: uint32 capabilities
+} __attribute__((packed));
+
+struct SessionAcceptPayload {
+    uint64  token;           // Present this in the next SESSION_HELLO
+    uint8   resumed;         // 1 = held input and settings were kept
+    uint8   active;          // 1 = Haiku currently has control
+    // then: uint32 capabilities of the server
+} __attribute__((packed));
+
+// What a peer can receive, announced after the hello/accept payloads.
+// Absent means none.
+enum SessionCapability {
+    CAPABILITY_CLIPBOARD_LZ4 = 0x00000001,      // CLIPBOARD_COMPRESSED content
+    CAPABILITY_CLIPBOARD_MANIFEST = 0x00000002, // lazy clipboard, see below
+    CAPABILITY_BULK_FRAGMENTS = 0x00000004,     // BULK_FRAGMENT reassembly
+    CAPABILITY_FILE_TRANSFER = 0x00000008       // receives FILE_OFFER
+};
+
+// A piece of a large message (a clipboard, say), so that input can be sent
+// in between instead of waiting for all of it. The pieces of one message
+// come in order and are not interleaved with pieces of another; the
+// receiver handles the reassembled message as if it came whole.
+struct BulkFragmentPayload {
+    uint32  messageLength;   // of the whole message, header included
+    uint32  offset;          // of this piece within it
+    // followed by: the bytes of the piece
+} __attribute__((packed));
+
+// Lazy clipboard, between peers that both announced
+// CAPABILITY_CLIPBOARD_MANIFEST. Instead of CLIPBOARD_SYNC the owner of
+// new content sends a CLIPBOARD_MANIFEST listing its formats; the other
+// side pulls the formats it needs with CLIPBOARD_FETCH, a few chunks
+// ahead. The owner keeps no transfer state, so a fetch is cancelled by
+// no longer asking.
+struct ClipboardManifestPayload {
+    uint32  generation;      // changes with the content
+    uint8   formatCount;
+    // followed by: ClipboardFormatEntry formats[formatCount]
+} __attribute__((packed));
+
+struct ClipboardFormatEntry {
+    char    mimeType[32];    // NUL-terminated, e.g. "text/plain", "image/png"
+    uint32  size;
+    uint64  hash;            // ContentHash() of the data
+} __attribute__((packed));
+
+struct ClipboardFetchPayload {
+    uint32  generation;
+    uint8   format;          // index into the manifest
+    uint32  offset;
+    uint32  length;
+} __attribute__((packed));
+
+struct ClipboardChunkPayload {
+    uint32  generation;
+    uint8   format;
+    uint8   status;          // CLIPBOARD_CHUNK_*
+    uint32  offset;
+    uint32  length;
+    // followed by: uint8 data[length]
+} __attribute__((packed));
+
+enum ClipboardChunkStatus {
+    CLIPBOARD_CHUNK_OK = 0,
+    CLIPBOARD_CHUNK_GONE = 1     // content changed since the manifest
+};
+
+// File transfer to a server that announced CAPABILITY_FILE_TRANSFER, for
+// files dragged across the edge. The client offers one file at a time;
+// the server answers where to start, past whatever an interrupted attempt
+// at the same content already wrote, and the data follows in order as
+// FILE_DATA (bulk priority). FILE_ACCEPT is repeated as the data reaches
+// the disk, each time allowing FILE_TRANSFER_WINDOW bytes past its offset
+// to be in flight. FILE_DONE reports the checksum result.
+struct FileOfferPayload {
+    uint32  transferId;
+    uint64  size;
+    uint64  hash;            // ContentHash of the whole file
+    uint8   nameLength;
+    // followed by: the UTF-8 file name, without a path
+} __attribute__((packed));
+
+struct FileAcceptPayload {
+    uint32  transferId;
+    uint8   status;          // FileTransferStatus; anything but OK refuses
+    uint64  offset;          // first byte to send
+} __attribute__((packed));
+
+struct FileDataPayload {
+    uint32  transferId;
+    uint64  offset;
+    uint32  length;
+    // followed by: length bytes of the file
+} __attribute__((packed));
+
+struct FileDonePayload {
+    uint32  transferId;
+    uint8   status;          // FileTransferStatus
+} __attribute__((packed));
+
+enum FileTransferStatus {
+    FILE_OK = 0,
+    FILE_REFUSED = 1,        // bad name, no room, or busy
+    FILE_FAILED = 2,         // could not be written; resumable
+    FILE_CORRUPT = 3         // checksum mismatch, start over
+};
+
+#define FILE_DATA_CHUNK_SIZE    65536   // what the client sends per FILE_DATA
+#define FILE_TRANSFER_WINDOW    (2 * 1024 * 1024)
+
 // Switch edge constants
 enum SwitchEdge {
     EDGE_RIGHT  = 0,
@@ -99,6 +232,10 @@ enum SwitchEdge {
     EDGE_BOTTOM = 3
 };
 
+// Short lowercase name of an event type (e.g. "mouse_move"), "unknown"
+// for anything not listed above. Used for logging and metrics labels.
+const char* EventTypeName(uint8 eventType);
+
 // Modifier key mapping (macOS -> Haiku)
 // macOS:  Shift=0x01, Option=0x02, Control=0x04, Fn=0x10, CapsLock=0x20, Command=0x40
 // Haiku generic:  B_SHIFT_KEY=0x01, B_COMMAND_KEY=0x02, B_CONTROL_KEY=0x04,
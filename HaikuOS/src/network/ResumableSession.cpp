@@ -0,0 +1,53 @@
+#include "ResumableSession.h"
+
+#include <random>
+
+ResumableSession::ResumableSession(bigtime_t graceWindow)
+    : fGraceWindow(graceWindow),
+      fParkedSince(0),
+      fToken(0)
+{
+}
+
+uint64 ResumableSession::NewToken()
+{
+    // Tokens only need to be unguessable by an accidental peer, not secret
+    static std::random_device device;
+    static std::mt19937_64 generator(((uint64)device() << 32) ^ device());
+
+    uint64 token;
+    do {
+        token = generator();
+    } while (token == 0);
+    return token;
+}
+
+void ResumableSession::Park(uint64 token, bigtime_t now)
+{
+    if (token == 0)
+        return;
+
+    fToken = token;
+    // Guard against a clock reading of exactly zero meaning "not parked"
+    fParkedSince = now > 0 ? now : 1;
+}
+
+bool ResumableSession::Resume(uint64 token, bigtime_t now)
+{
+    if (token == 0 || token != fToken || !IsParked() || ParkExpired(now))
+        return false;
+
+    End();
+    return true;
+}
+
+void ResumableSession::End()
+{
+    fToken = 0;
+    fParkedSince = 0;
+}
+
+bool ResumableSession::ParkExpired(bigtime_t now) const
+{
+    return IsParked() && now - fParkedSince >= fGraceWindow;
+}
@@ -0,0 +1,35 @@
+#ifndef RESUMABLE_SESSION_H
+#define RESUMABLE_SESSION_H
+
+#include <SupportDefs.h>
+
+// Bookkeeping for the input-owning client's session when its connection
+// drops. The session is parked instead of ended; a client presenting the
+// same token within the grace window picks it up again with held keys,
+// buttons and active state untouched. Plain C++, callers provide the
+// clock and their own locking.
+class ResumableSession {
+public:
+    ResumableSession(bigtime_t graceWindow);
+
+    // Issued to every client in SESSION_ACCEPT; never 0
+    static uint64 NewToken();
+
+    void Park(uint64 token, bigtime_t now);
+
+    // True if token names the parked session and it is still within its
+    // grace window. The session is then attached again.
+    bool Resume(uint64 token, bigtime_t now);
+    void End();
+
+    bool IsParked() const { return fParkedSince != 0; }
+    bool ParkExpired(bigtime_t now) const;
+    uint64 Token() const { return fToken; }
+
+private:
+    bigtime_t fGraceWindow;
+    bigtime_t fParkedSince;     // 0 unless parked
+    uint64 fToken;              // token of the parked session
+};
+
+#endif // RESUMABLE_SESSION_H
@@ -0,0 +1,103 @@
+#include "SendScheduler.h"
+#include "Protocol.h"
+
+#include <cstring>
+
+SendScheduler::SendScheduler()
+    : fFrameOffset(0),
+      fBulkOffset(0),
+      fQueued(0),
+      fFragmenting(false),
+      fFragments(0)
+{
+}
+
+void SendScheduler::Enqueue(const void* message, size_t length,
+    SendPriority priority)
+{
+    if (length == 0)
+        return;
+
+    const uint8* bytes = (const uint8*)message;
+    std::deque<std::vector<uint8> >& queue
+        = priority == SEND_INPUT ? fInput : fBulk;
+    queue.push_back(std::vector<uint8>(bytes, bytes + length));
+    fQueued += length;
+}
+
+const uint8* SendScheduler::Peek(size_t* length)
+{
+    if (fFrameOffset == fFrame.size())
+        NextFrame();
+
+    *length = fFrame.size() - fFrameOffset;
+    return *length > 0 ? fFrame.data() + fFrameOffset : nullptr;
+}
+
+void SendScheduler::Consume(size_t length)
+{
+    fFrameOffset += length;
+}
+
+void SendScheduler::MakeEmpty()
+{
+    fFrame.clear();
+    fFrameOffset = 0;
+    fInput.clear();
+    fBulk.clear();
+    fBulkOffset = 0;
+    fQueued = 0;
+}
+
+void SendScheduler::NextFrame()
+{
+    fFrame.clear();
+    fFrameOffset = 0;
+
+    if (!fInput.empty()) {
+        fFrame.swap(fInput.front());
+        fInput.pop_front();
+        fQueued -= fFrame.size();
+        return;
+    }
+
+    if (fBulk.empty())
+        return;
+
+    std::vector<uint8>& message = fBulk.front();
+
+    // Small ones, and all of them for peers that cannot reassemble, go as is
+    if (fBulkOffset == 0
+        && (!fFragmenting || message.size() <= kFragmentSize)) {
+        fFrame.swap(message);
+        fBulk.pop_front();
+        fQueued -= fFrame.size();
+        return;
+    }
+
+    size_t length = message.size() - fBulkOffset;
+    if (length > kFragmentSize)
+        length = kFragmentSize;
+
+    fFrame.resize(sizeof(ProtocolHeader) + sizeof(BulkFragmentPayload)
+        + length);
+    ProtocolHeader* header = (ProtocolHeader*)fFrame.data();
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = EVENT_BULK_FRAGMENT;
+    header->length = sizeof(BulkFragmentPayload) + length;
+
+    BulkFragmentPayload* fragment
+        = (BulkFragmentPayload*)(fFrame.data() + sizeof(ProtocolHeader));
+    fragment->messageLength = message.size();
+    fragment->offset = fBulkOffset;
+    memcpy(fragment + 1, message.data() + fBulkOffset, length);
+
+    fBulkOffset += length;
+    fQueued -= length;
+    fFragments++;
+    if (fBulkOffset == message.size()) {
+        fBulk.pop_front();
+        fBulkOffset = 0;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef SEND_SCHEDULER_H
+#define SEND_SCHEDULER_H
+
+#include <SupportDefs.h>
+
+#include <deque>
+#include <vector>
+
+enum SendPriority {
+    SEND_INPUT = 0,     // input and small control messages, never wait
+    SEND_BULK           // clipboard and other large payloads
+};
+
+// The write queue of one connection. Input always goes out before bulk.
+// Bulk messages are cut into EVENT_BULK_FRAGMENT frames of kFragmentSize,
+// so input queued later overtakes them after at most one fragment instead
+// of waiting for a whole clipboard. Without fragmenting (peers that cannot
+// reassemble) bulk still yields to input, but only between messages.
+// Plain C++, no Be API.
+class SendScheduler {
+public:
+    static const size_t kFragmentSize = 8192;
+
+    SendScheduler();
+
+    void SetFragmenting(bool fragmenting) { fFragmenting = fragmenting; }
+
+    void Enqueue(const void* message, size_t length, SendPriority priority);
+
+    // The next bytes to write, nullptr if nothing is queued. A frame that
+    // was started is always finished before anything else.
+    const uint8* Peek(size_t* length);
+    void Consume(size_t length);
+
+    size_t QueuedBytes() const
+        { return fQueued + fFrame.size() - fFrameOffset; }
+    bool IsEmpty() const { return QueuedBytes() == 0; }
+    void MakeEmpty();
+
+    int64 CountFragments() const { return fFragments; }
+
+private:
+    void NextFrame();
+
+    std::vector<uint8> fFrame;      // being written
+    size_t fFrameOffset;
+    std::deque<std::vector<uint8> > fInput;
+    std::deque<std::vector<uint8> > fBulk;
+    size_t fBulkOffset;             // of fBulk.front() already framed
+    size_t fQueued;                 // queued, not yet framed
+    bool fFragmenting;
+    int64 fFragments;
+};
+
+#endif // SEND_SCHEDULER_H
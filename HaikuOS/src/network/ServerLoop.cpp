@@ -0,0 +1,548 @@
+#include "ServerLoop.h"
+#include "WireCapture.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+// A client whose unsent output grows beyond this is not reading; drop it
+// rather than buffer without bound
+static const size_t kMaxQueuedBytes = 8 * 1024 * 1024;
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+static void SetNonBlocking(int socket)
+{
+    int flags = fcntl(socket, F_GETFL, 0);
+    if (flags >= 0)
+        fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+}
+
+ServerLoop::ServerLoop(ServerLoopListener* listener)
+    : fListener(listener),
+      fListenSocket(-1),
+      fPort(0),
+      fRunning(false),
+      fPulseInterval(250000),
+      fRecorder(nullptr),
+      fReceiveTime(0),
+      fNextClientId(1)
+{
+    if (pipe(fWakePipe) == 0) {
+        SetNonBlocking(fWakePipe[0]);
+        SetNonBlocking(fWakePipe[1]);
+    } else {
+        fWakePipe[0] = fWakePipe[1] = -1;
+    }
+}
+
+ServerLoop::~ServerLoop()
+{
+    for (std::map<int32, Client*>::iterator it = fClients.begin();
+            it != fClients.end(); ++it) {
+        close(it->second->socket);
+        delete it->second;
+    }
+
+    if (fListenSocket >= 0)
+        close(fListenSocket);
+    if (fWakePipe[0] >= 0) {
+        close(fWakePipe[0]);
+        close(fWakePipe[1]);
+    }
+}
+
+status_t ServerLoop::Listen(uint16 port, int backlog)
+{
+    if (fWakePipe[0] < 0)
+        return B_ERROR;
+
+    fListenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (fListenSocket < 0)
+        return B_ERROR;
+
+    int opt = 1;
+    setsockopt(fListenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+
+    if (bind(fListenSocket, (struct sockaddr*)&addr, sizeof(addr)) < 0
+        || listen(fListenSocket, backlog) < 0) {
+        close(fListenSocket);
+        fListenSocket = -1;
+        return B_ERROR;
+    }
+
+    // Report the real port when asked for an ephemeral one
+    socklen_t addrLength = sizeof(addr);
+    if (getsockname(fListenSocket, (struct sockaddr*)&addr, &addrLength) == 0)
+        fPort = ntohs(addr.sin_port);
+    else
+        fPort = port;
+
+    SetNonBlocking(fListenSocket);
+    return B_OK;
+}
+
+void ServerLoop::Run()
+{
+    fRunning = true;
+
+    std::vector<struct pollfd> fds;
+    std::vector<Client*> polled;
+    bigtime_t nextPulse = Now() + fPulseInterval;
+
+    while (fRunning) {
+        bigtime_t now = Now();
+        bigtime_t wakeAt = nextPulse;
+
+        // Slots 0 and 1 are the wake pipe and the listening socket
+        fds.clear();
+        polled.clear();
+        struct pollfd pfd;
+        pfd.fd = fWakePipe[0];
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        fds.push_back(pfd);
+        pfd.fd = fListenSocket;
+        fds.push_back(pfd);
+
+        {
+            std::lock_guard<std::mutex> lock(fLock);
+            for (std::map<int32, Client*>::iterator it = fClients.begin();
+                    it != fClients.end(); ++it) {
+                Client* client = it->second;
+                if (client->closeReason != nullptr)
+                    continue;
+
+                pfd.fd = client->socket;
+                pfd.events = POLLIN;
+                if (client->connecting || !client->out.IsEmpty())
+                    pfd.events |= POLLOUT;
+                fds.push_back(pfd);
+                polled.push_back(client);
+
+                if (client->idleTimeout > 0
+                    && client->lastReceive + client->idleTimeout < wakeAt)
+                    wakeAt = client->lastReceive + client->idleTimeout;
+            }
+        }
+
+        int timeout = wakeAt > now ? (int)((wakeAt - now + 999) / 1000) : 0;
+        int ready = poll(fds.data(), fds.size(), timeout);
+        if (ready < 0 && errno != EINTR)
+            break;
+
+        if (ready > 0) {
+            if (fds[0].revents != 0) {
+                char drain[64];
+                while (read(fWakePipe[0], drain, sizeof(drain)) > 0)
+                    ;
+            }
+
+            if (fds[1].revents != 0)
+                Accept();
+
+            for (size_t i = 2; i < fds.size(); i++) {
+                short revents = fds[i].revents;
+                if (revents == 0)
+                    continue;
+
+                Client* client = polled[i - 2];
+                if (client->connecting) {
+                    FinishConnect(client);
+                    continue;
+                }
+                if ((revents & POLLOUT) != 0) {
+                    std::lock_guard<std::mutex> lock(fLock);
+                    Flush(client);
+                }
+                if ((revents & (POLLIN | POLLHUP | POLLERR)) != 0)
+                    Receive(client);
+            }
+        }
+
+        now = Now();
+        CheckIdle(now);
+        CloseMarked();
+
+        if (now >= nextPulse) {
+            fListener->Pulse(now);
+            // On a steady cadence, unless it fell a whole interval behind
+            nextPulse += fPulseInterval;
+            if (nextPulse <= now)
+                nextPulse = now + fPulseInterval;
+        }
+    }
+
+    // Hand every remaining client to the listener one last time
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+        for (std::map<int32, Client*>::iterator it = fClients.begin();
+                it != fClients.end(); ++it) {
+            if (it->second->closeReason == nullptr)
+                it->second->closeReason = "server stopped";
+        }
+    }
+    CloseMarked();
+}
+
+void ServerLoop::Quit()
+{
+    fRunning = false;
+    Wake();
+}
+
+int32 ServerLoop::Connect(const struct sockaddr_in& address)
+{
+    int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (socket < 0)
+        return -1;
+
+    SetNonBlocking(socket);
+    int opt = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    if (connect(socket, (const struct sockaddr*)&address, sizeof(address)) < 0
+        && errno != EINPROGRESS) {
+        close(socket);
+        return -1;
+    }
+
+    // Even an immediate success is reported from the loop, so the caller
+    // always has the id before ClientConnected()
+    char name[64];
+    snprintf(name, sizeof(name), "%s:%d", inet_ntoa(address.sin_addr),
+        ntohs(address.sin_port));
+    Client* client = AddClient(socket, name, true);
+    Wake();
+    return client->id;
+}
+
+status_t ServerLoop::Send(int32 clientId, const void* data, size_t length,
+    SendPriority priority)
+{
+    std::lock_guard<std::mutex> lock(fLock);
+
+    Client* client = FindLocked(clientId);
+    if (client == nullptr || client->closeReason != nullptr)
+        return B_ERROR;
+
+    const uint8* bytes = (const uint8*)data;
+
+    // Fast path: input with nothing queued, write straight to the socket
+    if (priority == SEND_INPUT && !client->connecting && client->out.IsEmpty()) {
+        ssize_t sent = send(client->socket, bytes, length, kSendFlags);
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                client->closeReason = "send failed";
+                Wake();
+                return B_ERROR;
+            }
+            sent = 0;
+        }
+        if ((size_t)sent == length)
+            return B_OK;
+
+        bytes += sent;
+        length -= sent;
+    }
+
+    if (client->out.QueuedBytes() + length > kMaxQueuedBytes) {
+        client->closeReason = "write queue overflow";
+        Wake();
+        return B_ERROR;
+    }
+
+    // Bulk goes through the scheduler even when the socket is idle, so it
+    // is only ever on the wire in fragments input can get between
+    client->out.Enqueue(bytes, length, priority);
+    if (!client->connecting)
+        Flush(client);
+    if (!client->out.IsEmpty())
+        Wake();     // poll for POLLOUT
+    return B_OK;
+}
+
+void ServerLoop::SetFragmenting(int32 clientId, bool fragmenting)
+{
+    std::lock_guard<std::mutex> lock(fLock);
+
+    Client* client = FindLocked(clientId);
+    if (client != nullptr)
+        client->out.SetFragmenting(fragmenting);
+}
+
+void ServerLoop::Disconnect(int32 clientId)
+{
+    std::lock_guard<std::mutex> lock(fLock);
+
+    Client* client = FindLocked(clientId);
+    if (client != nullptr && client->closeReason == nullptr) {
+        client->closeReason = "disconnected by server";
+        Wake();
+    }
+}
+
+void ServerLoop::SetIdleTimeout(int32 clientId, bigtime_t timeout)
+{
+    std::lock_guard<std::mutex> lock(fLock);
+
+    Client* client = FindLocked(clientId);
+    if (client != nullptr)
+        client->idleTimeout = timeout;
+}
+
+int32 ServerLoop::CountClients()
+{
+    std::lock_guard<std::mutex> lock(fLock);
+    return (int32)fClients.size();
+}
+
+size_t ServerLoop::QueuedBytes(int32 clientId)
+{
+    std::lock_guard<std::mutex> lock(fLock);
+
+    Client* client = FindLocked(clientId);
+    if (client == nullptr)
+        return 0;
+    return client->out.QueuedBytes();
+}
+
+size_t ServerLoop::BufferedBytes(int32 clientId)
+{
+    std::lock_guard<std::mutex> lock(fLock);
+
+    Client* client = FindLocked(clientId);
+    if (client == nullptr)
+        return 0;
+    return client->framer.Buffered();
+}
+
+bigtime_t ServerLoop::Now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (bigtime_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+status_t ServerLoop::Resolve(const char* host, uint16 port,
+    struct sockaddr_in* address)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* result;
+    if (getaddrinfo(host, nullptr, &hints, &result) != 0)
+        return B_NAME_NOT_FOUND;
+
+    memcpy(address, result->ai_addr, sizeof(*address));
+    address->sin_port = htons(port);
+    freeaddrinfo(result);
+    return B_OK;
+}
+
+void ServerLoop::Accept()
+{
+    while (true) {
+        struct sockaddr_in addr;
+        socklen_t addrLength = sizeof(addr);
+        int socket = accept(fListenSocket, (struct sockaddr*)&addr,
+            &addrLength);
+        if (socket < 0)
+            return;     // EAGAIN once the backlog is drained
+
+        SetNonBlocking(socket);
+        int opt = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        char address[64];
+        snprintf(address, sizeof(address), "%s:%d",
+            inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+        Client* client = AddClient(socket, address, false);
+        if (fRecorder != nullptr) {
+            fRecorder->RecordConnect(client->lastReceive, client->id,
+                client->address, false);
+        }
+        fListener->ClientConnected(client->id, socket, client->address);
+    }
+}
+
+ServerLoop::Client* ServerLoop::AddClient(int socket, const char* address,
+    bool connecting)
+{
+    Client* client = new Client;
+    client->socket = socket;
+    client->lastReceive = Now();
+    client->idleTimeout = 0;
+    client->closeReason = nullptr;
+    client->connecting = connecting;
+    strncpy(client->address, address, sizeof(client->address) - 1);
+    client->address[sizeof(client->address) - 1] = '\0';
+
+    std::lock_guard<std::mutex> lock(fLock);
+    client->id = fNextClientId++;
+    fClients[client->id] = client;
+    return client;
+}
+
+void ServerLoop::FinishConnect(Client* client)
+{
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(client->socket, SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+        error = errno;
+
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+        if (error != 0) {
+            if (client->closeReason == nullptr)
+                client->closeReason = "connect failed";
+            return;
+        }
+
+        // Whatever was sent while connecting goes out now
+        client->connecting = false;
+        client->lastReceive = Now();
+        Flush(client);
+    }
+
+    if (fRecorder != nullptr) {
+        fRecorder->RecordConnect(client->lastReceive, client->id,
+            client->address, true);
+    }
+    fListener->ClientConnected(client->id, client->socket, client->address);
+}
+
+void ServerLoop::Receive(Client* client)
+{
+    size_t available;
+    uint8* buffer = client->framer.ReceiveBuffer(&available);
+
+    ssize_t bytesRead = recv(client->socket, buffer, available, 0);
+    if (bytesRead < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return;
+    }
+    if (bytesRead <= 0) {
+        std::lock_guard<std::mutex> lock(fLock);
+        if (client->closeReason == nullptr)
+            client->closeReason = bytesRead == 0 ? "closed by peer" : "receive failed";
+        return;
+    }
+
+    client->lastReceive = Now();
+    fReceiveTime = client->lastReceive;
+    if (fRecorder != nullptr) {
+        fRecorder->RecordData(client->lastReceive, client->id, buffer,
+            bytesRead);
+    }
+    client->framer.Received(bytesRead);
+
+    const uint8* message;
+    size_t length;
+    FrameResult result;
+    while ((result = client->framer.NextMessage(&message, &length))
+            == FRAME_MESSAGE) {
+        fListener->MessageReceived(client->id, message, length);
+    }
+    fListener->ReceiveDone(client->id);
+
+    if (result == FRAME_TOO_LARGE) {
+        std::lock_guard<std::mutex> lock(fLock);
+        if (client->closeReason == nullptr)
+            client->closeReason = "message too large";
+    }
+}
+
+void ServerLoop::Flush(Client* client)
+{
+    const uint8* data;
+    size_t length;
+    while ((data = client->out.Peek(&length)) != nullptr) {
+        ssize_t sent = send(client->socket, data, length, kSendFlags);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK
+                && client->closeReason == nullptr)
+                client->closeReason = "send failed";
+            return;
+        }
+        client->out.Consume(sent);
+    }
+}
+
+void ServerLoop::CloseMarked()
+{
+    std::vector<Client*> closing;
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+        std::map<int32, Client*>::iterator it = fClients.begin();
+        while (it != fClients.end()) {
+            Client* client = it->second;
+            if (client->closeReason == nullptr) {
+                ++it;
+                continue;
+            }
+
+            // Best effort: a final message (e.g. a control switch) queued
+            // right before the disconnect should still go out
+            Flush(client);
+            closing.push_back(client);
+            fClients.erase(it++);
+        }
+    }
+
+    for (size_t i = 0; i < closing.size(); i++) {
+        Client* client = closing[i];
+        close(client->socket);
+        if (fRecorder != nullptr)
+            fRecorder->RecordDisconnect(Now(), client->id, client->closeReason);
+        fListener->ClientDisconnected(client->id, client->closeReason);
+        delete client;
+    }
+}
+
+void ServerLoop::CheckIdle(bigtime_t now)
+{
+    std::lock_guard<std::mutex> lock(fLock);
+    for (std::map<int32, Client*>::iterator it = fClients.begin();
+            it != fClients.end(); ++it) {
+        Client* client = it->second;
+        if (client->closeReason == nullptr && client->idleTimeout > 0
+            && now - client->lastReceive >= client->idleTimeout)
+            client->closeReason = "idle timeout";
+    }
+}
+
+void ServerLoop::Wake()
+{
+    char byte = 0;
+    write(fWakePipe[1], &byte, 1);
+}
+
+ServerLoop::Client* ServerLoop::FindLocked(int32 clientId)
+{
+    std::map<int32, Client*>::iterator it = fClients.find(clientId);
+    return it != fClients.end() ? it->second : nullptr;
+}
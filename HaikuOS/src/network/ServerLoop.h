@@ -0,0 +1,130 @@
+#ifndef SERVER_LOOP_H
+#define SERVER_LOOP_H
+
+#include <SupportDefs.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "MessageFramer.h"
+#include "SendScheduler.h"
+
+class WireRecorder;
+struct sockaddr_in;
+
+// Callbacks from ServerLoop, all made on the loop thread. They may call
+// back into the loop (Send(), Disconnect(), ...).
+class ServerLoopListener {
+public:
+    virtual ~ServerLoopListener() {}
+
+    // socket is handed out for socket options only; the loop owns it.
+    // Also called once an outgoing Connect() completes.
+    virtual void ClientConnected(int32 client, int socket,
+        const char* address) = 0;
+    virtual void MessageReceived(int32 client, const uint8* message,
+        size_t length) = 0;
+    virtual void ClientDisconnected(int32 client, const char* reason) = 0;
+    // After the messages of one read were handed out; what is left waits
+    // for the next read
+    virtual void ReceiveDone(int32 client) {}
+
+    // Roughly once per pulse interval, for timers of the listener
+    virtual void Pulse(bigtime_t now) {}
+};
+
+// Single-threaded poll() loop owning the listening socket and every
+// client socket. Each client has its own framing state and write queue,
+// so a slow reader, a new connection or a large message never holds up
+// the others. Only POSIX and std C++, so it can be driven off-target.
+class ServerLoop {
+public:
+    ServerLoop(ServerLoopListener* listener);
+    ~ServerLoop();
+
+    status_t Listen(uint16 port, int backlog);
+    uint16 Port() const { return fPort; }
+
+    // Runs until Quit(); closes all clients on the way out
+    void Run();
+    void Quit();
+
+    // The calls below are safe from any thread
+
+    // Opens an outgoing connection that is then served like any accepted
+    // client. Returns its id right away, or -1; a failed attempt ends in
+    // ClientDisconnected(). Never blocks, the address comes from Resolve().
+    int32 Connect(const struct sockaddr_in& address);
+
+    // Writes what the socket takes now and queues the rest for the loop.
+    // Queued input goes out before queued bulk messages.
+    status_t Send(int32 client, const void* data, size_t length,
+        SendPriority priority = SEND_INPUT);
+    // Whether bulk messages to client may go as BULK_FRAGMENTs
+    void SetFragmenting(int32 client, bool fragmenting);
+    void Disconnect(int32 client);
+
+    // Drops a client that sends nothing for this long; 0 disables
+    void SetIdleTimeout(int32 client, bigtime_t timeout);
+    void SetPulseInterval(bigtime_t interval) { fPulseInterval = interval; }
+    // Gets every client's received bytes, connects and disconnects while
+    // it is open. Set before Run().
+    void SetRecorder(WireRecorder* recorder) { fRecorder = recorder; }
+
+    int32 CountClients();
+    size_t QueuedBytes(int32 client);
+
+    // Received but not yet framed; loop thread only
+    size_t BufferedBytes(int32 client);
+    // When the message MessageReceived() is handing out was read from the
+    // socket; loop thread only
+    bigtime_t ReceiveTime() const { return fReceiveTime; }
+
+    static bigtime_t Now();     // monotonic microseconds
+
+    // Looks up host's IPv4 address. Blocks for as long as the name
+    // service takes, so never call it on the loop thread.
+    static status_t Resolve(const char* host, uint16 port,
+        struct sockaddr_in* address);
+
+private:
+    struct Client {
+        int32 id;
+        int socket;
+        MessageFramer framer;
+        SendScheduler out;
+        bigtime_t lastReceive;
+        bigtime_t idleTimeout;
+        const char* closeReason;    // set once the client is to be closed
+        bool connecting;            // outgoing, connect() still in progress
+        char address[64];
+    };
+
+    void Accept();
+    Client* AddClient(int socket, const char* address, bool connecting);
+    void FinishConnect(Client* client);
+    void Receive(Client* client);
+    void Flush(Client* client);
+    void CloseMarked();
+    void CheckIdle(bigtime_t now);
+    void Wake();
+    Client* FindLocked(int32 client);
+
+    ServerLoopListener* fListener;
+    int fListenSocket;
+    uint16 fPort;
+    int fWakePipe[2];
+    volatile bool fRunning;
+    bigtime_t fPulseInterval;
+    WireRecorder* fRecorder;
+    bigtime_t fReceiveTime;
+
+    // Guards the client table and write queues. Never held across a
+    // listener callback.
+    std::mutex fLock;
+    std::map<int32, Client*> fClients;
+    int32 fNextClientId;
+};
+
+#endif // SERVER_LOOP_H
@@ -0,0 +1,313 @@
+#include "WireCapture.h"
+
+#include <time.h>
+#include <chrono>
+#include <cstring>
+
+static const char kMagic[4] = { 'S', 'K', 'W', 'R' };
+static const size_t kHeaderSize = 8;
+
+// Wakes the writer early instead of waiting for its next round
+static const size_t kWriteThreshold = 64 * 1024;
+// The writer fell this far behind: the disk is stuck, stop capturing
+// rather than grow without bound
+static const size_t kMaxPending = 16 * 1024 * 1024;
+// How long records may sit in memory, i.e. what a crash can lose
+static const int kWriteIntervalMs = 250;
+// Nothing the server takes in comes close to this
+static const uint64 kMaxRecordLength = 64 * 1024 * 1024;
+
+static void AppendVarint(std::vector<uint8>& out, uint64 value)
+{
+    while (value >= 0x80) {
+        out.push_back((uint8)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8)value);
+}
+
+static void AppendInt64(std::vector<uint8>& out, int64 value)
+{
+    for (int i = 0; i < 8; i++)
+        out.push_back((uint8)((uint64)value >> (i * 8)));
+}
+
+static int64 ReadInt64(const uint8* data)
+{
+    uint64 value = 0;
+    for (int i = 7; i >= 0; i--)
+        value = (value << 8) | data[i];
+    return (int64)value;
+}
+
+static bigtime_t ClockNow(clockid_t clock)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (bigtime_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+WireRecorder::WireRecorder()
+    : fOpen(false),
+      fOverflowed(false),
+      fLastTime(0),
+      fQuitting(false),
+      fFile(nullptr)
+{
+}
+
+WireRecorder::~WireRecorder()
+{
+    Close();
+}
+
+status_t WireRecorder::Open(const char* path)
+{
+    Close();
+
+    FILE* file = fopen(path, "a+b");
+    if (file == nullptr)
+        return B_FILE_ERROR;
+
+    // Append only to a capture, never to whatever else is there
+    uint8 header[kHeaderSize];
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0) {
+        memset(header, 0, sizeof(header));
+        memcpy(header, kMagic, sizeof(kMagic));
+        header[4] = WIRE_CAPTURE_VERSION;
+        if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+            fclose(file);
+            return B_IO_ERROR;
+        }
+    } else {
+        rewind(file);
+        if (fread(header, 1, sizeof(header), file) != sizeof(header)
+            || memcmp(header, kMagic, sizeof(kMagic)) != 0
+            || header[4] != WIRE_CAPTURE_VERSION) {
+            fclose(file);
+            return B_BAD_DATA;
+        }
+        fseek(file, 0, SEEK_END);
+    }
+
+    bigtime_t now = ClockNow(CLOCK_MONOTONIC);
+    std::vector<uint8> session;
+    AppendInt64(session, now);
+    AppendInt64(session, ClockNow(CLOCK_REALTIME));
+
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+        fFile = file;
+        fPending.clear();
+        fQuitting = false;
+        fLastTime = now;
+        fOpen = true;
+    }
+    Append(WIRE_SESSION, now, 0, session.data(), session.size());
+
+    fThread = std::thread(&WireRecorder::Run, this);
+    return B_OK;
+}
+
+void WireRecorder::Close()
+{
+    if (!fThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+        fOpen = false;
+        fQuitting = true;
+    }
+    fCondition.notify_one();
+    fThread.join();
+
+    fclose(fFile);
+    fFile = nullptr;
+    fOverflowed = false;
+}
+
+void WireRecorder::RecordConnect(bigtime_t when, int32 client,
+    const char* address, bool outgoing)
+{
+    if (IsOpen()) {
+        Append(outgoing ? WIRE_CONNECT_OUT : WIRE_CONNECT, when, client,
+            address, strlen(address));
+    }
+}
+
+void WireRecorder::RecordData(bigtime_t when, int32 client,
+    const uint8* data, size_t length)
+{
+    if (IsOpen())
+        Append(WIRE_DATA, when, client, data, length);
+}
+
+void WireRecorder::RecordDisconnect(bigtime_t when, int32 client,
+    const char* reason)
+{
+    if (IsOpen())
+        Append(WIRE_DISCONNECT, when, client, reason, strlen(reason));
+}
+
+void WireRecorder::Append(uint8 type, bigtime_t when, int32 client,
+    const void* data, size_t length)
+{
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+        if (!fOpen)
+            return;
+
+        if (fPending.size() + length > kMaxPending) {
+            fOverflowed = true;
+            fOpen = false;
+            wake = true;
+        } else {
+            // Clients record from the loop thread, Open() from another;
+            // keep the deltas from going negative between the two
+            bigtime_t delta = when > fLastTime ? when - fLastTime : 0;
+            fLastTime += delta;
+
+            size_t before = fPending.size();
+            fPending.push_back(type);
+            AppendVarint(fPending, (uint64)delta);
+            AppendVarint(fPending, (uint64)(uint32)client);
+            AppendVarint(fPending, length);
+            fPending.insert(fPending.end(), (const uint8*)data,
+                (const uint8*)data + length);
+            wake = before < kWriteThreshold
+                && fPending.size() >= kWriteThreshold;
+        }
+    }
+    if (wake)
+        fCondition.notify_one();
+}
+
+void WireRecorder::Run()
+{
+    std::vector<uint8> writing;
+    std::unique_lock<std::mutex> lock(fLock);
+    for (;;) {
+        fCondition.wait_for(lock, std::chrono::milliseconds(kWriteIntervalMs),
+            [this] {
+                return fQuitting || !fOpen
+                    || fPending.size() >= kWriteThreshold;
+            });
+
+        bool done = fQuitting || !fOpen;
+        writing.swap(fPending);
+        lock.unlock();
+
+        if (!writing.empty()) {
+            fwrite(writing.data(), 1, writing.size(), fFile);
+            fflush(fFile);
+            writing.clear();
+        }
+
+        lock.lock();
+        if (done && fPending.empty())
+            break;
+    }
+}
+
+
+WireReader::WireReader()
+    : fFile(nullptr),
+      fTime(0)
+{
+}
+
+WireReader::~WireReader()
+{
+    Close();
+}
+
+status_t WireReader::Open(const char* path)
+{
+    Close();
+
+    fFile = fopen(path, "rb");
+    if (fFile == nullptr)
+        return B_ENTRY_NOT_FOUND;
+
+    uint8 header[kHeaderSize];
+    if (fread(header, 1, sizeof(header), fFile) != sizeof(header)
+        || memcmp(header, kMagic, sizeof(kMagic)) != 0
+        || header[4] != WIRE_CAPTURE_VERSION) {
+        Close();
+        return B_BAD_DATA;
+    }
+
+    fTime = 0;
+    return B_OK;
+}
+
+void WireReader::Close()
+{
+    if (fFile != nullptr) {
+        fclose(fFile);
+        fFile = nullptr;
+    }
+}
+
+status_t WireReader::Next(WireRecord* record, bigtime_t* wallTime)
+{
+    if (fFile == nullptr)
+        return B_ENTRY_NOT_FOUND;
+
+    int type = fgetc(fFile);
+    if (type == EOF)
+        return B_ENTRY_NOT_FOUND;
+
+    uint64 delta;
+    uint64 client;
+    uint64 length;
+    if (type < WIRE_SESSION || type > WIRE_DISCONNECT
+        || !ReadVarint(&delta) || !ReadVarint(&client)
+        || !ReadVarint(&length) || length > kMaxRecordLength) {
+        Close();
+        return B_BAD_DATA;
+    }
+
+    fData.resize(length);
+    if (length > 0 && fread(fData.data(), 1, length, fFile) != length) {
+        Close();
+        return B_BAD_DATA;
+    }
+
+    if (type == WIRE_SESSION) {
+        // A new server run: the deltas start over from its clock
+        if (length < 16) {
+            Close();
+            return B_BAD_DATA;
+        }
+        fTime = ReadInt64(fData.data());
+        if (wallTime != nullptr)
+            *wallTime = ReadInt64(fData.data() + 8);
+    } else
+        fTime += (bigtime_t)delta;
+
+    record->type = (uint8)type;
+    record->when = fTime;
+    record->client = (int32)(uint32)client;
+    record->data = fData.data();
+    record->length = length;
+    return B_OK;
+}
+
+bool WireReader::ReadVarint(uint64* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(fFile);
+        if (byte == EOF)
+            return false;
+        *value |= (uint64)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,110 @@
+#ifndef WIRE_CAPTURE_H
+#define WIRE_CAPTURE_H
+
+#include <SupportDefs.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Captures of the raw byte stream the server receives, for replaying a
+// session later (tools/replay). The file starts with
+//
+//   "SKWR" uint8 version, 3 bytes zero
+//
+// and records are only ever appended after that:
+//
+//   uint8 type, varint µs since the previous record, varint client,
+//   varint length, length bytes
+//
+// Varints are LEB128. Every Open() starts with a WIRE_SESSION record, so
+// captures of several server runs can share a file; a crash loses at most
+// the tail, and a torn last record is reported as such.
+enum WireRecordType {
+    WIRE_SESSION = 1,       // int64 monotonic µs, int64 wall clock µs (LE)
+    WIRE_CONNECT,           // accepted; the peer's address
+    WIRE_CONNECT_OUT,       // outgoing, to a neighbour; its address
+    WIRE_DATA,              // as returned by one recv()
+    WIRE_DISCONNECT         // the reason
+};
+
+#define WIRE_CAPTURE_VERSION    1
+
+struct WireRecord {
+    uint8 type;             // WireRecordType
+    bigtime_t when;         // monotonic µs on the recording machine
+    int32 client;
+    const uint8* data;      // valid until the next WireReader::Next()
+    size_t length;
+};
+
+// Appends to a capture from the server loop. Records go into memory and
+// a thread of its own writes them out, so a slow disk never holds up the
+// input behind them. Record*() cost one relaxed load while closed. Safe
+// from any thread.
+class WireRecorder {
+public:
+    WireRecorder();
+    ~WireRecorder();
+
+    // Creates path, or appends to a capture already there. B_BAD_DATA if
+    // the file is something else.
+    status_t Open(const char* path);
+    // Writes out what is pending
+    void Close();
+    bool IsOpen() const { return fOpen.load(std::memory_order_relaxed); }
+
+    // Set once the writer fell too far behind and gave up; the capture
+    // ends there. Cleared by Close().
+    bool Overflowed() const { return fOverflowed; }
+
+    void RecordConnect(bigtime_t when, int32 client, const char* address,
+        bool outgoing);
+    void RecordData(bigtime_t when, int32 client, const uint8* data,
+        size_t length);
+    void RecordDisconnect(bigtime_t when, int32 client, const char* reason);
+
+private:
+    void Append(uint8 type, bigtime_t when, int32 client, const void* data,
+        size_t length);
+    void Run();
+
+    std::atomic<bool> fOpen;
+    std::atomic<bool> fOverflowed;
+
+    std::mutex fLock;
+    std::condition_variable fCondition;
+    std::vector<uint8> fPending;    // encoded, not yet written
+    bigtime_t fLastTime;
+    bool fQuitting;
+    FILE* fFile;                    // writer thread once it runs
+    std::thread fThread;
+};
+
+// Reads a capture back record by record
+class WireReader {
+public:
+    WireReader();
+    ~WireReader();
+
+    // B_BAD_DATA if path is not a capture
+    status_t Open(const char* path);
+    void Close();
+
+    // B_OK with the next record, B_ENTRY_NOT_FOUND at the end, B_BAD_DATA
+    // for a damaged or torn record (nothing after it is read). A
+    // WIRE_SESSION's wall clock time is returned in wallTime, if given.
+    status_t Next(WireRecord* record, bigtime_t* wallTime = nullptr);
+
+private:
+    bool ReadVarint(uint64* value);
+
+    FILE* fFile;
+    bigtime_t fTime;
+    std::vector<uint8> fData;
+};
+
+#endif // WIRE_CAPTURE_H
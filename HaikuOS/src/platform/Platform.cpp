@@ -0,0 +1,10 @@
+#include "Platform.h"
+
+#include <time.h>
+
+bigtime_t SystemClock::Now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (bigtime_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
@@ -0,0 +1,72 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <SupportDefs.h>
+
+// What the portable core (libsoftkm_core) needs from the system it runs
+// on. InputInjector implements these with BScreen, the input_server
+// add-on ports and set_mouse_position(); benchmarks and replay tools on
+// other systems plug in fakes.
+
+// Monotonic microseconds, system_time() on Haiku
+class Clock {
+public:
+    virtual ~Clock() {}
+
+    virtual bigtime_t Now() = 0;
+};
+
+// CLOCK_MONOTONIC, which is system_time() on Haiku
+class SystemClock : public Clock {
+public:
+    virtual bigtime_t Now();
+};
+
+class ScreenGeometry {
+public:
+    virtual ~ScreenGeometry() {}
+
+    // In pixels, e.g. 1920 x 1080
+    virtual void GetScreenSize(float* width, float* height) = 0;
+};
+
+// Where input ends up. Positions are in screen pixels, keys and modifiers
+// in Haiku's terms. eventStart is when the event was taken up, for the
+// injection latency histogram. Returns whether the event was delivered.
+class InjectionSink {
+public:
+    virtual ~InjectionSink() {}
+
+    virtual bool KeyDown(bigtime_t eventStart, uint32 key,
+        uint32 modifiers, const char* bytes, uint8 numBytes) = 0;
+    virtual bool KeyUp(bigtime_t eventStart, uint32 key,
+        uint32 modifiers) = 0;
+    virtual bool MouseMoved(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers) = 0;
+    virtual bool MouseDown(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers, uint32 clicks) = 0;
+    virtual bool MouseUp(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers) = 0;
+    virtual bool MouseWheel(bigtime_t eventStart, float deltaX,
+        float deltaY, uint32 modifiers) = 0;
+
+    // The system cursor itself, as opposed to the events applications see.
+    // GetCursor() returns false if the position is unknown.
+    virtual void SetCursor(float x, float y) = 0;
+    virtual bool GetCursor(float* x, float* y) = 0;
+};
+
+// The connections to the other machines, as far as input handling needs
+// them: handing control back to the client or on to a neighbour server.
+// NetworkServer implements it over its ServerLoop sockets.
+class PeerLink {
+public:
+    virtual ~PeerLink() {}
+
+    virtual bool HasNeighbour(uint8 edge) const = 0;
+    // direction: 0 = to Haiku, 1 = to Mac; yRatio: 0 = top, 1 = bottom
+    virtual void SendControlSwitch(uint8 direction, float yRatio) = 0;
+    virtual status_t ForwardControl(uint8 edge, float yRatio) = 0;
+};
+
+#endif // PLATFORM_H
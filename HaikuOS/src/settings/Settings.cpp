@@ -10,6 +10,31 @@
 // Default values
 uint16 Settings::sPort = 31337;  // leet!
 bool Settings::sAutoStart = false;
+uint16 Settings::sMetricsPort = 0;  // metrics endpoint disabled
+BString Settings::sMetricsSocketPath;
+BString Settings::sReceiveDirectory;  // the Desktop
+BString Settings::sCapturePath;  // no capture
+Topology Settings::sTopology;
+EdgeSwitchConfig Settings::sEdgeSwitch = EdgeSwitchPolicy::kDefaultConfig;
+PointerPacingConfig Settings::sPointerPacing = {
+    false,      // off: injected as it comes
+    4000,       // at least 4ms of buffer
+    30000,      // at most 30ms
+    0           // at the screen's refresh rate
+};
+MotionPredictionConfig Settings::sMotionPrediction = {
+    false,      // off: the pointer trails by the latency
+    100000,     // never more than 100ms ahead
+    48.0f       // nor more than 48px
+};
+PointerAccelerationConfig Settings::sPointerAcceleration = {
+    false,      // off: moves as the client sent them
+    1.0f,       // slow moves 1:1
+    1.0f,       // fast ones up to twice as far
+    400.0f,     // from 400 px/s
+    1600.0f,    // all of it from 1600 px/s
+    0           // scaled by the screens' widths
+};
 
 static const char* kSettingsFileName = "softKM_settings";
 
@@ -46,7 +71,81 @@ void Settings::Load()
         sAutoStart = autoStart;
     }
 
-    printf("Settings loaded: port=%d, autoStart=%d\n", sPort, sAutoStart);
+    uint16 metricsPort;
+    if (settings.FindUInt16("metricsPort", &metricsPort) == B_OK) {
+        sMetricsPort = metricsPort;
+    }
+
+    const char* metricsSocketPath;
+    if (settings.FindString("metricsSocketPath", &metricsSocketPath) == B_OK) {
+        sMetricsSocketPath = metricsSocketPath;
+    }
+
+    const char* receiveDirectory;
+    if (settings.FindString("receiveDirectory", &receiveDirectory) == B_OK)
+        sReceiveDirectory = receiveDirectory;
+
+    const char* capturePath;
+    if (settings.FindString("capturePath", &capturePath) == B_OK)
+        sCapturePath = capturePath;
+
+    float value;
+    if (settings.FindFloat("switchVelocity", &value) == B_OK)
+        sEdgeSwitch.pushThroughVelocity = value;
+    if (settings.FindFloat("switchOvershoot", &value) == B_OK)
+        sEdgeSwitch.overshootDistance = value;
+    if (settings.FindFloat("switchCornerSize", &value) == B_OK)
+        sEdgeSwitch.cornerSize = value;
+    uint32 bypassModifiers;
+    if (settings.FindUInt32("switchBypassModifiers", &bypassModifiers) == B_OK)
+        sEdgeSwitch.bypassModifiers = bypassModifiers;
+
+    bool pacing;
+    if (settings.FindBool("pointerPacing", &pacing) == B_OK)
+        sPointerPacing.enabled = pacing;
+    int64 delay;
+    if (settings.FindInt64("pacingMinDelay", &delay) == B_OK)
+        sPointerPacing.minDelay = delay;
+    if (settings.FindInt64("pacingMaxDelay", &delay) == B_OK)
+        sPointerPacing.maxDelay = delay;
+    if (settings.FindFloat("pacingRefreshRate", &value) == B_OK)
+        sPointerPacing.refreshRate = value;
+
+    bool prediction;
+    if (settings.FindBool("pointerPrediction", &prediction) == B_OK)
+        sMotionPrediction.enabled = prediction;
+    if (settings.FindInt64("predictionMaxLookahead", &delay) == B_OK)
+        sMotionPrediction.maxLookahead = delay;
+    if (settings.FindFloat("predictionMaxOffset", &value) == B_OK)
+        sMotionPrediction.maxOffset = value;
+
+    bool acceleration;
+    if (settings.FindBool("pointerAcceleration", &acceleration) == B_OK)
+        sPointerAcceleration.enabled = acceleration;
+    if (settings.FindFloat("pointerSensitivity", &value) == B_OK)
+        sPointerAcceleration.sensitivity = value;
+    if (settings.FindFloat("accelerationGain", &value) == B_OK)
+        sPointerAcceleration.acceleration = value;
+    if (settings.FindFloat("accelerationThreshold", &value) == B_OK)
+        sPointerAcceleration.threshold = value;
+    if (settings.FindFloat("accelerationFullSpeed", &value) == B_OK)
+        sPointerAcceleration.fullSpeed = value;
+    if (settings.FindFloat("pointerScale", &value) == B_OK)
+        sPointerAcceleration.scale = value;
+
+    // One entry per link in each of the link fields
+    sTopology.MakeEmpty();
+    const char* host;
+    for (int32 i = 0; settings.FindString("linkHost", i, &host) == B_OK; i++) {
+        uint8 edge;
+        const char* neighbour;
+        if (settings.FindUInt8("linkEdge", i, &edge) == B_OK
+            && settings.FindString("linkNeighbour", i, &neighbour) == B_OK)
+            sTopology.AddLink(host, edge, neighbour);
+    }
+
+    printf("Settings loaded: port=%d, autoStart=%d, metricsPort=%d\n", sPort,
+        sAutoStart, sMetricsPort);
 }
 
 void Settings::Save()
@@ -64,6 +163,41 @@ void Settings::Save()
     BMessage settings;
     settings.AddUInt16("port", sPort);
     settings.AddBool("autoStart", sAutoStart);
+    settings.AddUInt16("metricsPort", sMetricsPort);
+    settings.AddString("metricsSocketPath", sMetricsSocketPath);
+    settings.AddString("receiveDirectory", sReceiveDirectory);
+    settings.AddString("capturePath", sCapturePath);
+
+    settings.AddFloat("switchVelocity", sEdgeSwitch.pushThroughVelocity);
+    settings.AddFloat("switchOvershoot", sEdgeSwitch.overshootDistance);
+    settings.AddFloat("switchCornerSize", sEdgeSwitch.cornerSize);
+    settings.AddUInt32("switchBypassModifiers", sEdgeSwitch.bypassModifiers);
+
+    settings.AddBool("pointerPacing", sPointerPacing.enabled);
+    settings.AddInt64("pacingMinDelay", sPointerPacing.minDelay);
+    settings.AddInt64("pacingMaxDelay", sPointerPacing.maxDelay);
+    settings.AddFloat("pacingRefreshRate", sPointerPacing.refreshRate);
+
+    settings.AddBool("pointerPrediction", sMotionPrediction.enabled);
+    settings.AddInt64("predictionMaxLookahead",
+        sMotionPrediction.maxLookahead);
+    settings.AddFloat("predictionMaxOffset", sMotionPrediction.maxOffset);
+
+    settings.AddBool("pointerAcceleration", sPointerAcceleration.enabled);
+    settings.AddFloat("pointerSensitivity", sPointerAcceleration.sensitivity);
+    settings.AddFloat("accelerationGain", sPointerAcceleration.acceleration);
+    settings.AddFloat("accelerationThreshold",
+        sPointerAcceleration.threshold);
+    settings.AddFloat("accelerationFullSpeed",
+        sPointerAcceleration.fullSpeed);
+    settings.AddFloat("pointerScale", sPointerAcceleration.scale);
+
+    for (int32 i = 0; i < sTopology.CountLinks(); i++) {
+        const Topology::Link* link = sTopology.LinkAt(i);
+        settings.AddString("linkHost", link->host);
+        settings.AddUInt8("linkEdge", link->edge);
+        settings.AddString("linkNeighbour", link->neighbour);
+    }
 
     if (settings.Flatten(&file) != B_OK) {
         fprintf(stderr, "Failed to write settings\n");
@@ -1,8 +1,15 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
+#include <String.h>
 #include <SupportDefs.h>
 
+#include "Topology.h"
+#include "../input/EdgeSwitchPolicy.h"
+#include "../input/MotionPredictor.h"
+#include "../input/PointerAccelerator.h"
+#include "../input/PointerPacer.h"
+
 class Settings {
 public:
     static void Load();
@@ -14,9 +21,56 @@ public:
     static bool GetAutoStart() { return sAutoStart; }
     static void SetAutoStart(bool autoStart) { sAutoStart = autoStart; }
 
+    // Prometheus metrics endpoint: loopback TCP port (0 = off) and/or
+    // Unix domain socket path (empty = off)
+    static uint16 GetMetricsPort() { return sMetricsPort; }
+    static void SetMetricsPort(uint16 port) { sMetricsPort = port; }
+
+    static const char* GetMetricsSocketPath() { return sMetricsSocketPath.String(); }
+    static void SetMetricsSocketPath(const char* path) { sMetricsSocketPath = path; }
+
+    // Where files dragged over from a client go; empty = the Desktop
+    static const char* GetReceiveDirectory() { return sReceiveDirectory.String(); }
+    static void SetReceiveDirectory(const char* path) { sReceiveDirectory = path; }
+
+    // Where the server records its incoming stream, see
+    // NetworkServer::StartCapture(); empty = off
+    static const char* GetCapturePath() { return sCapturePath.String(); }
+    static void SetCapturePath(const char* path) { sCapturePath = path; }
+
+    // Neighbours beyond this and other hosts' edges; the server reads it
+    // when it starts
+    static Topology& GetTopology() { return sTopology; }
+
+    // When the pointer leaves over an edge; the dwell time itself comes
+    // from the client's settings sync
+    static EdgeSwitchConfig& GetEdgeSwitchConfig() { return sEdgeSwitch; }
+
+    // Smoothing of pointer motion at the cost of a few ms; the server
+    // reads it when it starts
+    static PointerPacingConfig& GetPointerPacing() { return sPointerPacing; }
+
+    // Running the pointer ahead by the link's latency; the server reads
+    // it when it starts
+    static MotionPredictionConfig& GetMotionPrediction()
+        { return sMotionPrediction; }
+
+    // Gain curve and scale of the client's moves; read at startup
+    static PointerAccelerationConfig& GetPointerAcceleration()
+        { return sPointerAcceleration; }
+
 private:
     static uint16 sPort;
     static bool sAutoStart;
+    static uint16 sMetricsPort;
+    static BString sMetricsSocketPath;
+    static BString sReceiveDirectory;
+    static BString sCapturePath;
+    static Topology sTopology;
+    static EdgeSwitchConfig sEdgeSwitch;
+    static PointerPacingConfig sPointerPacing;
+    static MotionPredictionConfig sMotionPrediction;
+    static PointerAccelerationConfig sPointerAcceleration;
 };
 
 #endif // SETTINGS_H
@@ -0,0 +1,175 @@
+#include "Topology.h"
+#include "../network/Protocol.h"
+
+#include <unistd.h>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const char* kEdgeNames[] = { "right", "left", "top", "bottom" };
+
+Topology::Topology()
+    : fCount(0)
+{
+}
+
+status_t Topology::AddLink(const char* host, uint8 edge, const char* neighbour)
+{
+    if (host == nullptr || host[0] == '\0' || edge > EDGE_BOTTOM
+        || neighbour == nullptr || neighbour[0] == '\0'
+        || strlen(host) >= kMaxNameLength
+        || strlen(neighbour) >= kMaxAddressLength)
+        return B_BAD_VALUE;
+
+    Link* link = nullptr;
+    for (int32 i = 0; i < fCount; i++) {
+        if (fLinks[i].edge == edge && strcmp(fLinks[i].host, host) == 0) {
+            link = &fLinks[i];
+            break;
+        }
+    }
+
+    if (link == nullptr) {
+        if (fCount == kMaxLinks)
+            return B_NO_MEMORY;
+        link = &fLinks[fCount++];
+    }
+
+    strcpy(link->host, host);
+    link->edge = edge;
+    strcpy(link->neighbour, neighbour);
+    return B_OK;
+}
+
+void Topology::RemoveLinks(const char* host)
+{
+    int32 kept = 0;
+    for (int32 i = 0; i < fCount; i++) {
+        if (strcmp(fLinks[i].host, host) != 0)
+            fLinks[kept++] = fLinks[i];
+    }
+    fCount = kept;
+}
+
+const Topology::Link* Topology::LinkAt(int32 index) const
+{
+    if (index < 0 || index >= fCount)
+        return nullptr;
+    return &fLinks[index];
+}
+
+const char* Topology::NeighbourOf(const char* host, uint8 edge) const
+{
+    for (int32 i = 0; i < fCount; i++) {
+        if (fLinks[i].edge == edge && strcmp(fLinks[i].host, host) == 0)
+            return fLinks[i].neighbour;
+    }
+    return nullptr;
+}
+
+void Topology::FormatLinks(const char* host, char* buffer, size_t size) const
+{
+    if (size == 0)
+        return;
+
+    buffer[0] = '\0';
+    size_t used = 0;
+    for (int32 i = 0; i < fCount && used < size; i++) {
+        if (strcmp(fLinks[i].host, host) != 0)
+            continue;
+
+        int written = snprintf(buffer + used, size - used, "%s%s=%s",
+            used > 0 ? ", " : "", EdgeName(fLinks[i].edge),
+            fLinks[i].neighbour);
+        if (written < 0)
+            break;
+        used += written;
+    }
+}
+
+status_t Topology::ParseLinks(const char* host, const char* text)
+{
+    // Parse into a copy so a typo does not wipe the existing links
+    Topology parsed(*this);
+    parsed.RemoveLinks(host);
+
+    const char* cursor = text;
+    while (*cursor != '\0') {
+        while (*cursor == ',' || isspace((unsigned char)*cursor))
+            cursor++;
+        if (*cursor == '\0')
+            break;
+
+        const char* equals = strchr(cursor, '=');
+        if (equals == nullptr)
+            return B_BAD_VALUE;
+
+        int32 edge = -1;
+        for (int32 i = 0; i <= EDGE_BOTTOM; i++) {
+            size_t length = strlen(kEdgeNames[i]);
+            if ((size_t)(equals - cursor) == length
+                && strncmp(cursor, kEdgeNames[i], length) == 0)
+                edge = i;
+        }
+        if (edge < 0)
+            return B_BAD_VALUE;
+
+        const char* start = equals + 1;
+        const char* end = start;
+        while (*end != '\0' && *end != ',' && !isspace((unsigned char)*end))
+            end++;
+
+        char neighbour[kMaxAddressLength];
+        if (end == start || (size_t)(end - start) >= sizeof(neighbour))
+            return B_BAD_VALUE;
+        memcpy(neighbour, start, end - start);
+        neighbour[end - start] = '\0';
+
+        status_t result = parsed.AddLink(host, edge, neighbour);
+        if (result != B_OK)
+            return result;
+
+        cursor = end;
+    }
+
+    *this = parsed;
+    return B_OK;
+}
+
+const char* Topology::EdgeName(uint8 edge)
+{
+    return edge <= EDGE_BOTTOM ? kEdgeNames[edge] : "unknown";
+}
+
+status_t Topology::ParseAddress(const char* address, uint16 defaultPort,
+    char* host, size_t hostSize, uint16* port)
+{
+    const char* colon = strrchr(address, ':');
+    size_t hostLength = colon != nullptr ? (size_t)(colon - address)
+        : strlen(address);
+    if (hostLength == 0 || hostLength >= hostSize)
+        return B_BAD_VALUE;
+
+    memcpy(host, address, hostLength);
+    host[hostLength] = '\0';
+
+    *port = defaultPort;
+    if (colon != nullptr) {
+        char* end;
+        long value = strtol(colon + 1, &end, 10);
+        if (*end != '\0' || value <= 0 || value > 65535)
+            return B_BAD_VALUE;
+        *port = (uint16)value;
+    }
+    return B_OK;
+}
+
+status_t Topology::LocalHostName(char* buffer, size_t size)
+{
+    if (gethostname(buffer, size) != 0)
+        return B_ERROR;
+
+    buffer[size - 1] = '\0';
+    return B_OK;
+}
@@ -0,0 +1,54 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <SupportDefs.h>
+
+// Which machine sits beyond which screen edge of which host, e.g.
+// "haiku-a" right -> "haiku-b:31337". The table can be shared by every
+// machine in the row; each server only follows the links of its own host
+// name. Plain C++, no Be API dependencies.
+class Topology {
+public:
+    static const int32 kMaxLinks = 32;
+    static const size_t kMaxNameLength = 64;
+    static const size_t kMaxAddressLength = 128;
+
+    struct Link {
+        char host[kMaxNameLength];
+        uint8 edge;                         // SwitchEdge of host
+        char neighbour[kMaxAddressLength];  // "name[:port]"
+    };
+
+    Topology();
+
+    void MakeEmpty() { fCount = 0; }
+
+    // Replaces an existing link of host at that edge
+    status_t AddLink(const char* host, uint8 edge, const char* neighbour);
+    void RemoveLinks(const char* host);
+
+    int32 CountLinks() const { return fCount; }
+    const Link* LinkAt(int32 index) const;
+
+    // nullptr if host has nothing beyond that edge
+    const char* NeighbourOf(const char* host, uint8 edge) const;
+
+    // Links of one host as "right=haiku-b, bottom=haiku-c:31340"; Parse
+    // replaces all of host's links and leaves the table alone on error
+    void FormatLinks(const char* host, char* buffer, size_t size) const;
+    status_t ParseLinks(const char* host, const char* text);
+
+    static const char* EdgeName(uint8 edge);
+
+    // Splits "name[:port]", defaultPort if none is given
+    static status_t ParseAddress(const char* address, uint16 defaultPort,
+        char* host, size_t hostSize, uint16* port);
+
+    static status_t LocalHostName(char* buffer, size_t size);
+
+private:
+    Link fLinks[kMaxLinks];
+    int32 fCount;
+};
+
+#endif // TOPOLOGY_H
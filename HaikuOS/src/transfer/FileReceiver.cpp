@@ -0,0 +1,229 @@
+#include "FileReceiver.h"
+
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Saved in the state file beside a part file
+struct FileCheckpoint {
+    uint32 magic;
+    uint32 reserved;
+    uint64 size;
+    uint64 hash;
+    uint64 offset;          // bytes of the part file that are good
+    uint64 state;           // ContentHasher state at offset
+};
+
+static const uint32 kCheckpointMagic = 'SKpt';
+
+FileReceiver::FileReceiver()
+    : fFile(-1),
+      fStateFile(-1),
+      fTransferID(0),
+      fSize(0),
+      fHash(0),
+      fReceived(0),
+      fCheckpoint(0),
+      fHasher(0)
+{
+    fDirectory[0] = '\0';
+    fName[0] = '\0';
+    fPartPath[0] = '\0';
+    fStatePath[0] = '\0';
+}
+
+FileReceiver::~FileReceiver()
+{
+    Suspend();
+}
+
+status_t FileReceiver::Start(const char* directory, uint32 transferId,
+    const char* name, uint64 size, uint64 hash, uint64* offset)
+{
+    Suspend();
+
+    // Never let the sender pick the directory
+    size_t nameLength = strlen(name);
+    if (nameLength == 0 || nameLength >= sizeof(fName)
+        || strchr(name, '/') != nullptr || strcmp(name, ".") == 0
+        || strcmp(name, "..") == 0)
+        return B_BAD_VALUE;
+
+    // Part files are named after the content, so that the same file
+    // offered again finds what was received of it
+    if ((size_t)snprintf(fPartPath, sizeof(fPartPath),
+            "%s/.softkm-%016llx-%llx.part", directory, (unsigned long long)hash,
+            (unsigned long long)size) >= sizeof(fPartPath))
+        return B_NAME_TOO_LONG;
+    snprintf(fStatePath, sizeof(fStatePath), "%s/.softkm-%016llx-%llx.state",
+        directory, (unsigned long long)hash, (unsigned long long)size);
+
+    fFile = open(fPartPath, O_RDWR | O_CREAT, 0644);
+    if (fFile < 0)
+        return B_FROM_POSIX_ERROR(errno);
+    fStateFile = open(fStatePath, O_RDWR | O_CREAT, 0644);
+    if (fStateFile < 0) {
+        status_t error = B_FROM_POSIX_ERROR(errno);
+        Close();
+        return error;
+    }
+
+    fHasher = ContentHasher(size);
+    fReceived = 0;
+
+    FileCheckpoint checkpoint;
+    struct stat partStat;
+    if (pread(fStateFile, &checkpoint, sizeof(checkpoint), 0)
+            == (ssize_t)sizeof(checkpoint)
+        && checkpoint.magic == kCheckpointMagic && checkpoint.size == size
+        && checkpoint.hash == hash && checkpoint.offset <= size
+        && checkpoint.offset % 8 == 0 && fstat(fFile, &partStat) == 0
+        && (uint64)partStat.st_size >= checkpoint.offset) {
+        fHasher.Restore(checkpoint.offset, checkpoint.state);
+        fReceived = checkpoint.offset;
+    }
+
+    // Whatever is past the checkpoint may be incomplete; write it again
+    if (ftruncate(fFile, fReceived) != 0) {
+        status_t error = B_FROM_POSIX_ERROR(errno);
+        Close();
+        return error;
+    }
+
+    struct statvfs volume;
+    if (fstatvfs(fFile, &volume) == 0
+        && (uint64)volume.f_bavail * volume.f_frsize < size - fReceived) {
+        Close();
+        return B_DEVICE_FULL;
+    }
+
+    strlcpy(fDirectory, directory, sizeof(fDirectory));
+    strlcpy(fName, name, sizeof(fName));
+    fTransferID = transferId;
+    fSize = size;
+    fHash = hash;
+    fCheckpoint = fReceived;
+    *offset = fReceived;
+    return B_OK;
+}
+
+status_t FileReceiver::AddData(uint32 transferId, uint64 offset,
+    const void* data, size_t length)
+{
+    if (!IsActive() || transferId != fTransferID)
+        return B_BAD_VALUE;
+
+    if (offset != fReceived || length > fSize - fReceived) {
+        Suspend();
+        return B_BAD_VALUE;
+    }
+
+    const uint8* bytes = (const uint8*)data;
+    size_t written = 0;
+    while (written < length) {
+        ssize_t result = pwrite(fFile, bytes + written, length - written,
+            offset + written);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            status_t error = B_FROM_POSIX_ERROR(errno);
+            Suspend();
+            return error;
+        }
+        written += result;
+    }
+
+    fHasher.Update(data, length);
+    fReceived += length;
+
+    if (fReceived - fCheckpoint >= kCheckpointInterval && fReceived % 8 == 0)
+        Checkpoint();
+    return B_OK;
+}
+
+status_t FileReceiver::Finish(char* path, size_t pathSize)
+{
+    if (!IsComplete())
+        return B_BAD_VALUE;
+
+    bool intact = fHasher.Final() == fHash;
+    Close();
+    unlink(fStatePath);
+    if (!intact) {
+        unlink(fPartPath);
+        return B_BAD_DATA;
+    }
+
+    status_t status = FreePath(path, pathSize);
+    if (status != B_OK)
+        return status;
+    if (rename(fPartPath, path) != 0)
+        return B_FROM_POSIX_ERROR(errno);
+    return B_OK;
+}
+
+void FileReceiver::Suspend()
+{
+    if (!IsActive())
+        return;
+
+    if (fReceived > fCheckpoint && fReceived % 8 == 0)
+        Checkpoint();
+    Close();
+}
+
+void FileReceiver::Checkpoint()
+{
+    FileCheckpoint checkpoint;
+    checkpoint.magic = kCheckpointMagic;
+    checkpoint.reserved = 0;
+    checkpoint.size = fSize;
+    checkpoint.hash = fHash;
+    checkpoint.offset = fReceived;
+    checkpoint.state = fHasher.State();
+
+    // Not synced: after a crash, data missing below the checkpoint shows
+    // up as a checksum mismatch, and the file is sent again
+    if (pwrite(fStateFile, &checkpoint, sizeof(checkpoint), 0)
+            == (ssize_t)sizeof(checkpoint))
+        fCheckpoint = fReceived;
+}
+
+void FileReceiver::Close()
+{
+    if (fFile >= 0)
+        close(fFile);
+    if (fStateFile >= 0)
+        close(fStateFile);
+    fFile = -1;
+    fStateFile = -1;
+}
+
+status_t FileReceiver::FreePath(char* path, size_t pathSize) const
+{
+    // "name.ext", then "name 2.ext", "name 3.ext" and so on
+    const char* extension = strrchr(fName, '.');
+    if (extension == nullptr || extension == fName)
+        extension = fName + strlen(fName);
+    int baseLength = extension - fName;
+
+    struct stat entry;
+    for (int32 copy = 1; copy < 1000; copy++) {
+        int length;
+        if (copy == 1) {
+            length = snprintf(path, pathSize, "%s/%s", fDirectory, fName);
+        } else {
+            length = snprintf(path, pathSize, "%s/%.*s %ld%s", fDirectory,
+                baseLength, fName, (long)copy, extension);
+        }
+        if (length < 0 || (size_t)length >= pathSize)
+            return B_NAME_TOO_LONG;
+        if (lstat(path, &entry) != 0 && errno == ENOENT)
+            return B_OK;
+    }
+    return B_FILE_EXISTS;
+}
@@ -0,0 +1,66 @@
+#ifndef FILE_RECEIVER_H
+#define FILE_RECEIVER_H
+
+#include <SupportDefs.h>
+
+#include <limits.h>
+#include <stddef.h>
+
+#include "../clipboard/ContentHash.h"
+
+// Receiving end of a FILE_OFFER. Data is written straight into a hidden
+// part file in the destination directory as it arrives, so memory use does
+// not depend on the file size. Every kCheckpointInterval the offset and the
+// running checksum are saved beside it; an offer of the same content later
+// resumes from there instead of starting over. A complete file is checked
+// and renamed into place under a name that is not taken yet.
+// Plain C++ and POSIX, no Be API.
+class FileReceiver {
+public:
+    static const uint64 kCheckpointInterval = 8 * 1024 * 1024;
+
+    FileReceiver();
+    ~FileReceiver();
+
+    // Suspends a transfer still in progress. B_BAD_VALUE for a name that is
+    // not a plain file name, B_DEVICE_FULL if the rest will not fit; else
+    // *offset is where the sender is to continue.
+    status_t Start(const char* directory, uint32 transferId, const char* name,
+        uint64 size, uint64 hash, uint64* offset);
+
+    // Data has to come in order. On an error the transfer is suspended.
+    status_t AddData(uint32 transferId, uint64 offset, const void* data,
+        size_t length);
+
+    bool IsActive() const { return fFile >= 0; }
+    bool IsComplete() const { return IsActive() && fReceived == fSize; }
+    uint32 TransferID() const { return fTransferID; }
+    uint64 Received() const { return fReceived; }
+
+    // Checks the checksum and moves the file into place, returning its path.
+    // B_BAD_DATA on a mismatch; what was received is then thrown away.
+    status_t Finish(char* path, size_t pathSize);
+
+    // Saves how far it got and closes, to be resumed by a later Start()
+    void Suspend();
+
+private:
+    void Checkpoint();
+    void Close();
+    status_t FreePath(char* path, size_t pathSize) const;
+
+    int fFile;
+    int fStateFile;
+    uint32 fTransferID;
+    uint64 fSize;
+    uint64 fHash;
+    uint64 fReceived;
+    uint64 fCheckpoint;     // offset saved last
+    ContentHasher fHasher;
+    char fDirectory[PATH_MAX];
+    char fName[NAME_MAX + 1];
+    char fPartPath[PATH_MAX];
+    char fStatePath[PATH_MAX];
+};
+
+#endif // FILE_RECEIVER_H
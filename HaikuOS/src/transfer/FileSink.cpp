@@ -0,0 +1,208 @@
+#include "FileSink.h"
+#include "../network/Protocol.h"
+
+#include <cstring>
+
+// Acknowledging every FILE_DATA would double the messages for nothing
+static const uint64 kAcknowledgeInterval = FILE_TRANSFER_WINDOW / 4;
+// Room for acknowledgements still on their way to the sender
+static const size_t kMaxQueued = 2 * FILE_TRANSFER_WINDOW;
+
+FileSink::FileSink(FileSinkListener* listener)
+    : fListener(listener),
+      fClient(-1),
+      fAcknowledged(0),
+      fQueued(0),
+      fQuitting(false)
+{
+    fThread = std::thread(&FileSink::Run, this);
+}
+
+FileSink::~FileSink()
+{
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+        fQuitting = true;
+    }
+    fCondition.notify_one();
+    fThread.join();
+}
+
+void FileSink::Offer(int32 client, const char* directory, uint32 transferId,
+    const char* name, uint64 size, uint64 hash)
+{
+    Job job;
+    job.type = JOB_OFFER;
+    job.client = client;
+    job.transferId = transferId;
+    job.offset = size;
+    job.hash = hash;
+    job.directory = directory;
+    job.name = name;
+    Post(job);
+}
+
+status_t FileSink::Write(int32 client, uint32 transferId, uint64 offset,
+    const void* data, size_t length)
+{
+    Job job;
+    job.client = client;
+    job.transferId = transferId;
+    job.offset = offset;
+    job.hash = 0;
+
+    bool overrun;
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+        overrun = fQueued + length > kMaxQueued;
+    }
+    if (overrun) {
+        job.type = JOB_FAIL;
+        Post(job);
+        return B_NO_MEMORY;
+    }
+
+    job.type = JOB_DATA;
+    job.data.assign((const uint8*)data, (const uint8*)data + length);
+    Post(job);
+    return B_OK;
+}
+
+void FileSink::ClientGone(int32 client)
+{
+    Job job;
+    job.type = JOB_SUSPEND;
+    job.client = client;
+    job.transferId = 0;
+    job.offset = 0;
+    job.hash = 0;
+    Post(job);
+}
+
+size_t FileSink::QueuedBytes()
+{
+    std::lock_guard<std::mutex> lock(fLock);
+    return fQueued;
+}
+
+void FileSink::Post(Job& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(fLock);
+        fQueued += job.data.size();
+        fJobs.push_back(std::move(job));
+    }
+    fCondition.notify_one();
+}
+
+void FileSink::Run()
+{
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(fLock);
+            fCondition.wait(lock,
+                [this] { return fQuitting || !fJobs.empty(); });
+            if (fQuitting)
+                break;
+            job = std::move(fJobs.front());
+            fJobs.pop_front();
+            fQueued -= job.data.size();
+        }
+        Process(job);
+    }
+
+    // Data still queued is lost, the checkpoint says where to resume
+    fReceiver.Suspend();
+}
+
+void FileSink::Process(Job& job)
+{
+    switch (job.type) {
+        case JOB_OFFER:
+        {
+            if (fReceiver.IsActive() && fClient != job.client) {
+                fListener->FileAccepted(job.client, job.transferId,
+                    FILE_REFUSED, 0);
+                break;
+            }
+
+            uint64 offset = 0;
+            if (fReceiver.Start(job.directory.c_str(), job.transferId,
+                    job.name.c_str(), job.offset, job.hash, &offset) != B_OK) {
+                fClient = -1;
+                fListener->FileAccepted(job.client, job.transferId,
+                    FILE_REFUSED, 0);
+                break;
+            }
+
+            fClient = job.client;
+            fAcknowledged = offset;
+            fListener->FileAccepted(job.client, job.transferId, FILE_OK,
+                offset);
+
+            // Empty, or all of it was there from an earlier attempt
+            if (fReceiver.IsComplete())
+                Finish();
+            break;
+        }
+
+        case JOB_DATA:
+            // Data still in flight for a transfer that ended is dropped
+            if (job.client != fClient || !fReceiver.IsActive()
+                || job.transferId != fReceiver.TransferID())
+                break;
+
+            if (fReceiver.AddData(job.transferId, job.offset, job.data.data(),
+                    job.data.size()) != B_OK) {
+                fClient = -1;
+                fListener->FileDone(job.client, job.transferId, FILE_FAILED,
+                    nullptr);
+                break;
+            }
+
+            if (fReceiver.IsComplete()) {
+                Finish();
+            } else if (fReceiver.Received() - fAcknowledged
+                    >= kAcknowledgeInterval) {
+                fAcknowledged = fReceiver.Received();
+                fListener->FileAccepted(job.client, job.transferId, FILE_OK,
+                    fAcknowledged);
+            }
+            break;
+
+        case JOB_SUSPEND:
+            if (job.client == fClient) {
+                fReceiver.Suspend();
+                fClient = -1;
+            }
+            break;
+
+        case JOB_FAIL:
+            if (job.client == fClient && fReceiver.IsActive()
+                && job.transferId == fReceiver.TransferID()) {
+                fReceiver.Suspend();
+                fClient = -1;
+                fListener->FileDone(job.client, job.transferId, FILE_FAILED,
+                    nullptr);
+            }
+            break;
+    }
+}
+
+void FileSink::Finish()
+{
+    int32 client = fClient;
+    uint32 transferId = fReceiver.TransferID();
+    char path[PATH_MAX];
+    status_t status = fReceiver.Finish(path, sizeof(path));
+    fClient = -1;
+
+    uint8 result = FILE_FAILED;
+    if (status == B_OK)
+        result = FILE_OK;
+    else if (status == B_BAD_DATA)
+        result = FILE_CORRUPT;
+    fListener->FileDone(client, transferId, result,
+        status == B_OK ? path : nullptr);
+}
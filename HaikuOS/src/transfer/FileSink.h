@@ -0,0 +1,89 @@
+#ifndef FILE_SINK_H
+#define FILE_SINK_H
+
+#include <SupportDefs.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FileReceiver.h"
+
+// Replies from FileSink, made on its thread
+class FileSinkListener {
+public:
+    virtual ~FileSinkListener() {}
+
+    // status is a FileTransferStatus. Repeated with FILE_OK as the data is
+    // written; offset is then how far it got.
+    virtual void FileAccepted(int32 client, uint32 transferId, uint8 status,
+        uint64 offset) = 0;
+    // path is the file's final path, or nullptr unless status is FILE_OK
+    virtual void FileDone(int32 client, uint32 transferId, uint8 status,
+        const char* path) = 0;
+};
+
+// Runs a FileReceiver on a thread of its own: the server loop only copies
+// FILE_DATA into a queue, so a disk stalled in write-back never holds up
+// the input that arrives behind it. Offsets are acknowledged once written,
+// and a sender keeps to FILE_TRANSFER_WINDOW past them, which bounds the
+// queue. One transfer at a time; other clients' offers are refused
+// meanwhile. Only std C++ and POSIX, so it runs unchanged on Linux.
+class FileSink {
+public:
+    FileSink(FileSinkListener* listener);
+    ~FileSink();
+
+    void Offer(int32 client, const char* directory, uint32 transferId,
+        const char* name, uint64 size, uint64 hash);
+    // B_NO_MEMORY, failing the transfer, for a client far past its window
+    status_t Write(int32 client, uint32 transferId, uint64 offset,
+        const void* data, size_t length);
+    // Keeps what was received for when it offers the file again
+    void ClientGone(int32 client);
+
+    size_t QueuedBytes();
+
+private:
+    enum JobType {
+        JOB_OFFER,
+        JOB_DATA,
+        JOB_SUSPEND,
+        JOB_FAIL
+    };
+
+    struct Job {
+        JobType type;
+        int32 client;
+        uint32 transferId;
+        uint64 offset;              // or, for an offer, the size
+        uint64 hash;
+        std::string directory;
+        std::string name;
+        std::vector<uint8> data;
+    };
+
+    void Post(Job& job);
+    void Run();
+    void Process(Job& job);
+    void Finish();
+
+    FileSinkListener* fListener;
+
+    // Sink thread only
+    FileReceiver fReceiver;
+    int32 fClient;                  // sender of the current transfer
+    uint64 fAcknowledged;
+
+    std::mutex fLock;
+    std::condition_variable fCondition;
+    std::deque<Job> fJobs;
+    size_t fQueued;                 // data bytes in fJobs
+    bool fQuitting;
+    std::thread fThread;
+};
+
+#endif // FILE_SINK_H
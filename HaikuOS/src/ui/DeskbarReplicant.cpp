@@ -11,6 +11,7 @@
 #include <Resources.h>
 #include <File.h>
 
+#include <cstdio>
 #include <cstring>
 
 DeskbarReplicant::DeskbarReplicant(BRect frame, const char* name)
@@ -18,8 +19,17 @@ DeskbarReplicant::DeskbarReplicant(BRect frame, const char* name)
       fConnectedIcon(nullptr),
       fDisconnectedIcon(nullptr),
       fIsConnected(false),
+      fIsActive(false),
+      fLinkQuality(LINK_QUALITY_NONE),
+      fLogVisible(false),
       fDragger(nullptr),
-      fStatusPoller(nullptr)
+      fEventsPerSecond(0),
+      fRoundTripTime(0),
+      fInjectLatencyP99(0),
+      fDropped(0),
+      fMerged(0),
+      fRateHistoryIndex(0),
+      fRateHistoryCount(0)
 {
     Init();
 }
@@ -29,15 +39,23 @@ DeskbarReplicant::DeskbarReplicant(BMessage* archive)
       fConnectedIcon(nullptr),
       fDisconnectedIcon(nullptr),
       fIsConnected(false),
+      fIsActive(false),
+      fLinkQuality(LINK_QUALITY_NONE),
+      fLogVisible(false),
       fDragger(nullptr),
-      fStatusPoller(nullptr)
+      fEventsPerSecond(0),
+      fRoundTripTime(0),
+      fInjectLatencyP99(0),
+      fDropped(0),
+      fMerged(0),
+      fRateHistoryIndex(0),
+      fRateHistoryCount(0)
 {
     Init();
 }
 
 DeskbarReplicant::~DeskbarReplicant()
 {
-    delete fStatusPoller;
     delete fConnectedIcon;
     delete fDisconnectedIcon;
 }
@@ -45,6 +63,7 @@ DeskbarReplicant::~DeskbarReplicant()
 void DeskbarReplicant::Init()
 {
     CreateIcons();
+    UpdateToolTip();
 }
 
 void DeskbarReplicant::CreateIcons()
@@ -108,38 +127,27 @@ void DeskbarReplicant::AttachedToWindow()
 
     SetLowColor(ViewColor());
 
-    // Start polling for connection status every second
-    if (fStatusPoller == nullptr) {
-        BMessage pollMsg(MSG_POLL_STATUS);
-        fStatusPoller = new BMessageRunner(BMessenger(this),
-            &pollMsg, 1000000);  // 1 second interval
-    }
-
-    // Query status immediately
-    QueryConnectionStatus();
+    // The app pushes MSG_CONNECTION_STATUS to us whenever its state changes
+    SubscribeToStatus(true);
 }
 
 void DeskbarReplicant::DetachedFromWindow()
 {
-    delete fStatusPoller;
-    fStatusPoller = nullptr;
+    SubscribeToStatus(false);
 
     BView::DetachedFromWindow();
 }
 
-void DeskbarReplicant::QueryConnectionStatus()
+void DeskbarReplicant::SubscribeToStatus(bool subscribe)
 {
     BMessenger appMessenger("application/x-vnd.softKM");
-    if (appMessenger.IsValid()) {
-        BMessage query(MSG_QUERY_CONNECTION_STATUS);
-        BMessage reply;
-        if (appMessenger.SendMessage(&query, &reply, 500000, 500000) == B_OK) {
-            bool connected;
-            if (reply.FindBool("connected", &connected) == B_OK) {
-                SetConnected(connected);
-            }
-        }
-    }
+    if (!appMessenger.IsValid())
+        return;
+
+    // Asynchronous with zero timeout so the Deskbar thread never waits on us
+    BMessage request(subscribe ? MSG_SUBSCRIBE_STATUS : MSG_UNSUBSCRIBE_STATUS);
+    request.AddMessenger("target", BMessenger(this));
+    appMessenger.SendMessage(&request, (BHandler*)NULL, 0);
 }
 
 status_t DeskbarReplicant::Archive(BMessage* archive, bool deep) const
@@ -172,6 +180,30 @@ void DeskbarReplicant::Draw(BRect updateRect)
     if (icon != nullptr) {
         DrawBitmap(icon, BPoint(0, 0));
     }
+
+    if (!fIsConnected)
+        return;
+
+    // Link quality dot in the bottom right corner
+    rgb_color dotColor;
+    switch (fLinkQuality) {
+        case LINK_QUALITY_GOOD:
+            dotColor = make_color(0, 200, 60);
+            break;
+        case LINK_QUALITY_FAIR:
+            dotColor = make_color(240, 190, 0);
+            break;
+        default:
+            dotColor = make_color(220, 30, 30);
+            break;
+    }
+
+    BRect dot(11, 11, 15, 15);
+    SetDrawingMode(B_OP_COPY);
+    SetHighColor(dotColor);
+    FillEllipse(dot);
+    SetHighColor(make_color(40, 40, 40));
+    StrokeEllipse(dot);
 }
 
 void DeskbarReplicant::MouseDown(BPoint where)
@@ -208,19 +240,30 @@ void DeskbarReplicant::MouseDown(BPoint where)
 void DeskbarReplicant::MessageReceived(BMessage* message)
 {
     switch (message->what) {
-        case MSG_POLL_STATUS:
-            QueryConnectionStatus();
-            break;
-
         case MSG_CONNECTION_STATUS:
         {
-            bool connected;
-            if (message->FindBool("connected", &connected) == B_OK) {
-                SetConnected(connected);
-            }
+            bool value;
+            if (message->FindBool("active", &value) == B_OK)
+                fIsActive = value;
+            if (message->FindBool("logVisible", &value) == B_OK)
+                fLogVisible = value;
+
+            int32 quality;
+            if (message->FindInt32("quality", &quality) == B_OK)
+                fLinkQuality = quality;
+
+            if (message->FindBool("connected", &value) == B_OK)
+                SetConnected(value);
+
+            Invalidate();
+            UpdateToolTip();
             break;
         }
 
+        case MSG_METRICS_UPDATE:
+            UpdateMetrics(message);
+            break;
+
         case MSG_SHOW_SETTINGS:
         {
             BMessenger messenger("application/x-vnd.softKM");
@@ -267,32 +310,162 @@ void DeskbarReplicant::SetConnected(bool connected)
 {
     if (fIsConnected != connected) {
         fIsConnected = connected;
+        if (!connected) {
+            fRateHistoryCount = 0;
+            fRateHistoryIndex = 0;
+        }
         Invalidate();
+        UpdateToolTip();
     }
 }
 
+void DeskbarReplicant::UpdateMetrics(BMessage* message)
+{
+    message->FindFloat("eventsPerSecond", &fEventsPerSecond);
+    message->FindInt64("roundTripTime", &fRoundTripTime);
+    message->FindInt64("injectLatencyP99", &fInjectLatencyP99);
+    message->FindInt64("dropped", &fDropped);
+    message->FindInt64("merged", &fMerged);
+    fClients = *message;
+
+    fRateHistory[fRateHistoryIndex] = fEventsPerSecond;
+    fRateHistoryIndex = (fRateHistoryIndex + 1) % kSparklineLength;
+    if (fRateHistoryCount < kSparklineLength)
+        fRateHistoryCount++;
+
+    UpdateToolTip();
+}
+
+void DeskbarReplicant::BuildSparkline(char* buffer, size_t size) const
+{
+    // Eighth blocks U+2581..U+2588, three bytes each in UTF-8
+    static const char* kBlocks[] = {
+        "\xe2\x96\x81", "\xe2\x96\x82", "\xe2\x96\x83", "\xe2\x96\x84",
+        "\xe2\x96\x85", "\xe2\x96\x86", "\xe2\x96\x87", "\xe2\x96\x88"
+    };
+
+    buffer[0] = '\0';
+
+    float peak = 0;
+    for (int32 i = 0; i < fRateHistoryCount; i++) {
+        if (fRateHistory[i] > peak)
+            peak = fRateHistory[i];
+    }
+
+    // Oldest sample first
+    int32 start = (fRateHistoryIndex - fRateHistoryCount + kSparklineLength)
+        % kSparklineLength;
+    size_t used = 0;
+    for (int32 i = 0; i < fRateHistoryCount && used + 4 <= size; i++) {
+        float rate = fRateHistory[(start + i) % kSparklineLength];
+        int32 level = peak > 0 ? (int32)(rate / peak * 7.0f + 0.5f) : 0;
+        memcpy(buffer + used, kBlocks[level], 3);
+        used += 3;
+    }
+    buffer[used] = '\0';
+}
+
+void DeskbarReplicant::UpdateToolTip()
+{
+    if (!fIsConnected) {
+        SetToolTip("softKM: disconnected");
+        return;
+    }
+
+    char sparkline[kSparklineLength * 3 + 1];
+    BuildSparkline(sparkline, sizeof(sparkline));
+
+    char text[512];
+    snprintf(text, sizeof(text),
+        "softKM: %.0f events/s\n"
+        "%s\n"
+        "RTT %.1f ms, injection p99 %.2f ms\n"
+        "%lld dropped, %lld merged in the last second",
+        fEventsPerSecond, sparkline,
+        fRoundTripTime / 1000.0, fInjectLatencyP99 / 1000.0,
+        (long long)fDropped, (long long)fMerged);
+    SetToolTip(text);
+}
+
 void DeskbarReplicant::ShowPopUpMenu(BPoint where)
 {
     BPopUpMenu* menu = new BPopUpMenu("softKM", false, false);
 
-    // Status item (disabled, just for info)
-    BMenuItem* statusItem = new BMenuItem(
-        fIsConnected ? "Connected" : "Disconnected", nullptr);
+    // Status items (disabled, just for info)
+    const char* statusLabel = "Disconnected";
+    if (fIsConnected)
+        statusLabel = fIsActive ? "Connected (controlling Haiku)" : "Connected";
+    BMenuItem* statusItem = new BMenuItem(statusLabel, nullptr);
     statusItem->SetEnabled(false);
     menu->AddItem(statusItem);
 
-    menu->AddSeparatorItem();
-
-    // Show/Hide Log (toggle based on current state)
-    BMessage logQuery(MSG_QUERY_LOG_VISIBLE);
-    BMessage reply;
-    BMessenger messenger("application/x-vnd.softKM");
-    bool logVisible = false;
-    if (messenger.IsValid() && messenger.SendMessage(&logQuery, &reply, 500000, 500000) == B_OK) {
-        reply.FindBool("visible", &logVisible);
+    if (fIsConnected) {
+        const char* qualityLabel = "Link: good";
+        if (fLinkQuality == LINK_QUALITY_FAIR)
+            qualityLabel = "Link: fair";
+        else if (fLinkQuality == LINK_QUALITY_POOR)
+            qualityLabel = "Link: poor";
+        BMenuItem* qualityItem = new BMenuItem(qualityLabel, nullptr);
+        qualityItem->SetEnabled(false);
+        menu->AddItem(qualityItem);
+
+        char label[128];
+        snprintf(label, sizeof(label), "%.0f events/s, RTT %.1f ms",
+            fEventsPerSecond, fRoundTripTime / 1000.0);
+        BMenuItem* rateItem = new BMenuItem(label, nullptr);
+        rateItem->SetEnabled(false);
+        menu->AddItem(rateItem);
+
+        snprintf(label, sizeof(label), "Injection p99 %.2f ms",
+            fInjectLatencyP99 / 1000.0);
+        BMenuItem* latencyItem = new BMenuItem(label, nullptr);
+        latencyItem->SetEnabled(false);
+        menu->AddItem(latencyItem);
+
+        snprintf(label, sizeof(label), "%lld dropped, %lld merged",
+            (long long)fDropped, (long long)fMerged);
+        BMenuItem* droppedItem = new BMenuItem(label, nullptr);
+        droppedItem->SetEnabled(false);
+        menu->AddItem(droppedItem);
+
+        // One line per client, the one owning input marked
+        type_code type;
+        int32 clientCount = 0;
+        if (fClients.GetInfo("clientAddress", &type, &clientCount) == B_OK
+            && clientCount > 0) {
+            snprintf(label, sizeof(label), "Clients (%ld)", clientCount);
+            BMenu* clientMenu = new BMenu(label);
+            for (int32 i = 0; i < clientCount; i++) {
+                const char* address = "";
+                bool owner = false;
+                int64 events = 0;
+                int64 rejected = 0;
+                int64 roundTripTime = 0;
+                int32 takeovers = 0;
+                fClients.FindString("clientAddress", i, &address);
+                fClients.FindBool("clientOwner", i, &owner);
+                fClients.FindInt64("clientEvents", i, &events);
+                fClients.FindInt64("clientRejected", i, &rejected);
+                fClients.FindInt64("clientRoundTripTime", i, &roundTripTime);
+                fClients.FindInt32("clientTakeovers", i, &takeovers);
+
+                snprintf(label, sizeof(label),
+                    "%s: %lld events, %lld rejected, %ld takeovers, "
+                    "RTT %.1f ms", address, (long long)events,
+                    (long long)rejected, takeovers, roundTripTime / 1000.0);
+                BMenuItem* clientItem = new BMenuItem(label, nullptr);
+                clientItem->SetMarked(owner);
+                clientItem->SetEnabled(false);
+                clientMenu->AddItem(clientItem);
+            }
+            menu->AddItem(clientMenu);
+        }
     }
 
-    BMenuItem* logItem = new BMenuItem(logVisible ? "Hide Log" : "Show Log",
+    menu->AddSeparatorItem();
+
+    // Show/Hide Log (toggle based on the last pushed state)
+    BMenuItem* logItem = new BMenuItem(fLogVisible ? "Hide Log" : "Show Log",
         new BMessage(MSG_TOGGLE_LOG));
     menu->AddItem(logItem);
 
@@ -3,15 +3,10 @@
 
 #include <View.h>
 #include <Bitmap.h>
-#include <MessageRunner.h>
+#include <Message.h>
 
 #define REPLICANT_NAME "softKM"
 
-// Message for polling connection status
-enum {
-    MSG_POLL_STATUS = 'poll'
-};
-
 class BDragger;
 class BPopUpMenu;
 
@@ -42,13 +37,31 @@ private:
     void Init();
     void CreateIcons();
     void ShowPopUpMenu(BPoint where);
-    void QueryConnectionStatus();
+    void SubscribeToStatus(bool subscribe);
+    void UpdateMetrics(BMessage* message);
+    void UpdateToolTip();
+    void BuildSparkline(char* buffer, size_t size) const;
+
+    static const int32 kSparklineLength = 24;
 
     BBitmap* fConnectedIcon;
     BBitmap* fDisconnectedIcon;
     bool fIsConnected;
+    bool fIsActive;
+    int32 fLinkQuality;
+    bool fLogVisible;
     BDragger* fDragger;
-    BMessageRunner* fStatusPoller;
+
+    // Latest pushed link metrics
+    float fEventsPerSecond;
+    bigtime_t fRoundTripTime;
+    bigtime_t fInjectLatencyP99;
+    int64 fDropped;
+    int64 fMerged;
+    float fRateHistory[kSparklineLength];
+    int32 fRateHistoryIndex;
+    int32 fRateHistoryCount;
+    BMessage fClients;          // client fields of the last update
 };
 
 // Required export for replicant instantiation
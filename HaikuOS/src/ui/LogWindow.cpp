@@ -1,5 +1,6 @@
 #include "LogWindow.h"
 #include "../Logger.h"
+#include "../SoftKMApp.h"
 
 #include <Application.h>
 #include <Autolock.h>
@@ -263,4 +264,19 @@ void LogWindow::Show()
     // Enable logging when window is shown
     Logger::Instance().SetEnabled(true);
     BWindow::Show();
+    NotifyVisibility(true);
+}
+
+void LogWindow::Hide()
+{
+    BWindow::Hide();
+    NotifyVisibility(false);
+}
+
+void LogWindow::NotifyVisibility(bool visible)
+{
+    // Let the app push the new state to Deskbar replicants
+    BMessage msg(MSG_LOG_VISIBILITY_CHANGED);
+    msg.AddBool("visible", visible);
+    be_app->PostMessage(&msg);
 }
@@ -29,6 +29,7 @@ public:
     virtual void MessageReceived(BMessage* message);
     virtual bool QuitRequested();
     virtual void Show();
+    virtual void Hide();
 
 private:
     LogWindow();
@@ -36,6 +37,7 @@ private:
 
     LogCategory CategorizeEntry(const char* entry);
     bool ShouldShow(const char* entry);
+    void NotifyVisibility(bool visible);
 
     static LogWindow* sInstance;
     static BLocker sLock;
@@ -41,8 +41,20 @@ SettingsWindow::SettingsWindow()
     fPortControl = new BTextControl("Port:", "", nullptr);
     fPortControl->SetModificationMessage(new BMessage('port'));
 
+    fMetricsPortControl = new BTextControl("Metrics port:", "", nullptr);
+
+    // e.g. "right=haiku-b, bottom=haiku-c:31340"
+    fNeighboursControl = new BTextControl("Neighbours:", "", nullptr);
+
     fAutoStartCheck = new BCheckBox("Start automatically on login", nullptr);
 
+    // Takes effect when the server starts, like the neighbours
+    fPacingCheck = new BCheckBox("Smooth pointer motion (adds a little delay)",
+        nullptr);
+    fPacingDelayControl = new BTextControl("Smoothing delay:", "", nullptr);
+    fPredictionCheck = new BCheckBox(
+        "Predict pointer motion on slow links", nullptr);
+
     fSaveButton = new BButton("Save", new BMessage(MSG_SAVE_SETTINGS));
     fCancelButton = new BButton("Cancel", new BMessage(MSG_CANCEL_SETTINGS));
 
@@ -60,9 +72,17 @@ SettingsWindow::SettingsWindow()
             .AddGrid(B_USE_DEFAULT_SPACING, B_USE_SMALL_SPACING)
                 .Add(new BStringView("portLabel", "Listen Port:"), 0, 0)
                 .Add(fPortControl, 1, 0)
-                .Add(statusLabel, 0, 1)
-                .Add(statusValue, 1, 1)
+                .Add(new BStringView("metricsLabel", "Metrics Port (0 = off):"), 0, 1)
+                .Add(fMetricsPortControl, 1, 1)
+                .Add(new BStringView("neighboursLabel", "Neighbours (edge=host):"), 0, 2)
+                .Add(fNeighboursControl, 1, 2)
+                .Add(new BStringView("pacingLabel", "Max Smoothing Delay (ms):"), 0, 3)
+                .Add(fPacingDelayControl, 1, 3)
+                .Add(statusLabel, 0, 4)
+                .Add(statusValue, 1, 4)
             .End()
+            .Add(fPacingCheck)
+            .Add(fPredictionCheck)
             .Add(fAutoStartCheck)
             .AddGlue()
             .Add(new BSeparatorView(B_HORIZONTAL))
@@ -141,7 +161,28 @@ void SettingsWindow::LoadSettings()
     snprintf(portStr, sizeof(portStr), "%u", Settings::GetPort());
     fPortControl->SetText(portStr);
 
+    snprintf(portStr, sizeof(portStr), "%u", Settings::GetMetricsPort());
+    fMetricsPortControl->SetText(portStr);
+
+    // Only this machine's links are edited here
+    char hostName[Topology::kMaxNameLength];
+    char neighbours[512] = "";
+    if (Topology::LocalHostName(hostName, sizeof(hostName)) == B_OK) {
+        Settings::GetTopology().FormatLinks(hostName, neighbours,
+            sizeof(neighbours));
+    }
+    fNeighboursControl->SetText(neighbours);
+
     fAutoStartCheck->SetValue(Settings::GetAutoStart() ? B_CONTROL_ON : B_CONTROL_OFF);
+
+    const PointerPacingConfig& pacing = Settings::GetPointerPacing();
+    fPacingCheck->SetValue(pacing.enabled ? B_CONTROL_ON : B_CONTROL_OFF);
+    char delayStr[16];
+    snprintf(delayStr, sizeof(delayStr), "%g", pacing.maxDelay / 1000.0);
+    fPacingDelayControl->SetText(delayStr);
+
+    fPredictionCheck->SetValue(Settings::GetMotionPrediction().enabled
+        ? B_CONTROL_ON : B_CONTROL_OFF);
 }
 
 void SettingsWindow::SaveSettings()
@@ -152,8 +193,30 @@ void SettingsWindow::SaveSettings()
     }
     Settings::SetPort(port);
 
+    // 0 or garbage disables the metrics endpoint
+    Settings::SetMetricsPort((uint16)atoi(fMetricsPortControl->Text()));
+
+    // A malformed list keeps the previous neighbours
+    char hostName[Topology::kMaxNameLength];
+    if (Topology::LocalHostName(hostName, sizeof(hostName)) == B_OK) {
+        Settings::GetTopology().ParseLinks(hostName,
+            fNeighboursControl->Text());
+    }
+
     Settings::SetAutoStart(fAutoStartCheck->Value() == B_CONTROL_ON);
 
+    // Garbage keeps the previous delay; never below the minimum
+    PointerPacingConfig& pacing = Settings::GetPointerPacing();
+    pacing.enabled = fPacingCheck->Value() == B_CONTROL_ON;
+    double delay = atof(fPacingDelayControl->Text());
+    if (delay > 0) {
+        pacing.maxDelay = (bigtime_t)(delay * 1000);
+        if (pacing.maxDelay < pacing.minDelay)
+            pacing.maxDelay = pacing.minDelay;
+    }
+    Settings::GetMotionPrediction().enabled
+        = fPredictionCheck->Value() == B_CONTROL_ON;
+
     Settings::Save();
 }
 
@@ -26,7 +26,12 @@ private:
     BMenuBar* fMenuBar;
     BMenuItem* fLogMenuItem;
     BTextControl* fPortControl;
+    BTextControl* fMetricsPortControl;
+    BTextControl* fNeighboursControl;
     BCheckBox* fAutoStartCheck;
+    BCheckBox* fPacingCheck;
+    BTextControl* fPacingDelayControl;
+    BCheckBox* fPredictionCheck;
     BButton* fSaveButton;
     BButton* fCancelButton;
 };
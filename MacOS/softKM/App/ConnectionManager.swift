@@ -15,6 +15,7 @@ class ConnectionManager: ObservableObject {
 
     private var networkClient: NetworkClient?
     private var cancellables = Set<AnyCancellable>()
+    private var didDeferHandshake = false
 
     enum ConnectionState: Equatable {
         case disconnected
@@ -39,6 +40,7 @@ class ConnectionManager: ObservableObject {
     private init() {
         networkClient = NetworkClient()
         setupBindings()
+        observeSession()
         observeSettings()
     }
 
@@ -51,21 +53,45 @@ class ConnectionManager: ObservableObject {
                 self.connectionState = state
                 self.isConnected = (state == .connected)
 
-                // Send screen info and settings when newly connected
+                // Send screen info and settings when newly connected. A
+                // resumed session already has them; wait for SESSION_ACCEPT.
                 if !wasConnected && self.isConnected {
-                    self.sendScreenInfo()
-                    self.sendSettings()
+                    if self.networkClient?.hasResumableSession ?? false {
+                        self.didDeferHandshake = true
+                    } else {
+                        self.sendScreenInfo()
+                        self.sendSettings()
+                    }
                 }
 
-                // Auto-switch to monitor mode when connection is lost while capturing
+                // Auto-switch to monitor mode when connection is lost while
+                // capturing, unless the session comes back in time
                 if wasConnected && !self.isConnected && self.isCapturing {
-                    LOG("Connection lost while capturing - switching to monitor mode")
-                    SwitchController.shared.deactivateCaptureMode()
+                    DispatchQueue.main.asyncAfter(deadline: .now() + 3.0) { [weak self] in
+                        guard let self = self, !self.isConnected, self.isCapturing else { return }
+                        LOG("Connection lost while capturing - switching to monitor mode")
+                        SwitchController.shared.deactivateCaptureMode()
+                    }
                 }
             }
             .store(in: &cancellables)
     }
 
+    private func observeSession() {
+        NotificationCenter.default.publisher(for: .sessionEstablished)
+            .sink { [weak self] notification in
+                guard let self = self,
+                      let info = notification.object as? SessionInfo else { return }
+                // Haiku dropped our old session, so do the full handshake
+                if !info.resumed && self.didDeferHandshake {
+                    self.sendScreenInfo()
+                    self.sendSettings()
+                }
+                self.didDeferHandshake = false
+            }
+            .store(in: &cancellables)
+    }
+
     private func observeSettings() {
         // Observe edge dwell time changes and sync to Haiku
         NotificationCenter.default.publisher(for: UserDefaults.didChangeNotification)
@@ -127,6 +153,21 @@ class ConnectionManager: ObservableObject {
         networkClient?.send(event: event)
     }
 
+    /// Whether Haiku announced it decodes compressed clipboard content
+    var serverAcceptsCompressedClipboard: Bool {
+        return ((networkClient?.serverCapabilities ?? 0) & Protocol.capabilityClipboardLZ4) != 0
+    }
+
+    /// Whether Haiku takes clipboard manifests instead of CLIPBOARD_SYNC
+    var serverAcceptsClipboardManifest: Bool {
+        return ((networkClient?.serverCapabilities ?? 0) & Protocol.capabilityClipboardManifest) != 0
+    }
+
+    /// Whether Haiku takes files dragged across the edge
+    var serverAcceptsFiles: Bool {
+        return ((networkClient?.serverCapabilities ?? 0) & Protocol.capabilityFileTransfer) != 0
+    }
+
     func sendControlSwitch(toHaiku: Bool, yRatio: Float = 0.5) {
         let event = InputEvent.controlSwitch(toHaiku: toHaiku, yRatio: yRatio)
         send(event: event)
@@ -1,12 +1,311 @@
 import Cocoa
+import Compression
 
 class ClipboardManager {
     static let shared = ClipboardManager()
 
     private static let maxClipboardSize = 1_048_576  // 1MB
 
+    // contentHash of the last content each way, nil = none
+    private var lastSentHash: UInt64?
+    private var lastReceivedHash: UInt64?
+
+    // Lazy clipboard (CAPABILITY_CLIPBOARD_MANIFEST). Pasteboard types by
+    // the MIME type used on Haiku's clipboard; file references travel as a
+    // text/uri-list of file URLs.
+    private static let formatTypes: [(mimeType: String, type: NSPasteboard.PasteboardType)] = [
+        ("text/plain", .string),
+        ("text/rtf", .rtf),
+        ("text/html", .html),
+        ("image/png", .png),
+        ("image/tiff", .tiff),
+        ("text/uri-list", .fileURL)
+    ]
+    private static let fetchChunkSize = 16384
+    private static let fetchWindow = 4          // chunks asked for ahead
+    private static let fetchTimeout = 5.0       // seconds without progress
+    private static let maxChunkSize = 65536     // served per CLIPBOARD_FETCH
+
+    // What we announced to Haiku, served to its fetches from the receive thread
+    private let sourceLock = NSLock()
+    private var sourceChangeCount = -1
+    private var sourceGeneration: UInt32 = 0
+    private var sourceFormats: [ClipboardFormat] = []
+    private var sourceData: [Data] = []
+
+    // What Haiku announced; promised on the pasteboard, fetched on paste
+    private let fetchLock = NSLock()
+    private let fetchProgress = DispatchSemaphore(value: 0)
+    private var remoteGeneration: UInt32 = 0
+    private var remoteFormats: [ClipboardFormat] = []
+    private var remoteChangeCount = -1
+    private var remoteProvider: RemoteClipboardProvider?
+    private var fetch: RemoteFetch?
+
     private init() {}
 
+    /// Same function as ContentHash() on Haiku; the hash travels in CLIPBOARD_SYNC
+    static func contentHash(_ data: Data) -> UInt64 {
+        var hasher = ContentHasher(length: UInt64(data.count))
+        hasher.update(data)
+        return hasher.finalize()
+    }
+
+    /// CLIPBOARD_SYNC contentType and data for content, LZ4-compressed if the
+    /// server decodes it and it is worth it. COMPRESSION_LZ4_RAW is the plain
+    /// LZ4 block format Haiku's Lz4Block reads.
+    static func encodeForSync(_ data: Data, compress: Bool) -> (UInt8, Data) {
+        guard compress, data.count >= Protocol.clipboardCompressThreshold else {
+            return (0x00, data)
+        }
+
+        let capacity = data.count + data.count / 255 + 16
+        var payload = Data(count: 4 + capacity)
+        let compressedSize = payload.withUnsafeMutableBytes { (dst: UnsafeMutableRawBufferPointer) -> Int in
+            data.withUnsafeBytes { (src: UnsafeRawBufferPointer) -> Int in
+                var originalLE = UInt32(data.count).littleEndian
+                withUnsafeBytes(of: &originalLE) { dst.copyMemory(from: $0) }
+                return compression_encode_buffer(
+                    dst.baseAddress!.advanced(by: 4).assumingMemoryBound(to: UInt8.self), capacity,
+                    src.bindMemory(to: UInt8.self).baseAddress!, data.count,
+                    nil, COMPRESSION_LZ4_RAW)
+            }
+        }
+        guard compressedSize > 0, 4 + compressedSize < data.count else {
+            return (0x00, data)
+        }
+        payload.count = 4 + compressedSize
+        return (Protocol.clipboardCompressed, payload)
+    }
+
+    /// Decodes CLIPBOARD_COMPRESSED data straight into one buffer of the
+    /// original size, nil if malformed
+    static func decompress(_ payload: Data) -> Data? {
+        guard payload.count >= 4 else { return nil }
+        let originalLength = Int(payload.prefix(4).withUnsafeBytes { $0.loadUnaligned(as: UInt32.self) })
+        guard originalLength <= maxClipboardSize else { return nil }
+
+        var data = Data(count: originalLength)
+        let decodedSize = data.withUnsafeMutableBytes { (dst: UnsafeMutableRawBufferPointer) -> Int in
+            payload.withUnsafeBytes { (src: UnsafeRawBufferPointer) -> Int in
+                guard let dstBase = dst.bindMemory(to: UInt8.self).baseAddress,
+                      let srcBase = src.bindMemory(to: UInt8.self).baseAddress else { return 0 }
+                return compression_decode_buffer(
+                    dstBase, originalLength, srcBase.advanced(by: 4), src.count - 4,
+                    nil, COMPRESSION_LZ4_RAW)
+            }
+        }
+        return decodedSize == originalLength ? data : nil
+    }
+
+    /// Whether content with this hash still has to go to Haiku
+    func needsSync(hash: UInt64) -> Bool {
+        return hash != lastSentHash && hash != lastReceivedHash
+    }
+
+    func markSent(hash: UInt64) {
+        lastSentHash = hash
+    }
+
+    /// Same as ClipboardManifest::Hash() on Haiku: contentHash of the entries as sent
+    static func manifestHash(_ formats: [ClipboardFormat]) -> UInt64 {
+        var entries = Protocol.encode(.clipboardManifest(generation: 0, formats: formats))
+        entries.removeFirst(8 + 5)  // header, generation and count
+        return contentHash(entries)
+    }
+
+    /// Describes the pasteboard for CLIPBOARD_MANIFEST and keeps a snapshot
+    /// to serve Haiku's fetches from. nil if there is nothing Haiku can use,
+    /// or if the pasteboard holds what Haiku announced itself.
+    func buildManifest() -> (generation: UInt32, formats: [ClipboardFormat])? {
+        let pasteboard = NSPasteboard.general
+        let changeCount = pasteboard.changeCount
+        guard changeCount != remoteChangeCount else { return nil }
+
+        sourceLock.lock()
+        defer { sourceLock.unlock() }
+
+        // Unchanged since the last switch: no need to read it all again
+        if changeCount == sourceChangeCount {
+            guard !sourceFormats.isEmpty else { return nil }
+            return (sourceGeneration, sourceFormats)
+        }
+
+        var formats: [ClipboardFormat] = []
+        var contents: [Data] = []
+        for (mimeType, type) in Self.formatTypes {
+            guard let data = Self.pasteboardData(pasteboard, type: type) else { continue }
+            formats.append(ClipboardFormat(mimeType: mimeType, size: UInt32(data.count),
+                                           hash: Self.contentHash(data)))
+            contents.append(data)
+        }
+
+        sourceChangeCount = changeCount
+        sourceGeneration = UInt32(truncatingIfNeeded: changeCount)
+        sourceFormats = formats
+        sourceData = contents
+        guard !formats.isEmpty else { return nil }
+        return (sourceGeneration, formats)
+    }
+
+    private static func pasteboardData(_ pasteboard: NSPasteboard, type: NSPasteboard.PasteboardType) -> Data? {
+        switch type {
+        case .string:
+            return pasteboard.string(forType: .string)?.data(using: .utf8)
+        case .fileURL:
+            let urls = (pasteboard.pasteboardItems ?? []).compactMap { $0.string(forType: .fileURL) }
+            return urls.isEmpty ? nil : urls.joined(separator: "\r\n").data(using: .utf8)
+        default:
+            return pasteboard.data(forType: type)
+        }
+    }
+
+    /// Part of an announced format for CLIPBOARD_FETCH; nil once the
+    /// content was replaced. Any thread.
+    func readChunk(generation: UInt32, format: UInt8, offset: UInt32, length: UInt32) -> Data? {
+        sourceLock.lock()
+        defer { sourceLock.unlock() }
+
+        guard generation == sourceGeneration, Int(format) < sourceData.count else { return nil }
+        let data = sourceData[Int(format)]
+        guard Int(offset) <= data.count else { return nil }
+        let end = Int(offset) + min(Int(length), Self.maxChunkSize, data.count - Int(offset))
+        return data.subdata(in: Int(offset)..<end)
+    }
+
+    /// Haiku's clipboard changed: promise its formats on the pasteboard
+    /// without fetching any of them yet
+    func manifestReceived(generation: UInt32, formats: [ClipboardFormat]) {
+        let hash = Self.manifestHash(formats)
+        lastReceivedHash = hash
+        guard hash != lastSentHash else {
+            LOG("Clipboard from Haiku is what we sent, not written")
+            return
+        }
+
+        var types: [NSPasteboard.PasteboardType] = []
+        for format in formats {
+            if let entry = Self.formatTypes.first(where: { $0.mimeType == format.mimeType }) {
+                types.append(entry.type)
+            }
+        }
+        guard !types.isEmpty else {
+            LOG("No usable clipboard formats from Haiku")
+            return
+        }
+
+        fetchLock.lock()
+        remoteGeneration = generation
+        remoteFormats = formats
+        fetch = nil
+        fetchLock.unlock()
+        fetchProgress.signal()
+
+        let provider = RemoteClipboardProvider()
+        let item = NSPasteboardItem()
+        item.setDataProvider(provider, forTypes: types)
+
+        let pasteboard = NSPasteboard.general
+        pasteboard.clearContents()
+        pasteboard.writeObjects([item])
+        remoteProvider = provider
+        remoteChangeCount = pasteboard.changeCount
+        LOG("Clipboard from Haiku offered lazily: \(types.count) formats")
+    }
+
+    /// Pulls one announced format from Haiku, a few chunks ahead, for a
+    /// paste. Blocks the calling (main) thread; chunks arrive on the
+    /// receive thread. nil on timeout or if the content went away.
+    fileprivate func fetchRemote(type: NSPasteboard.PasteboardType) -> Data? {
+        guard let mimeType = Self.formatTypes.first(where: { $0.type == type })?.mimeType else { return nil }
+
+        fetchLock.lock()
+        guard let index = remoteFormats.firstIndex(where: { $0.mimeType == mimeType }) else {
+            fetchLock.unlock()
+            return nil
+        }
+        let format = remoteFormats[index]
+        let current = RemoteFetch(generation: remoteGeneration, format: UInt8(index), size: Int(format.size))
+        fetch = current
+        fetchLock.unlock()
+        LOG("Fetching \(mimeType) from Haiku: \(format.size) bytes")
+
+        while true {
+            fetchLock.lock()
+            guard fetch === current, !current.failed else {
+                fetchLock.unlock()
+                LOG("Clipboard fetch from Haiku cancelled")
+                return nil
+            }
+            if current.received == current.data.count {
+                fetch = nil
+                fetchLock.unlock()
+                break
+            }
+            var requests: [(offset: Int, length: Int)] = []
+            while current.requested < current.data.count
+                    && current.requested - current.received < Self.fetchWindow * Self.fetchChunkSize {
+                let length = min(Self.fetchChunkSize, current.data.count - current.requested)
+                requests.append((current.requested, length))
+                current.requested += length
+            }
+            fetchLock.unlock()
+
+            for request in requests {
+                ConnectionManager.shared.send(event: .clipboardFetch(
+                    generation: current.generation, format: current.format,
+                    offset: UInt32(request.offset), length: UInt32(request.length)))
+            }
+            if fetchProgress.wait(timeout: .now() + Self.fetchTimeout) == .timedOut {
+                fetchLock.lock()
+                if fetch === current { fetch = nil }
+                fetchLock.unlock()
+                LOG("Clipboard fetch from Haiku timed out")
+                return nil
+            }
+        }
+
+        guard Self.contentHash(current.data) == format.hash else {
+            LOG("Clipboard fetch from Haiku corrupt")
+            return nil
+        }
+
+        // Haiku's file references are a text/uri-list; a pasteboard item holds one
+        if type == .fileURL {
+            let first = String(decoding: current.data, as: UTF8.self)
+                .components(separatedBy: "\r\n").first ?? ""
+            return first.data(using: .utf8)
+        }
+        return current.data
+    }
+
+    /// CLIPBOARD_CHUNK, on the receive thread
+    func chunkReceived(generation: UInt32, format: UInt8, status: UInt8, offset: UInt32, data: Data) {
+        fetchLock.lock()
+        if let current = fetch, current.generation == generation, current.format == format {
+            if status != Protocol.chunkStatusOK || Int(offset) != current.received
+                || data.count > current.requested - current.received || data.isEmpty {
+                current.failed = true
+            } else {
+                current.data.replaceSubrange(current.received..<(current.received + data.count), with: data)
+                current.received += data.count
+            }
+        }
+        fetchLock.unlock()
+        fetchProgress.signal()
+    }
+
+    /// Something else was copied over what Haiku announced
+    fileprivate func remoteContentReleased(by provider: RemoteClipboardProvider) {
+        guard provider === remoteProvider else { return }
+        fetchLock.lock()
+        remoteFormats = []
+        fetch = nil
+        fetchLock.unlock()
+        fetchProgress.signal()
+        remoteProvider = nil
+    }
+
     /// Get current clipboard text as Data for syncing (returns nil if empty or too large)
     func getClipboardForSync() -> Data? {
         let pasteboard = NSPasteboard.general
@@ -24,12 +323,32 @@ class ClipboardManager {
     }
 
     /// Set clipboard from received sync data
-    func setClipboardFromSync(contentType: UInt8, data: Data) {
-        guard contentType == 0x00 else {
+    func setClipboardFromSync(contentType: UInt8, data: Data, hash: UInt64?) {
+        let compressed = (contentType & Protocol.clipboardCompressed) != 0
+        guard contentType & ~Protocol.clipboardCompressed == 0x00 else {
             LOG("Unsupported clipboard content type: \(contentType)")
             return
         }
-        guard let text = String(data: data, encoding: .utf8) else {
+        // Haiku always sends the hash with compressed content
+        guard !compressed || hash != nil else {
+            LOG("Compressed clipboard without hash, ignored")
+            return
+        }
+
+        // Rewriting identical content would bump the pasteboard change count;
+        // it is not even decoded
+        let receivedHash = hash ?? Self.contentHash(data)
+        lastReceivedHash = receivedHash
+        if let current = NSPasteboard.general.string(forType: .string)?.data(using: .utf8),
+           Self.contentHash(current) == receivedHash {
+            LOG("Clipboard from Haiku unchanged, not written")
+            return
+        }
+        guard let content = compressed ? Self.decompress(data) : data else {
+            LOG("Corrupt compressed clipboard from Haiku")
+            return
+        }
+        guard let text = String(data: content, encoding: .utf8) else {
             LOG("Failed to decode clipboard text from Haiku")
             return
         }
@@ -40,3 +359,95 @@ class ClipboardManager {
         LOG("Clipboard updated from Haiku: \(text.count) characters")
     }
 }
+
+/// One format being pulled from Haiku, into a buffer of its announced size
+private final class RemoteFetch {
+    let generation: UInt32
+    let format: UInt8
+    var data: Data
+    var requested = 0
+    var received = 0
+    var failed = false
+
+    init(generation: UInt32, format: UInt8, size: Int) {
+        self.generation = generation
+        self.format = format
+        self.data = Data(count: size)
+    }
+}
+
+/// Supplies Haiku's formats only once a paste asks for them
+private final class RemoteClipboardProvider: NSObject, NSPasteboardItemDataProvider {
+    func pasteboard(_ pasteboard: NSPasteboard?, item: NSPasteboardItem,
+                    provideDataForType type: NSPasteboard.PasteboardType) {
+        if let data = ClipboardManager.shared.fetchRemote(type: type) {
+            item.setData(data, forType: type)
+        }
+    }
+
+    func pasteboardFinishedWithDataProvider(_ pasteboard: NSPasteboard) {
+        DispatchQueue.main.async {
+            ClipboardManager.shared.remoteContentReleased(by: self)
+        }
+    }
+}
+
+/// ClipboardManager.contentHash over data that comes in pieces, such as a
+/// file read a chunk at a time; ContentHasher on Haiku. The total length is
+/// part of the hash, so it has to be known up front.
+struct ContentHasher {
+    private static let prime1: UInt64 = 0x9E3779B185EBCA87
+    private static let prime2: UInt64 = 0xC2B2AE3D27D4EB4F
+    private static let prime3: UInt64 = 0x165667B19E3779F9
+
+    private var hash: UInt64
+    private var pending: [UInt8] = []  // the start of an incomplete word
+
+    init(length: UInt64) {
+        hash = ContentHasher.prime3 ^ (length &* ContentHasher.prime1)
+    }
+
+    private static func rotateLeft(_ value: UInt64, _ bits: UInt64) -> UInt64 {
+        return (value << bits) | (value >> (64 - bits))
+    }
+
+    private mutating func mix(_ word: UInt64) {
+        hash ^= word &* ContentHasher.prime2
+        hash = ContentHasher.rotateLeft(hash, 31) &* ContentHasher.prime1
+    }
+
+    mutating func update(_ data: Data) {
+        data.withUnsafeBytes { (bytes: UnsafeRawBufferPointer) in
+            var offset = 0
+            if !pending.isEmpty {
+                while pending.count < 8 && offset < bytes.count {
+                    pending.append(bytes[offset])
+                    offset += 1
+                }
+                guard pending.count == 8 else { return }
+                mix(UInt64(littleEndian: pending.withUnsafeBytes { $0.loadUnaligned(as: UInt64.self) }))
+                pending.removeAll()
+            }
+            while offset + 8 <= bytes.count {
+                mix(UInt64(littleEndian: bytes.loadUnaligned(fromByteOffset: offset, as: UInt64.self)))
+                offset += 8
+            }
+            pending.append(contentsOf: bytes[offset...])
+        }
+    }
+
+    func finalize() -> UInt64 {
+        var hash = self.hash
+        for byte in pending {
+            hash ^= UInt64(byte) &* ContentHasher.prime3
+            hash = ContentHasher.rotateLeft(hash, 11) &* ContentHasher.prime1
+        }
+
+        hash ^= hash >> 33
+        hash = hash &* ContentHasher.prime2
+        hash ^= hash >> 29
+        hash = hash &* ContentHasher.prime3
+        hash ^= hash >> 32
+        return hash
+    }
+}
@@ -21,6 +21,12 @@ class SwitchController {
     // macOS sometimes sends events with incorrect modifier flags, so we track state ourselves
     private var pressedModifierKeys: Set<UInt32> = []
 
+    // Files dragged across the edge, sent to Haiku when the drag is dropped
+    // there. The drag pasteboard outlives the drag, so it only counts if it
+    // changed since the button went down.
+    private var draggedFiles: [URL] = []
+    private var dragChangeCount = 0
+
     private init() {
         // Ensure cursor is visible on startup (reset any stale state)
         CGAssociateMouseAndMouseCursorPosition(1)
@@ -116,6 +122,9 @@ class SwitchController {
 
     private func handleMouseButton(event: CGEvent, isDown: Bool) -> Unmanaged<CGEvent>? {
         guard mode == .capturing else {
+            if isDown && event.type == .leftMouseDown {
+                dragChangeCount = NSPasteboard(name: .drag).changeCount
+            }
             return Unmanaged.passUnretained(event)
         }
 
@@ -132,6 +141,11 @@ class SwitchController {
         } else {
             LOG("MouseUp: buttons=0x\(String(format: "%02X", buttons))")
             connectionManager.send(event: .mouseUp(buttons: buttons, x: Float(location.x), y: Float(location.y), modifiers: modifiers))
+            if event.type == .leftMouseUp && !draggedFiles.isEmpty {
+                LOG("Dropped \(draggedFiles.count) files on Haiku")
+                FileSender.shared.send(draggedFiles)
+                draggedFiles = []
+            }
         }
 
         return nil  // Consume event
@@ -324,11 +338,29 @@ class SwitchController {
 
         // Now set mode after cursor is locked
         mode = .capturing
-
-        // Send clipboard to Haiku before switching
-        if let clipboardData = ClipboardManager.shared.getClipboardForSync() {
-            LOG("Sending clipboard to Haiku: \(clipboardData.count) bytes")
-            connectionManager.send(event: .clipboardSync(contentType: 0x00, data: clipboardData))
+        draggedFiles = connectionManager.serverAcceptsFiles ? filesBeingDragged() : []
+
+        // Send clipboard to Haiku before switching, unless Haiku already has
+        // it. Newer servers only get a manifest and fetch what they need.
+        if connectionManager.serverAcceptsClipboardManifest {
+            if let manifest = ClipboardManager.shared.buildManifest() {
+                let hash = ClipboardManager.manifestHash(manifest.formats)
+                if ClipboardManager.shared.needsSync(hash: hash) {
+                    LOG("Announcing \(manifest.formats.count) clipboard formats to Haiku")
+                    connectionManager.send(event: .clipboardManifest(generation: manifest.generation,
+                                                                     formats: manifest.formats))
+                    ClipboardManager.shared.markSent(hash: hash)
+                }
+            }
+        } else if let clipboardData = ClipboardManager.shared.getClipboardForSync() {
+            let hash = ClipboardManager.contentHash(clipboardData)
+            if ClipboardManager.shared.needsSync(hash: hash) {
+                LOG("Sending clipboard to Haiku: \(clipboardData.count) bytes")
+                let (contentType, payload) = ClipboardManager.encodeForSync(
+                    clipboardData, compress: connectionManager.serverAcceptsCompressedClipboard)
+                connectionManager.send(event: .clipboardSync(contentType: contentType, data: payload, hash: hash))
+                ClipboardManager.shared.markSent(hash: hash)
+            }
         }
 
         // Notify Haiku with Y ratio for smooth cursor transition
@@ -346,6 +378,7 @@ class SwitchController {
     func deactivateCaptureMode(yRatio: Float = 0.5) {
         LOG("Deactivating capture mode - switching back to macOS, yRatio=\(yRatio)")
         mode = .monitoring
+        draggedFiles = []  // carried back without a drop
 
         // Clear modifier tracking state
         pressedModifierKeys.removeAll()
@@ -429,6 +462,16 @@ class SwitchController {
         edgeDetector.reset()
     }
 
+    /// Files of a Finder drag in progress; folders are left out
+    private func filesBeingDragged() -> [URL] {
+        guard NSEvent.pressedMouseButtons & 1 != 0 else { return [] }
+        let pasteboard = NSPasteboard(name: .drag)
+        guard pasteboard.changeCount != dragChangeCount else { return [] }
+        let urls = pasteboard.readObjects(forClasses: [NSURL.self],
+                                          options: [.urlReadingFileURLsOnly: true]) as? [URL] ?? []
+        return urls.filter { !$0.hasDirectoryPath }
+    }
+
     private func mapMouseButtons(event: CGEvent) -> UInt32 {
         let type = event.type
         switch type {
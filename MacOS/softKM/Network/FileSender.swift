@@ -0,0 +1,239 @@
+import Foundation
+
+/// Sends the files of a drag dropped on Haiku, one at a time. Each file is
+/// read as it goes out, never more than Protocol.fileTransferWindow past
+/// what Haiku has written, so memory use does not depend on the file size.
+/// A file cut off by a dropped connection is offered again once the session
+/// is back, and Haiku continues from what it already has.
+class FileSender {
+    static let shared = FileSender()
+
+    private let queue = DispatchQueue(label: "com.softkm.files")
+    private let maxAttempts = 3
+    private let replyTimeout: TimeInterval = 10
+    private let reconnectTimeout: TimeInterval = 60
+
+    // Everything below is guarded by condition
+    private let condition = NSCondition()
+    private var pending: [URL] = []
+    private var running = false
+    private var sessionReady = false
+    private var nextTransferId: UInt32 = 1
+
+    // The transfer on the wire
+    private var transferId: UInt32 = 0
+    private var acceptStatus: UInt8?
+    private var acknowledged: UInt64 = 0
+    private var doneStatus: UInt8?
+    private var connectionLost = false
+
+    private init() {
+        NotificationCenter.default.addObserver(
+            self,
+            selector: #selector(handleSessionEstablished),
+            name: .sessionEstablished,
+            object: nil
+        )
+    }
+
+    func send(_ urls: [URL]) {
+        condition.lock()
+        pending.append(contentsOf: urls)
+        let start = !running
+        running = true
+        condition.unlock()
+
+        if start {
+            queue.async { [weak self] in
+                self?.run()
+            }
+        }
+    }
+
+    /// FILE_ACCEPT, from the receive thread
+    func accepted(transferId: UInt32, status: UInt8, offset: UInt64) {
+        condition.lock()
+        if transferId == self.transferId {
+            if acceptStatus == nil {
+                acceptStatus = status
+                acknowledged = offset
+            } else {
+                acknowledged = max(acknowledged, offset)
+            }
+            condition.broadcast()
+        }
+        condition.unlock()
+    }
+
+    /// FILE_DONE, from the receive thread
+    func done(transferId: UInt32, status: UInt8) {
+        condition.lock()
+        if transferId == self.transferId {
+            doneStatus = status
+            condition.broadcast()
+        }
+        condition.unlock()
+    }
+
+    func connectionClosed() {
+        condition.lock()
+        sessionReady = false
+        connectionLost = true
+        condition.broadcast()
+        condition.unlock()
+    }
+
+    @objc private func handleSessionEstablished(_ notification: Notification) {
+        condition.lock()
+        sessionReady = true
+        condition.broadcast()
+        condition.unlock()
+    }
+
+    private func run() {
+        while let url = nextFile() {
+            let name = url.lastPathComponent
+            for attempt in 1...maxAttempts {
+                let status = transfer(url)
+                if status == Protocol.fileStatusOK {
+                    LOG("Sent \(name) to Haiku")
+                    break
+                }
+                if status == Protocol.fileStatusRefused {
+                    LOG("Haiku refused \(name)")
+                    break
+                }
+                LOG("Sending \(name) failed (status \(status), attempt \(attempt))")
+                guard attempt < maxAttempts, waitForSession() else { break }
+            }
+        }
+    }
+
+    private func nextFile() -> URL? {
+        condition.lock()
+        defer { condition.unlock() }
+        guard !pending.isEmpty else {
+            running = false
+            return nil
+        }
+        return pending.removeFirst()
+    }
+
+    /// Returns at once unless the connection dropped during the last attempt
+    private func waitForSession() -> Bool {
+        let deadline = Date().addingTimeInterval(reconnectTimeout)
+        condition.lock()
+        defer { condition.unlock() }
+        while connectionLost && !sessionReady {
+            if !condition.wait(until: deadline) {
+                return false
+            }
+        }
+        return true
+    }
+
+    /// One attempt at a file; the FileTransferStatus it ended with
+    private func transfer(_ url: URL) -> UInt8 {
+        guard let handle = try? FileHandle(forReadingFrom: url) else {
+            return Protocol.fileStatusRefused
+        }
+        defer { try? handle.close() }
+
+        // The checksum goes first, in the offer; it also names Haiku's part
+        // file, so that a resume finds it
+        var size: UInt64 = 0
+        var hasher: ContentHasher
+        do {
+            size = try handle.seekToEnd()
+            try handle.seek(toOffset: 0)
+            hasher = ContentHasher(length: size)
+            while let chunk = try autoreleasepool(invoking: { try handle.read(upToCount: 1 << 20) }),
+                  !chunk.isEmpty {
+                hasher.update(chunk)
+            }
+        } catch {
+            LOG("Could not read \(url.path): \(error)")
+            return Protocol.fileStatusRefused
+        }
+
+        condition.lock()
+        let id = nextTransferId
+        nextTransferId &+= 1
+        transferId = id
+        acceptStatus = nil
+        acknowledged = 0
+        doneStatus = nil
+        connectionLost = false
+        condition.unlock()
+
+        ConnectionManager.shared.send(event: .fileOffer(transferId: id, size: size, hash: hasher.finalize(),
+                                                        name: url.lastPathComponent))
+
+        // Where to start from, past what an earlier attempt left on Haiku
+        var offset: UInt64 = 0
+        condition.lock()
+        let replyDeadline = Date().addingTimeInterval(replyTimeout)
+        while acceptStatus == nil && !connectionLost && condition.wait(until: replyDeadline) {}
+        let reply = acceptStatus
+        offset = acknowledged
+        condition.unlock()
+        guard let status = reply else { return Protocol.fileStatusFailed }
+        guard status == Protocol.fileStatusOK else { return status }
+        if offset > 0 {
+            LOG("Resuming \(url.lastPathComponent) at byte \(offset)")
+        }
+
+        do {
+            try handle.seek(toOffset: offset)
+            while offset < size {
+                guard let result = waitForWindow(offset: offset) else {
+                    break
+                }
+                if result != Protocol.fileStatusOK {
+                    return result
+                }
+
+                let length = Int(min(UInt64(Protocol.fileDataChunkSize), size - offset))
+                guard let data = try autoreleasepool(invoking: { try handle.read(upToCount: length) }),
+                      !data.isEmpty else {
+                    LOG("\(url.path) got shorter while being sent")
+                    return Protocol.fileStatusFailed
+                }
+                ConnectionManager.shared.send(event: .fileData(transferId: id, offset: offset, data: data))
+                offset += UInt64(data.count)
+            }
+        } catch {
+            LOG("Could not read \(url.path): \(error)")
+            return Protocol.fileStatusFailed
+        }
+
+        // Haiku checks the checksum once everything is written
+        condition.lock()
+        defer { condition.unlock() }
+        while doneStatus == nil && !connectionLost {
+            if !condition.wait(until: Date().addingTimeInterval(replyTimeout)) {
+                break
+            }
+        }
+        return doneStatus ?? Protocol.fileStatusFailed
+    }
+
+    /// Blocks until offset is within the window. FILE_OK to go on, another
+    /// status if the transfer ended, nil when it finished early.
+    private func waitForWindow(offset: UInt64) -> UInt8? {
+        condition.lock()
+        defer { condition.unlock() }
+        while offset >= acknowledged + Protocol.fileTransferWindow && doneStatus == nil && !connectionLost {
+            if !condition.wait(until: Date().addingTimeInterval(replyTimeout)) {
+                return Protocol.fileStatusFailed
+            }
+        }
+        if connectionLost {
+            return Protocol.fileStatusFailed
+        }
+        if let status = doneStatus {
+            return status == Protocol.fileStatusOK ? nil : status
+        }
+        return Protocol.fileStatusOK
+    }
+}
@@ -3,12 +3,17 @@ import Darwin
 
 extension Notification.Name {
     static let switchToMac = Notification.Name("switchToMac")
+    static let sessionEstablished = Notification.Name("sessionEstablished")
 }
 
 struct SwitchToMacInfo {
     let yRatio: Float  // 0.0 = top, 1.0 = bottom
 }
 
+struct SessionInfo {
+    let resumed: Bool  // Haiku kept held input, active state and settings
+}
+
 class NetworkClient: ObservableObject {
     @Published var connectionState: ConnectionManager.ConnectionState = .disconnected
 
@@ -27,6 +32,32 @@ class NetworkClient: ObservableObject {
     private var hasPendingMouse = false
     private let batchLock = NSLock()
 
+    // Session resumption: Haiku keeps held keys and buttons for a few
+    // seconds after a drop. Releases made while disconnected are replayed
+    // once the session is resumed so nothing stays stuck.
+    private let resumeWindow: TimeInterval = 3.0
+    private let maxPendingReleases = 64
+    private var sessionToken: UInt64 = 0
+    private var resumeDeadline = Date.distantPast
+    private var pendingReleases: [InputEvent] = []
+    private let releaseLock = NSLock()
+
+    // SessionCapability bits from SESSION_ACCEPT, 0 until then
+    private(set) var serverCapabilities: UInt32 = 0
+
+    // Clipboard payloads are written from their own queue, a BULK_FRAGMENT
+    // at a time, so a key press waits for one fragment at most rather than
+    // a whole image. The lock keeps frames from different threads whole.
+    private let bulkQueue = DispatchQueue(label: "com.softkm.network.bulk")
+    private let sendLock = NSLock()
+    // Small, so the kernel does not buffer much bulk data ahead of input
+    private let sendBufferSize: Int32 = 16384
+    private let maxBulkMessage = 8 + 16 * 1024 * 1024
+
+    var hasResumableSession: Bool {
+        return sessionToken != 0 && Date() < resumeDeadline
+    }
+
     func connect(to host: String, port: Int, useTLS: Bool) {
         disconnect()
 
@@ -85,6 +116,8 @@ class NetworkClient: ObservableObject {
             } else {
                 LOG("TCP_NODELAY enabled")
             }
+            var sndbuf = self.sendBufferSize
+            setsockopt(self.socketFD, SOL_SOCKET, SO_SNDBUF, &sndbuf, socklen_t(MemoryLayout<Int32>.size))
 
             // Connect
             if Darwin.connect(self.socketFD, addr.pointee.ai_addr, addr.pointee.ai_addrlen) < 0 {
@@ -104,6 +137,12 @@ class NetworkClient: ObservableObject {
 
             DispatchQueue.main.async {
                 self.connectionState = .connected
+                // Must be the first message so Haiku can restore the session
+                self.serverCapabilities = 0
+                self.sendDirect(event: .sessionHello(token: self.hasResumableSession ? self.sessionToken : 0,
+                                                     capabilities: Protocol.capabilityClipboardLZ4
+                                                         | Protocol.capabilityClipboardManifest
+                                                         | Protocol.capabilityBulkFragments))
                 self.startHeartbeat()
             }
 
@@ -119,6 +158,7 @@ class NetworkClient: ObservableObject {
         flushTimer?.invalidate()
         flushTimer = nil
         shouldRun = false
+        FileSender.shared.connectionClosed()
 
         if socketFD >= 0 {
             // Shutdown to unblock recv
@@ -166,6 +206,12 @@ class NetworkClient: ObservableObject {
     private func sendDirect(event: InputEvent) {
         let fd = socketFD
         guard connectionState == .connected, fd >= 0 else {
+            queueReleaseIfResumable(event)
+            return
+        }
+
+        if event.isBulk {
+            sendBulk(event: event, fd: fd)
             return
         }
 
@@ -178,20 +224,45 @@ class NetworkClient: ObservableObject {
             lastLogTime = now
         }
 
-        data.withUnsafeBytes { ptr in
-            let sent = Darwin.send(fd, ptr.baseAddress, data.count, 0)
-            if sent < 0 {
-                LOG("Send error: \(String(cString: strerror(errno)))")
-                DispatchQueue.main.async { [weak self] in
-                    self?.disconnect()
-                }
+        write(data, to: fd)
+    }
+
+    private func sendBulk(event: InputEvent, fd: Int32) {
+        let fragmenting = serverCapabilities & Protocol.capabilityBulkFragments != 0
+        bulkQueue.async { [weak self] in
+            guard let self = self else { return }
+            let message = Protocol.encode(event)
+            let frames = fragmenting && message.count > Protocol.bulkFragmentSize
+                ? Protocol.fragments(of: message) : [message]
+            for frame in frames {
+                // Stop if the connection went away meanwhile
+                guard self.socketFD == fd, self.write(frame, to: fd) else { return }
             }
         }
     }
 
+    @discardableResult
+    private func write(_ data: Data, to fd: Int32) -> Bool {
+        sendLock.lock()
+        defer { sendLock.unlock() }
+
+        let sent = data.withUnsafeBytes { ptr in
+            Darwin.send(fd, ptr.baseAddress, data.count, 0)
+        }
+        if sent < 0 {
+            LOG("Send error: \(String(cString: strerror(errno)))")
+            DispatchQueue.main.async { [weak self] in
+                self?.disconnect()
+            }
+            return false
+        }
+        return true
+    }
+
     private func receiveLoop() {
         var buffer = [UInt8](repeating: 0, count: 4096)
         var accumulated = Data()
+        var assembly = Data()  // bulk message being put back together
 
         while shouldRun && socketFD >= 0 {
             let bytesRead = recv(socketFD, &buffer, buffer.count, 0)
@@ -202,6 +273,7 @@ class NetworkClient: ObservableObject {
                 }
                 // Connection closed or error
                 LOG("Receive error or connection closed")
+                resumeDeadline = Date().addingTimeInterval(resumeWindow)
                 DispatchQueue.main.async { [weak self] in
                     self?.disconnect()
                     self?.scheduleReconnect()
@@ -231,12 +303,44 @@ class NetworkClient: ObservableObject {
 
                 // Process complete message
                 let messageData = accumulated.subdata(in: 0..<messageSize)
-                handleReceivedData(messageData)
+                if messageData[3] == EventType.bulkFragment.rawValue {
+                    if let message = addFragment(messageData, to: &assembly) {
+                        handleReceivedData(message)
+                    }
+                } else {
+                    handleReceivedData(messageData)
+                }
                 accumulated.removeSubrange(0..<messageSize)
             }
         }
     }
 
+    /// Returns the whole message once its last fragment is in. A fragment out
+    /// of order drops the message, like on the Haiku side.
+    private func addFragment(_ frame: Data, to assembly: inout Data) -> Data? {
+        guard frame.count >= 16 else {  // header(8) + messageLength(4) + offset(4)
+            LOG("BULK_FRAGMENT message too short")
+            return nil
+        }
+        let total = Int(frame.subdata(in: 8..<12).withUnsafeBytes { $0.load(as: UInt32.self) })
+        let offset = Int(frame.subdata(in: 12..<16).withUnsafeBytes { $0.load(as: UInt32.self) })
+        if offset == 0 {
+            assembly.removeAll()
+        }
+        guard offset == assembly.count, total >= 8, total <= maxBulkMessage,
+              offset + frame.count - 16 <= total else {
+            LOG("BULK_FRAGMENT out of order, dropping the message")
+            assembly.removeAll()
+            return nil
+        }
+
+        assembly.append(frame.subdata(in: 16..<frame.count))
+        guard assembly.count == total else { return nil }
+        let message = assembly
+        assembly = Data()
+        return message
+    }
+
     private func handleReceivedData(_ data: Data) {
         guard data.count >= 8 else {
             LOG("Data too short, ignoring")
@@ -246,6 +350,37 @@ class NetworkClient: ObservableObject {
         let eventType = data[3]
         if eventType == EventType.heartbeatAck.rawValue {
             // Heartbeat ACK - silent
+        } else if eventType == EventType.heartbeat.rawValue {
+            // Haiku measures round-trip time with its own heartbeats - echo them
+            sendDirect(event: .heartbeatAck)
+        } else if eventType == EventType.sessionAccept.rawValue {
+            guard data.count >= 18 else {  // header(8) + token(8) + resumed(1) + active(1)
+                LOG("SESSION_ACCEPT message too short")
+                return
+            }
+            let token = data.subdata(in: 8..<16).withUnsafeBytes { $0.load(as: UInt64.self) }
+            let resumed = data[16] != 0
+            LOG("Session \(resumed ? "resumed" : "started") (Haiku active=\(data[17]))")
+            sessionToken = token
+            // Capabilities trailer, absent from older servers
+            if data.count >= 22 {
+                serverCapabilities = data.subdata(in: 18..<22).withUnsafeBytes { $0.load(as: UInt32.self) }
+            }
+
+            releaseLock.lock()
+            let releases = pendingReleases
+            pendingReleases.removeAll()
+            releaseLock.unlock()
+            if resumed {
+                for event in releases {
+                    sendDirect(event: event)
+                }
+            }
+
+            let info = SessionInfo(resumed: resumed)
+            DispatchQueue.main.async {
+                NotificationCenter.default.post(name: .sessionEstablished, object: info)
+            }
         } else if eventType == EventType.controlSwitch.rawValue {
             // Haiku is telling us to switch control back to macOS
             guard data.count >= 9 else {
@@ -298,14 +433,105 @@ class NetworkClient: ObservableObject {
             let clipboardData = data.subdata(in: 13..<(13 + Int(dataLength)))
             LOG("Received clipboard from Haiku: \(dataLength) bytes")
 
+            // Content hash trailer, absent from older servers
+            var hash: UInt64? = nil
+            let hashStart = 13 + Int(dataLength)
+            if data.count >= hashStart + 8 {
+                hash = data.subdata(in: hashStart..<(hashStart + 8)).withUnsafeBytes { $0.load(as: UInt64.self) }
+            }
+
+            DispatchQueue.main.async {
+                ClipboardManager.shared.setClipboardFromSync(contentType: contentType, data: clipboardData, hash: hash)
+            }
+        } else if eventType == EventType.clipboardManifest.rawValue {
+            // Haiku announces its clipboard formats; nothing is fetched until a paste asks
+            guard data.count >= 13 else {  // header(8) + generation(4) + formatCount(1)
+                LOG("CLIPBOARD_MANIFEST message too short")
+                return
+            }
+            let generation = data.subdata(in: 8..<12).withUnsafeBytes { $0.load(as: UInt32.self) }
+            let count = Int(data[12])
+            guard data.count >= 13 + count * Protocol.manifestEntrySize else {
+                LOG("CLIPBOARD_MANIFEST incomplete")
+                return
+            }
+            var formats: [ClipboardFormat] = []
+            for index in 0..<count {
+                let start = 13 + index * Protocol.manifestEntrySize
+                let name = data.subdata(in: start..<(start + 32)).prefix { $0 != 0 }
+                let size = data.subdata(in: (start + 32)..<(start + 36)).withUnsafeBytes { $0.load(as: UInt32.self) }
+                let hash = data.subdata(in: (start + 36)..<(start + 44)).withUnsafeBytes { $0.load(as: UInt64.self) }
+                formats.append(ClipboardFormat(mimeType: String(decoding: name, as: UTF8.self), size: size, hash: hash))
+            }
             DispatchQueue.main.async {
-                ClipboardManager.shared.setClipboardFromSync(contentType: contentType, data: clipboardData)
+                ClipboardManager.shared.manifestReceived(generation: generation, formats: formats)
             }
+        } else if eventType == EventType.clipboardFetch.rawValue {
+            // Served right here: the main thread may be busy pasting
+            guard data.count >= 21 else {  // header(8) + generation(4) + format(1) + offset(4) + length(4)
+                LOG("CLIPBOARD_FETCH message too short")
+                return
+            }
+            let generation = data.subdata(in: 8..<12).withUnsafeBytes { $0.load(as: UInt32.self) }
+            let format = data[12]
+            let offset = data.subdata(in: 13..<17).withUnsafeBytes { $0.load(as: UInt32.self) }
+            let length = data.subdata(in: 17..<21).withUnsafeBytes { $0.load(as: UInt32.self) }
+            let chunk = ClipboardManager.shared.readChunk(generation: generation, format: format,
+                                                          offset: offset, length: length)
+            sendDirect(event: .clipboardChunk(generation: generation, format: format,
+                                              status: chunk == nil ? Protocol.chunkStatusGone : Protocol.chunkStatusOK,
+                                              offset: offset, data: chunk ?? Data()))
+        } else if eventType == EventType.clipboardChunk.rawValue {
+            // Not via the main thread, which is blocked in the paste waiting for it
+            guard data.count >= 22 else {  // header(8) + generation(4) + format(1) + status(1) + offset(4) + length(4)
+                LOG("CLIPBOARD_CHUNK message too short")
+                return
+            }
+            let generation = data.subdata(in: 8..<12).withUnsafeBytes { $0.load(as: UInt32.self) }
+            let format = data[12]
+            let status = data[13]
+            let offset = data.subdata(in: 14..<18).withUnsafeBytes { $0.load(as: UInt32.self) }
+            let length = Int(data.subdata(in: 18..<22).withUnsafeBytes { $0.load(as: UInt32.self) })
+            guard data.count >= 22 + length else {
+                LOG("CLIPBOARD_CHUNK incomplete")
+                return
+            }
+            ClipboardManager.shared.chunkReceived(generation: generation, format: format, status: status,
+                                                  offset: offset, data: data.subdata(in: 22..<(22 + length)))
+        } else if eventType == EventType.fileAccept.rawValue {
+            guard data.count >= 21 else {  // header(8) + transferId(4) + status(1) + offset(8)
+                LOG("FILE_ACCEPT message too short")
+                return
+            }
+            let transferId = data.subdata(in: 8..<12).withUnsafeBytes { $0.load(as: UInt32.self) }
+            let offset = data.subdata(in: 13..<21).withUnsafeBytes { $0.load(as: UInt64.self) }
+            FileSender.shared.accepted(transferId: transferId, status: data[12], offset: offset)
+        } else if eventType == EventType.fileDone.rawValue {
+            guard data.count >= 13 else {  // header(8) + transferId(4) + status(1)
+                LOG("FILE_DONE message too short")
+                return
+            }
+            let transferId = data.subdata(in: 8..<12).withUnsafeBytes { $0.load(as: UInt32.self) }
+            FileSender.shared.done(transferId: transferId, status: data[12])
         } else {
             LOG("Received event type: 0x\(String(format: "%02X", eventType))")
         }
     }
 
+    private func queueReleaseIfResumable(_ event: InputEvent) {
+        switch event {
+        case .keyUp, .mouseUp:
+            guard sessionToken != 0 else { return }
+            releaseLock.lock()
+            if pendingReleases.count < maxPendingReleases {
+                pendingReleases.append(event)
+            }
+            releaseLock.unlock()
+        default:
+            break
+        }
+    }
+
     private func startHeartbeat() {
         heartbeatTimer?.invalidate()
         heartbeatTimer = Timer.scheduledTimer(withTimeInterval: 5.0, repeats: true) { [weak self] _ in
@@ -320,7 +546,9 @@ class NetworkClient: ObservableObject {
     }
 
     private func scheduleReconnect() {
-        DispatchQueue.main.asyncAfter(deadline: .now() + 5.0) { [weak self] in
+        // Retry quickly while Haiku still holds our session
+        let delay = hasResumableSession ? 0.25 : 5.0
+        DispatchQueue.main.asyncAfter(deadline: .now() + delay) { [weak self] in
             guard self?.connectionState != .connected else { return }
             let settings = SettingsManager.shared
             self?.connect(to: settings.hostAddress, port: settings.port, useTLS: settings.useTLS)
@@ -12,6 +12,16 @@ enum EventType: UInt8 {
     case settingsSync = 0x12
     case teamMonitor = 0x13
     case clipboardSync = 0x14
+    case sessionHello = 0x15
+    case sessionAccept = 0x16
+    case clipboardManifest = 0x17
+    case clipboardFetch = 0x18
+    case clipboardChunk = 0x19
+    case bulkFragment = 0x1A
+    case fileOffer = 0x1B
+    case fileAccept = 0x1C
+    case fileData = 0x1D
+    case fileDone = 0x1E
     case heartbeat = 0xF0
     case heartbeatAck = 0xF1
 }
@@ -27,7 +37,13 @@ enum InputEvent {
     case screenInfo(width: Float, height: Float)
     case settingsSync(edgeDwellTime: Float, macSwitchEdge: UInt8, haikuReturnEdge: UInt8, yOffsetRatio: Float)
     case teamMonitor
-    case clipboardSync(contentType: UInt8, data: Data)
+    case clipboardSync(contentType: UInt8, data: Data, hash: UInt64)  // hash: ClipboardManager.contentHash(data)
+    case sessionHello(token: UInt64, capabilities: UInt32)  // token 0 = start a new session
+    case clipboardManifest(generation: UInt32, formats: [ClipboardFormat])
+    case clipboardFetch(generation: UInt32, format: UInt8, offset: UInt32, length: UInt32)
+    case clipboardChunk(generation: UInt32, format: UInt8, status: UInt8, offset: UInt32, data: Data)
+    case fileOffer(transferId: UInt32, size: UInt64, hash: UInt64, name: String)  // hash: ContentHasher over the file
+    case fileData(transferId: UInt32, offset: UInt64, data: Data)
     case heartbeat
     case heartbeatAck
 
@@ -44,16 +60,65 @@ enum InputEvent {
         case .settingsSync: return .settingsSync
         case .teamMonitor: return .teamMonitor
         case .clipboardSync: return .clipboardSync
+        case .sessionHello: return .sessionHello
+        case .clipboardManifest: return .clipboardManifest
+        case .clipboardFetch: return .clipboardFetch
+        case .clipboardChunk: return .clipboardChunk
+        case .fileOffer: return .fileOffer
+        case .fileData: return .fileData
         case .heartbeat: return .heartbeat
         case .heartbeatAck: return .heartbeatAck
         }
     }
+
+    /// Large payloads that must not hold up input on the socket
+    var isBulk: Bool {
+        switch self {
+        case .clipboardSync, .clipboardManifest, .clipboardChunk, .fileData: return true
+        default: return false
+        }
+    }
+}
+
+/// One entry of a CLIPBOARD_MANIFEST
+struct ClipboardFormat {
+    let mimeType: String    // at most 31 bytes, e.g. "text/plain"
+    let size: UInt32
+    let hash: UInt64        // ClipboardManager.contentHash
 }
 
 struct Protocol {
     static let magic: UInt16 = 0x534B  // "SK"
     static let version: UInt8 = 0x01
 
+    // Session capabilities, announced after the hello/accept payloads
+    static let capabilityClipboardLZ4: UInt32 = 0x01
+    static let capabilityClipboardManifest: UInt32 = 0x02
+    static let capabilityBulkFragments: UInt32 = 0x04
+
+    static let capabilityFileTransfer: UInt32 = 0x08
+
+    // BULK_FRAGMENT: messageLength(4) + offset(4) + a slice of the message
+    static let bulkFragmentSize = 8192
+
+    // Lazy clipboard: manifest entries and CLIPBOARD_CHUNK status
+    static let manifestEntrySize = 44  // mimeType(32) + size(4) + hash(8)
+    static let chunkStatusOK: UInt8 = 0
+    static let chunkStatusGone: UInt8 = 1
+
+    // File transfer: FILE_ACCEPT/FILE_DONE status, and how far ahead of the
+    // last accepted offset FILE_DATA may run
+    static let fileStatusOK: UInt8 = 0
+    static let fileStatusRefused: UInt8 = 1
+    static let fileStatusFailed: UInt8 = 2
+    static let fileStatusCorrupt: UInt8 = 3
+    static let fileDataChunkSize = 65536
+    static let fileTransferWindow: UInt64 = 2 * 1024 * 1024
+
+    // CLIPBOARD_SYNC contentType flag: uint32 original length + LZ4 block
+    static let clipboardCompressed: UInt8 = 0x80
+    static let clipboardCompressThreshold = 4096
+
     static func encode(_ event: InputEvent) -> Data {
         var data = Data()
 
@@ -71,6 +136,28 @@ struct Protocol {
         return data
     }
 
+    /// A bulk message cut into BULK_FRAGMENT frames, so that input can be
+    /// written between them
+    static func fragments(of message: Data) -> [Data] {
+        var frames: [Data] = []
+        var offset = 0
+        while offset < message.count {
+            let length = min(bulkFragmentSize, message.count - offset)
+            var frame = Data()
+            var magicLE = magic.littleEndian
+            frame.append(contentsOf: withUnsafeBytes(of: &magicLE) { Array($0) })
+            frame.append(version)
+            frame.append(EventType.bulkFragment.rawValue)
+            appendUInt32(&frame, UInt32(8 + length))
+            appendUInt32(&frame, UInt32(message.count))
+            appendUInt32(&frame, UInt32(offset))
+            frame.append(message.subdata(in: offset..<(offset + length)))
+            frames.append(frame)
+            offset += length
+        }
+        return frames
+    }
+
     private static func encodePayload(_ event: InputEvent) -> Data {
         var payload = Data()
 
@@ -124,10 +211,58 @@ struct Protocol {
             payload.append(haikuReturnEdge)
             appendFloat(&payload, yOffsetRatio)
 
-        case .clipboardSync(let contentType, let data):
+        case .clipboardSync(let contentType, let data, let hash):
             payload.append(contentType)
             appendUInt32(&payload, UInt32(data.count))
             payload.append(data)
+            // Trailer, lets Haiku skip committing content it already has
+            var hashLE = hash.littleEndian
+            payload.append(contentsOf: withUnsafeBytes(of: &hashLE) { Array($0) })
+
+        case .sessionHello(let token, let capabilities):
+            var tokenLE = token.littleEndian
+            payload.append(contentsOf: withUnsafeBytes(of: &tokenLE) { Array($0) })
+            appendUInt32(&payload, capabilities)
+
+        case .clipboardManifest(let generation, let formats):
+            appendUInt32(&payload, generation)
+            payload.append(UInt8(formats.count))
+            for format in formats {
+                var mimeType = Array(format.mimeType.utf8.prefix(31))
+                mimeType += [UInt8](repeating: 0, count: 32 - mimeType.count)
+                payload.append(contentsOf: mimeType)
+                appendUInt32(&payload, format.size)
+                var hashLE = format.hash.littleEndian
+                payload.append(contentsOf: withUnsafeBytes(of: &hashLE) { Array($0) })
+            }
+
+        case .clipboardFetch(let generation, let format, let offset, let length):
+            appendUInt32(&payload, generation)
+            payload.append(format)
+            appendUInt32(&payload, offset)
+            appendUInt32(&payload, length)
+
+        case .clipboardChunk(let generation, let format, let status, let offset, let data):
+            appendUInt32(&payload, generation)
+            payload.append(format)
+            payload.append(status)
+            appendUInt32(&payload, offset)
+            appendUInt32(&payload, UInt32(data.count))
+            payload.append(data)
+
+        case .fileOffer(let transferId, let size, let hash, let name):
+            appendUInt32(&payload, transferId)
+            appendUInt64(&payload, size)
+            appendUInt64(&payload, hash)
+            let bytes = Array(name.utf8.prefix(255))
+            payload.append(UInt8(bytes.count))
+            payload.append(contentsOf: bytes)
+
+        case .fileData(let transferId, let offset, let data):
+            appendUInt32(&payload, transferId)
+            appendUInt64(&payload, offset)
+            appendUInt32(&payload, UInt32(data.count))
+            payload.append(data)
 
         case .teamMonitor, .heartbeat, .heartbeatAck:
             break
@@ -141,6 +276,11 @@ struct Protocol {
         data.append(contentsOf: withUnsafeBytes(of: &valueLE) { Array($0) })
     }
 
+    private static func appendUInt64(_ data: inout Data, _ value: UInt64) {
+        var valueLE = value.littleEndian
+        data.append(contentsOf: withUnsafeBytes(of: &valueLE) { Array($0) })
+    }
+
     private static func appendFloat(_ data: inout Data, _ value: Float) {
         var bits = value.bitPattern.littleEndian
         data.append(contentsOf: withUnsafeBytes(of: &bits) { Array($0) })
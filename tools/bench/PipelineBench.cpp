@@ -0,0 +1,825 @@
+// Micro-benchmarks for the stages an input event passes through on the
+// server: framing and dispatch, key and modifier translation, InputCore
+// (game mode detection and edge checks) and, on Haiku, marshalling the
+// add-on message; and the clipboard codec, where an event is one whole
+// clipboard of typical text or code. Runs against libsoftkm_core, see
+// Makefile.
+//
+//   PipelineBench [--filter text] [--baseline file] [--threshold percent]
+//                 [--write-baseline file]
+//
+// With --baseline it exits 1 when a benchmark got slower than its baseline
+// by more than the threshold (default 50%, timings are noisy) or makes
+// more allocations per event than it did.
+
+#include "clipboard/ContentHash.h"
+#include "clipboard/Lz4Block.h"
+#include "input/EdgeSwitchPolicy.h"
+#include "input/InputCore.h"
+#include "input/KeyMap.h"
+#include "network/InputDispatcher.h"
+#include "network/MessageFramer.h"
+#include "network/Protocol.h"
+
+#ifdef __HAIKU__
+#include <Message.h>
+#endif
+
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every operator new in the process is counted; the benchmarks are
+// single-threaded
+static uint64 sAllocations = 0;
+
+void* operator new(size_t size)
+{
+    sAllocations++;
+    void* memory = malloc(size > 0 ? size : 1);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+static bigtime_t Now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (bigtime_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Keeps results alive so the compiler cannot drop the work
+static volatile uint64 sSink;
+
+// #pragma mark - Fakes
+
+class BenchClock : public Clock {
+public:
+    BenchClock() : fNow(1000000) {}
+    virtual bigtime_t Now() { return fNow += 1000; }    // a 1 kHz mouse
+
+private:
+    bigtime_t fNow;
+};
+
+class BenchScreen : public ScreenGeometry {
+public:
+    virtual void GetScreenSize(float* width, float* height)
+    {
+        *width = 1920;
+        *height = 1080;
+    }
+};
+
+// Takes every event and does nothing; the cursor either follows what it
+// is set to (normal use) or stays put (a game warping it back)
+class NullSink : public InjectionSink {
+public:
+    NullSink(bool pinned) : fPinned(pinned), fX(960), fY(540), fEvents(0) {}
+
+    virtual bool KeyDown(bigtime_t, uint32 key, uint32, const char*, uint8)
+        { fEvents += key; return true; }
+    virtual bool KeyUp(bigtime_t, uint32 key, uint32)
+        { fEvents += key; return true; }
+    virtual bool MouseMoved(bigtime_t, float x, float, uint32, uint32)
+        { fEvents += (uint64)x; return true; }
+    virtual bool MouseDown(bigtime_t, float, float, uint32, uint32, uint32)
+        { fEvents++; return true; }
+    virtual bool MouseUp(bigtime_t, float, float, uint32, uint32)
+        { fEvents++; return true; }
+    virtual bool MouseWheel(bigtime_t, float, float, uint32)
+        { fEvents++; return true; }
+
+    virtual void SetCursor(float x, float y)
+    {
+        if (!fPinned) {
+            fX = x;
+            fY = y;
+        }
+    }
+
+    virtual bool GetCursor(float* x, float* y)
+    {
+        *x = fX;
+        *y = fY;
+        return true;
+    }
+
+    uint64 Events() const { return fEvents; }
+
+private:
+    bool fPinned;
+    float fX;
+    float fY;
+    uint64 fEvents;
+};
+
+class NullLink : public PeerLink {
+public:
+    virtual bool HasNeighbour(uint8) const { return false; }
+    virtual void SendControlSwitch(uint8, float) {}
+    virtual status_t ForwardControl(uint8, float) { return B_ERROR; }
+};
+
+class NullHandler : public InputEventHandler {
+public:
+    NullHandler() : fTotal(0) {}
+
+    virtual void InjectKeyDown(uint32 keyCode, uint32 modifiers, const char*,
+        uint8 numBytes) { fTotal += keyCode + modifiers + numBytes; }
+    virtual void InjectKeyUp(uint32 keyCode, uint32 modifiers)
+        { fTotal += keyCode + modifiers; }
+    virtual void InjectMouseMove(float x, float y, bool, uint32 modifiers)
+        { fTotal += (uint64)(x + y) + modifiers; }
+    virtual void InjectMouseDown(uint32 buttons, float, float, uint32, uint32)
+        { fTotal += buttons; }
+    virtual void InjectMouseUp(uint32 buttons, float, float, uint32)
+        { fTotal += buttons; }
+    virtual void InjectMouseWheel(float, float, uint32) { fTotal++; }
+
+    uint64 fTotal;
+};
+
+// #pragma mark - Messages
+
+template<typename Payload>
+static void AppendMessage(std::vector<uint8>& stream, uint8 eventType,
+    const Payload& payload, const void* extra = nullptr, size_t extraLength = 0)
+{
+    ProtocolHeader header;
+    header.magic = PROTOCOL_MAGIC;
+    header.version = PROTOCOL_VERSION;
+    header.eventType = eventType;
+    header.length = sizeof(Payload) + extraLength;
+
+    const uint8* bytes = (const uint8*)&header;
+    stream.insert(stream.end(), bytes, bytes + sizeof(header));
+    bytes = (const uint8*)&payload;
+    stream.insert(stream.end(), bytes, bytes + sizeof(payload));
+    if (extraLength > 0) {
+        bytes = (const uint8*)extra;
+        stream.insert(stream.end(), bytes, bytes + extraLength);
+    }
+}
+
+static MouseMovePayload RelativeMove(float x, float y)
+{
+    MouseMovePayload move;
+    move.x = x;
+    move.y = y;
+    move.relative = 1;
+    move.modifiers = 0;
+    return move;
+}
+
+static KeyEventPayload KeyPayload(uint32 keyCode)
+{
+    KeyEventPayload key;
+    key.keyCode = keyCode;
+    key.modifiers = 0x01;
+    key.numBytes = 1;
+    return key;
+}
+
+// #pragma mark - Benchmarks
+
+// Each runs count events and returns something derived from them
+
+// 64 mouse moves arrive per recv(), as they do from a 1 kHz mouse over a
+// congested link; each is framed and decoded
+static uint64 FrameAndDispatch(uint64 count)
+{
+    std::vector<uint8> batch;
+    for (int i = 0; i < 64; i++)
+        AppendMessage(batch, EVENT_MOUSE_MOVE, RelativeMove(i & 1 ? 1 : -1, 0));
+
+    MessageFramer framer;
+    NullHandler handler;
+    for (uint64 done = 0; done < count; done += 64) {
+        size_t available;
+        uint8* buffer = framer.ReceiveBuffer(&available, batch.size());
+        memcpy(buffer, batch.data(), batch.size());
+        framer.Received(batch.size());
+
+        const uint8* message;
+        size_t length;
+        while (framer.NextMessage(&message, &length) == FRAME_MESSAGE)
+            DispatchInputEvent(message, length, &handler);
+    }
+    return handler.fTotal;
+}
+
+static uint64 DispatchKeyDown(uint64 count)
+{
+    std::vector<uint8> message;
+    AppendMessage(message, EVENT_KEY_DOWN, KeyPayload(0x00), "a", 1);
+
+    NullHandler handler;
+    for (uint64 i = 0; i < count; i++)
+        DispatchInputEvent(message.data(), message.size(), &handler);
+    return handler.fTotal;
+}
+
+static uint64 TranslateKeys(uint64 count)
+{
+    uint64 total = 0;
+    for (uint64 i = 0; i < count; i++) {
+        uint32 haikuKey;
+        TranslateKeyCode((uint32)(i & 0x7f), &haikuKey);
+        total += haikuKey;
+    }
+    return total;
+}
+
+static uint64 MapAllModifiers(uint64 count)
+{
+    uint64 total = 0;
+    for (uint64 i = 0; i < count; i++)
+        total += MapModifiers((uint32)(i & 0x7f));
+    return total;
+}
+
+// Back and forth in the middle of the screen: no edge, normal mode
+static uint64 CoreMouseMove(uint64 count)
+{
+    BenchClock clock;
+    BenchScreen screen;
+    NullSink sink(false);
+    NullLink link;
+    InputCore core(&clock, &screen, &sink);
+    core.SetPeerLink(&link);
+    core.SetActive(true);
+
+    for (uint64 i = 0; i < count; i++)
+        core.InjectMouseMove((i & 32) != 0 ? 3 : -3, 0, true, 0);
+    return sink.Events();
+}
+
+// Pushing along the return edge, below the dwell: every move is checked
+// against the switch rules
+static uint64 CoreMouseMoveAtEdge(uint64 count)
+{
+    BenchClock clock;
+    BenchScreen screen;
+    NullSink sink(false);
+    NullLink link;
+    InputCore core(&clock, &screen, &sink);
+    core.SetPeerLink(&link);
+    EdgeSwitchConfig config = { 1000000000LL, 0, 0, 0, 0 };
+    core.SetEdgeSwitchConfig(config);
+    core.SetReturnEdge(EDGE_LEFT);
+    core.SetActive(true);
+    core.InjectMouseMove(-100, 0, true, 0);
+
+    for (uint64 i = 0; i < count; i++)
+        core.InjectMouseMove(-1, (i & 32) != 0 ? 2 : -2, true, 0);
+    return sink.Events();
+}
+
+// The cursor is warped back by a game, so auto game mode kicks in
+static uint64 CoreMouseMoveGameMode(uint64 count)
+{
+    BenchClock clock;
+    BenchScreen screen;
+    NullSink sink(true);
+    NullLink link;
+    InputCore core(&clock, &screen, &sink);
+    core.SetPeerLink(&link);
+    core.SetActive(true);
+
+    for (uint64 i = 0; i < count; i++)
+        core.InjectMouseMove((i & 32) != 0 ? 3 : -3, 1, true, 0);
+    return sink.Events() + core.IsGameMode();
+}
+
+static uint64 EdgePolicyUpdate(uint64 count)
+{
+    EdgeSwitchPolicy policy;
+    policy.SetScreen(1920, 1080);
+    policy.SetEdges(1 << EDGE_LEFT);
+    uint64 total = 0;
+    bigtime_t when = 0;
+    for (uint64 i = 0; i < count; i++) {
+        when += 1000;
+        total += policy.Update(when, (float)(i & 7), 540, 0);
+    }
+    return total;
+}
+
+static uint64 CoreKeyDownUp(uint64 count)
+{
+    BenchClock clock;
+    BenchScreen screen;
+    NullSink sink(false);
+    InputCore core(&clock, &screen, &sink);
+    core.SetActive(true);
+
+    for (uint64 i = 0; i < count; i += 2) {
+        uint32 key = (uint32)(i & 0x3f);
+        core.InjectKeyDown(key, 0x1001, "a", 1);
+        core.InjectKeyUp(key, 0x1001);
+    }
+    return sink.Events();
+}
+
+// All of the above in a row, minus marshalling
+static uint64 PipelineMouseMove(uint64 count)
+{
+    std::vector<uint8> batch;
+    for (int i = 0; i < 64; i++)
+        AppendMessage(batch, EVENT_MOUSE_MOVE, RelativeMove(i & 32 ? 3 : -3, 0));
+
+    BenchClock clock;
+    BenchScreen screen;
+    NullSink sink(false);
+    NullLink link;
+    InputCore core(&clock, &screen, &sink);
+    core.SetPeerLink(&link);
+    core.SetActive(true);
+
+    MessageFramer framer;
+    for (uint64 done = 0; done < count; done += 64) {
+        size_t available;
+        uint8* buffer = framer.ReceiveBuffer(&available, batch.size());
+        memcpy(buffer, batch.data(), batch.size());
+        framer.Received(batch.size());
+
+        const uint8* message;
+        size_t length;
+        while (framer.NextMessage(&message, &length) == FRAME_MESSAGE)
+            DispatchInputEvent(message, length, &core);
+    }
+    return sink.Events();
+}
+
+// #pragma mark - Clipboard
+
+// Clipboards as people copy them: prose, and source code. Made up from
+// a fixed seed, so every run codes the same bytes.
+static uint32 sClipboardSeed;
+
+static uint32 NextRandom()
+{
+    sClipboardSeed ^= sClipboardSeed << 13;
+    sClipboardSeed ^= sClipboardSeed >> 17;
+    sClipboardSeed ^= sClipboardSeed << 5;
+    return sClipboardSeed;
+}
+
+static const char* Pick(const char* const* words, size_t count)
+{
+    // Two draws, the smaller wins: common words come up far more often,
+    // as in real text
+    uint32 a = NextRandom() % count;
+    uint32 b = NextRandom() % count;
+    return words[a < b ? a : b];
+}
+
+static const char* const kWords[] = {
+    "the", "of", "and", "to", "a", "in", "is", "that", "it", "for", "as",
+    "with", "was", "on", "be", "by", "this", "are", "or", "from", "at",
+    "which", "not", "but", "have", "an", "they", "we", "can", "all", "one",
+    "there", "been", "if", "more", "when", "will", "would", "so", "no",
+    "what", "up", "out", "about", "into", "than", "them", "only", "other",
+    "time", "some", "could", "these", "two", "may", "first", "then", "do",
+    "any", "like", "my", "now", "over", "such", "our", "even", "most",
+    "made", "after", "also", "did", "many", "before", "must", "through",
+    "years", "where", "much", "your", "way", "well", "down", "should",
+    "because", "each", "just", "those", "people", "how", "too", "little",
+    "state", "good", "very", "make", "world", "still", "own", "see", "men",
+    "work", "long", "get", "here", "between", "both", "life", "being",
+    "under", "never", "day", "same", "another", "know", "while", "last",
+    "might", "great", "old", "year", "off", "come", "since", "against",
+    "go", "came", "right", "used", "take", "three", "screen", "keyboard",
+    "pointer", "connection", "server", "clipboard", "window", "network",
+    "machine", "settings", "latency", "document", "meeting", "schedule",
+    "release", "version", "feature", "problem", "question", "answer",
+};
+
+static const char* const kIdentifiers[] = {
+    "status", "client", "message", "length", "buffer", "offset", "size",
+    "count", "index", "result", "header", "payload", "data", "name",
+    "fLock", "fClients", "fSocket", "fQueued", "fState", "B_OK",
+    "B_ERROR", "nullptr", "true", "false", "const", "uint32", "int32",
+    "status_t", "size_t", "bigtime_t", "fListener", "settings", "edge",
+};
+
+static void AppendWords(std::vector<uint8>& text, const char* const* words,
+    size_t count, int32 number)
+{
+    for (int32 i = 0; i < number; i++) {
+        const char* word = Pick(words, count);
+        if (i > 0)
+            text.push_back(' ');
+        text.insert(text.end(), word, word + strlen(word));
+    }
+}
+
+static std::vector<uint8> MakeText(size_t size)
+{
+    sClipboardSeed = 2463534242u;
+    std::vector<uint8> text;
+    while (text.size() < size) {
+        // A paragraph of sentences
+        int32 sentences = 3 + NextRandom() % 5;
+        for (int32 i = 0; i < sentences; i++) {
+            size_t start = text.size();
+            AppendWords(text, kWords, sizeof(kWords) / sizeof(kWords[0]),
+                6 + NextRandom() % 18);
+            text[start] = toupper(text[start]);
+            text.insert(text.end(), ". ", ". " + 2);
+        }
+        text.back() = '\n';
+        text.push_back('\n');
+    }
+    text.resize(size);
+    return text;
+}
+
+static std::vector<uint8> MakeCode(size_t size)
+{
+    static const char* const kLines[] = {
+        "%sif (%s == %s)\n",
+        "%sreturn %s;\n",
+        "%s%s = %s;\n",
+        "%s%s(%s);\n",
+        "%sfor (int32 i = 0; i < %s; i++) {\n",
+        "%s// %s %s\n",
+        "%sstatus_t %s = %s->Send(%s, sizeof(header));\n",
+        "%s} else if (%s != B_OK) {\n",
+    };
+    static const char* const kIndents[] = { "", "    ", "        ",
+        "            " };
+
+    sClipboardSeed = 88675123u;
+    size_t identifierCount = sizeof(kIdentifiers) / sizeof(kIdentifiers[0]);
+    std::vector<uint8> code;
+    char line[256];
+    while (code.size() < size) {
+        const char* indent = kIndents[1 + NextRandom() % 3];
+        uint32 kind = NextRandom() % (sizeof(kLines) / sizeof(kLines[0]));
+        int length;
+        if (kind == 5) {
+            // Comments are prose
+            std::vector<uint8> words;
+            AppendWords(words, kWords, sizeof(kWords) / sizeof(kWords[0]),
+                4 + NextRandom() % 8);
+            words.push_back('\0');
+            length = snprintf(line, sizeof(line), "%s// %s\n", indent,
+                (const char*)words.data());
+        } else {
+            length = snprintf(line, sizeof(line), kLines[kind], indent,
+                Pick(kIdentifiers, identifierCount),
+                Pick(kIdentifiers, identifierCount),
+                Pick(kIdentifiers, identifierCount));
+        }
+        code.insert(code.end(), line, line + std::min(length,
+            (int)sizeof(line) - 1));
+        if (NextRandom() % 8 == 0)
+            code.insert(code.end(), "}\n\n", "}\n\n" + 3);
+    }
+    code.resize(size);
+    return code;
+}
+
+// A clipboard and its LZ4 block, made once and shared by all runs
+struct ClipboardSample {
+    std::vector<uint8> content;
+    std::vector<uint8> compressed;
+    std::vector<uint8> decoded;
+};
+
+static ClipboardSample& Sample(bool code, size_t size)
+{
+    static std::map<std::pair<bool, size_t>, ClipboardSample> sSamples;
+    ClipboardSample& sample = sSamples[std::make_pair(code, size)];
+    if (sample.content.empty()) {
+        sample.content = code ? MakeCode(size) : MakeText(size);
+        sample.compressed.resize(Lz4CompressBound(size));
+        ssize_t length = Lz4Compress(sample.content.data(), size,
+            sample.compressed.data(), sample.compressed.size());
+        sample.compressed.resize(length > 0 ? length : 0);
+        sample.decoded.resize(size);
+    }
+    return sample;
+}
+
+// What SendClipboardSync() does to content of 4 KB and up, into a buffer
+// of Lz4CompressBound() allocated once
+template<bool kCode, size_t kSize>
+static uint64 ClipboardCompress(uint64 count)
+{
+    ClipboardSample& sample = Sample(kCode, kSize);
+    static std::vector<uint8> sBuffer(Lz4CompressBound(kSize));
+    uint64 total = 0;
+    for (uint64 i = 0; i < count; i++) {
+        total += Lz4Compress(sample.content.data(), kSize, sBuffer.data(),
+            sBuffer.size());
+    }
+    return total;
+}
+
+// The receiving end: straight into one buffer of the original size
+template<bool kCode, size_t kSize>
+static uint64 ClipboardDecompress(uint64 count)
+{
+    ClipboardSample& sample = Sample(kCode, kSize);
+    uint64 total = 0;
+    for (uint64 i = 0; i < count; i++) {
+        total += Lz4Decompress(sample.compressed.data(),
+            sample.compressed.size(), sample.decoded.data(), kSize);
+    }
+    return total;
+}
+
+// The hash every CLIPBOARD_SYNC carries, taken by both ends
+template<size_t kSize>
+static uint64 ClipboardHash(uint64 count)
+{
+    ClipboardSample& sample = Sample(false, kSize);
+    uint64 total = 0;
+    for (uint64 i = 0; i < count; i++)
+        total += ContentHash(sample.content.data(), kSize);
+    return total;
+}
+
+// Returns how many did not decode to what was compressed
+static int PrintClipboardRatios()
+{
+    static const size_t kSizes[] = { 4096, 65536, 1048576 };
+    printf("\n%-24s %10s %10s\n", "clipboard", "bytes", "ratio");
+    int mismatches = 0;
+    for (int code = 0; code < 2; code++) {
+        for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); i++) {
+            ClipboardSample& sample = Sample(code != 0, kSizes[i]);
+            char name[32];
+            snprintf(name, sizeof(name), "%s %zu KB", code ? "code" : "text",
+                kSizes[i] / 1024);
+            Lz4Decompress(sample.compressed.data(), sample.compressed.size(),
+                sample.decoded.data(), kSizes[i]);
+            bool mismatch = sample.decoded != sample.content;
+            printf("%-24s %10zu %9.2f:1%s\n", name, sample.compressed.size(),
+                (double)kSizes[i] / sample.compressed.size(),
+                mismatch ? "  MISMATCH" : "");
+            if (mismatch)
+                mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+#ifdef __HAIKU__
+// What InputInjector does for each event on its way to the add-on port,
+// short of write_port()
+static uint64 MarshalMouseMove(uint64 count)
+{
+    uint64 total = 0;
+    for (uint64 i = 0; i < count; i++) {
+        BMessage msg('sMmv');
+        msg.AddPoint("where", BPoint((float)(i & 1023), 540));
+        msg.AddInt32("buttons", 0);
+        msg.AddInt32("modifiers", 0);
+
+        ssize_t flatSize = msg.FlattenedSize();
+        char* buffer = new char[flatSize];
+        if (msg.Flatten(buffer, flatSize) == B_OK)
+            total += buffer[flatSize - 1];
+        delete[] buffer;
+    }
+    return total;
+}
+
+static uint64 MarshalKeyDown(uint64 count)
+{
+    uint64 total = 0;
+    for (uint64 i = 0; i < count; i++) {
+        BMessage msg('sKdn');
+        msg.AddInt32("key", (int32)(i & 0x7f));
+        msg.AddInt32("modifiers", 0x1001);
+        msg.AddInt32("raw_char", 'a');
+        msg.AddString("bytes", "a");
+
+        ssize_t flatSize = msg.FlattenedSize();
+        char* buffer = new char[flatSize];
+        if (msg.Flatten(buffer, flatSize) == B_OK)
+            total += buffer[flatSize - 1];
+        delete[] buffer;
+    }
+    return total;
+}
+#endif
+
+struct Benchmark {
+    const char* name;
+    uint64 (*run)(uint64 count);
+};
+
+static const Benchmark kBenchmarks[] = {
+    { "frame_dispatch_move", FrameAndDispatch },
+    { "dispatch_key_down", DispatchKeyDown },
+    { "translate_key_code", TranslateKeys },
+    { "map_modifiers", MapAllModifiers },
+    { "edge_policy_update", EdgePolicyUpdate },
+    { "core_mouse_move", CoreMouseMove },
+    { "core_mouse_move_edge", CoreMouseMoveAtEdge },
+    { "core_mouse_move_game", CoreMouseMoveGameMode },
+    { "core_key_down_up", CoreKeyDownUp },
+    { "pipeline_mouse_move", PipelineMouseMove },
+    { "lz4_compress_text_4k", ClipboardCompress<false, 4096> },
+    { "lz4_decompress_text_4k", ClipboardDecompress<false, 4096> },
+    { "lz4_compress_code_4k", ClipboardCompress<true, 4096> },
+    { "lz4_decompress_code_4k", ClipboardDecompress<true, 4096> },
+    { "lz4_compress_text_64k", ClipboardCompress<false, 65536> },
+    { "lz4_decompress_text_64k", ClipboardDecompress<false, 65536> },
+    { "lz4_compress_code_64k", ClipboardCompress<true, 65536> },
+    { "lz4_decompress_code_64k", ClipboardDecompress<true, 65536> },
+    { "lz4_compress_text_1m", ClipboardCompress<false, 1048576> },
+    { "lz4_decompress_text_1m", ClipboardDecompress<false, 1048576> },
+    { "content_hash_1m", ClipboardHash<1048576> },
+#ifdef __HAIKU__
+    { "marshal_mouse_move", MarshalMouseMove },
+    { "marshal_key_down", MarshalKeyDown },
+#endif
+};
+
+// #pragma mark - Runner
+
+struct Result {
+    double nanoseconds;     // per event
+    double allocations;     // per event
+};
+
+static Result Measure(const Benchmark& benchmark)
+{
+    // Grow the count until a run takes long enough to time; from one, for
+    // the clipboards of a megabyte
+    uint64 count = 1;
+    bigtime_t elapsed;
+    for (;;) {
+        bigtime_t start = Now();
+        sSink = benchmark.run(count);
+        elapsed = Now() - start;
+        if (elapsed > 50000000 || count >= (1ULL << 32))
+            break;
+        count *= 4;
+    }
+
+    // The best of several runs, the others met interruptions
+    Result result;
+    result.nanoseconds = (double)elapsed / count;
+    for (int run = 0; run < 5; run++) {
+        uint64 allocations = sAllocations;
+        bigtime_t start = Now();
+        sSink = benchmark.run(count);
+        elapsed = Now() - start;
+        double nanoseconds = (double)elapsed / count;
+        if (nanoseconds < result.nanoseconds)
+            result.nanoseconds = nanoseconds;
+        result.allocations = (double)(sAllocations - allocations) / count;
+    }
+    return result;
+}
+
+static bool ReadBaseline(const char* path, std::map<std::string, Result>& baseline)
+{
+    FILE* file = fopen(path, "r");
+    if (file == nullptr)
+        return false;
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        char name[128];
+        Result result;
+        if (line[0] == '#'
+            || sscanf(line, "%127s %lf %lf", name, &result.nanoseconds,
+                &result.allocations) != 3)
+            continue;
+        baseline[name] = result;
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const char* filter = nullptr;
+    const char* baselinePath = nullptr;
+    const char* writePath = nullptr;
+    double threshold = 50;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            filter = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+            baselinePath = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--write-baseline") == 0 && i + 1 < argc)
+            writePath = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [--filter text] [--baseline file] "
+                "[--threshold percent] [--write-baseline file]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::map<std::string, Result> baseline;
+    if (baselinePath != nullptr && !ReadBaseline(baselinePath, baseline)) {
+        fprintf(stderr, "Cannot read baseline %s\n", baselinePath);
+        return 2;
+    }
+
+    FILE* output = nullptr;
+    if (writePath != nullptr) {
+        output = fopen(writePath, "w");
+        if (output == nullptr) {
+            fprintf(stderr, "Cannot write %s\n", writePath);
+            return 2;
+        }
+        fprintf(output, "# name ns/event allocations/event\n");
+    }
+
+    printf("%-24s %10s %12s %10s\n", "benchmark", "ns/event", "allocs/event",
+        "baseline");
+    int regressions = 0;
+    bool codec = false;
+    for (size_t i = 0; i < sizeof(kBenchmarks) / sizeof(kBenchmarks[0]); i++) {
+        const Benchmark& benchmark = kBenchmarks[i];
+        if (filter != nullptr && strstr(benchmark.name, filter) == nullptr)
+            continue;
+
+        if (strncmp(benchmark.name, "lz4_", 4) == 0)
+            codec = true;
+
+        Result result = Measure(benchmark);
+        printf("%-24s %10.1f %12.3f", benchmark.name, result.nanoseconds,
+            result.allocations);
+        if (output != nullptr) {
+            fprintf(output, "%s %.1f %.3f\n", benchmark.name,
+                result.nanoseconds, result.allocations);
+        }
+
+        std::map<std::string, Result>::iterator known
+            = baseline.find(benchmark.name);
+        if (known == baseline.end()) {
+            printf("\n");
+            continue;
+        }
+
+        const Result& expected = known->second;
+        bool slower = result.nanoseconds
+            > expected.nanoseconds * (1 + threshold / 100);
+        bool allocates = result.allocations > expected.allocations + 0.001;
+        printf(" %10.1f%s%s\n", expected.nanoseconds,
+            slower ? "  SLOWER" : "", allocates ? "  MORE ALLOCATIONS" : "");
+        if (slower || allocates)
+            regressions++;
+    }
+
+    if (output != nullptr)
+        fclose(output);
+    if (codec) {
+        int mismatches = PrintClipboardRatios();
+        if (mismatches > 0) {
+            printf("%d clipboard(s) did not survive LZ4\n", mismatches);
+            return 1;
+        }
+    }
+    if (regressions > 0) {
+        printf("%d regression(s) beyond %.0f%% or in allocations\n",
+            regressions, threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,416 @@
+// Keystroke latency during a bulk transfer, on one machine: the server
+// pushes a multi-megabyte clipboard to a client that reads no faster than
+// a real link would carry it, and sends a key press every --interval ms
+// meanwhile, over ServerLoop and its SendScheduler on loopback. Sockets
+// are set up as NetworkServer sets them up. Three runs:
+//
+//   idle        keys only
+//   fragmented  the transfer as BULK_FRAGMENTs, as to current clients
+//   whole       the transfer as one message, as to clients that cannot
+//               reassemble; for comparison only
+//
+//   BulkHarness [--size MB] [--rate MB/s] [--interval ms] [--max-p99 µs]
+//
+// Prints key latency from the server sending to the client reading it.
+// With --max-p99 it exits 1 if the fragmented p99 is above that; it
+// always does if a key or the transfer went missing.
+
+#include "LoadClient.h"
+
+#include "network/MessageFramer.h"
+#include "network/Protocol.h"
+#include "network/ServerLoop.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// NetworkServer's kSendBufferSize
+static const int kSendBufferSize = 16384;
+// Keys sent in the idle run
+static const int32 kIdleKeys = 500;
+
+
+class BulkServer : public ServerLoopListener {
+public:
+    BulkServer() : fClient(-1), fLoop(this) {}
+
+    status_t Start();
+    void Stop();
+    uint16 Port() const { return fLoop.Port(); }
+
+    void SetFragmenting(bool fragmenting)
+        { fLoop.SetFragmenting(fClient, fragmenting); }
+    status_t SendTransfer(size_t size);
+    // The key code carries the sequence number
+    status_t SendKey(uint32 sequence);
+
+    std::atomic<int32> fClient;
+
+    // ServerLoopListener
+    virtual void ClientConnected(int32 client, int socket,
+        const char* address);
+    virtual void MessageReceived(int32 client, const uint8* message,
+        size_t length) {}
+    virtual void ClientDisconnected(int32 client, const char* reason)
+        { fClient = -1; }
+
+private:
+    ServerLoop fLoop;
+    std::thread fThread;
+};
+
+status_t BulkServer::Start()
+{
+    status_t status = fLoop.Listen(0, 1);
+    if (status != B_OK)
+        return status;
+
+    fThread = std::thread(&ServerLoop::Run, &fLoop);
+    return B_OK;
+}
+
+void BulkServer::Stop()
+{
+    fLoop.Quit();
+    if (fThread.joinable())
+        fThread.join();
+}
+
+void BulkServer::ClientConnected(int32 client, int socket,
+    const char* address)
+{
+    int sndbuf = kSendBufferSize;
+    setsockopt(socket, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    fClient = client;
+}
+
+status_t BulkServer::SendTransfer(size_t size)
+{
+    // An uncompressed CLIPBOARD_SYNC, without the optional hash
+    std::vector<uint8> message(sizeof(ProtocolHeader)
+        + sizeof(ClipboardSyncPayload) + size, 'x');
+    ProtocolHeader* header = (ProtocolHeader*)message.data();
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = EVENT_CLIPBOARD_SYNC;
+    header->length = sizeof(ClipboardSyncPayload) + size;
+
+    ClipboardSyncPayload* payload
+        = (ClipboardSyncPayload*)(message.data() + sizeof(ProtocolHeader));
+    payload->contentType = 0x00;
+    payload->dataLength = size;
+
+    return fLoop.Send(fClient, message.data(), message.size(), SEND_BULK);
+}
+
+status_t BulkServer::SendKey(uint32 sequence)
+{
+    uint8 buffer[sizeof(ProtocolHeader) + sizeof(KeyEventPayload) + 1];
+    ProtocolHeader* header = (ProtocolHeader*)buffer;
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = EVENT_KEY_DOWN;
+    header->length = sizeof(KeyEventPayload) + 1;
+
+    KeyEventPayload key = { sequence, 0, 1 };
+    memcpy(buffer + sizeof(ProtocolHeader), &key, sizeof(key));
+    buffer[sizeof(buffer) - 1] = 'a';
+    return fLoop.Send(fClient, buffer, sizeof(buffer));
+}
+
+
+// Reads on a thread of its own at no more than rate bytes per second,
+// stamping each key by its sequence number
+class BulkClient {
+public:
+    BulkClient(double rate, size_t maxKeys);
+    ~BulkClient();
+
+    bool Connect(uint16 port);
+    // Until the server hangs up
+    void Join();
+
+    // Only safe to read after Join()
+    const std::vector<bigtime_t>& Arrivals() const { return fArrivals; }
+
+    std::atomic<int32> fTransfers;
+
+private:
+    void Run();
+
+    double fRate;
+    int fSocket;
+    MessageFramer fIn;
+    std::vector<bigtime_t> fArrivals;
+    std::thread fThread;
+};
+
+BulkClient::BulkClient(double rate, size_t maxKeys)
+    : fTransfers(0),
+      fRate(rate),
+      fSocket(-1),
+      fArrivals(maxKeys, 0)
+{
+}
+
+BulkClient::~BulkClient()
+{
+    if (fSocket >= 0)
+        close(fSocket);
+}
+
+bool BulkClient::Connect(uint16 port)
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    fSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (fSocket < 0)
+        return false;
+
+    // Small, as on the server, so the backlog stays in the scheduler
+    int rcvbuf = kSendBufferSize;
+    setsockopt(fSocket, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (connect(fSocket, (struct sockaddr*)&address, sizeof(address)) < 0)
+        return false;
+
+    int opt = 1;
+    setsockopt(fSocket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    fThread = std::thread(&BulkClient::Run, this);
+    return true;
+}
+
+void BulkClient::Join()
+{
+    if (fThread.joinable())
+        fThread.join();
+}
+
+void BulkClient::Run()
+{
+    bigtime_t start = LoadNow();
+    double consumed = 0;
+    for (;;) {
+        // What the link has carried since the start, less what was read
+        double allowed = fRate * (LoadNow() - start) / 1000000 - consumed;
+        if (allowed < 1024) {
+            usleep(500);
+            continue;
+        }
+
+        size_t available;
+        uint8* buffer = fIn.ReceiveBuffer(&available, 65536);
+        available = std::min(available, (size_t)allowed);
+        ssize_t bytesRead = recv(fSocket, buffer, available, 0);
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            return;
+        fIn.Received(bytesRead);
+        consumed += bytesRead;
+
+        // Never more than one link's worth of idle time saved up
+        consumed = std::max(consumed,
+            fRate * (LoadNow() - start) / 1000000 - 65536);
+
+        const uint8* message;
+        size_t length;
+        while (fIn.NextMessage(&message, &length) == FRAME_MESSAGE) {
+            const ProtocolHeader* header = (const ProtocolHeader*)message;
+            const uint8* payload = message + sizeof(ProtocolHeader);
+            if (header->eventType == EVENT_KEY_DOWN
+                && header->length >= sizeof(KeyEventPayload)) {
+                KeyEventPayload key;
+                memcpy(&key, payload, sizeof(key));
+                if (key.keyCode < fArrivals.size())
+                    fArrivals[key.keyCode] = LoadNow();
+            } else if (header->eventType == EVENT_BULK_FRAGMENT) {
+                const BulkFragmentPayload* fragment
+                    = (const BulkFragmentPayload*)payload;
+                if (fragment->offset + length - sizeof(ProtocolHeader)
+                        - sizeof(BulkFragmentPayload)
+                        == fragment->messageLength)
+                    fTransfers++;
+            } else if (header->eventType == EVENT_CLIPBOARD_SYNC)
+                fTransfers++;
+        }
+    }
+}
+
+
+struct KeyRun {
+    uint32 first;               // sequence number of its first key
+    std::vector<bigtime_t> sent;
+};
+
+// Keys every interval, for count keys or, with a transfer, until the
+// client has all of it; false if it never arrived
+static bool RunKeys(BulkServer& server, BulkClient& client, size_t transfer,
+    bigtime_t interval, uint32 maxKeys, KeyRun& run)
+{
+    int32 transfers = client.fTransfers;
+    if (transfer > 0 && server.SendTransfer(transfer) != B_OK)
+        return false;
+
+    bigtime_t next = LoadNow();
+    for (;;) {
+        uint32 sequence = run.first + run.sent.size();
+        if (sequence >= maxKeys)
+            return false;
+        if (transfer == 0 && (int32)run.sent.size() == kIdleKeys)
+            break;
+        if (transfer > 0 && client.fTransfers > transfers)
+            break;
+
+        while (LoadNow() < next)
+            usleep(100);
+        run.sent.push_back(LoadNow());
+        if (server.SendKey(sequence) != B_OK)
+            return false;
+        next += interval;
+    }
+
+    // The last keys reach the client
+    usleep(50000);
+    return true;
+}
+
+// Latencies of run; the number of keys that never arrived in *lost
+static std::vector<bigtime_t> Latencies(const KeyRun& run,
+    const std::vector<bigtime_t>& arrivals, int32* lost)
+{
+    std::vector<bigtime_t> times;
+    for (size_t i = 0; i < run.sent.size(); i++) {
+        bigtime_t arrived = arrivals[run.first + i];
+        if (arrived == 0)
+            (*lost)++;
+        else
+            times.push_back(arrived - run.sent[i]);
+    }
+    return times;
+}
+
+static void PrintTimes(const char* name, std::vector<bigtime_t>& times)
+{
+    printf("  %-20s %6zu %9lld %9lld %9lld\n", name, times.size(),
+        (long long)Percentile(times, 50), (long long)Percentile(times, 99),
+        (long long)Percentile(times, 100));
+}
+
+static void Usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [--size MB] [--rate MB/s] [--interval ms] "
+        "[--max-p99 µs]\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    size_t size = 4 * 1024 * 1024;
+    double rate = 12.5 * 1024 * 1024;
+    bigtime_t interval = 2000;
+    bigtime_t maxP99 = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        double number = value != nullptr ? atof(value) : 0;
+
+        if (strcmp(argv[i], "--size") == 0 && number > 0)
+            size = (size_t)(number * 1024 * 1024);
+        else if (strcmp(argv[i], "--rate") == 0 && number > 0)
+            rate = number * 1024 * 1024;
+        else if (strcmp(argv[i], "--interval") == 0 && number > 0)
+            interval = (bigtime_t)(number * 1000);
+        else if (strcmp(argv[i], "--max-p99") == 0 && number > 0)
+            maxP99 = (bigtime_t)number;
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (size > kMaxMessageSize - 64) {
+        fprintf(stderr, "At most %zu MB in one message\n",
+            kMaxMessageSize / (1024 * 1024) - 1);
+        return 2;
+    }
+
+    // Room for both transfers with a few times the keys they should take
+    uint32 maxKeys = kIdleKeys
+        + 2 * 4 * (uint32)(size / rate * 1000000 / interval + 100);
+
+    BulkServer server;
+    BulkClient client(rate, maxKeys);
+    if (server.Start() != B_OK || !client.Connect(server.Port())) {
+        fprintf(stderr, "Cannot connect: %s\n", strerror(errno));
+        server.Stop();
+        return 2;
+    }
+    bigtime_t deadline = LoadNow() + 2000000;
+    while (server.fClient < 0 && LoadNow() < deadline)
+        usleep(1000);
+
+    KeyRun idle = { 0 };
+    KeyRun fragmented;
+    KeyRun whole;
+    bool completed = server.fClient >= 0
+        && RunKeys(server, client, 0, interval, maxKeys, idle);
+    if (completed) {
+        fragmented.first = idle.first + idle.sent.size();
+        server.SetFragmenting(true);
+        completed = RunKeys(server, client, size, interval, maxKeys,
+            fragmented);
+    }
+    if (completed) {
+        whole.first = fragmented.first + fragmented.sent.size();
+        server.SetFragmenting(false);
+        completed = RunKeys(server, client, size, interval, maxKeys, whole);
+    }
+
+    server.Stop();
+    client.Join();
+
+    if (!completed) {
+        fprintf(stderr, "A transfer never completed\n");
+        return 1;
+    }
+
+    int32 lost = 0;
+    std::vector<bigtime_t> idleTimes
+        = Latencies(idle, client.Arrivals(), &lost);
+    std::vector<bigtime_t> fragmentedTimes
+        = Latencies(fragmented, client.Arrivals(), &lost);
+    std::vector<bigtime_t> wholeTimes
+        = Latencies(whole, client.Arrivals(), &lost);
+
+    printf("%.1f MB at %.1f MB/s, a key every %.1f ms\n",
+        size / (1024.0 * 1024), rate / (1024 * 1024), interval / 1000.0);
+    printf("  %-20s %6s %9s %9s %9s\n", "key µs", "keys", "p50", "p99",
+        "max");
+    PrintTimes("idle", idleTimes);
+    PrintTimes("fragmented", fragmentedTimes);
+    PrintTimes("whole", wholeTimes);
+
+    if (lost > 0) {
+        printf("%d keys never arrived\n", (int)lost);
+        return 1;
+    }
+    if (maxP99 > 0 && Percentile(fragmentedTimes, 99) > maxP99) {
+        printf("fragmented p99 above %lld µs\n", (long long)maxP99);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,457 @@
+// One ServerLoop serving hundreds of connections, on one machine. A crowd
+// of idle-ish clients each sends a heartbeat every --interval ms, as
+// Mac clients in monitor mode do, while the owner moves the mouse at
+// 1 kHz through LoadClient. Shows whether the loop's cost per wake-up,
+// which grows with the number of sockets it polls, eats into the owner's
+// latency, and whether any client gets starved or dropped.
+//
+//   CrowdHarness [--clients n] [--interval ms] [--mouse hz] ...
+//                [--duration seconds] [--max-p99 µs]
+//
+// Prints how long connecting the crowd took and heartbeat round trips
+// for the owner and the crowd. With --max-p99 it exits 1 if the owner's
+// p99 is above that; it always does if a client was dropped or never
+// answered.
+
+#include "LoadClient.h"
+#include "Workloads.h"
+
+#include "network/MessageFramer.h"
+#include "network/Protocol.h"
+#include "network/ServerLoop.h"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+
+// Answers heartbeats and counts input, for any number of clients
+class CrowdServer : public ServerLoopListener {
+public:
+    CrowdServer() : fClients(0), fDropped(0), fInput(0), fLoop(this) {}
+
+    status_t Start();
+    void Stop();
+    uint16 Port() const { return fLoop.Port(); }
+
+    std::atomic<int32> fClients;
+    std::atomic<int32> fDropped;
+    std::atomic<int64> fInput;
+
+    // ServerLoopListener
+    virtual void ClientConnected(int32 client, int socket,
+        const char* address) { fClients++; }
+    virtual void MessageReceived(int32 client, const uint8* message,
+        size_t length);
+    virtual void ClientDisconnected(int32 client, const char* reason)
+        { fClients--; fDropped++; }
+
+private:
+    ServerLoop fLoop;
+    std::thread fThread;
+};
+
+status_t CrowdServer::Start()
+{
+    status_t status = fLoop.Listen(0, 128);
+    if (status != B_OK)
+        return status;
+
+    fThread = std::thread(&ServerLoop::Run, &fLoop);
+    return B_OK;
+}
+
+void CrowdServer::Stop()
+{
+    fLoop.Quit();
+    if (fThread.joinable())
+        fThread.join();
+}
+
+void CrowdServer::MessageReceived(int32 client, const uint8* message,
+    size_t length)
+{
+    const ProtocolHeader* header = (const ProtocolHeader*)message;
+    if (header->eventType >= EVENT_KEY_DOWN
+        && header->eventType <= EVENT_MOUSE_WHEEL) {
+        fInput++;
+        return;
+    }
+    if (header->eventType != EVENT_HEARTBEAT)
+        return;
+
+    ProtocolHeader ack;
+    ack.magic = PROTOCOL_MAGIC;
+    ack.version = PROTOCOL_VERSION;
+    ack.eventType = EVENT_HEARTBEAT_ACK;
+    ack.length = 0;
+    fLoop.Send(client, &ack, sizeof(ack));
+}
+
+
+// The crowd, all on one thread of its own
+class Crowd {
+public:
+    Crowd(bigtime_t interval) : fInterval(interval), fRunning(false) {}
+    ~Crowd();
+
+    // Connects count clients one after the other
+    bool Connect(uint16 port, int32 count);
+    void Start();
+    // Joins the thread; the results are safe to read after
+    void Stop();
+
+    int32 Count() const { return (int32)fPeers.size(); }
+    int32 Unanswered() const;
+    int32 Lost() const;
+    std::vector<bigtime_t>& RoundTrips() { return fRoundTrips; }
+
+private:
+    struct Peer {
+        int socket;
+        MessageFramer in;
+        bigtime_t next;         // due time of the next heartbeat
+        bigtime_t sent;         // of the heartbeat in flight, 0 if none
+        int32 answered;
+    };
+
+    void Run();
+    bool Receive(Peer& peer);
+
+    bigtime_t fInterval;
+    std::vector<Peer*> fPeers;
+    std::vector<bigtime_t> fRoundTrips;
+    std::thread fThread;
+    std::atomic<bool> fRunning;
+};
+
+Crowd::~Crowd()
+{
+    for (size_t i = 0; i < fPeers.size(); i++) {
+        if (fPeers[i]->socket >= 0)
+            close(fPeers[i]->socket);
+        delete fPeers[i];
+    }
+}
+
+bool Crowd::Connect(uint16 port, int32 count)
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    for (int32 i = 0; i < count; i++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+        if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            close(fd);
+            return false;
+        }
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+        Peer* peer = new Peer;
+        peer->socket = fd;
+        peer->next = 0;
+        peer->sent = 0;
+        peer->answered = 0;
+        fPeers.push_back(peer);
+    }
+    return true;
+}
+
+void Crowd::Start()
+{
+    // Spread evenly over one interval, not all at once
+    bigtime_t now = LoadNow();
+    for (size_t i = 0; i < fPeers.size(); i++)
+        fPeers[i]->next = now + fInterval * i / fPeers.size();
+
+    fRoundTrips.reserve(1 << 20);
+    fRunning = true;
+    fThread = std::thread(&Crowd::Run, this);
+}
+
+void Crowd::Stop()
+{
+    fRunning = false;
+    if (fThread.joinable())
+        fThread.join();
+}
+
+int32 Crowd::Unanswered() const
+{
+    int32 count = 0;
+    for (size_t i = 0; i < fPeers.size(); i++) {
+        if (fPeers[i]->answered == 0)
+            count++;
+    }
+    return count;
+}
+
+int32 Crowd::Lost() const
+{
+    int32 count = 0;
+    for (size_t i = 0; i < fPeers.size(); i++) {
+        if (fPeers[i]->socket < 0)
+            count++;
+    }
+    return count;
+}
+
+void Crowd::Run()
+{
+    ProtocolHeader heartbeat;
+    heartbeat.magic = PROTOCOL_MAGIC;
+    heartbeat.version = PROTOCOL_VERSION;
+    heartbeat.eventType = EVENT_HEARTBEAT;
+    heartbeat.length = 0;
+
+    std::vector<struct pollfd> fds(fPeers.size());
+    while (fRunning) {
+        bigtime_t now = LoadNow();
+        bigtime_t next = now + 100000;
+        for (size_t i = 0; i < fPeers.size(); i++) {
+            Peer& peer = *fPeers[i];
+            if (peer.socket >= 0 && peer.sent == 0 && peer.next <= now) {
+                // Eight bytes always fit the send buffer
+                if (send(peer.socket, &heartbeat, sizeof(heartbeat),
+                        kSendFlags) == sizeof(heartbeat)) {
+                    peer.sent = now;
+                } else {
+                    close(peer.socket);
+                    peer.socket = -1;
+                }
+                peer.next += fInterval;
+            }
+            if (peer.socket >= 0 && peer.sent == 0)
+                next = std::min(next, peer.next);
+
+            fds[i].fd = peer.socket;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        bigtime_t wait = next - now;
+        int ready = poll(fds.data(), fds.size(),
+            wait > 0 ? (int)((wait + 999) / 1000) : 0);
+        if (ready <= 0)
+            continue;
+
+        for (size_t i = 0; i < fPeers.size(); i++) {
+            if (fds[i].revents == 0 || fPeers[i]->socket < 0)
+                continue;
+            if (!Receive(*fPeers[i])) {
+                close(fPeers[i]->socket);
+                fPeers[i]->socket = -1;
+            }
+        }
+    }
+}
+
+bool Crowd::Receive(Peer& peer)
+{
+    for (;;) {
+        size_t available;
+        uint8* buffer = peer.in.ReceiveBuffer(&available, 64);
+        ssize_t bytesRead = recv(peer.socket, buffer, available, 0);
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK
+                || errno == EINTR))
+            return true;
+        if (bytesRead <= 0)
+            return false;
+        peer.in.Received(bytesRead);
+
+        const uint8* message;
+        size_t length;
+        while (peer.in.NextMessage(&message, &length) == FRAME_MESSAGE) {
+            const ProtocolHeader* header = (const ProtocolHeader*)message;
+            if (header->eventType == EVENT_HEARTBEAT_ACK && peer.sent != 0) {
+                fRoundTrips.push_back(LoadNow() - peer.sent);
+                peer.sent = 0;
+                peer.answered++;
+            }
+        }
+    }
+}
+
+
+static void PrintTimes(const char* name, std::vector<bigtime_t>& times)
+{
+    if (times.empty())
+        return;
+    printf("  %-20s %9lld %9lld %9lld %9lld\n", name,
+        (long long)Percentile(times, 50), (long long)Percentile(times, 99),
+        (long long)Percentile(times, 99.9), (long long)Percentile(times, 100));
+}
+
+static void Usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [--clients n] [--interval ms] "
+        WORKLOAD_USAGE "\n"
+        "           [--duration seconds] [--max-p99 µs]\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    int32 clients = 300;
+    bigtime_t interval = 100000;
+    double duration = 3;
+    bigtime_t maxP99 = 0;
+    std::vector<Workload*> workloads;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        double number = value != nullptr ? atof(value) : 0;
+
+        Workload* workload = CreateWorkload(argv[i], value);
+        if (workload != nullptr)
+            workloads.push_back(workload);
+        else if (strcmp(argv[i], "--clients") == 0 && number >= 1)
+            clients = (int32)number;
+        else if (strcmp(argv[i], "--interval") == 0 && number > 0)
+            interval = (bigtime_t)(number * 1000);
+        else if (strcmp(argv[i], "--duration") == 0 && number > 0)
+            duration = number;
+        else if (strcmp(argv[i], "--max-p99") == 0 && number > 0)
+            maxP99 = (bigtime_t)number;
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (workloads.empty())
+        workloads.push_back(CreateWorkload("--mouse", "1000"));
+
+    // Both ends of every connection live in this process
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0
+        && limit.rlim_cur < (rlim_t)clients * 2 + 64) {
+        limit.rlim_cur = std::min(limit.rlim_max, (rlim_t)clients * 2 + 64);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    CrowdServer server;
+    if (server.Start() != B_OK) {
+        fprintf(stderr, "Cannot listen: %s\n", strerror(errno));
+        return 2;
+    }
+
+    Crowd crowd(interval);
+    bigtime_t connectStart = LoadNow();
+    if (!crowd.Connect(server.Port(), clients)) {
+        fprintf(stderr, "Connected %d of %d clients: %s\n",
+            (int)crowd.Count(), (int)clients, strerror(errno));
+        server.Stop();
+        return 2;
+    }
+    while (server.fClients < clients && LoadNow() - connectStart < 10000000)
+        usleep(1000);
+    bigtime_t connectTime = LoadNow() - connectStart;
+    if (server.fClients < clients) {
+        fprintf(stderr, "The server accepted %d of %d clients\n",
+            (int)server.fClients, (int)clients);
+        server.Stop();
+        return 1;
+    }
+
+    LoadClient owner;
+    owner.SetScreen(1920, 1080);
+    if (!owner.Connect("127.0.0.1", server.Port())) {
+        fprintf(stderr, "Cannot connect the owner: %s\n", strerror(errno));
+        server.Stop();
+        return 2;
+    }
+
+    crowd.Start();
+    bigtime_t start = LoadNow();
+    bigtime_t end = start + (bigtime_t)(duration * 1000000);
+    bigtime_t nextHeartbeat = start;
+    for (size_t i = 0; i < workloads.size(); i++)
+        workloads[i]->Start(start);
+
+    bool connected = true;
+    while (connected) {
+        bigtime_t now = LoadNow();
+        if (now >= end)
+            break;
+
+        for (size_t i = 0; i < workloads.size(); i++) {
+            while (workloads[i]->Next() <= now)
+                workloads[i]->Fire(owner);
+        }
+        if (nextHeartbeat <= now) {
+            owner.SendHeartbeat();
+            nextHeartbeat += interval / 10;
+        }
+
+        bigtime_t next = std::min(end, nextHeartbeat);
+        for (size_t i = 0; i < workloads.size(); i++)
+            next = std::min(next, workloads[i]->Next());
+        connected = owner.Service(next);
+    }
+
+    // Every heartbeat still in flight gets its answer
+    bigtime_t deadline = LoadNow() + 2000000;
+    while (connected && owner.HeartbeatsPending() && LoadNow() < deadline)
+        connected = owner.Service(std::min(LoadNow() + 10000, deadline));
+    usleep(interval);
+    crowd.Stop();
+
+    std::vector<bigtime_t> ownerTrips;
+    owner.TakeRoundTrips(ownerTrips);
+    int64 input = server.fInput;
+    int32 dropped = server.fDropped;
+    server.Stop();
+
+    printf("%d clients connected in %lld ms, %lld input events from the "
+        "owner\n", (int)clients + 1, (long long)(connectTime / 1000),
+        (long long)input);
+    printf("  %-20s %9s %9s %9s %9s\n", "heartbeat µs", "p50", "p99", "p999",
+        "max");
+    PrintTimes("owner", ownerTrips);
+    PrintTimes("crowd", crowd.RoundTrips());
+
+    for (size_t i = 0; i < workloads.size(); i++)
+        delete workloads[i];
+
+    bool failed = false;
+    if (!connected || dropped > 0 || crowd.Lost() > 0) {
+        printf("%d clients dropped\n", (int)(dropped + crowd.Lost()));
+        failed = true;
+    }
+    if (crowd.Unanswered() > 0) {
+        printf("%d clients never got an answer\n", (int)crowd.Unanswered());
+        failed = true;
+    }
+    if (maxP99 > 0 && !ownerTrips.empty()
+        && Percentile(ownerTrips, 99) > maxP99) {
+        printf("owner p99 above %lld µs\n", (long long)maxP99);
+        failed = true;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,572 @@
+// A multi-gigabyte file transfer, on one machine: LoadClient stands in for
+// the Mac client sending a dragged file, and the server receives it the
+// way NetworkServer does, through ServerLoop and FileSink into a scratch
+// directory. The content is synthetic, generated from the offset, so any
+// size costs no memory on either side.
+//
+//   FileHarness [--size GB] [--drop-at fraction] [--dir path] [--keep]
+//
+// The sender offers the file, keeps to FILE_TRANSFER_WINDOW past what was
+// acknowledged and hangs up once --drop-at of it is sent (0 for never); it
+// then comes back and offers the file again, which has to resume from
+// FileReceiver's last checkpoint rather than from the start. The default
+// 5 GB takes offsets past 4 GB. The received file is read
+// back and checked against the content. Prints the throughput and the
+// most FileSink ever held in memory; exits 1 if the file did not arrive
+// intact, did not resume, or the sink held more than the window.
+
+#include "LoadClient.h"
+
+#include "clipboard/ContentHash.h"
+#include "network/Protocol.h"
+#include "network/ServerLoop.h"
+#include "transfer/FileSink.h"
+
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* kFileName = "synthetic.bin";
+// Longest wait for any one answer from the server
+static const bigtime_t kReplyTimeout = 10000000;
+
+
+// The synthetic content: 8 bytes at a time, each a mix of its offset
+static void Generate(uint64 offset, uint8* data, size_t length)
+{
+    for (size_t i = 0; i < length; i += 8) {
+        uint64 word = (offset + i) / 8 * 0x9E3779B97F4A7C15ULL;
+        word ^= word >> 29;
+        word *= 0xBF58476D1CE4E5B9ULL;
+        word ^= word >> 32;
+        memcpy(data + i, &word, std::min((size_t)8, length - i));
+    }
+}
+
+static uint64 ContentHashOf(uint64 size)
+{
+    ContentHasher hasher(size);
+    std::vector<uint8> chunk(1024 * 1024);
+    for (uint64 offset = 0; offset < size; offset += chunk.size()) {
+        size_t length = std::min((uint64)chunk.size(), size - offset);
+        Generate(offset, chunk.data(), length);
+        hasher.Update(chunk.data(), length);
+    }
+    return hasher.Final();
+}
+
+// Whether the file at path holds exactly size bytes of the content
+static bool Verify(const char* path, uint64 size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    std::vector<uint8> expected(1024 * 1024);
+    std::vector<uint8> actual(expected.size());
+    uint64 offset = 0;
+    bool intact = true;
+    while (intact) {
+        ssize_t bytesRead = read(fd, actual.data(), actual.size());
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            break;
+        Generate(offset, expected.data(), bytesRead);
+        intact = memcmp(expected.data(), actual.data(), bytesRead) == 0;
+        offset += bytesRead;
+    }
+    close(fd);
+    return intact && offset == size;
+}
+
+
+// NetworkServer's side of a file transfer, minus the system
+class FileServer : public ServerLoopListener, private FileSinkListener {
+public:
+    FileServer(const char* directory);
+
+    status_t Start();
+    void Stop();
+    uint16 Port() const { return fLoop.Port(); }
+
+    std::string DonePath();
+
+    std::atomic<int32> fDisconnects;
+    std::atomic<int32> fOverruns;
+    std::atomic<size_t> fMaxQueued;     // by FileSink, at any FILE_DATA
+
+    // ServerLoopListener
+    virtual void ClientConnected(int32 client, int socket,
+        const char* address) {}
+    virtual void MessageReceived(int32 client, const uint8* message,
+        size_t length);
+    virtual void ClientDisconnected(int32 client, const char* reason);
+
+private:
+    void Reply(int32 client, uint8 type, const void* payload,
+        uint32 length);
+
+    // FileSinkListener
+    virtual void FileAccepted(int32 client, uint32 transferId, uint8 status,
+        uint64 offset);
+    virtual void FileDone(int32 client, uint32 transferId, uint8 status,
+        const char* path);
+
+    std::string fDirectory;
+    ServerLoop fLoop;
+    FileSink fSink;
+    std::thread fThread;
+    std::mutex fLock;
+    std::string fDonePath;
+};
+
+FileServer::FileServer(const char* directory)
+    : fDisconnects(0),
+      fOverruns(0),
+      fMaxQueued(0),
+      fDirectory(directory),
+      fLoop(this),
+      fSink(this)
+{
+}
+
+status_t FileServer::Start()
+{
+    status_t status = fLoop.Listen(0, 1);
+    if (status != B_OK)
+        return status;
+
+    fThread = std::thread(&ServerLoop::Run, &fLoop);
+    return B_OK;
+}
+
+void FileServer::Stop()
+{
+    fLoop.Quit();
+    if (fThread.joinable())
+        fThread.join();
+}
+
+std::string FileServer::DonePath()
+{
+    std::lock_guard<std::mutex> lock(fLock);
+    return fDonePath;
+}
+
+void FileServer::MessageReceived(int32 client, const uint8* message,
+    size_t length)
+{
+    const ProtocolHeader* header = (const ProtocolHeader*)message;
+    const uint8* payload = message + sizeof(ProtocolHeader);
+
+    switch (header->eventType) {
+        case EVENT_SESSION_HELLO:
+        {
+            SessionAcceptPayload accept;
+            memset(&accept, 0, sizeof(accept));
+            uint32 capabilities = CAPABILITY_BULK_FRAGMENTS
+                | CAPABILITY_FILE_TRANSFER;
+            uint8 reply[sizeof(accept) + sizeof(capabilities)];
+            memcpy(reply, &accept, sizeof(accept));
+            memcpy(reply + sizeof(accept), &capabilities,
+                sizeof(capabilities));
+            Reply(client, EVENT_SESSION_ACCEPT, reply, sizeof(reply));
+            fLoop.SetFragmenting(client, true);
+            break;
+        }
+
+        case EVENT_FILE_OFFER:
+        {
+            const FileOfferPayload* offer = (const FileOfferPayload*)payload;
+            if (header->length < sizeof(FileOfferPayload)
+                || header->length - sizeof(FileOfferPayload)
+                    < offer->nameLength)
+                break;
+            char name[256];
+            memcpy(name, offer + 1, offer->nameLength);
+            name[offer->nameLength] = '\0';
+            fSink.Offer(client, fDirectory.c_str(), offer->transferId, name,
+                offer->size, offer->hash);
+            break;
+        }
+
+        case EVENT_FILE_DATA:
+        {
+            const FileDataPayload* fileData = (const FileDataPayload*)payload;
+            if (header->length < sizeof(FileDataPayload)
+                || header->length - sizeof(FileDataPayload)
+                    < fileData->length)
+                break;
+            if (fSink.Write(client, fileData->transferId, fileData->offset,
+                    fileData + 1, fileData->length) != B_OK)
+                fOverruns++;
+            fMaxQueued = std::max((size_t)fMaxQueued, fSink.QueuedBytes());
+            break;
+        }
+    }
+}
+
+void FileServer::ClientDisconnected(int32 client, const char* reason)
+{
+    fSink.ClientGone(client);
+    fDisconnects++;
+}
+
+void FileServer::Reply(int32 client, uint8 type, const void* payload,
+    uint32 length)
+{
+    std::vector<uint8> message(sizeof(ProtocolHeader) + length);
+    ProtocolHeader header;
+    header.magic = PROTOCOL_MAGIC;
+    header.version = PROTOCOL_VERSION;
+    header.eventType = type;
+    header.length = length;
+    memcpy(message.data(), &header, sizeof(header));
+    if (length > 0)
+        memcpy(message.data() + sizeof(header), payload, length);
+    fLoop.Send(client, message.data(), message.size());
+}
+
+void FileServer::FileAccepted(int32 client, uint32 transferId, uint8 status,
+    uint64 offset)
+{
+    FileAcceptPayload accept;
+    accept.transferId = transferId;
+    accept.status = status;
+    accept.offset = offset;
+    Reply(client, EVENT_FILE_ACCEPT, &accept, sizeof(accept));
+}
+
+void FileServer::FileDone(int32 client, uint32 transferId, uint8 status,
+    const char* path)
+{
+    if (path != nullptr) {
+        std::lock_guard<std::mutex> lock(fLock);
+        fDonePath = path;
+    }
+
+    FileDonePayload done;
+    done.transferId = transferId;
+    done.status = status;
+    Reply(client, EVENT_FILE_DONE, &done, sizeof(done));
+}
+
+
+// The Mac client's sending side, on top of LoadClient
+class FileSender : public LoadClientListener {
+public:
+    FileSender(LoadClient& client, uint64 size, uint64 hash);
+
+    // Offers the file as transferId and waits for the answer; false if
+    // it was refused or none came
+    bool Offer(uint32 transferId);
+    // Sends until the file is complete or until offset stop, staying
+    // within the window; false if the server went away
+    bool Send(uint64 stop);
+    // Waits for FILE_DONE; its status, or -1 if none came
+    int32 WaitDone();
+
+    uint64 Next() const { return fNext; }
+    uint64 Acknowledged() const { return fAcknowledged; }
+    // Counting what is sent again after a resume
+    uint64 BytesSent() const { return fBytesSent; }
+
+    // LoadClientListener
+    virtual void InputQueued(uint64 index, uint8 type, bigtime_t when) {}
+    virtual void MessageReceived(const uint8* message, size_t length);
+
+private:
+    LoadClient& fClient;
+    uint64 fSize;
+    uint64 fHash;
+    uint32 fTransferID;
+    int32 fAccepted;            // FileTransferStatus, -1 until answered
+    int32 fDone;
+    uint64 fNext;               // first byte not yet queued
+    uint64 fAcknowledged;
+    uint64 fBytesSent;
+    std::vector<uint8> fChunk;
+};
+
+FileSender::FileSender(LoadClient& client, uint64 size, uint64 hash)
+    : fClient(client),
+      fSize(size),
+      fHash(hash),
+      fTransferID(0),
+      fAccepted(-1),
+      fDone(-1),
+      fNext(0),
+      fAcknowledged(0),
+      fBytesSent(0),
+      fChunk(sizeof(FileDataPayload) + FILE_DATA_CHUNK_SIZE)
+{
+}
+
+bool FileSender::Offer(uint32 transferId)
+{
+    fTransferID = transferId;
+    fAccepted = -1;
+    fDone = -1;
+
+    uint8 offer[sizeof(FileOfferPayload) + 255];
+    FileOfferPayload payload;
+    payload.transferId = transferId;
+    payload.size = fSize;
+    payload.hash = fHash;
+    payload.nameLength = strlen(kFileName);
+    memcpy(offer, &payload, sizeof(payload));
+    memcpy(offer + sizeof(payload), kFileName, payload.nameLength);
+    fClient.Send(EVENT_FILE_OFFER, offer,
+        sizeof(payload) + payload.nameLength, SEND_BULK);
+
+    bigtime_t deadline = LoadNow() + kReplyTimeout;
+    while (fAccepted < 0 && LoadNow() < deadline) {
+        if (!fClient.Service(LoadNow() + 1000))
+            return false;
+    }
+    return fAccepted == FILE_OK;
+}
+
+bool FileSender::Send(uint64 stop)
+{
+    stop = std::min(stop, fSize);
+    bigtime_t progress = LoadNow();
+    while (fNext < stop) {
+        // Nothing more than the window allows, and not much more queued
+        // here than the socket can take
+        while (fNext < stop
+            && fNext < fAcknowledged + FILE_TRANSFER_WINDOW
+            && fClient.Queued() < 2 * FILE_DATA_CHUNK_SIZE) {
+            uint32 length = (uint32)std::min((uint64)FILE_DATA_CHUNK_SIZE,
+                stop - fNext);
+            FileDataPayload payload;
+            payload.transferId = fTransferID;
+            payload.offset = fNext;
+            payload.length = length;
+            memcpy(fChunk.data(), &payload, sizeof(payload));
+            Generate(fNext, fChunk.data() + sizeof(payload), length);
+            fClient.Send(EVENT_FILE_DATA, fChunk.data(),
+                sizeof(payload) + length, SEND_BULK);
+            fNext += length;
+            fBytesSent += length;
+        }
+
+        uint64 acknowledged = fAcknowledged;
+        if (!fClient.Service(LoadNow() + 1000))
+            return false;
+        if (fAcknowledged != acknowledged)
+            progress = LoadNow();
+        else if (LoadNow() - progress > kReplyTimeout) {
+            fprintf(stderr, "Nothing acknowledged past %llu MB for %lld s\n",
+                (unsigned long long)(fAcknowledged >> 20),
+                (long long)(kReplyTimeout / 1000000));
+            return false;
+        }
+        // FILE_DONE can come in right behind the last of the data
+        if (fAccepted != FILE_OK || (fDone >= 0 && fNext < stop)) {
+            fprintf(stderr, "The server ended the transfer at %llu MB\n",
+                (unsigned long long)(fAcknowledged >> 20));
+            return false;
+        }
+    }
+    return true;
+}
+
+int32 FileSender::WaitDone()
+{
+    bigtime_t deadline = LoadNow() + kReplyTimeout;
+    while (fDone < 0 && LoadNow() < deadline) {
+        if (!fClient.Service(LoadNow() + 1000))
+            break;
+    }
+    return fDone;
+}
+
+void FileSender::MessageReceived(const uint8* message, size_t length)
+{
+    const ProtocolHeader* header = (const ProtocolHeader*)message;
+    const uint8* payload = message + sizeof(ProtocolHeader);
+
+    if (header->eventType == EVENT_FILE_ACCEPT
+        && header->length >= sizeof(FileAcceptPayload)) {
+        FileAcceptPayload accept;
+        memcpy(&accept, payload, sizeof(accept));
+        if (accept.transferId != fTransferID)
+            return;
+        // The first answer says where to start, later ones how far the
+        // data got
+        if (fAccepted < 0)
+            fNext = accept.offset;
+        fAccepted = accept.status;
+        fAcknowledged = accept.offset;
+    } else if (header->eventType == EVENT_FILE_DONE
+        && header->length >= sizeof(FileDonePayload)) {
+        FileDonePayload done;
+        memcpy(&done, payload, sizeof(done));
+        if (done.transferId == fTransferID)
+            fDone = done.status;
+    }
+}
+
+
+// Also the part and state files of a transfer that failed
+static void RemoveScratch(const char* directory)
+{
+    DIR* dir = opendir(directory);
+    if (dir == nullptr)
+        return;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        std::string path = std::string(directory) + "/" + entry->d_name;
+        unlink(path.c_str());
+    }
+    closedir(dir);
+    rmdir(directory);
+}
+
+static void Usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [--size GB] [--drop-at fraction] "
+        "[--dir path] [--keep]\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    uint64 size = 5ULL * 1024 * 1024 * 1024;
+    double dropAt = 0.5;
+    const char* directory = nullptr;
+    bool keep = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        double number = value != nullptr ? atof(value) : 0;
+
+        if (strcmp(argv[i], "--keep") == 0) {
+            keep = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--size") == 0 && number > 0)
+            size = (uint64)(number * 1024 * 1024 * 1024);
+        else if (strcmp(argv[i], "--drop-at") == 0 && value != nullptr
+            && number >= 0 && number < 1)
+            dropAt = number;
+        else if (strcmp(argv[i], "--dir") == 0 && value != nullptr)
+            directory = value;
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    char scratch[] = "/tmp/softkm-files-XXXXXX";
+    if (directory == nullptr) {
+        directory = mkdtemp(scratch);
+        if (directory == nullptr) {
+            fprintf(stderr, "Cannot create a scratch directory: %s\n",
+                strerror(errno));
+            return 2;
+        }
+    }
+
+    printf("Hashing %.2f GB of content\n", size / (1024.0 * 1024 * 1024));
+    uint64 hash = ContentHashOf(size);
+
+    FileServer server(directory);
+    if (server.Start() != B_OK) {
+        fprintf(stderr, "Cannot listen: %s\n", strerror(errno));
+        return 2;
+    }
+
+    LoadClient client;
+    FileSender sender(client, size, hash);
+    client.SetListener(&sender);
+    if (!client.Connect("127.0.0.1", server.Port())) {
+        fprintf(stderr, "Cannot connect: %s\n", strerror(errno));
+        server.Stop();
+        return 2;
+    }
+
+    bool failed = false;
+    uint64 resumedFrom = 0;
+    uint64 dropOffset = (uint64)(size * dropAt) / FILE_DATA_CHUNK_SIZE
+        * FILE_DATA_CHUNK_SIZE;
+    bigtime_t start = LoadNow();
+
+    uint32 transferId = 1;
+    bool sent = sender.Offer(transferId);
+    if (sent && dropOffset > 0) {
+        sent = sender.Send(dropOffset);
+
+        // The link goes away mid-file; what was in flight is lost
+        uint64 acknowledged = sender.Acknowledged();
+        int32 disconnects = server.fDisconnects;
+        client.Drop();
+        bigtime_t deadline = LoadNow() + kReplyTimeout;
+        while (server.fDisconnects == disconnects && LoadNow() < deadline)
+            usleep(1000);
+
+        sent = sent && client.Resume("127.0.0.1", server.Port())
+            && sender.Offer(++transferId);
+        resumedFrom = sender.Next();
+        printf("Dropped at %llu MB (%llu MB acknowledged), resumed from "
+            "%llu MB\n", (unsigned long long)(dropOffset >> 20),
+            (unsigned long long)(acknowledged >> 20),
+            (unsigned long long)(resumedFrom >> 20));
+
+        // The sink checkpoints what it wrote on losing the client, which
+        // can be past the last acknowledgement
+        if (sent && (resumedFrom == 0 || resumedFrom > dropOffset)) {
+            printf("The transfer did not resume from its checkpoint\n");
+            failed = true;
+        }
+    }
+    sent = sent && sender.Send(size);
+
+    int32 status = sent ? sender.WaitDone() : -1;
+    bigtime_t elapsed = LoadNow() - start;
+    std::string path = server.DonePath();
+    size_t maxQueued = server.fMaxQueued;
+    server.Stop();
+
+    if (status != FILE_OK) {
+        printf("The transfer ended with status %d\n", (int)status);
+        failed = true;
+    } else {
+        printf("%.2f GB in %.1f s, %.0f MB/s; the sink held %zu KB at most\n",
+            size / (1024.0 * 1024 * 1024), elapsed / 1000000.0,
+            sender.BytesSent() / (1024.0 * 1024) / (elapsed / 1000000.0),
+            maxQueued / 1024);
+        if (!Verify(path.c_str(), size)) {
+            printf("%s does not hold the content sent\n", path.c_str());
+            failed = true;
+        }
+    }
+    if (maxQueued > FILE_TRANSFER_WINDOW || server.fOverruns > 0) {
+        printf("The sink held more than the window allows\n");
+        failed = true;
+    }
+
+    if (!keep) {
+        if (!path.empty())
+            unlink(path.c_str());
+        if (directory == scratch)
+            RemoveScratch(scratch);
+    }
+    return failed ? 1 : 0;
+}
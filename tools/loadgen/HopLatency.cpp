@@ -0,0 +1,393 @@
+// Latency added by each server in a row of them, on one machine: forks
+// one process per hop, each a ServerLoop of its own listening on
+// loopback, and drives the first with LoadClient's workloads. A hop
+// relays every message it gets to the next one, as a server does with its
+// owner's input once control went on, connecting on the first message
+// from its loop thread like NetworkServer::ForwardControl(). The next
+// hop's address is resolved before the loop runs.
+//
+//   HopLatency [--hops n] [--mouse hz] [--typing wpm] ...
+//              [--duration seconds] [--max-hop-p99 µs]
+//
+// Each hop stamps every input event when its loop read it; CLOCK_MONOTONIC
+// is shared by the processes, so the stamps compare to the client's
+// capture stamp directly. Prints p50/p99/p999/max of what each hop added
+// and of capture to the last hop. With --max-hop-p99 it exits 1 if any
+// hop's p99 is above that.
+
+#include "LoadClient.h"
+#include "Workloads.h"
+
+#include "network/Protocol.h"
+#include "network/ServerLoop.h"
+
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Left to drain the relays before the client hangs up, which then closes
+// the row hop by hop
+static const bigtime_t kSettleTime = 300000;
+
+
+static bool WriteAll(int fd, const void* data, size_t length)
+{
+    const uint8* bytes = (const uint8*)data;
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        bytes += written;
+        length -= written;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, void* data, size_t length)
+{
+    uint8* bytes = (uint8*)data;
+    while (length > 0) {
+        ssize_t bytesRead = read(fd, bytes, length);
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            return false;
+        bytes += bytesRead;
+        length -= bytesRead;
+    }
+    return true;
+}
+
+
+// One server of the row, run in a process of its own
+class Hop : public ServerLoopListener {
+public:
+    Hop(int32 index);
+
+    status_t Listen() { return fLoop.Listen(0, 1); }
+    uint16 Port() const { return fLoop.Port(); }
+    void SetNext(const struct sockaddr_in& address);
+
+    // Until the upstream client or the next hop goes away
+    void Run() { fLoop.Run(); }
+
+    const std::vector<bigtime_t>& Stamps() const { return fStamps; }
+
+    // ServerLoopListener
+    virtual void ClientConnected(int32 client, int socket,
+        const char* address);
+    virtual void MessageReceived(int32 client, const uint8* message,
+        size_t length);
+    virtual void ClientDisconnected(int32 client, const char* reason);
+
+private:
+    ServerLoop fLoop;
+    int32 fIndex;
+    bool fHasNext;
+    struct sockaddr_in fNext;
+    int32 fUpstream;
+    int32 fRelay;
+    std::vector<bigtime_t> fStamps;
+};
+
+Hop::Hop(int32 index)
+    : fLoop(this),
+      fIndex(index),
+      fHasNext(false),
+      fUpstream(-1),
+      fRelay(-1)
+{
+    memset(&fNext, 0, sizeof(fNext));
+    fStamps.reserve(1 << 20);
+}
+
+void Hop::SetNext(const struct sockaddr_in& address)
+{
+    fNext = address;
+    fHasNext = true;
+}
+
+void Hop::ClientConnected(int32 client, int socket, const char* address)
+{
+    if (client != fRelay)
+        fUpstream = client;
+}
+
+void Hop::MessageReceived(int32 client, const uint8* message, size_t length)
+{
+    if (client != fUpstream)
+        return;
+
+    const ProtocolHeader* header = (const ProtocolHeader*)message;
+    bool input = header->eventType >= EVENT_KEY_DOWN
+        && header->eventType <= EVENT_MOUSE_WHEEL;
+    if (input)
+        fStamps.push_back(fLoop.ReceiveTime());
+
+    if (!fHasNext)
+        return;
+
+    if (fRelay < 0) {
+        fRelay = fLoop.Connect(fNext);
+        if (fRelay < 0) {
+            fprintf(stderr, "hop %d: cannot connect on: %s\n",
+                (int)fIndex + 1, strerror(errno));
+            fLoop.Quit();
+            return;
+        }
+    }
+    fLoop.Send(fRelay, message, length, input ? SEND_INPUT : SEND_BULK);
+}
+
+void Hop::ClientDisconnected(int32 client, const char* reason)
+{
+    if (client == fUpstream)
+        fUpstream = -1;
+    else if (client == fRelay) {
+        // Also closed by the loop on its way out, after the upstream left
+        if (fUpstream >= 0) {
+            fprintf(stderr, "hop %d: lost the next hop: %s\n",
+                (int)fIndex + 1, reason);
+        }
+        fRelay = -1;
+    } else
+        return;
+
+    fLoop.Quit();
+}
+
+
+// Listens, reports its port on report, relays to nextPort (0 for the last
+// hop) until its upstream is gone, then reports its stamps
+static int RunHop(int32 index, uint16 nextPort, int report)
+{
+    Hop hop(index);
+    if (hop.Listen() != B_OK) {
+        fprintf(stderr, "hop %d: cannot listen: %s\n", (int)index + 1,
+            strerror(errno));
+        return 1;
+    }
+
+    if (nextPort != 0) {
+        struct sockaddr_in next;
+        if (ServerLoop::Resolve("localhost", nextPort, &next) != B_OK) {
+            fprintf(stderr, "hop %d: cannot resolve localhost\n",
+                (int)index + 1);
+            return 1;
+        }
+        hop.SetNext(next);
+    }
+
+    uint16 port = hop.Port();
+    if (!WriteAll(report, &port, sizeof(port)))
+        return 1;
+
+    hop.Run();
+
+    uint64 count = hop.Stamps().size();
+    if (!WriteAll(report, &count, sizeof(count))
+        || !WriteAll(report, hop.Stamps().data(), count * sizeof(bigtime_t)))
+        return 1;
+    return 0;
+}
+
+
+// The client side stamps, by input event index
+class CaptureRecorder : public LoadClientListener {
+public:
+    CaptureRecorder() { fCaptures.reserve(1 << 20); }
+
+    virtual void InputQueued(uint64 index, uint8 type, bigtime_t when)
+        { fCaptures.push_back(when); }
+
+    const std::vector<bigtime_t>& Captures() const { return fCaptures; }
+
+private:
+    std::vector<bigtime_t> fCaptures;
+};
+
+
+static void PrintTimes(const char* name, std::vector<bigtime_t>& times)
+{
+    printf("  %-20s %9lld %9lld %9lld %9lld\n", name,
+        (long long)Percentile(times, 50), (long long)Percentile(times, 99),
+        (long long)Percentile(times, 99.9), (long long)Percentile(times, 100));
+}
+
+static void Usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [--hops n] " WORKLOAD_USAGE "\n"
+        "           [--duration seconds] [--max-hop-p99 µs]\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    int32 hopCount = 3;
+    double duration = 3;
+    bigtime_t maxHopP99 = 0;
+    std::vector<Workload*> workloads;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        double number = value != nullptr ? atof(value) : 0;
+
+        Workload* workload = CreateWorkload(argv[i], value);
+        if (workload != nullptr)
+            workloads.push_back(workload);
+        else if (strcmp(argv[i], "--hops") == 0 && number >= 1)
+            hopCount = (int32)number;
+        else if (strcmp(argv[i], "--duration") == 0 && number > 0)
+            duration = number;
+        else if (strcmp(argv[i], "--max-hop-p99") == 0 && number > 0)
+            maxHopP99 = (bigtime_t)number;
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (workloads.empty())
+        workloads.push_back(CreateWorkload("--mouse", "1000"));
+
+    // A hop whose upstream hung up must not take the driver with it
+    signal(SIGPIPE, SIG_IGN);
+
+    // From the last hop back, so each knows the port of the next
+    std::vector<int> reports(hopCount, -1);
+    std::vector<pid_t> hops(hopCount, -1);
+    uint16 nextPort = 0;
+    for (int32 index = hopCount - 1; index >= 0; index--) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            fprintf(stderr, "Cannot create a pipe: %s\n", strerror(errno));
+            return 2;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            for (int32 other = index + 1; other < hopCount; other++)
+                close(reports[other]);
+            _exit(RunHop(index, nextPort, fds[1]));
+        }
+        close(fds[1]);
+        if (pid < 0 || !ReadAll(fds[0], &nextPort, sizeof(nextPort))) {
+            fprintf(stderr, "Cannot start hop %d\n", (int)index + 1);
+            return 2;
+        }
+        reports[index] = fds[0];
+        hops[index] = pid;
+    }
+
+    CaptureRecorder recorder;
+    bool connected;
+    {
+        LoadClient client;
+        client.SetListener(&recorder);
+        client.SetScreen(1920, 1080);
+        if (!client.Connect("127.0.0.1", nextPort)) {
+            fprintf(stderr, "Cannot connect to the first hop: %s\n",
+                strerror(errno));
+            return 2;
+        }
+
+        bigtime_t start = LoadNow();
+        bigtime_t end = start + (bigtime_t)(duration * 1000000);
+        for (size_t i = 0; i < workloads.size(); i++)
+            workloads[i]->Start(start);
+
+        connected = true;
+        while (connected) {
+            bigtime_t now = LoadNow();
+            if (now >= end)
+                break;
+
+            for (size_t i = 0; i < workloads.size(); i++) {
+                while (workloads[i]->Next() <= now)
+                    workloads[i]->Fire(client);
+            }
+
+            bigtime_t next = end;
+            for (size_t i = 0; i < workloads.size(); i++)
+                next = std::min(next, workloads[i]->Next());
+            connected = client.Service(next);
+        }
+
+        bigtime_t settled = LoadNow() + kSettleTime;
+        while (connected && LoadNow() < settled)
+            connected = client.Service(settled);
+    }
+
+    // The client is gone; each hop reports once its upstream closed
+    std::vector<std::vector<bigtime_t> > stamps(hopCount);
+    bool complete = true;
+    for (int32 index = 0; index < hopCount; index++) {
+        uint64 count;
+        if (ReadAll(reports[index], &count, sizeof(count))) {
+            stamps[index].resize(count);
+            if (!ReadAll(reports[index], stamps[index].data(),
+                    count * sizeof(bigtime_t)))
+                stamps[index].clear();
+        }
+        close(reports[index]);
+
+        int status;
+        waitpid(hops[index], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            complete = false;
+    }
+
+    const std::vector<bigtime_t>& captures = recorder.Captures();
+    size_t count = captures.size();
+    for (int32 index = 0; index < hopCount; index++) {
+        if (stamps[index].size() < count) {
+            printf("hop %d got %zu of %zu input events\n", (int)index + 1,
+                stamps[index].size(), captures.size());
+            count = stamps[index].size();
+        }
+    }
+
+    printf("%d hops, %zu input events\n", (int)hopCount, count);
+    printf("  %-20s %9s %9s %9s %9s\n", "µs", "p50", "p99", "p999", "max");
+
+    bool overLimit = false;
+    std::vector<bigtime_t> times(count);
+    for (int32 index = 0; index < hopCount && count > 0; index++) {
+        for (size_t i = 0; i < count; i++) {
+            bigtime_t from = index == 0 ? captures[i] : stamps[index - 1][i];
+            times[i] = stamps[index][i] - from;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "hop %d", (int)index + 1);
+        PrintTimes(name, times);
+        if (maxHopP99 > 0 && Percentile(times, 99) > maxHopP99)
+            overLimit = true;
+    }
+    for (size_t i = 0; i < count; i++)
+        times[i] = stamps[hopCount - 1][i] - captures[i];
+    if (count > 0)
+        PrintTimes("capture-last hop", times);
+
+    for (size_t i = 0; i < workloads.size(); i++)
+        delete workloads[i];
+
+    if (!connected || !complete || count < captures.size()) {
+        fprintf(stderr, "The row broke off\n");
+        return 1;
+    }
+    if (overLimit) {
+        printf("a hop's p99 is above %lld µs\n", (long long)maxHopP99);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,506 @@
+// End-to-end input latency on one machine: LoadGen's client and workloads
+// against the portable server core over loopback, in one process, with an
+// injection sink that only records. Each input event is stamped four
+// times on the same clock:
+//
+//   capture    the client queues it (where the Mac client would take it)
+//   receive    ServerLoop read it off the socket
+//   dispatch   it goes to DispatchInputEvent()
+//   inject     InputCore hands it to the sink
+//
+//   LatencyHarness [--mouse hz] [--typing wpm] [--chords per-second]
+//                  [--scroll flings-per-second] [--clipboard kb[@seconds]]
+//                  [--rtt ms] [--jitter ms] [--loss %] [--reorder %]
+//                  [--bandwidth kbit/s] [--seed n]
+//                  [--duration seconds] [--csv file] [--max-p99 µs]
+//
+// The link options put a LinkSimulator between client and server, so the
+// numbers can be had for a Wi-Fi-like network without one; a given seed
+// draws the same delays and losses on every run.
+//
+// Prints p50/p99/p999/max per event type for each stage and end to end.
+// --csv writes one row per event, times in µs from the start. With
+// --max-p99 it exits 1 if any type's end-to-end p99 is above that, for
+// scripts. Relative moves go through the server's MoveCoalescer: a merged
+// batch is stamped injected on its newest move, the others have no inject
+// stamp and are counted as merged, as are events InputCore drops.
+
+#include "LinkSimulator.h"
+#include "LoadClient.h"
+#include "Workloads.h"
+
+#include "input/InputCore.h"
+#include "input/MoveCoalescer.h"
+#include "network/InputDispatcher.h"
+#include "network/Protocol.h"
+#include "network/ServerLoop.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+static const char* kTypeNames[] = {
+    "key down", "key up", "mouse move", "mouse down", "mouse up", "wheel"
+};
+static const int kTypeCount = sizeof(kTypeNames) / sizeof(kTypeNames[0]);
+
+struct ServerStamp {
+    bigtime_t receive;
+    bigtime_t dispatch;
+    bigtime_t inject;       // 0 if nothing was injected for it
+};
+
+
+static bool IsRelativeMove(const ProtocolHeader* header, const uint8* payload)
+{
+    MouseMovePayload move;
+    if (header->eventType != EVENT_MOUSE_MOVE || header->length < sizeof(move))
+        return false;
+    memcpy(&move, payload, sizeof(move));
+    return move.relative != 0;
+}
+
+
+// What the server does with a client, minus the system: ServerLoop,
+// DispatchInputEvent(), MoveCoalescer and InputCore on a thread of its own
+class HarnessServer : public ServerLoopListener, private InjectionSink,
+    private ScreenGeometry, private PeerLink {
+public:
+    HarnessServer();
+
+    status_t Start();
+    // Joins the loop thread; the stamps are safe to read after
+    void Stop();
+    uint16 Port() const { return fLoop.Port(); }
+
+    const std::vector<ServerStamp>& Stamps() const { return fStamps; }
+
+    // ServerLoopListener
+    virtual void ClientConnected(int32 client, int socket,
+        const char* address) {}
+    virtual void MessageReceived(int32 client, const uint8* message,
+        size_t length);
+    virtual void ClientDisconnected(int32 client, const char* reason) {}
+    virtual void ReceiveDone(int32 client) { Flush(); }
+
+private:
+    void Flush();
+    void Reply(int32 client, uint8 type, const void* payload,
+        uint32 length);
+    bool Injected();
+
+    // InjectionSink
+    virtual bool KeyDown(bigtime_t eventStart, uint32 key,
+        uint32 modifiers, const char* bytes, uint8 numBytes)
+        { return Injected(); }
+    virtual bool KeyUp(bigtime_t eventStart, uint32 key, uint32 modifiers)
+        { return Injected(); }
+    virtual bool MouseMoved(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers)
+        { return Injected(); }
+    virtual bool MouseDown(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers, uint32 clicks)
+        { return Injected(); }
+    virtual bool MouseUp(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers)
+        { return Injected(); }
+    virtual bool MouseWheel(bigtime_t eventStart, float deltaX,
+        float deltaY, uint32 modifiers)
+        { return Injected(); }
+    virtual void SetCursor(float x, float y) { fCursorX = x; fCursorY = y; }
+    virtual bool GetCursor(float* x, float* y)
+        { *x = fCursorX; *y = fCursorY; return true; }
+
+    // ScreenGeometry
+    virtual void GetScreenSize(float* width, float* height)
+        { *width = 1920; *height = 1080; }
+
+    // PeerLink; no neighbours, and control going back is not answered
+    virtual bool HasNeighbour(uint8 edge) const { return false; }
+    virtual void SendControlSwitch(uint8 direction, float yRatio) {}
+    virtual status_t ForwardControl(uint8 edge, float yRatio)
+        { return B_ERROR; }
+
+    ServerLoop fLoop;
+    SystemClock fClock;
+    InputCore fCore;
+    MoveCoalescer fCoalescer;
+    std::thread fThread;
+    std::vector<ServerStamp> fStamps;   // loop thread until Stop()
+    ssize_t fDispatching;               // index in fStamps, or -1
+    ssize_t fNewestHeld;                // the last move fCoalescer holds
+    float fCursorX;
+    float fCursorY;
+};
+
+HarnessServer::HarnessServer()
+    : fLoop(this),
+      fCore(&fClock, this, this),
+      fCoalescer(&fClock, &fCore),
+      fDispatching(-1),
+      fNewestHeld(-1),
+      fCursorX(0),
+      fCursorY(0)
+{
+    fCore.SetPeerLink(this);
+}
+
+status_t HarnessServer::Start()
+{
+    status_t status = fLoop.Listen(0, 1);
+    if (status != B_OK)
+        return status;
+
+    fStamps.reserve(1 << 20);
+    fThread = std::thread(&ServerLoop::Run, &fLoop);
+    return B_OK;
+}
+
+void HarnessServer::Stop()
+{
+    fLoop.Quit();
+    if (fThread.joinable())
+        fThread.join();
+}
+
+void HarnessServer::MessageReceived(int32 client, const uint8* message,
+    size_t length)
+{
+    const ProtocolHeader* header = (const ProtocolHeader*)message;
+    const uint8* payload = message + sizeof(ProtocolHeader);
+
+    if (header->eventType >= EVENT_KEY_DOWN
+        && header->eventType <= EVENT_MOUSE_WHEEL) {
+        // What the coalescer holds goes in before anything but another
+        // relative move; flushed here, it is stamped on the right event
+        if (!IsRelativeMove(header, payload))
+            Flush();
+
+        ServerStamp stamp = { fLoop.ReceiveTime(), fClock.Now(), 0 };
+        fDispatching = (ssize_t)fStamps.size();
+        fStamps.push_back(stamp);
+        DispatchInputEvent(message, length, &fCoalescer);
+        if (fCoalescer.IsHolding())
+            fNewestHeld = fDispatching;
+        fDispatching = -1;
+        return;
+    }
+
+    Flush();
+
+    switch (header->eventType) {
+        case EVENT_HEARTBEAT:
+            Reply(client, EVENT_HEARTBEAT_ACK, nullptr, 0);
+            break;
+
+        case EVENT_SESSION_HELLO:
+        {
+            SessionAcceptPayload accept;
+            memset(&accept, 0, sizeof(accept));
+            uint32 capabilities = CAPABILITY_BULK_FRAGMENTS;
+            uint8 reply[sizeof(accept) + sizeof(capabilities)];
+            memcpy(reply, &accept, sizeof(accept));
+            memcpy(reply + sizeof(accept), &capabilities,
+                sizeof(capabilities));
+            Reply(client, EVENT_SESSION_ACCEPT, reply, sizeof(reply));
+            fLoop.SetFragmenting(client, true);
+            break;
+        }
+
+        case EVENT_CONTROL_SWITCH:
+        {
+            ControlSwitchPayload control;
+            if (header->length < sizeof(control))
+                break;
+            memcpy(&control, payload, sizeof(control));
+            if (control.direction == 0)
+                fCore.SetActive(true, control.yRatio);
+            break;
+        }
+
+        case EVENT_SETTINGS_SYNC:
+        {
+            SettingsSyncPayload settings;
+            if (header->length < sizeof(settings))
+                break;
+            memcpy(&settings, payload, sizeof(settings));
+            fCore.SetDwellTime((bigtime_t)(settings.edgeDwellTime * 1000000));
+            fCore.SetReturnEdge(settings.haikuReturnEdge);
+            break;
+        }
+    }
+}
+
+void HarnessServer::Flush()
+{
+    if (!fCoalescer.IsHolding())
+        return;
+
+    fDispatching = fNewestHeld;
+    fCoalescer.Flush();
+    fDispatching = -1;
+}
+
+void HarnessServer::Reply(int32 client, uint8 type, const void* payload,
+    uint32 length)
+{
+    std::vector<uint8> message(sizeof(ProtocolHeader) + length);
+    ProtocolHeader header;
+    header.magic = PROTOCOL_MAGIC;
+    header.version = PROTOCOL_VERSION;
+    header.eventType = type;
+    header.length = length;
+    memcpy(message.data(), &header, sizeof(header));
+    if (length > 0)
+        memcpy(message.data() + sizeof(header), payload, length);
+    fLoop.Send(client, message.data(), message.size());
+}
+
+bool HarnessServer::Injected()
+{
+    // The first injection an event causes is the one the user sees
+    if (fDispatching >= 0 && fStamps[fDispatching].inject == 0)
+        fStamps[fDispatching].inject = fClock.Now();
+    return true;
+}
+
+
+// The client side stamps, by input event index
+class CaptureRecorder : public LoadClientListener {
+public:
+    struct Capture {
+        uint8 type;
+        bigtime_t when;
+    };
+
+    CaptureRecorder() { fCaptures.reserve(1 << 20); }
+
+    virtual void InputQueued(uint64 index, uint8 type, bigtime_t when)
+    {
+        Capture capture = { type, when };
+        fCaptures.push_back(capture);
+    }
+
+    const std::vector<Capture>& Captures() const { return fCaptures; }
+
+private:
+    std::vector<Capture> fCaptures;
+};
+
+
+struct StageTimes {
+    std::vector<bigtime_t> network;     // capture to receive
+    std::vector<bigtime_t> framing;     // receive to dispatch
+    std::vector<bigtime_t> core;        // dispatch to inject
+    std::vector<bigtime_t> total;       // capture to inject
+    uint64 count;
+    uint64 notInjected;     // merged into a later event, or dropped
+};
+
+static void PrintStage(const char* name, std::vector<bigtime_t>& times)
+{
+    if (times.empty())
+        return;
+    printf("  %-20s %9lld %9lld %9lld %9lld\n", name,
+        (long long)Percentile(times, 50), (long long)Percentile(times, 99),
+        (long long)Percentile(times, 99.9), (long long)Percentile(times, 100));
+}
+
+static void Usage(const char* name)
+{
+    fprintf(stderr, "usage: %s " WORKLOAD_USAGE "\n"
+        "           " LINK_USAGE "\n"
+        "           [--duration seconds] [--csv file] [--max-p99 µs]\n",
+        name);
+}
+
+int main(int argc, char** argv)
+{
+    double duration = 5;
+    const char* csvPath = nullptr;
+    bigtime_t maxP99 = 0;
+    std::vector<Workload*> workloads;
+    LinkConditions conditions;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        double number = value != nullptr ? atof(value) : 0;
+
+        Workload* workload = CreateWorkload(argv[i], value);
+        if (workload != nullptr)
+            workloads.push_back(workload);
+        else if (ParseLinkOption(argv[i], value, &conditions))
+            ;
+        else if (strcmp(argv[i], "--duration") == 0 && number > 0)
+            duration = number;
+        else if (strcmp(argv[i], "--csv") == 0 && value != nullptr)
+            csvPath = value;
+        else if (strcmp(argv[i], "--max-p99") == 0 && number > 0)
+            maxP99 = (bigtime_t)number;
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (workloads.empty())
+        workloads.push_back(CreateWorkload("--mouse", "1000"));
+
+    HarnessServer server;
+    if (server.Start() != B_OK) {
+        fprintf(stderr, "Cannot listen: %s\n", strerror(errno));
+        return 2;
+    }
+
+    uint16 port = server.Port();
+    LinkSimulator link(conditions);
+    if (!conditions.IsPerfect()) {
+        if (link.Start("127.0.0.1", port) != B_OK) {
+            fprintf(stderr, "Cannot start the link: %s\n", strerror(errno));
+            server.Stop();
+            return 2;
+        }
+        port = link.Port();
+    }
+
+    CaptureRecorder recorder;
+    LoadClient client;
+    client.SetListener(&recorder);
+    client.SetScreen(1920, 1080);
+    if (!client.Connect("127.0.0.1", port)) {
+        fprintf(stderr, "Cannot connect to the server: %s\n", strerror(errno));
+        link.Stop();
+        server.Stop();
+        return 2;
+    }
+
+    bigtime_t start = LoadNow();
+    bigtime_t end = start + (bigtime_t)(duration * 1000000);
+    for (size_t i = 0; i < workloads.size(); i++)
+        workloads[i]->Start(start);
+
+    bool connected = true;
+    while (connected) {
+        bigtime_t now = LoadNow();
+        if (now >= end)
+            break;
+
+        for (size_t i = 0; i < workloads.size(); i++) {
+            while (workloads[i]->Next() <= now)
+                workloads[i]->Fire(client);
+        }
+
+        bigtime_t next = end;
+        for (size_t i = 0; i < workloads.size(); i++)
+            next = std::min(next, workloads[i]->Next());
+        connected = client.Service(next);
+    }
+
+    // The server handles a connection in order: once this heartbeat is
+    // answered, every event before it has its stamps
+    if (connected) {
+        client.SendHeartbeat();
+        bigtime_t deadline = LoadNow() + 10000000;
+        while (connected && client.HeartbeatsPending() && LoadNow() < deadline)
+            connected = client.Service(std::min(LoadNow() + 10000, deadline));
+    }
+    link.Stop();
+    server.Stop();
+
+    const std::vector<CaptureRecorder::Capture>& captures
+        = recorder.Captures();
+    const std::vector<ServerStamp>& stamps = server.Stamps();
+    size_t count = std::min(captures.size(), stamps.size());
+    if (count < captures.size()) {
+        printf("%zu of %zu input events never reached the server\n",
+            captures.size() - count, captures.size());
+    }
+
+    FILE* csv = nullptr;
+    if (csvPath != nullptr) {
+        csv = fopen(csvPath, "w");
+        if (csv == nullptr) {
+            fprintf(stderr, "Cannot write %s: %s\n", csvPath, strerror(errno));
+            return 2;
+        }
+        fprintf(csv, "index,type,capture,receive,dispatch,inject\n");
+    }
+
+    StageTimes stages[kTypeCount];
+    for (int i = 0; i < kTypeCount; i++) {
+        stages[i].count = 0;
+        stages[i].notInjected = 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const CaptureRecorder::Capture& capture = captures[i];
+        const ServerStamp& stamp = stamps[i];
+        StageTimes& stage = stages[capture.type - EVENT_KEY_DOWN];
+
+        stage.count++;
+        stage.network.push_back(stamp.receive - capture.when);
+        stage.framing.push_back(stamp.dispatch - stamp.receive);
+        if (stamp.inject != 0) {
+            stage.core.push_back(stamp.inject - stamp.dispatch);
+            stage.total.push_back(stamp.inject - capture.when);
+        } else
+            stage.notInjected++;
+
+        if (csv != nullptr) {
+            fprintf(csv, "%zu,%s,%lld,%lld,%lld,", i,
+                kTypeNames[capture.type - EVENT_KEY_DOWN],
+                (long long)(capture.when - start),
+                (long long)(stamp.receive - start),
+                (long long)(stamp.dispatch - start));
+            if (stamp.inject != 0)
+                fprintf(csv, "%lld\n", (long long)(stamp.inject - start));
+            else
+                fprintf(csv, "\n");
+        }
+    }
+    if (csv != nullptr)
+        fclose(csv);
+
+    bool overLimit = false;
+    for (int i = 0; i < kTypeCount; i++) {
+        StageTimes& stage = stages[i];
+        if (stage.count == 0)
+            continue;
+
+        printf("%s: %llu", kTypeNames[i], (unsigned long long)stage.count);
+        if (stage.notInjected > 0) {
+            printf(", %llu merged or dropped",
+                (unsigned long long)stage.notInjected);
+        }
+        printf("\n  %-20s %9s %9s %9s %9s\n", "µs", "p50", "p99", "p999",
+            "max");
+        PrintStage("capture-receive", stage.network);
+        PrintStage("receive-dispatch", stage.framing);
+        PrintStage("dispatch-inject", stage.core);
+        PrintStage("capture-inject", stage.total);
+
+        if (maxP99 > 0 && !stage.total.empty()
+            && Percentile(stage.total, 99) > maxP99) {
+            overLimit = true;
+        }
+    }
+
+    if (!conditions.IsPerfect())
+        link.PrintStats(stdout);
+
+    for (size_t i = 0; i < workloads.size(); i++)
+        delete workloads[i];
+
+    if (!connected) {
+        fprintf(stderr, "The connection broke off\n");
+        return 1;
+    }
+    if (overLimit) {
+        printf("end-to-end p99 above %lld µs\n", (long long)maxP99);
+        return 1;
+    }
+    return 0;
+}
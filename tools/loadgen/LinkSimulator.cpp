@@ -0,0 +1,413 @@
+#include "LinkSimulator.h"
+#include "LoadClient.h"
+#include "network/Protocol.h"
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+// What one TCP segment carries on Ethernet and most Wi-Fi
+static const size_t kSegmentSize = 1448;
+// IP and TCP headers, counted against the bandwidth cap
+static const size_t kSegmentOverhead = 52;
+// Linux retransmits a lost tail after about two round trips (the loss
+// probe) and not sooner than this
+static const bigtime_t kMinRetransmitTimeout = 10000;
+// Each further loss of the same segment doubles the wait; give up
+// drawing after this many
+static const int kMaxRetransmits = 6;
+// How long poll() may sleep when nothing is due, so Stop() is noticed
+static const int kIdlePollMs = 10;
+
+
+LinkConditions::LinkConditions()
+    : roundTrip(0),
+      jitter(0),
+      loss(0),
+      reorder(0),
+      bandwidth(0),
+      seed(1)
+{
+}
+
+bool LinkConditions::IsPerfect() const
+{
+    return roundTrip == 0 && jitter == 0 && loss == 0 && reorder == 0
+        && bandwidth == 0;
+}
+
+bool ParseLinkOption(const char* option, const char* value,
+    LinkConditions* conditions)
+{
+    if (value == nullptr)
+        return false;
+    double number = atof(value);
+    if (number < 0)
+        return false;
+
+    if (strcmp(option, "--rtt") == 0)
+        conditions->roundTrip = (bigtime_t)(number * 1000);
+    else if (strcmp(option, "--jitter") == 0)
+        conditions->jitter = (bigtime_t)(number * 1000);
+    else if (strcmp(option, "--loss") == 0 && number < 100)
+        conditions->loss = number / 100;
+    else if (strcmp(option, "--reorder") == 0 && number <= 100)
+        conditions->reorder = number / 100;
+    else if (strcmp(option, "--bandwidth") == 0 && number > 0)
+        conditions->bandwidth = (uint64)(number * 1000);
+    else if (strcmp(option, "--seed") == 0)
+        conditions->seed = (uint32)strtoul(value, nullptr, 0);
+    else
+        return false;
+    return true;
+}
+
+
+LinkSimulator::LinkSimulator(const LinkConditions& conditions)
+    : fConditions(conditions),
+      fListenSocket(-1),
+      fPort(0),
+      fHostPort(0),
+      fQuitting(false)
+{
+    fHost[0] = '\0';
+    for (int i = 0; i < 2; i++) {
+        Direction& direction = fDirections[i];
+        direction.from = -1;
+        direction.to = -1;
+        // One generator each way, so what goes up never shifts the draws
+        // for what comes down
+        direction.random.seed(conditions.seed * 2 + i);
+        direction.linkFree = 0;
+        direction.lastDue = 0;
+        direction.ended = false;
+        direction.shutDown = false;
+        memset(&direction.stats, 0, sizeof(direction.stats));
+    }
+}
+
+LinkSimulator::~LinkSimulator()
+{
+    Stop();
+}
+
+status_t LinkSimulator::Start(const char* host, uint16 port)
+{
+    fListenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (fListenSocket < 0)
+        return B_ERROR;
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t addressLength = sizeof(address);
+    if (bind(fListenSocket, (struct sockaddr*)&address, sizeof(address)) < 0
+        || listen(fListenSocket, 1) < 0
+        || getsockname(fListenSocket, (struct sockaddr*)&address,
+            &addressLength) < 0) {
+        close(fListenSocket);
+        fListenSocket = -1;
+        return B_ERROR;
+    }
+    fPort = ntohs(address.sin_port);
+
+    strlcpy(fHost, host, sizeof(fHost));
+    fHostPort = port;
+    fQuitting = false;
+    fThread = std::thread(&LinkSimulator::Run, this);
+    return B_OK;
+}
+
+void LinkSimulator::Stop()
+{
+    fQuitting = true;
+    if (fThread.joinable())
+        fThread.join();
+
+    if (fListenSocket >= 0) {
+        close(fListenSocket);
+        fListenSocket = -1;
+    }
+}
+
+void LinkSimulator::PrintStats(FILE* file) const
+{
+    static const char* kNames[] = { "up", "down" };
+    for (int i = 0; i < 2; i++) {
+        const LinkStats& stats = fDirections[i].stats;
+        fprintf(file, "link %-4s %llu segments, %llu bytes: %llu "
+            "retransmitted, %llu reordered, %llu held behind them\n",
+            kNames[i], (unsigned long long)stats.segments,
+            (unsigned long long)stats.bytes,
+            (unsigned long long)stats.retransmitted,
+            (unsigned long long)stats.reordered,
+            (unsigned long long)stats.held);
+    }
+}
+
+void LinkSimulator::Run()
+{
+    struct pollfd pfd;
+    pfd.fd = fListenSocket;
+    pfd.events = POLLIN;
+    while (!fQuitting) {
+        pfd.revents = 0;
+        if (poll(&pfd, 1, kIdlePollMs) > 0)
+            break;
+    }
+    if (fQuitting)
+        return;
+
+    int client = accept(fListenSocket, nullptr, nullptr);
+    if (client < 0)
+        return;
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* result;
+    int server = -1;
+    if (getaddrinfo(fHost, nullptr, &hints, &result) == 0) {
+        struct sockaddr_in address;
+        memcpy(&address, result->ai_addr, sizeof(address));
+        address.sin_port = htons(fHostPort);
+        freeaddrinfo(result);
+
+        server = socket(AF_INET, SOCK_STREAM, 0);
+        if (server >= 0 && connect(server, (struct sockaddr*)&address,
+                sizeof(address)) < 0) {
+            close(server);
+            server = -1;
+        }
+    }
+    if (server < 0) {
+        close(client);
+        return;
+    }
+
+    int sockets[2] = { client, server };
+    for (int i = 0; i < 2; i++) {
+        int opt = 1;
+        setsockopt(sockets[i], IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        fcntl(sockets[i], F_SETFL, fcntl(sockets[i], F_GETFL, 0) | O_NONBLOCK);
+    }
+    fDirections[LINK_UP].from = client;
+    fDirections[LINK_UP].to = server;
+    fDirections[LINK_DOWN].from = server;
+    fDirections[LINK_DOWN].to = client;
+
+    while (!fQuitting && Relay())
+        ;
+
+    close(client);
+    close(server);
+}
+
+// One round: hands over what is due, then waits for more or the next due
+// segment. False once both directions are done.
+bool LinkSimulator::Relay()
+{
+    bigtime_t now = LoadNow();
+    bigtime_t next = now + kIdlePollMs * 1000;
+    bool done = true;
+
+    struct pollfd pfds[2];
+    for (int i = 0; i < 2; i++) {
+        Direction& direction = fDirections[i];
+        if (!Write(direction, now))
+            return false;
+
+        if (!direction.inFlight.empty())
+            next = std::min(next, direction.inFlight.front().due);
+        if (direction.ended && direction.inFlight.empty()
+            && direction.sending.empty() && !direction.shutDown) {
+            shutdown(direction.to, SHUT_WR);
+            direction.shutDown = true;
+        }
+        done = done && direction.shutDown;
+
+        pfds[i].fd = direction.ended ? -1 : direction.from;
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
+    }
+    if (done)
+        return false;
+
+    // The socket one direction writes to is the other one's source
+    for (int i = 0; i < 2; i++) {
+        if (!fDirections[i].sending.empty()) {
+            if (pfds[1 - i].fd < 0) {
+                pfds[1 - i].fd = fDirections[i].to;
+                pfds[1 - i].events = POLLOUT;
+            } else
+                pfds[1 - i].events |= POLLOUT;
+        }
+    }
+
+    // As LoadClient::Service(): poll() sleeps in whole milliseconds, spin
+    // the last stretch so delays come out to the µs
+    bigtime_t wait = next - now;
+    int timeout = wait > 2000 ? (int)((wait - 1000) / 1000) : 0;
+    if (poll(pfds, 2, timeout) < 0)
+        return true;
+
+    now = LoadNow();
+    for (int i = 0; i < 2; i++) {
+        if (!fDirections[i].ended
+            && (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0
+            && !Read(fDirections[i], now))
+            return false;
+    }
+    return true;
+}
+
+bool LinkSimulator::Read(Direction& direction, bigtime_t now)
+{
+    uint8 buffer[64 * 1024];
+    ssize_t bytes = recv(direction.from, buffer, sizeof(buffer), 0);
+    if (bytes < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    if (bytes == 0) {
+        // Whatever is left over was never a whole message; pass it on
+        if (!direction.received.empty()) {
+            Schedule(direction, direction.received.data(),
+                direction.received.size(), now);
+            direction.received.clear();
+        }
+        direction.ended = true;
+        return true;
+    }
+
+    direction.received.insert(direction.received.end(), buffer,
+        buffer + bytes);
+    Cut(direction, now);
+    return true;
+}
+
+// A sender with TCP_NODELAY puts each message on the wire as it is
+// written, so messages are where segments start
+void LinkSimulator::Cut(Direction& direction, bigtime_t now)
+{
+    std::vector<uint8>& received = direction.received;
+    size_t offset = 0;
+    while (received.size() - offset >= sizeof(ProtocolHeader)) {
+        ProtocolHeader header;
+        memcpy(&header, received.data() + offset, sizeof(header));
+
+        size_t length;
+        if (header.magic != PROTOCOL_MAGIC)
+            length = received.size() - offset;   // not ours; as it comes
+        else {
+            length = sizeof(header) + header.length;
+            if (received.size() - offset < length)
+                break;
+        }
+
+        for (size_t done = 0; done < length; done += kSegmentSize) {
+            Schedule(direction, received.data() + offset + done,
+                std::min(kSegmentSize, length - done), now);
+        }
+        offset += length;
+    }
+    received.erase(received.begin(), received.begin() + offset);
+}
+
+void LinkSimulator::Schedule(Direction& direction, const uint8* data,
+    size_t length, bigtime_t now)
+{
+    // Draws happen in the same order on every run, whatever the timing
+    double jitter = Chance(direction);
+    bool reordered = Chance(direction) < fConditions.reorder;
+    int losses = 0;
+    while (losses < kMaxRetransmits && Chance(direction) < fConditions.loss)
+        losses++;
+
+    bigtime_t sent = now;
+    if (fConditions.bandwidth > 0) {
+        bigtime_t start = std::max(now, direction.linkFree);
+        direction.linkFree = start + (bigtime_t)((length + kSegmentOverhead)
+            * 8 * 1000000 / fConditions.bandwidth);
+        sent = direction.linkFree;
+    }
+
+    bigtime_t oneWay = fConditions.roundTrip / 2;
+    bigtime_t due = sent + oneWay + (bigtime_t)(jitter * fConditions.jitter);
+
+    bigtime_t timeout = std::max(2 * fConditions.roundTrip,
+        kMinRetransmitTimeout);
+    for (int i = 0; i < losses; i++) {
+        due += timeout;
+        timeout *= 2;
+    }
+    // Those sent after it get in first, and TCP holds them until it is
+    // there: from the application's side it is just late
+    if (reordered)
+        due += oneWay + fConditions.jitter;
+
+    LinkStats& stats = direction.stats;
+    stats.segments++;
+    stats.bytes += length;
+    if (losses > 0)
+        stats.retransmitted++;
+    if (reordered)
+        stats.reordered++;
+    if (due < direction.lastDue) {
+        due = direction.lastDue;
+        stats.held++;
+    }
+    direction.lastDue = due;
+
+    Segment segment;
+    segment.due = due;
+    segment.data.assign(data, data + length);
+    direction.inFlight.push_back(std::move(segment));
+}
+
+bool LinkSimulator::Write(Direction& direction, bigtime_t now)
+{
+    while (!direction.inFlight.empty()
+        && direction.inFlight.front().due <= now) {
+        std::vector<uint8>& data = direction.inFlight.front().data;
+        direction.sending.insert(direction.sending.end(), data.begin(),
+            data.end());
+        direction.inFlight.pop_front();
+    }
+
+    if (direction.sending.empty())
+        return true;
+
+    ssize_t sent = send(direction.to, direction.sending.data(),
+        direction.sending.size(), kSendFlags);
+    if (sent < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    direction.sending.erase(direction.sending.begin(),
+        direction.sending.begin() + sent);
+    return true;
+}
+
+// Uniform in [0, 1); mt19937's sequence is fixed by the standard, unlike
+// what the <random> distributions make of it
+double LinkSimulator::Chance(Direction& direction)
+{
+    return direction.random() / 4294967296.0;
+}
@@ -0,0 +1,111 @@
+#ifndef LINK_SIMULATOR_H
+#define LINK_SIMULATOR_H
+
+#include <SupportDefs.h>
+
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <thread>
+#include <vector>
+
+// The network LinkSimulator pretends to be; all zero is a plain relay
+struct LinkConditions {
+    LinkConditions();
+
+    bool IsPerfect() const;
+
+    bigtime_t roundTrip;    // µs, half of it each way
+    bigtime_t jitter;       // µs; each segment's one-way delay grows by up to this
+    double loss;            // 0-1, chance a segment has to be retransmitted
+    double reorder;         // 0-1, chance a segment is overtaken by later ones
+    uint64 bandwidth;       // bits per second each way; 0 = unlimited
+    uint32 seed;
+};
+
+// For --rtt ms, --jitter ms, --loss %, --reorder %, --bandwidth kbit/s
+// and --seed n; false for other options or a bad value
+bool ParseLinkOption(const char* option, const char* value,
+    LinkConditions* conditions);
+
+#define LINK_USAGE "[--rtt ms] [--jitter ms] [--loss %%] [--reorder %%]\n" \
+    "           [--bandwidth kbit/s] [--seed n]"
+
+enum LinkDirection {
+    LINK_UP = 0,        // client to server
+    LINK_DOWN           // server to client
+};
+
+struct LinkStats {
+    uint64 segments;
+    uint64 bytes;
+    uint64 retransmitted;   // segments lost at least once
+    uint64 reordered;
+    uint64 held;            // delivered late only because one before was
+};
+
+// A TCP relay that delays what passes through it like a worse network
+// would. Each direction is cut into segments along message boundaries,
+// large messages into MSS-sized pieces, and every segment gets its delay
+// from a generator seeded by LinkConditions::seed: the same message
+// sequence sees the same delays, losses and reorderings on every run.
+// The connection stays TCP, so a lost or reordered segment shows up as
+// it would to softKM: late, and holding up everything behind it.
+class LinkSimulator {
+public:
+    LinkSimulator(const LinkConditions& conditions);
+    ~LinkSimulator();
+
+    // Listens on a loopback port of its own and relays the first
+    // connection made to it to host:port
+    status_t Start(const char* host, uint16 port);
+    void Stop();
+    uint16 Port() const { return fPort; }
+
+    // Safe to read after Stop()
+    const LinkStats& Stats(LinkDirection direction) const
+        { return fDirections[direction].stats; }
+    // A line each way, for the tools' summaries
+    void PrintStats(FILE* file) const;
+
+private:
+    struct Segment {
+        bigtime_t due;
+        std::vector<uint8> data;
+    };
+
+    struct Direction {
+        int from;
+        int to;
+        std::mt19937 random;
+        std::vector<uint8> received;    // not yet a whole message
+        std::deque<Segment> inFlight;   // in the order they are due
+        std::vector<uint8> sending;     // due, not yet taken by the socket
+        bigtime_t linkFree;             // the bandwidth cap's next free slot
+        bigtime_t lastDue;
+        bool ended;                     // from has closed
+        bool shutDown;                  // and to was told
+        LinkStats stats;
+    };
+
+    void Run();
+    bool Relay();
+    bool Read(Direction& direction, bigtime_t now);
+    void Cut(Direction& direction, bigtime_t now);
+    void Schedule(Direction& direction, const uint8* data, size_t length,
+        bigtime_t now);
+    bool Write(Direction& direction, bigtime_t now);
+    double Chance(Direction& direction);
+
+    LinkConditions fConditions;
+    int fListenSocket;
+    uint16 fPort;
+    char fHost[256];
+    uint16 fHostPort;
+    Direction fDirections[2];
+    std::atomic<bool> fQuitting;
+    std::thread fThread;
+};
+
+#endif // LINK_SIMULATOR_H
@@ -0,0 +1,323 @@
+#include "LoadClient.h"
+#include "network/Protocol.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+bigtime_t LoadNow()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (bigtime_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+bigtime_t Percentile(std::vector<bigtime_t>& values, double percentile)
+{
+    if (values.empty())
+        return 0;
+    size_t index = (size_t)(percentile / 100 * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+LoadClient::LoadClient()
+    : fBulkBytes(0),
+      fSwitchesBack(0),
+      fListener(nullptr),
+      fScreenWidth(2560),
+      fScreenHeight(1440),
+      fSocket(-1),
+      fToken(0),
+      fSessionAccepts(0),
+      fResumed(false),
+      fDeferredHandshake(false),
+      fInputSent(0),
+      fInputHandled(0)
+{
+}
+
+LoadClient::~LoadClient()
+{
+    if (fSocket >= 0)
+        close(fSocket);
+}
+
+void LoadClient::SetScreen(float width, float height)
+{
+    fScreenWidth = width;
+    fScreenHeight = height;
+}
+
+bool LoadClient::Connect(const char* host, uint16 port)
+{
+    if (!Open(host, port))
+        return false;
+
+    // What the Mac client sends on connecting
+    fToken = 0;
+    uint8 hello[sizeof(SessionHelloPayload) + sizeof(uint32)];
+    uint32 capabilities = CAPABILITY_BULK_FRAGMENTS;
+    memcpy(hello, &fToken, sizeof(fToken));
+    memcpy(hello + sizeof(fToken), &capabilities, sizeof(capabilities));
+    Send(EVENT_SESSION_HELLO, hello, sizeof(hello));
+
+    Handshake();
+    return true;
+}
+
+void LoadClient::Drop()
+{
+    if (fSocket >= 0)
+        close(fSocket);
+    fSocket = -1;
+    fOut.MakeEmpty();
+    fIn.Reset();
+    fHeartbeats.clear();
+}
+
+bool LoadClient::Resume(const char* host, uint16 port)
+{
+    Drop();
+    if (!Open(host, port))
+        return false;
+
+    uint8 hello[sizeof(SessionHelloPayload) + sizeof(uint32)];
+    uint32 capabilities = CAPABILITY_BULK_FRAGMENTS;
+    memcpy(hello, &fToken, sizeof(fToken));
+    memcpy(hello + sizeof(fToken), &capabilities, sizeof(capabilities));
+    Send(EVENT_SESSION_HELLO, hello, sizeof(hello));
+
+    fDeferredHandshake = true;
+    return true;
+}
+
+bool LoadClient::Open(const char* host, uint16 port)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* result;
+    if (getaddrinfo(host, nullptr, &hints, &result) != 0)
+        return false;
+
+    struct sockaddr_in address;
+    memcpy(&address, result->ai_addr, sizeof(address));
+    address.sin_port = htons(port);
+    freeaddrinfo(result);
+
+    fSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (fSocket < 0
+        || connect(fSocket, (struct sockaddr*)&address, sizeof(address)) < 0)
+        return false;
+
+    int opt = 1;
+    setsockopt(fSocket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    fcntl(fSocket, F_SETFL, fcntl(fSocket, F_GETFL, 0) | O_NONBLOCK);
+    return true;
+}
+
+void LoadClient::Handshake()
+{
+    ScreenInfoPayload screen = { fScreenWidth, fScreenHeight };
+    Send(EVENT_SCREEN_INFO, &screen, sizeof(screen));
+
+    SettingsSyncPayload settings;
+    settings.edgeDwellTime = 0.3f;
+    settings.macSwitchEdge = 0;     // right
+    settings.haikuReturnEdge = 1;   // left
+    settings.yOffsetRatio = 0;
+    Send(EVENT_SETTINGS_SYNC, &settings, sizeof(settings));
+
+    TakeControl();
+}
+
+void LoadClient::TakeControl()
+{
+    ControlSwitchPayload control = { 0, 0.5f };
+    Send(EVENT_CONTROL_SWITCH, &control, sizeof(control));
+
+    // In from the return edge; clear of all edges from there
+    MouseMovePayload move = { 600, 0, 1, 0 };
+    Send(EVENT_MOUSE_MOVE, &move, sizeof(move));
+}
+
+void LoadClient::Send(uint8 type, const void* payload, uint32 length,
+    SendPriority priority)
+{
+    std::vector<uint8> message(sizeof(ProtocolHeader) + length);
+    ProtocolHeader header;
+    header.magic = PROTOCOL_MAGIC;
+    header.version = PROTOCOL_VERSION;
+    header.eventType = type;
+    header.length = length;
+    memcpy(message.data(), &header, sizeof(header));
+    memcpy(message.data() + sizeof(header), payload, length);
+    fOut.Enqueue(message.data(), message.size(), priority);
+
+    if (type >= EVENT_KEY_DOWN && type <= EVENT_MOUSE_WHEEL) {
+        if (fListener != nullptr)
+            fListener->InputQueued(fInputSent, type, LoadNow());
+        fInputSent++;
+    }
+}
+
+void LoadClient::SendKey(uint8 type, uint32 keyCode, uint32 modifiers,
+    char byte)
+{
+    uint8 payload[sizeof(KeyEventPayload) + 1];
+    KeyEventPayload key;
+    key.keyCode = keyCode;
+    key.modifiers = modifiers;
+    key.numBytes = byte != 0 ? 1 : 0;
+    memcpy(payload, &key, sizeof(key));
+    payload[sizeof(key)] = (uint8)byte;
+    Send(type, payload, sizeof(key) + key.numBytes);
+}
+
+void LoadClient::SendHeartbeat()
+{
+    Heartbeat heartbeat;
+    heartbeat.sent = LoadNow();
+    heartbeat.inputSent = fInputSent;
+    fHeartbeats.push_back(heartbeat);
+    Send(EVENT_HEARTBEAT, nullptr, 0);
+}
+
+bool LoadClient::Service(bigtime_t until)
+{
+    for (;;) {
+        Flush();
+
+        // Spin the last stretch, poll() sleeps in whole milliseconds and
+        // an 8 kHz mouse is due every 125 µs
+        bigtime_t remaining = until - LoadNow();
+        int timeout = remaining > 2000 ? (int)((remaining - 1000) / 1000) : 0;
+
+        struct pollfd pfd;
+        pfd.fd = fSocket;
+        pfd.events = POLLIN | (fOut.IsEmpty() ? 0 : POLLOUT);
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeout) > 0
+            && (pfd.revents & (POLLIN | POLLHUP | POLLERR)) != 0
+            && !Receive())
+            return false;
+
+        if (LoadNow() >= until)
+            return true;
+    }
+}
+
+void LoadClient::TakeRoundTrips(std::vector<bigtime_t>& roundTrips)
+{
+    roundTrips.insert(roundTrips.end(), fRoundTrips.begin(),
+        fRoundTrips.end());
+    fRoundTrips.clear();
+}
+
+void LoadClient::Flush()
+{
+    const uint8* data;
+    size_t length;
+    while ((data = fOut.Peek(&length)) != nullptr) {
+        ssize_t sent = send(fSocket, data, length, kSendFlags);
+        if (sent <= 0)
+            return;     // EAGAIN; errors show up on the receiving side
+        fOut.Consume(sent);
+    }
+}
+
+bool LoadClient::Receive()
+{
+    for (;;) {
+        size_t available;
+        uint8* buffer = fIn.ReceiveBuffer(&available);
+        ssize_t bytesRead = recv(fSocket, buffer, available, 0);
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK
+                || errno == EINTR))
+            return true;
+        if (bytesRead <= 0) {
+            fprintf(stderr, "The server closed the connection\n");
+            return false;
+        }
+        fIn.Received(bytesRead);
+
+        const uint8* message;
+        size_t messageLength;
+        while (fIn.NextMessage(&message, &messageLength) == FRAME_MESSAGE)
+            Handle(message, messageLength);
+    }
+}
+
+void LoadClient::Handle(const uint8* message, size_t length)
+{
+    const ProtocolHeader* header = (const ProtocolHeader*)message;
+    const uint8* payload = message + sizeof(ProtocolHeader);
+
+    switch (header->eventType) {
+        case EVENT_HEARTBEAT:
+            Send(EVENT_HEARTBEAT_ACK, nullptr, 0);
+            break;
+
+        case EVENT_HEARTBEAT_ACK:
+            if (!fHeartbeats.empty()) {
+                fRoundTrips.push_back(LoadNow() - fHeartbeats.front().sent);
+                fInputHandled = fHeartbeats.front().inputSent;
+                fHeartbeats.pop_front();
+            }
+            break;
+
+        case EVENT_SESSION_ACCEPT:
+        {
+            if (header->length < sizeof(SessionAcceptPayload))
+                break;
+            SessionAcceptPayload accept;
+            memcpy(&accept, payload, sizeof(accept));
+            fToken = accept.token;
+            fResumed = accept.resumed != 0;
+            fSessionAccepts++;
+
+            if (header->length >= sizeof(SessionAcceptPayload) + sizeof(uint32)) {
+                uint32 capabilities;
+                memcpy(&capabilities, payload + sizeof(SessionAcceptPayload),
+                    sizeof(capabilities));
+                fOut.SetFragmenting(
+                    (capabilities & CAPABILITY_BULK_FRAGMENTS) != 0);
+            }
+
+            // The server dropped the old session, start over
+            if (fDeferredHandshake && !fResumed)
+                Handshake();
+            fDeferredHandshake = false;
+            break;
+        }
+
+        case EVENT_CONTROL_SWITCH:
+            // Pushed over an edge after all; take it back and go on
+            if (header->length >= 1 && payload[0] == 1) {
+                fSwitchesBack++;
+                TakeControl();
+            }
+            break;
+    }
+
+    if (fListener != nullptr)
+        fListener->MessageReceived(message, length);
+}
@@ -0,0 +1,99 @@
+#ifndef LOAD_CLIENT_H
+#define LOAD_CLIENT_H
+
+#include "network/MessageFramer.h"
+#include "network/SendScheduler.h"
+
+#include <deque>
+#include <vector>
+
+// Told about each input event as LoadClient queues it, and about what
+// comes back
+class LoadClientListener {
+public:
+    virtual ~LoadClientListener() {}
+
+    // index counts input events from 0, in the order the server gets them
+    virtual void InputQueued(uint64 index, uint8 type, bigtime_t when) = 0;
+    // Any message from the server, after LoadClient handled it
+    virtual void MessageReceived(const uint8* message, size_t length) {}
+};
+
+// The connection to the server and what was measured on it
+class LoadClient {
+public:
+    LoadClient();
+    ~LoadClient();
+
+    void SetListener(LoadClientListener* listener) { fListener = listener; }
+    // The Mac screen announced in SCREEN_INFO
+    void SetScreen(float width, float height);
+
+    bool Connect(const char* host, uint16 port);
+    void TakeControl();
+
+    // Hangs up without a word, as a dropped link does; held keys and
+    // buttons stay held on this side
+    void Drop();
+    // Connects again presenting the session token, and like the Mac
+    // client leaves the handshake until SESSION_ACCEPT tells whether the
+    // session was resumed
+    bool Resume(const char* host, uint16 port);
+
+    void Send(uint8 type, const void* payload, uint32 length,
+        SendPriority priority = SEND_INPUT);
+    void SendKey(uint8 type, uint32 keyCode, uint32 modifiers, char byte = 0);
+    void SendHeartbeat();
+
+    // Writes what the socket takes and handles what came in, waiting up
+    // to until for either
+    bool Service(bigtime_t until);
+
+    int32 SessionAccepts() const { return fSessionAccepts; }
+    bool Resumed() const { return fResumed; }
+
+    uint64 InputSent() const { return fInputSent; }
+    uint64 InputHandled() const { return fInputHandled; }
+    size_t Queued() const { return fOut.QueuedBytes(); }
+    bool HeartbeatsPending() const { return !fHeartbeats.empty(); }
+
+    // Taken since the last call
+    void TakeRoundTrips(std::vector<bigtime_t>& roundTrips);
+
+    uint64 fBulkBytes;
+    int32 fSwitchesBack;
+
+private:
+    struct Heartbeat {
+        bigtime_t sent;
+        uint64 inputSent;       // input events queued before it
+    };
+
+    bool Open(const char* host, uint16 port);
+    void Handshake();
+    void Flush();
+    bool Receive();
+    void Handle(const uint8* message, size_t length);
+
+    LoadClientListener* fListener;
+    float fScreenWidth;
+    float fScreenHeight;
+    int fSocket;
+    SendScheduler fOut;
+    MessageFramer fIn;
+    std::deque<Heartbeat> fHeartbeats;
+    std::vector<bigtime_t> fRoundTrips;
+    uint64 fToken;
+    int32 fSessionAccepts;
+    bool fResumed;
+    bool fDeferredHandshake;
+    uint64 fInputSent;
+    uint64 fInputHandled;
+};
+
+// Monotonic microseconds, as ServerLoop::Now()
+bigtime_t LoadNow();
+// percentile 0-100 of values, which get reordered; 0 if empty
+bigtime_t Percentile(std::vector<bigtime_t>& values, double percentile);
+
+#endif // LOAD_CLIENT_H
@@ -0,0 +1,204 @@
+// Synthetic softKM client: takes control of a server like the Mac client
+// does and sends it input at a set rate, for soak tests without a Mac.
+//
+//   LoadGen [--mouse hz] [--typing wpm] [--chords per-second]
+//           [--scroll flings-per-second] [--clipboard kb[@seconds]]
+//           [--rtt ms] [--jitter ms] [--loss %] [--reorder %]
+//           [--bandwidth kbit/s] [--seed n]
+//           [--duration seconds] [--heartbeat ms] [--screen WxH]
+//           [host[:port]]
+//
+// Workloads given together run interleaved; without any, --mouse 1000.
+// The input is real: typing goes to the focused window, so point it at a
+// test machine. The pointer circles in the middle of the screen, chords
+// are Shift+Control+Option with F5-F8.
+//
+// Heartbeats go out with the input. The server handles a connection's
+// messages in order, so each HEARTBEAT_ACK tells the round-trip time and
+// that every input event sent before its heartbeat was handled: that
+// count over time is the server's achieved throughput. The backlog column
+// is therefore only as fine as --heartbeat (default 100 ms).
+//
+// The link options relay the connection through a LinkSimulator, for
+// trying heartbeat timeouts and the like against a real server on a
+// network worse than the one at hand.
+
+#include "LinkSimulator.h"
+#include "LoadClient.h"
+#include "Workloads.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+static void Usage(const char* name)
+{
+    fprintf(stderr, "usage: %s " WORKLOAD_USAGE "\n"
+        "           " LINK_USAGE "\n"
+        "           [--duration seconds] [--heartbeat ms] [--screen WxH]\n"
+        "           [host[:port]]\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    char host[256] = "127.0.0.1";
+    uint16 port = 31337;
+    double duration = 10;
+    bigtime_t heartbeatInterval = 100000;
+    std::vector<Workload*> workloads;
+    LinkConditions conditions;
+
+    LoadClient client;
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        double number = value != nullptr ? atof(value) : 0;
+
+        Workload* workload = CreateWorkload(argv[i], value);
+        if (workload != nullptr)
+            workloads.push_back(workload);
+        else if (ParseLinkOption(argv[i], value, &conditions))
+            ;
+        else if (strcmp(argv[i], "--duration") == 0 && number > 0)
+            duration = number;
+        else if (strcmp(argv[i], "--heartbeat") == 0 && number > 0)
+            heartbeatInterval = (bigtime_t)(number * 1000);
+        else if (strcmp(argv[i], "--screen") == 0 && value != nullptr) {
+            float width;
+            float height;
+            if (sscanf(value, "%fx%f", &width, &height) != 2) {
+                Usage(argv[0]);
+                return 2;
+            }
+            client.SetScreen(width, height);
+        } else if (argv[i][0] != '-') {
+            strlcpy(host, argv[i], sizeof(host));
+            char* colon = strrchr(host, ':');
+            if (colon != nullptr) {
+                *colon = '\0';
+                port = (uint16)atoi(colon + 1);
+            }
+            continue;
+        } else {
+            Usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+    if (workloads.empty())
+        workloads.push_back(CreateWorkload("--mouse", "1000"));
+
+    LinkSimulator link(conditions);
+    uint16 connectPort = port;
+    if (!conditions.IsPerfect()) {
+        if (link.Start(host, port) != B_OK) {
+            fprintf(stderr, "Cannot start the link: %s\n", strerror(errno));
+            return 2;
+        }
+        connectPort = link.Port();
+    }
+
+    if (!client.Connect(conditions.IsPerfect() ? host : "127.0.0.1",
+            connectPort)) {
+        fprintf(stderr, "Cannot connect to %s:%d: %s\n", host, port,
+            strerror(errno));
+        return 2;
+    }
+
+    bigtime_t start = LoadNow();
+    bigtime_t end = start + (bigtime_t)(duration * 1000000);
+    for (size_t i = 0; i < workloads.size(); i++)
+        workloads[i]->Start(start);
+
+    printf("%7s %10s %10s %8s %9s %9s %9s %9s\n", "time", "sent/s", "server/s",
+        "backlog", "rtt p50", "rtt p99", "rtt max", "queued");
+
+    std::vector<bigtime_t> roundTrips;     // this report interval
+    std::vector<bigtime_t> allRoundTrips;
+    bigtime_t nextHeartbeat = start;
+    bigtime_t lastReport = start;
+    uint64 lastSent = 0;
+    uint64 lastHandled = 0;
+    bool connected = true;
+
+    while (connected) {
+        bigtime_t now = LoadNow();
+        if (now >= end)
+            break;
+
+        for (size_t i = 0; i < workloads.size(); i++) {
+            while (workloads[i]->Next() <= now)
+                workloads[i]->Fire(client);
+        }
+        if (now >= nextHeartbeat) {
+            client.SendHeartbeat();
+            nextHeartbeat += heartbeatInterval;
+        }
+
+        if (now - lastReport >= 1000000) {
+            client.TakeRoundTrips(roundTrips);
+            double seconds = (now - lastReport) / 1000000.0;
+            printf("%6.1fs %10.0f %10.0f %8llu %7.2fms %7.2fms %7.2fms %8zuB\n",
+                (now - start) / 1000000.0,
+                (client.InputSent() - lastSent) / seconds,
+                (client.InputHandled() - lastHandled) / seconds,
+                (unsigned long long)(client.InputSent() - client.InputHandled()),
+                Percentile(roundTrips, 50) / 1000.0,
+                Percentile(roundTrips, 99) / 1000.0,
+                Percentile(roundTrips, 100) / 1000.0, client.Queued());
+            fflush(stdout);
+
+            allRoundTrips.insert(allRoundTrips.end(), roundTrips.begin(),
+                roundTrips.end());
+            roundTrips.clear();
+            lastSent = client.InputSent();
+            lastHandled = client.InputHandled();
+            lastReport = now;
+        }
+
+        bigtime_t next = std::min(std::min(nextHeartbeat, end),
+            lastReport + 1000000);
+        for (size_t i = 0; i < workloads.size(); i++)
+            next = std::min(next, workloads[i]->Next());
+        connected = client.Service(next);
+    }
+    bigtime_t sentUntil = LoadNow();
+
+    // One last heartbeat tells when the server got through everything
+    if (connected) {
+        client.SendHeartbeat();
+        bigtime_t deadline = LoadNow() + 10000000;
+        while (connected && client.HeartbeatsPending() && LoadNow() < deadline)
+            connected = client.Service(std::min(LoadNow() + 10000, deadline));
+    }
+    bigtime_t handledUntil = LoadNow();
+    client.TakeRoundTrips(allRoundTrips);
+    link.Stop();
+
+    double sendSeconds = (sentUntil - start) / 1000000.0;
+    double handleSeconds = (handledUntil - start) / 1000000.0;
+    printf("\noffered %llu input events in %.2f s (%.0f/s)\n",
+        (unsigned long long)client.InputSent(), sendSeconds,
+        client.InputSent() / sendSeconds);
+    printf("server handled %llu%s in %.2f s (%.0f/s)\n",
+        (unsigned long long)client.InputHandled(),
+        client.HeartbeatsPending() ? " (last heartbeat unanswered)" : "",
+        handleSeconds, client.InputHandled() / handleSeconds);
+    printf("heartbeat rtt over %zu: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, "
+        "max %.2f ms\n", allRoundTrips.size(),
+        Percentile(allRoundTrips, 50) / 1000.0,
+        Percentile(allRoundTrips, 90) / 1000.0,
+        Percentile(allRoundTrips, 99) / 1000.0,
+        Percentile(allRoundTrips, 100) / 1000.0);
+    if (client.fBulkBytes > 0)
+        printf("clipboard: %llu bytes\n", (unsigned long long)client.fBulkBytes);
+    if (client.fSwitchesBack > 0)
+        printf("control came back %d time(s)\n", client.fSwitchesBack);
+    if (!conditions.IsPerfect())
+        link.PrintStats(stdout);
+
+    for (size_t i = 0; i < workloads.size(); i++)
+        delete workloads[i];
+    return connected ? 0 : 1;
+}
@@ -0,0 +1,478 @@
+// Session resume under repeated drops, on one machine: LoadClient stands
+// in for the Mac client and hangs up mid-drag or mid-chord, then comes
+// back with its session token as the Mac client does. The server is the
+// portable core put together the way NetworkServer does it: ServerLoop,
+// ControlArbiter, ResumableSession and InputCore, with an injection sink
+// that counts.
+//
+//   ResumeHarness [--cycles n] [--grace ms] [--expire-every n]
+//
+// Most drops are back well within the grace window and must resume with
+// the button or keys still held: nothing released behind the user's back,
+// and the client's own releases landing after the resume. Every n-th drop
+// outlasts the window; the server must then have released all of it by
+// itself and start a new session. Prints the time from reconnecting to
+// SESSION_ACCEPT and exits 1 on any stuck or spurious release.
+
+#include "LoadClient.h"
+
+#include "input/InputCore.h"
+#include "network/ControlArbiter.h"
+#include "network/InputDispatcher.h"
+#include "network/Protocol.h"
+#include "network/ResumableSession.h"
+#include "network/ServerLoop.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <vector>
+
+// Mac key codes and modifier bit of the chord: Command-X
+static const uint32 kCommandKey = 0x37;
+static const uint32 kXKey = 0x07;
+static const uint32 kModifierCommand = 0x40;
+// How often the server looks for an expired parked session
+static const bigtime_t kServerPulse = 10000;
+
+
+// NetworkServer's session handling over the core, minus the system
+class ResumeServer : public ServerLoopListener, private InjectionSink,
+    private ScreenGeometry, private PeerLink {
+public:
+    ResumeServer(bigtime_t graceWindow);
+
+    status_t Start();
+    void Stop();
+    uint16 Port() const { return fLoop.Port(); }
+
+    // Injected by the core, counted on the loop thread
+    std::atomic<int32> fKeysDown;
+    std::atomic<int32> fKeysUp;
+    std::atomic<int32> fButtonsDown;
+    std::atomic<int32> fButtonsUp;
+    std::atomic<int32> fMoves;
+    std::atomic<int32> fRejected;
+    std::atomic<int32> fExpired;
+
+    // ServerLoopListener
+    virtual void ClientConnected(int32 client, int socket,
+        const char* address) {}
+    virtual void MessageReceived(int32 client, const uint8* message,
+        size_t length);
+    virtual void ClientDisconnected(int32 client, const char* reason);
+    virtual void Pulse(bigtime_t now);
+
+private:
+    void HandleSessionHello(int32 client, uint64 token);
+    void HandleControlSwitch(int32 client, bool toHaiku, float yRatio);
+    void ReleaseInputState();
+    void Reply(int32 client, uint8 type, const void* payload,
+        uint32 length);
+
+    // InjectionSink
+    virtual bool KeyDown(bigtime_t eventStart, uint32 key,
+        uint32 modifiers, const char* bytes, uint8 numBytes)
+        { fKeysDown++; return true; }
+    virtual bool KeyUp(bigtime_t eventStart, uint32 key, uint32 modifiers)
+        { fKeysUp++; return true; }
+    virtual bool MouseMoved(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers)
+        { fMoves++; return true; }
+    virtual bool MouseDown(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers, uint32 clicks)
+        { fButtonsDown++; return true; }
+    virtual bool MouseUp(bigtime_t eventStart, float x, float y,
+        uint32 buttons, uint32 modifiers)
+        { fButtonsUp++; return true; }
+    virtual bool MouseWheel(bigtime_t eventStart, float deltaX,
+        float deltaY, uint32 modifiers)
+        { return true; }
+    virtual void SetCursor(float x, float y) { fCursorX = x; fCursorY = y; }
+    virtual bool GetCursor(float* x, float* y)
+        { *x = fCursorX; *y = fCursorY; return true; }
+
+    // ScreenGeometry
+    virtual void GetScreenSize(float* width, float* height)
+        { *width = 1920; *height = 1080; }
+
+    // PeerLink; no neighbours, and control going back is not answered
+    virtual bool HasNeighbour(uint8 edge) const { return false; }
+    virtual void SendControlSwitch(uint8 direction, float yRatio) {}
+    virtual status_t ForwardControl(uint8 edge, float yRatio)
+        { return B_ERROR; }
+
+    ServerLoop fLoop;
+    SystemClock fClock;
+    InputCore fCore;
+    ControlArbiter fArbiter;
+    ResumableSession fSession;
+    std::map<int32, uint64> fTokens;
+    std::thread fThread;
+    float fCursorX;
+    float fCursorY;
+};
+
+ResumeServer::ResumeServer(bigtime_t graceWindow)
+    : fKeysDown(0),
+      fKeysUp(0),
+      fButtonsDown(0),
+      fButtonsUp(0),
+      fMoves(0),
+      fRejected(0),
+      fExpired(0),
+      fLoop(this),
+      fCore(&fClock, this, this),
+      fSession(graceWindow),
+      fCursorX(0),
+      fCursorY(0)
+{
+    fCore.SetPeerLink(this);
+}
+
+status_t ResumeServer::Start()
+{
+    status_t status = fLoop.Listen(0, 4);
+    if (status != B_OK)
+        return status;
+
+    fLoop.SetPulseInterval(kServerPulse);
+    fThread = std::thread(&ServerLoop::Run, &fLoop);
+    return B_OK;
+}
+
+void ResumeServer::Stop()
+{
+    fLoop.Quit();
+    if (fThread.joinable())
+        fThread.join();
+}
+
+void ResumeServer::MessageReceived(int32 client, const uint8* message,
+    size_t length)
+{
+    const ProtocolHeader* header = (const ProtocolHeader*)message;
+    const uint8* payload = message + sizeof(ProtocolHeader);
+
+    if (!fArbiter.Accepts(client, header->eventType)) {
+        fRejected++;
+        return;
+    }
+    if (ControlArbiter::IsInputEvent(header->eventType)) {
+        DispatchInputEvent(message, length, &fCore);
+        return;
+    }
+
+    switch (header->eventType) {
+        case EVENT_HEARTBEAT:
+            Reply(client, EVENT_HEARTBEAT_ACK, nullptr, 0);
+            break;
+
+        case EVENT_SESSION_HELLO:
+        {
+            uint64 token = 0;
+            if (header->length >= sizeof(SessionHelloPayload))
+                memcpy(&token, payload, sizeof(token));
+            HandleSessionHello(client, token);
+            break;
+        }
+
+        case EVENT_CONTROL_SWITCH:
+        {
+            ControlSwitchPayload control;
+            if (header->length < sizeof(control))
+                break;
+            memcpy(&control, payload, sizeof(control));
+            HandleControlSwitch(client, control.direction == 0,
+                control.yRatio);
+            break;
+        }
+    }
+}
+
+void ResumeServer::ClientDisconnected(int32 client, const char* reason)
+{
+    uint64 token = fTokens[client];
+    fTokens.erase(client);
+
+    // Clients that never owned input hold nothing
+    if (fArbiter.ReleaseControl(client))
+        fSession.Park(token, fClock.Now());
+}
+
+void ResumeServer::Pulse(bigtime_t now)
+{
+    if (fSession.ParkExpired(fClock.Now())) {
+        ReleaseInputState();
+        fSession.End();
+        fExpired++;
+    }
+}
+
+void ResumeServer::HandleSessionHello(int32 client, uint64 token)
+{
+    bool resumed = fSession.Resume(token, fClock.Now());
+    if (resumed)
+        fArbiter.TakeControl(client);
+    else
+        token = ResumableSession::NewToken();
+    fTokens[client] = token;
+
+    uint8 reply[sizeof(SessionAcceptPayload) + sizeof(uint32)];
+    SessionAcceptPayload accept;
+    accept.token = token;
+    accept.resumed = resumed ? 1 : 0;
+    accept.active = fCore.IsActive() ? 1 : 0;
+    uint32 capabilities = 0;
+    memcpy(reply, &accept, sizeof(accept));
+    memcpy(reply + sizeof(accept), &capabilities, sizeof(capabilities));
+    Reply(client, EVENT_SESSION_ACCEPT, reply, sizeof(reply));
+}
+
+void ResumeServer::HandleControlSwitch(int32 client, bool toHaiku,
+    float yRatio)
+{
+    if (!toHaiku) {
+        if (fArbiter.ReleaseControl(client))
+            ReleaseInputState();
+        return;
+    }
+
+    if (fArbiter.TakeControl(client) >= 0)
+        fCore.ReleaseAll();
+    else if (fSession.IsParked()) {
+        fCore.ReleaseAll();
+        fSession.End();
+    }
+    fCore.SetActive(true, yRatio);
+}
+
+void ResumeServer::ReleaseInputState()
+{
+    fCore.ReleaseAll();
+    fCore.SetActive(false);
+}
+
+void ResumeServer::Reply(int32 client, uint8 type, const void* payload,
+    uint32 length)
+{
+    std::vector<uint8> message(sizeof(ProtocolHeader) + length);
+    ProtocolHeader header;
+    header.magic = PROTOCOL_MAGIC;
+    header.version = PROTOCOL_VERSION;
+    header.eventType = type;
+    header.length = length;
+    memcpy(message.data(), &header, sizeof(header));
+    if (length > 0)
+        memcpy(message.data() + sizeof(header), payload, length);
+    fLoop.Send(client, message.data(), message.size());
+}
+
+
+// Until the server answered everything sent so far
+static bool Sync(LoadClient& client)
+{
+    client.SendHeartbeat();
+    bigtime_t deadline = LoadNow() + 2000000;
+    while (client.HeartbeatsPending()) {
+        if (LoadNow() >= deadline || !client.Service(LoadNow() + 1000))
+            return false;
+    }
+    return true;
+}
+
+static void SendButton(LoadClient& client, bool down)
+{
+    if (down) {
+        MouseDownPayload button = { 1, 0, 0, 0, 1 };
+        client.Send(EVENT_MOUSE_DOWN, &button, sizeof(button));
+    } else {
+        MouseButtonPayload button = { 1, 0, 0, 0 };
+        client.Send(EVENT_MOUSE_UP, &button, sizeof(button));
+    }
+}
+
+static void SendMove(LoadClient& client, float x, float y)
+{
+    MouseMovePayload move = { x, y, 1, 0 };
+    client.Send(EVENT_MOUSE_MOVE, &move, sizeof(move));
+}
+
+static void Usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [--cycles n] [--grace ms] "
+        "[--expire-every n]\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    int32 cycles = 40;
+    bigtime_t grace = 200000;
+    int32 expireEvery = 5;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        double number = value != nullptr ? atof(value) : 0;
+
+        if (strcmp(argv[i], "--cycles") == 0 && number >= 1)
+            cycles = (int32)number;
+        else if (strcmp(argv[i], "--grace") == 0 && number > 0)
+            grace = (bigtime_t)(number * 1000);
+        else if (strcmp(argv[i], "--expire-every") == 0 && number >= 0)
+            expireEvery = (int32)number;
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    ResumeServer server(grace);
+    if (server.Start() != B_OK) {
+        fprintf(stderr, "Cannot listen: %s\n", strerror(errno));
+        return 2;
+    }
+
+    LoadClient client;
+    client.SetScreen(1920, 1080);
+    if (!client.Connect("127.0.0.1", server.Port()) || !Sync(client)) {
+        fprintf(stderr, "Cannot connect to the server: %s\n", strerror(errno));
+        server.Stop();
+        return 2;
+    }
+
+    std::vector<bigtime_t> resumeTimes;
+    int32 resumed = 0;
+    int32 expired = 0;
+    int32 spurious = 0;     // released while the session was to be kept
+    int32 stuck = 0;        // still held once everything was released
+    int32 failures = 0;
+
+    for (int32 cycle = 0; cycle < cycles; cycle++) {
+        bool drag = cycle % 2 == 0;
+        bool outlast = expireEvery > 0 && cycle % expireEvery
+            == expireEvery - 1;
+
+        // Hold a button and move, or hold Command-X
+        if (drag) {
+            SendButton(client, true);
+            for (int32 i = 0; i < 5; i++)
+                SendMove(client, i % 2 == 0 ? 6 : -4, 3);
+        } else {
+            client.SendKey(EVENT_KEY_DOWN, kCommandKey, kModifierCommand);
+            client.SendKey(EVENT_KEY_DOWN, kXKey, kModifierCommand, 'x');
+        }
+        if (!Sync(client)) {
+            failures++;
+            break;
+        }
+        int32 held = drag ? 1 : 2;
+        int32 releasedBefore = server.fKeysUp + server.fButtonsUp;
+
+        // Gone for a moment, or for longer than the grace window
+        client.Drop();
+        bigtime_t away = outlast ? grace + 100000 : grace / 4;
+        bigtime_t until = LoadNow() + away;
+        while (LoadNow() < until)
+            client.Service(until);
+
+        bigtime_t reconnect = LoadNow();
+        int32 accepts = client.SessionAccepts();
+        if (!client.Resume("127.0.0.1", server.Port())) {
+            fprintf(stderr, "Cannot reconnect: %s\n", strerror(errno));
+            failures++;
+            break;
+        }
+        bigtime_t deadline = reconnect + 2000000;
+        while (client.SessionAccepts() == accepts && LoadNow() < deadline)
+            client.Service(LoadNow() + 500);
+        if (client.SessionAccepts() == accepts) {
+            fprintf(stderr, "cycle %d: no SESSION_ACCEPT\n", (int)cycle);
+            failures++;
+            break;
+        }
+        resumeTimes.push_back(LoadNow() - reconnect);
+
+        int32 released = server.fKeysUp + server.fButtonsUp - releasedBefore;
+        if (outlast) {
+            expired++;
+            if (client.Resumed()) {
+                fprintf(stderr, "cycle %d: resumed after the grace window\n",
+                    (int)cycle);
+                failures++;
+            }
+            if (released != held) {
+                fprintf(stderr, "cycle %d: %d of %d held released on expiry\n",
+                    (int)cycle, (int)released, (int)held);
+                stuck += held - released;
+            }
+        } else {
+            if (!client.Resumed()) {
+                fprintf(stderr, "cycle %d: not resumed after %lld ms\n",
+                    (int)cycle, (long long)(away / 1000));
+                failures++;
+            } else
+                resumed++;
+            if (released != 0) {
+                fprintf(stderr, "cycle %d: %d released while away\n",
+                    (int)cycle, (int)released);
+                spurious += released;
+            }
+
+            // Carry on where the drop happened and let go
+            int32 moves = server.fMoves;
+            if (drag) {
+                SendMove(client, 5, 5);
+                SendButton(client, false);
+            } else {
+                client.SendKey(EVENT_KEY_UP, kXKey, kModifierCommand);
+                client.SendKey(EVENT_KEY_UP, kCommandKey, 0);
+            }
+            if (!Sync(client)) {
+                failures++;
+                break;
+            }
+            if (drag && server.fMoves == moves) {
+                fprintf(stderr, "cycle %d: input after resume not injected\n",
+                    (int)cycle);
+                failures++;
+            }
+        }
+
+        if (!Sync(client)) {
+            failures++;
+            break;
+        }
+        int32 keysHeld = server.fKeysDown - server.fKeysUp;
+        int32 buttonsHeld = server.fButtonsDown - server.fButtonsUp;
+        if (keysHeld != 0 || buttonsHeld != 0) {
+            fprintf(stderr, "cycle %d: %d keys and %d buttons stuck\n",
+                (int)cycle, (int)keysHeld, (int)buttonsHeld);
+            stuck += keysHeld + buttonsHeld;
+            failures++;
+            break;
+        }
+    }
+    server.Stop();
+
+    printf("%d drops: %d resumed, %d outlasted the %lld ms grace window "
+        "(%d expired on the server)\n", (int)(resumed + expired + failures),
+        (int)resumed, (int)expired, (long long)(grace / 1000),
+        (int)server.fExpired);
+    if (!resumeTimes.empty()) {
+        printf("  reconnect to SESSION_ACCEPT µs: p50 %lld  p99 %lld  "
+            "max %lld\n", (long long)Percentile(resumeTimes, 50),
+            (long long)Percentile(resumeTimes, 99),
+            (long long)Percentile(resumeTimes, 100));
+    }
+    printf("  spurious releases %d, stuck %d, rejected input %d\n",
+        (int)spurious, (int)stuck, (int)server.fRejected);
+
+    if (failures > 0 || spurious > 0 || stuck > 0 || server.fRejected > 0)
+        return 1;
+    return 0;
+}
@@ -0,0 +1,402 @@
+// Edge switch latency against the clipboard, on one machine: the time
+// from the server deciding to hand control to the Mac to the client
+// having read CONTROL_SWITCH, over ServerLoop on loopback. The server
+// builds CLIPBOARD_SYNC the way NetworkServer::SendClipboardSync() does
+// for a client with LZ4 and bulk fragments, and sends it
+//
+//   empty       not at all: the clipboard is empty
+//   pre-synced  when the clipboard changed, some time before the switch,
+//               as the app does on B_CLIPBOARD_CHANGED
+//   inline      right before CONTROL_SWITCH, as the switch once did; for
+//               comparison only
+//
+//   SwitchHarness [--switches n] [--gap ms] [--size bytes] [--max-p99 µs]
+//
+// A pre-synced clipboard can still be on the wire at the switch when it
+// changed just before; CONTROL_SWITCH must then get past its fragments.
+// With --max-p99 it exits 1 if the empty or the pre-synced p99 is above
+// that.
+
+#include "LoadClient.h"
+
+#include "clipboard/ContentHash.h"
+#include "clipboard/Lz4Block.h"
+#include "network/MessageFramer.h"
+#include "network/Protocol.h"
+#include "network/ServerLoop.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+enum ClipboardMode {
+    CLIPBOARD_EMPTY,
+    CLIPBOARD_PRESYNCED,
+    CLIPBOARD_INLINE
+};
+
+
+// The Haiku side: one client, which owns input until the next switch
+class SwitchServer : public ServerLoopListener {
+public:
+    SwitchServer() : fClient(-1), fLoop(this) {}
+
+    status_t Start();
+    void Stop();
+    uint16 Port() const { return fLoop.Port(); }
+
+    // Copies, hashes, compresses and queues content as CLIPBOARD_SYNC
+    status_t SendClipboard(const uint8* content, uint32 length);
+    status_t SendControlSwitch();
+
+    std::atomic<int32> fClient;
+
+    // ServerLoopListener
+    virtual void ClientConnected(int32 client, int socket,
+        const char* address);
+    virtual void MessageReceived(int32 client, const uint8* message,
+        size_t length) {}
+    virtual void ClientDisconnected(int32 client, const char* reason)
+        { fClient = -1; }
+
+private:
+    ServerLoop fLoop;
+    std::thread fThread;
+};
+
+status_t SwitchServer::Start()
+{
+    status_t status = fLoop.Listen(0, 1);
+    if (status != B_OK)
+        return status;
+
+    fThread = std::thread(&ServerLoop::Run, &fLoop);
+    return B_OK;
+}
+
+void SwitchServer::Stop()
+{
+    fLoop.Quit();
+    if (fThread.joinable())
+        fThread.join();
+}
+
+void SwitchServer::ClientConnected(int32 client, int socket,
+    const char* address)
+{
+    // What SESSION_HELLO with CAPABILITY_BULK_FRAGMENTS would set
+    fLoop.SetFragmenting(client, true);
+    fClient = client;
+}
+
+status_t SwitchServer::SendClipboard(const uint8* content, uint32 length)
+{
+    // GetClipboardForSync() hands out a copy
+    uint8* clipData = new uint8[length];
+    memcpy(clipData, content, length);
+    uint64 hash = ContentHash(clipData, length);
+
+    size_t bodySize = sizeof(uint32) + Lz4CompressBound(length);
+    size_t bufferSize = sizeof(ProtocolHeader) + sizeof(ClipboardSyncPayload)
+        + bodySize + sizeof(hash);
+    uint8* buffer = new uint8[bufferSize];
+    uint8* data = buffer + sizeof(ProtocolHeader) + sizeof(ClipboardSyncPayload);
+
+    uint8 contentType = 0x00;
+    uint32 wireLength = length;
+    ssize_t compressed = Lz4Compress(clipData, length, data + sizeof(uint32),
+        bodySize - sizeof(uint32));
+    if (compressed > 0 && compressed + sizeof(uint32) < length) {
+        memcpy(data, &length, sizeof(uint32));
+        contentType |= CLIPBOARD_COMPRESSED;
+        wireLength = compressed + sizeof(uint32);
+    } else
+        memcpy(data, clipData, length);
+    memcpy(data + wireLength, &hash, sizeof(hash));
+
+    ProtocolHeader* header = (ProtocolHeader*)buffer;
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = EVENT_CLIPBOARD_SYNC;
+    header->length = sizeof(ClipboardSyncPayload) + wireLength + sizeof(hash);
+
+    ClipboardSyncPayload* payload
+        = (ClipboardSyncPayload*)(buffer + sizeof(ProtocolHeader));
+    payload->contentType = contentType;
+    payload->dataLength = wireLength;
+
+    status_t status = fLoop.Send(fClient, buffer,
+        sizeof(ProtocolHeader) + header->length, SEND_BULK);
+
+    delete[] buffer;
+    delete[] clipData;
+    return status;
+}
+
+status_t SwitchServer::SendControlSwitch()
+{
+    uint8 buffer[sizeof(ProtocolHeader) + sizeof(ControlSwitchPayload)];
+    ProtocolHeader* header = (ProtocolHeader*)buffer;
+    header->magic = PROTOCOL_MAGIC;
+    header->version = PROTOCOL_VERSION;
+    header->eventType = EVENT_CONTROL_SWITCH;
+    header->length = sizeof(ControlSwitchPayload);
+
+    ControlSwitchPayload payload = { 1, 0.5f };
+    memcpy(buffer + sizeof(ProtocolHeader), &payload, sizeof(payload));
+    return fLoop.Send(fClient, buffer, sizeof(buffer));
+}
+
+
+// The Mac side, reading on a thread of its own and stamping each
+// CONTROL_SWITCH as it comes out of the framer
+class SwitchClient {
+public:
+    SwitchClient() : fSwitches(0), fLastSwitch(0), fClipboards(0),
+        fBytes(0), fSocket(-1) {}
+    ~SwitchClient();
+
+    bool Connect(uint16 port);
+    // Until the server hangs up
+    void Join();
+
+    std::atomic<int32> fSwitches;
+    std::atomic<bigtime_t> fLastSwitch;
+    std::atomic<int32> fClipboards;
+    std::atomic<uint64> fBytes;
+
+private:
+    void Run();
+
+    int fSocket;
+    MessageFramer fIn;
+    std::thread fThread;
+};
+
+SwitchClient::~SwitchClient()
+{
+    if (fSocket >= 0)
+        close(fSocket);
+}
+
+bool SwitchClient::Connect(uint16 port)
+{
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    fSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (fSocket < 0
+        || connect(fSocket, (struct sockaddr*)&address, sizeof(address)) < 0)
+        return false;
+
+    int opt = 1;
+    setsockopt(fSocket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    fThread = std::thread(&SwitchClient::Run, this);
+    return true;
+}
+
+void SwitchClient::Join()
+{
+    if (fThread.joinable())
+        fThread.join();
+}
+
+void SwitchClient::Run()
+{
+    for (;;) {
+        size_t available;
+        uint8* buffer = fIn.ReceiveBuffer(&available, 65536);
+        ssize_t bytesRead = recv(fSocket, buffer, available, 0);
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0)
+            return;
+        fIn.Received(bytesRead);
+        fBytes += bytesRead;
+
+        const uint8* message;
+        size_t length;
+        while (fIn.NextMessage(&message, &length) == FRAME_MESSAGE) {
+            const ProtocolHeader* header = (const ProtocolHeader*)message;
+            if (header->eventType == EVENT_CONTROL_SWITCH) {
+                fLastSwitch = LoadNow();
+                fSwitches++;
+            } else if (header->eventType == EVENT_BULK_FRAGMENT) {
+                // The last fragment of each CLIPBOARD_SYNC
+                const BulkFragmentPayload* fragment
+                    = (const BulkFragmentPayload*)(message
+                        + sizeof(ProtocolHeader));
+                if (fragment->offset + length - sizeof(ProtocolHeader)
+                        - sizeof(BulkFragmentPayload)
+                        == fragment->messageLength)
+                    fClipboards++;
+            } else if (header->eventType == EVENT_CLIPBOARD_SYNC)
+                fClipboards++;
+        }
+    }
+}
+
+
+// Text that compresses about as well as source code does
+static std::vector<uint8> MakeContent(size_t size)
+{
+    std::vector<uint8> content;
+    content.reserve(size + 128);
+    for (uint32 line = 0; content.size() < size; line++) {
+        char text[128];
+        int length = snprintf(text, sizeof(text),
+            "    status_t status = fWidget%u->Update(fields[%u], %u);\n",
+            line % 97, line % 13, line * 2654435761u >> 20);
+        content.insert(content.end(), text, text + length);
+    }
+    content.resize(size);
+    return content;
+}
+
+// One switch per gap; returns false if the client stopped answering
+static bool RunSwitches(SwitchServer& server, SwitchClient& client,
+    ClipboardMode mode, const std::vector<uint8>& content, int32 count,
+    bigtime_t gap, std::vector<bigtime_t>& times)
+{
+    times.clear();
+    for (int32 i = 0; i < count; i++) {
+        bigtime_t next = LoadNow() + gap;
+
+        // The clipboard changes anywhere from just before the switch to
+        // most of a gap earlier
+        if (mode == CLIPBOARD_PRESYNCED) {
+            bigtime_t change = next - gap * (i % 10 + 1) / 11;
+            while (LoadNow() < change)
+                usleep(100);
+            if (server.SendClipboard(content.data(), content.size()) != B_OK)
+                return false;
+        }
+        while (LoadNow() < next)
+            usleep(100);
+
+        int32 switches = client.fSwitches;
+        bigtime_t decided = LoadNow();
+        if (mode == CLIPBOARD_INLINE
+            && server.SendClipboard(content.data(), content.size()) != B_OK)
+            return false;
+        if (server.SendControlSwitch() != B_OK)
+            return false;
+
+        bigtime_t deadline = decided + 2000000;
+        while (client.fSwitches == switches && LoadNow() < deadline)
+            usleep(50);
+        if (client.fSwitches == switches)
+            return false;
+        times.push_back(client.fLastSwitch - decided);
+    }
+    return true;
+}
+
+static void PrintTimes(const char* name, std::vector<bigtime_t>& times)
+{
+    printf("  %-20s %9lld %9lld %9lld\n", name,
+        (long long)Percentile(times, 50), (long long)Percentile(times, 99),
+        (long long)Percentile(times, 100));
+}
+
+static void Usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [--switches n] [--gap ms] [--size bytes] "
+        "[--max-p99 µs]\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    int32 count = 200;
+    bigtime_t gap = 20000;
+    size_t size = 1024 * 1024;
+    bigtime_t maxP99 = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        double number = value != nullptr ? atof(value) : 0;
+
+        if (strcmp(argv[i], "--switches") == 0 && number >= 1)
+            count = (int32)number;
+        else if (strcmp(argv[i], "--gap") == 0 && number > 0)
+            gap = (bigtime_t)(number * 1000);
+        else if (strcmp(argv[i], "--size") == 0 && number >= 1)
+            size = (size_t)number;
+        else if (strcmp(argv[i], "--max-p99") == 0 && number > 0)
+            maxP99 = (bigtime_t)number;
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+        i++;
+    }
+
+    SwitchServer server;
+    SwitchClient client;
+    if (server.Start() != B_OK || !client.Connect(server.Port())) {
+        fprintf(stderr, "Cannot connect: %s\n", strerror(errno));
+        server.Stop();
+        return 2;
+    }
+    bigtime_t deadline = LoadNow() + 2000000;
+    while (server.fClient < 0 && LoadNow() < deadline)
+        usleep(1000);
+
+    std::vector<uint8> content = MakeContent(size);
+    std::vector<bigtime_t> empty;
+    std::vector<bigtime_t> presynced;
+    std::vector<bigtime_t> inlined;
+    bool completed = server.fClient >= 0
+        && RunSwitches(server, client, CLIPBOARD_EMPTY, content, count, gap,
+            empty)
+        && RunSwitches(server, client, CLIPBOARD_PRESYNCED, content, count,
+            gap, presynced)
+        && RunSwitches(server, client, CLIPBOARD_INLINE, content, count, gap,
+            inlined);
+
+    // The last clipboards were overtaken by their switches
+    deadline = LoadNow() + 2000000;
+    while (completed && client.fClipboards < count * 2
+        && LoadNow() < deadline)
+        usleep(1000);
+
+    server.Stop();
+    client.Join();
+
+    if (!completed) {
+        fprintf(stderr, "A switch never arrived\n");
+        return 1;
+    }
+
+    printf("%d switches each, %zu byte clipboard, %d clipboards and %llu "
+        "bytes read\n", (int)count, size, (int)client.fClipboards,
+        (unsigned long long)client.fBytes);
+    printf("  %-20s %9s %9s %9s\n", "switch µs", "p50", "p99", "max");
+    PrintTimes("empty", empty);
+    PrintTimes("pre-synced", presynced);
+    PrintTimes("inline", inlined);
+
+    if (client.fClipboards != count * 2) {
+        printf("%d of %d clipboards arrived\n", (int)client.fClipboards,
+            (int)count * 2);
+        return 1;
+    }
+    if (maxP99 > 0 && (Percentile(empty, 99) > maxP99
+            || Percentile(presynced, 99) > maxP99)) {
+        printf("switch p99 above %lld µs\n", (long long)maxP99);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,273 @@
+#include "Workloads.h"
+#include "LoadClient.h"
+#include "clipboard/ContentHash.h"
+#include "network/Protocol.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+// Mac virtual key codes and modifier bits as the client sends them, see
+// KeyMap.cpp and MapModifiers()
+static const uint32 kMacShift = 0x38;
+static const uint32 kMacControl = 0x3B;
+static const uint32 kMacOption = 0x3A;
+static const uint32 kModifierShift = 0x01;
+static const uint32 kModifierOption = 0x02;
+static const uint32 kModifierControl = 0x04;
+
+// Relative moves around a circle, one lap a second
+class MouseWorkload : public Workload {
+public:
+    MouseWorkload(double hz)
+        : fInterval(1000000 / hz), fSteps((int)hz), fStep(0), fTime(0)
+    {
+    }
+
+    virtual void Start(bigtime_t now)
+    {
+        Workload::Start(now);
+        fTime = now;
+    }
+
+    virtual void Fire(LoadClient& client)
+    {
+        static const float kRadius = 150;
+        double from = 2 * M_PI * fStep / fSteps;
+        double to = 2 * M_PI * (fStep + 1) / fSteps;
+        fStep = (fStep + 1) % fSteps;
+
+        MouseMovePayload move;
+        move.x = (float)(kRadius * (cos(to) - cos(from)));
+        move.y = (float)(kRadius * (sin(to) - sin(from)));
+        move.relative = 1;
+        move.modifiers = 0;
+        client.Send(EVENT_MOUSE_MOVE, &move, sizeof(move));
+
+        fTime += fInterval;
+        fNext = (bigtime_t)fTime;
+    }
+
+private:
+    double fInterval;
+    int fSteps;
+    int fStep;
+    double fTime;
+};
+
+class TypingWorkload : public Workload {
+public:
+    TypingWorkload(double wordsPerMinute)
+        // Five characters a word
+        : fInterval((bigtime_t)(60000000 / (wordsPerMinute * 5))),
+          fHold(std::min(fInterval / 2, (bigtime_t)60000)),
+          fIndex(0),
+          fDown(false),
+          fPressed(0)
+    {
+    }
+
+    virtual void Fire(LoadClient& client)
+    {
+        static const char kText[] = "the quick brown fox jumps over the lazy dog ";
+
+        if (!fDown) {
+            char character = kText[fIndex];
+            fIndex = (fIndex + 1) % (sizeof(kText) - 1);
+            fPressed = character;
+            client.SendKey(EVENT_KEY_DOWN, KeyCode(character), 0, character);
+            fDown = true;
+            fNext += fHold;
+        } else {
+            client.SendKey(EVENT_KEY_UP, KeyCode(fPressed), 0);
+            fDown = false;
+            fNext += fInterval - fHold;
+        }
+    }
+
+private:
+    static uint32 KeyCode(char character)
+    {
+        // ANSI layout, a-z
+        static const uint8 kLetters[26] = {
+            0x00, 0x0B, 0x08, 0x02, 0x0E, 0x03, 0x05, 0x04, 0x22, 0x26,
+            0x28, 0x25, 0x2E, 0x2D, 0x1F, 0x23, 0x0C, 0x0F, 0x01, 0x11,
+            0x20, 0x09, 0x0D, 0x07, 0x10, 0x06
+        };
+        if (character >= 'a' && character <= 'z')
+            return kLetters[character - 'a'];
+        return 0x31;    // space
+    }
+
+    bigtime_t fInterval;
+    bigtime_t fHold;
+    size_t fIndex;
+    bool fDown;
+    char fPressed;
+};
+
+// Three modifiers down, a function key, everything up again, all at once
+class ChordWorkload : public Workload {
+public:
+    ChordWorkload(double perSecond)
+        : fInterval(1000000 / perSecond), fTime(0), fKey(0)
+    {
+    }
+
+    virtual void Start(bigtime_t now)
+    {
+        Workload::Start(now);
+        fTime = now;
+    }
+
+    virtual void Fire(LoadClient& client)
+    {
+        static const uint32 kFunctionKeys[] = { 0x60, 0x61, 0x62, 0x64 };
+        uint32 key = kFunctionKeys[fKey++ % 4];
+        uint32 all = kModifierShift | kModifierControl | kModifierOption;
+
+        client.SendKey(EVENT_KEY_DOWN, kMacShift, kModifierShift);
+        client.SendKey(EVENT_KEY_DOWN, kMacControl,
+            kModifierShift | kModifierControl);
+        client.SendKey(EVENT_KEY_DOWN, kMacOption, all);
+        client.SendKey(EVENT_KEY_DOWN, key, all);
+        client.SendKey(EVENT_KEY_UP, key, all);
+        client.SendKey(EVENT_KEY_UP, kMacOption,
+            kModifierShift | kModifierControl);
+        client.SendKey(EVENT_KEY_UP, kMacControl, kModifierShift);
+        client.SendKey(EVENT_KEY_UP, kMacShift, 0);
+
+        fTime += fInterval;
+        fNext = (bigtime_t)fTime;
+    }
+
+private:
+    double fInterval;
+    double fTime;
+    uint32 fKey;
+};
+
+// Trackpad flings: a burst of wheel events at 120 Hz, decaying; a new
+// fling picks up speed again
+class ScrollWorkload : public Workload {
+public:
+    ScrollWorkload(double flingsPerSecond)
+        : fFlingInterval((bigtime_t)(1000000 / flingsPerSecond)),
+          fNextFling(0),
+          fNextTick(0),
+          fVelocity(0),
+          fDirection(1)
+    {
+    }
+
+    virtual void Start(bigtime_t now)
+    {
+        Workload::Start(now);
+        fNextFling = now;
+        fNextTick = now;
+    }
+
+    virtual void Fire(LoadClient& client)
+    {
+        static const bigtime_t kTick = 8333;
+
+        if (fNextFling <= fNext) {
+            fVelocity = 12;
+            fDirection = -fDirection;
+            fNextFling += fFlingInterval;
+            fNextTick = fNext;
+        }
+
+        if (fVelocity > 0.05f && fNextTick <= fNext) {
+            MouseWheelPayload wheel;
+            wheel.deltaX = 0;
+            wheel.deltaY = fDirection * fVelocity;
+            wheel.modifiers = 0;
+            client.Send(EVENT_MOUSE_WHEEL, &wheel, sizeof(wheel));
+            fVelocity *= 0.92f;
+            fNextTick += kTick;
+        }
+
+        fNext = fVelocity > 0.05f ? std::min(fNextTick, fNextFling)
+            : fNextFling;
+    }
+
+private:
+    bigtime_t fFlingInterval;
+    bigtime_t fNextFling;
+    bigtime_t fNextTick;
+    float fVelocity;
+    float fDirection;
+};
+
+// Text clipboards of a set size, different each time so the server never
+// skips one as already held; they go as bulk, fragmented if the server
+// reassembles, so input overtakes them
+class ClipboardWorkload : public Workload {
+public:
+    ClipboardWorkload(size_t size, bigtime_t interval)
+        : fInterval(interval), fCount(0)
+    {
+        fContent.resize(size);
+        for (size_t i = 0; i < size; i++)
+            fContent[i] = (uint8)('a' + (i * 7 + i / 64) % 26);
+    }
+
+    virtual void Fire(LoadClient& client)
+    {
+        snprintf((char*)fContent.data(), std::min(fContent.size(), (size_t)24),
+            "softKM load %llu ", (unsigned long long)++fCount);
+
+        ClipboardSyncPayload sync;
+        sync.contentType = 0;
+        sync.dataLength = (uint32)fContent.size();
+        uint64 hash = ContentHash(fContent.data(), fContent.size());
+
+        std::vector<uint8> payload(sizeof(sync) + fContent.size()
+            + sizeof(hash));
+        memcpy(payload.data(), &sync, sizeof(sync));
+        memcpy(payload.data() + sizeof(sync), fContent.data(),
+            fContent.size());
+        memcpy(payload.data() + sizeof(sync) + fContent.size(), &hash,
+            sizeof(hash));
+        client.Send(EVENT_CLIPBOARD_SYNC, payload.data(),
+            (uint32)payload.size(), SEND_BULK);
+        client.fBulkBytes += payload.size();
+
+        fNext += fInterval;
+    }
+
+private:
+    bigtime_t fInterval;
+    uint64 fCount;
+    std::vector<uint8> fContent;
+};
+
+
+Workload* CreateWorkload(const char* option, const char* value)
+{
+    double number = value != nullptr ? atof(value) : 0;
+    if (number <= 0)
+        return nullptr;
+
+    if (strcmp(option, "--mouse") == 0)
+        return new MouseWorkload(number);
+    if (strcmp(option, "--typing") == 0)
+        return new TypingWorkload(number);
+    if (strcmp(option, "--chords") == 0)
+        return new ChordWorkload(number);
+    if (strcmp(option, "--scroll") == 0)
+        return new ScrollWorkload(number);
+    if (strcmp(option, "--clipboard") == 0) {
+        const char* at = strchr(value, '@');
+        double seconds = at != nullptr ? atof(at + 1) : 1;
+        if (seconds <= 0)
+            return nullptr;
+        return new ClipboardWorkload((size_t)(number * 1024),
+            (bigtime_t)(seconds * 1000000));
+    }
+    return nullptr;
+}
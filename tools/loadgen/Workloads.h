@@ -0,0 +1,31 @@
+#ifndef WORKLOADS_H
+#define WORKLOADS_H
+
+#include <SupportDefs.h>
+
+class LoadClient;
+
+// Something LoadClient sends on a schedule
+class Workload {
+public:
+    Workload() : fNext(0) {}
+    virtual ~Workload() {}
+
+    virtual void Start(bigtime_t now) { fNext = now; }
+    bigtime_t Next() const { return fNext; }
+    // Sends what is due at Next() and moves it on
+    virtual void Fire(LoadClient& client) = 0;
+
+protected:
+    bigtime_t fNext;
+};
+
+// For --mouse hz, --typing wpm, --chords per-second, --scroll
+// flings-per-second and --clipboard kb[@seconds]; nullptr for other
+// options or a bad value
+Workload* CreateWorkload(const char* option, const char* value);
+
+#define WORKLOAD_USAGE "[--mouse hz] [--typing wpm] [--chords per-second]\n" \
+    "           [--scroll flings-per-second] [--clipboard kb[@seconds]]"
+
+#endif // WORKLOADS_H
@@ -0,0 +1,54 @@
+#ifndef DEFRAMER_H
+#define DEFRAMER_H
+
+#include "network/MessageFramer.h"
+
+#include <cstring>
+#include <map>
+
+// Frames each client's captured chunks back into messages
+class Deframer {
+public:
+    ~Deframer() { Reset(); }
+
+    template<typename Handler>
+    void Feed(int32 client, const uint8* data, size_t length,
+        Handler handler)
+    {
+        MessageFramer*& framer = fFramers[client];
+        if (framer == nullptr)
+            framer = new MessageFramer;
+
+        size_t available;
+        uint8* buffer = framer->ReceiveBuffer(&available, length);
+        memcpy(buffer, data, length);
+        framer->Received(length);
+
+        const uint8* message;
+        size_t messageLength;
+        while (framer->NextMessage(&message, &messageLength) == FRAME_MESSAGE)
+            handler(message, messageLength);
+    }
+
+    void Remove(int32 client)
+    {
+        std::map<int32, MessageFramer*>::iterator it = fFramers.find(client);
+        if (it != fFramers.end()) {
+            delete it->second;
+            fFramers.erase(it);
+        }
+    }
+
+    void Reset()
+    {
+        for (std::map<int32, MessageFramer*>::iterator it = fFramers.begin();
+                it != fFramers.end(); ++it)
+            delete it->second;
+        fFramers.clear();
+    }
+
+private:
+    std::map<int32, MessageFramer*> fFramers;
+};
+
+#endif // DEFRAMER_H
@@ -0,0 +1,368 @@
+// Measures what MotionPredictor buys on a capture (see WireReplay): the
+// input events are run through the predictor on the capture's timeline,
+// ticked at the display rate, and every frame the pointer shown is held
+// against where the client's pointer got to one lookahead later. Without
+// prediction the pointer is that far behind; the table compares the two
+// and turns the error left over into the latency actually saved, the lag
+// that would leave the same error without prediction.
+//
+//   PredictionEval [--lookahead ms,ms,...] [--max-offset px]
+//                  [--refresh hz] capture
+//
+// Frames count while the pointer moves or is shown away from the truth.
+
+#include "input/MotionPredictor.h"
+#include "network/InputDispatcher.h"
+#include "network/Protocol.h"
+#include "network/WireCapture.h"
+
+#include "Deframer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <vector>
+
+// Longer gaps are not interpolated over; as in MotionPredictor
+static const bigtime_t kPauseGap = 100000;
+// Lags tried when looking for the one that matches an error
+static const bigtime_t kLagStep = 1000;
+
+class EvalClock : public Clock {
+public:
+    EvalClock() : fNow(0) {}
+
+    virtual bigtime_t Now() { return fNow; }
+    void Set(bigtime_t now) { fNow = now; }
+
+private:
+    bigtime_t fNow;
+};
+
+// Where the injected moves take the pointer; clicks and keys are ignored
+class PositionSink : public InputEventHandler {
+public:
+    PositionSink() : fX(0), fY(0) {}
+
+    float X() const { return fX; }
+    float Y() const { return fY; }
+
+    virtual void InjectKeyDown(uint32 keyCode, uint32 modifiers,
+        const char* bytes, uint8 numBytes) {}
+    virtual void InjectKeyUp(uint32 keyCode, uint32 modifiers) {}
+    virtual void InjectMouseMove(float x, float y, bool relative,
+        uint32 modifiers)
+    {
+        if (relative) {
+            fX += x;
+            fY += y;
+        } else {
+            fX = x;
+            fY = y;
+        }
+    }
+    virtual void InjectMouseDown(uint32 buttons, float x, float y,
+        uint32 modifiers, uint32 clicks) {}
+    virtual void InjectMouseUp(uint32 buttons, float x, float y,
+        uint32 modifiers) {}
+    virtual void InjectMouseWheel(float deltaX, float deltaY,
+        uint32 modifiers) {}
+
+private:
+    float fX;
+    float fY;
+};
+
+struct Event {
+    bigtime_t when;
+    std::vector<uint8> message;
+};
+
+// Where the client's pointer was after each event
+struct PathPoint {
+    bigtime_t when;
+    float x;
+    float y;
+};
+
+// One run of the server: its input events on a timeline of their own
+struct Segment {
+    std::vector<Event> events;
+    std::vector<PathPoint> path;
+};
+
+static bool ReadCapture(const char* path, std::vector<Segment>& segments)
+{
+    WireReader reader;
+    if (reader.Open(path) != B_OK) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return false;
+    }
+
+    Deframer deframer;
+    std::set<int32> outgoing;
+    WireRecord record;
+    status_t status;
+    while ((status = reader.Next(&record)) == B_OK) {
+        switch (record.type) {
+            case WIRE_SESSION:
+                segments.push_back(Segment());
+                deframer.Reset();
+                outgoing.clear();
+                break;
+            case WIRE_CONNECT_OUT:
+                outgoing.insert(record.client);
+                break;
+            case WIRE_DISCONNECT:
+                outgoing.erase(record.client);
+                deframer.Remove(record.client);
+                break;
+            case WIRE_DATA:
+            {
+                if (segments.empty() || outgoing.count(record.client) > 0)
+                    break;
+                bigtime_t when = record.when;
+                Segment& segment = segments.back();
+                deframer.Feed(record.client, record.data, record.length,
+                    [&segment, when](const uint8* message, size_t length) {
+                        uint8 type
+                            = ((const ProtocolHeader*)message)->eventType;
+                        if (type < EVENT_KEY_DOWN
+                            || type > EVENT_MOUSE_WHEEL)
+                            return;
+                        Event event;
+                        event.when = when;
+                        event.message.assign(message, message + length);
+                        segment.events.push_back(event);
+                    });
+                break;
+            }
+        }
+    }
+
+    if (status == B_BAD_DATA)
+        fprintf(stderr, "The capture ends in a damaged record\n");
+    return true;
+}
+
+static void TracePath(Segment& segment)
+{
+    PositionSink truth;
+    for (size_t i = 0; i < segment.events.size(); i++) {
+        const Event& event = segment.events[i];
+        DispatchInputEvent(event.message.data(), event.message.size(),
+            &truth);
+        PathPoint point = { event.when, truth.X(), truth.Y() };
+        if (!segment.path.empty() && segment.path.back().when == event.when)
+            segment.path.back() = point;
+        else
+            segment.path.push_back(point);
+    }
+}
+
+// The client's pointer at when. Interpolated, it moves between events
+// unless they are a pause apart, as the hand did; otherwise it is where
+// the events put it, as shown without prediction.
+static void PathAt(const std::vector<PathPoint>& path, bigtime_t when,
+    bool interpolate, float* x, float* y)
+{
+    std::vector<PathPoint>::const_iterator next = std::upper_bound(
+        path.begin(), path.end(), when,
+        [](bigtime_t when, const PathPoint& point) {
+            return when < point.when;
+        });
+    if (next == path.begin()) {
+        *x = 0;
+        *y = 0;
+        return;
+    }
+
+    const PathPoint& from = *(next - 1);
+    *x = from.x;
+    *y = from.y;
+    if (!interpolate || next == path.end()
+        || next->when - from.when > kPauseGap)
+        return;
+
+    float fraction = (float)(when - from.when) / (next->when - from.when);
+    *x += (next->x - from.x) * fraction;
+    *y += (next->y - from.y) * fraction;
+}
+
+// Distance between the pointer shown at each frame and the client's
+// pointer lookahead later, over the frames where either moves
+struct Errors {
+    std::vector<float> predicted;
+    std::vector<bigtime_t> frames;      // when each was shown
+};
+
+static void Evaluate(Segment& segment, bigtime_t lookahead, float maxOffset,
+    bigtime_t framePeriod, Errors& errors)
+{
+    if (segment.events.empty())
+        return;
+
+    EvalClock clock;
+    PositionSink shown;
+    MotionPredictor predictor(&clock, &shown);
+    MotionPredictionConfig config = { true, lookahead, maxOffset };
+    predictor.SetConfig(config);
+    predictor.SetLookahead(lookahead);
+
+    const std::vector<PathPoint>& path = segment.path;
+    bigtime_t end = segment.events.back().when + kPauseGap;
+    size_t next = 0;
+    for (bigtime_t frame = segment.events.front().when; frame <= end;
+            frame += framePeriod) {
+        for (; next < segment.events.size()
+                && segment.events[next].when <= frame; next++) {
+            const Event& event = segment.events[next];
+            clock.Set(event.when);
+            DispatchInputEvent(event.message.data(), event.message.size(),
+                &predictor);
+        }
+        clock.Set(frame);
+        predictor.Tick();
+
+        float nowX, nowY, laterX, laterY;
+        PathAt(path, frame, true, &nowX, &nowY);
+        PathAt(path, frame + lookahead, true, &laterX, &laterY);
+        if (nowX == laterX && nowY == laterY && shown.X() == nowX
+            && shown.Y() == nowY)
+            continue;
+
+        errors.predicted.push_back(hypotf(shown.X() - laterX,
+            shown.Y() - laterY));
+        errors.frames.push_back(frame);
+    }
+}
+
+// The error of showing the pointer as it came in, lag late, on the same
+// frames
+static double MeanLagError(const std::vector<Segment>& segments,
+    const std::vector<Errors>& errors, bigtime_t lookahead, bigtime_t lag)
+{
+    double sum = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < segments.size(); i++) {
+        const std::vector<PathPoint>& path = segments[i].path;
+        for (size_t j = 0; j < errors[i].frames.size(); j++) {
+            bigtime_t frame = errors[i].frames[j];
+            float shownX, shownY, laterX, laterY;
+            PathAt(path, frame + lookahead - lag, false, &shownX, &shownY);
+            PathAt(path, frame + lookahead, true, &laterX, &laterY);
+            sum += hypotf(shownX - laterX, shownY - laterY);
+            count++;
+        }
+    }
+    return count > 0 ? sum / count : 0;
+}
+
+static float Percentile(std::vector<float>& values, double percentile)
+{
+    if (values.empty())
+        return 0;
+    size_t index = (size_t)(percentile / 100 * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void Usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [--lookahead ms,ms,...] [--max-offset px]\n"
+        "           [--refresh hz] capture\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<bigtime_t> lookaheads;
+    float maxOffset = 48;
+    float refreshRate = 60;
+    const char* path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--lookahead") == 0 && i + 1 < argc) {
+            for (char* list = argv[++i]; *list != '\0';) {
+                char* end;
+                double milliseconds = strtod(list, &end);
+                if (end == list || milliseconds <= 0)
+                    break;
+                lookaheads.push_back((bigtime_t)(milliseconds * 1000));
+                list = *end == ',' ? end + 1 : end;
+            }
+        } else if (strcmp(argv[i], "--max-offset") == 0 && i + 1 < argc)
+            maxOffset = atof(argv[++i]);
+        else if (strcmp(argv[i], "--refresh") == 0 && i + 1 < argc)
+            refreshRate = atof(argv[++i]);
+        else if (argv[i][0] != '-' && path == nullptr)
+            path = argv[i];
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if (path == nullptr || refreshRate <= 0) {
+        Usage(argv[0]);
+        return 2;
+    }
+    if (lookaheads.empty()) {
+        static const bigtime_t kDefaultLookaheads[] = {
+            8000, 16000, 32000, 64000, 100000 };
+        lookaheads.assign(kDefaultLookaheads, kDefaultLookaheads + 5);
+    }
+
+    std::vector<Segment> segments;
+    if (!ReadCapture(path, segments))
+        return 1;
+    size_t events = 0;
+    for (size_t i = 0; i < segments.size(); i++) {
+        TracePath(segments[i]);
+        events += segments[i].events.size();
+    }
+    if (events == 0) {
+        fprintf(stderr, "No input events in %s\n", path);
+        return 1;
+    }
+
+    bigtime_t framePeriod = (bigtime_t)(1000000 / refreshRate);
+    printf("%zu input events, %.0f Hz, offsets up to %.0f px\n\n", events,
+        refreshRate, maxOffset);
+    printf("lookahead  frames   lag error px     predicted error px"
+        "     latency saved\n");
+    printf("       ms              mean            mean    p95    max"
+        "        ms\n");
+    for (size_t i = 0; i < lookaheads.size(); i++) {
+        bigtime_t lookahead = lookaheads[i];
+        std::vector<Errors> errors(segments.size());
+        std::vector<float> all;
+        for (size_t j = 0; j < segments.size(); j++) {
+            Evaluate(segments[j], lookahead, maxOffset, framePeriod,
+                errors[j]);
+            all.insert(all.end(), errors[j].predicted.begin(),
+                errors[j].predicted.end());
+        }
+
+        double mean = 0;
+        for (size_t j = 0; j < all.size(); j++)
+            mean += all[j];
+        mean = all.empty() ? 0 : mean / all.size();
+
+        // The longest lag no worse than the prediction is what is left;
+        // past the lookahead the prediction made things worse
+        bigtime_t matched = 0;
+        while (matched + kLagStep <= 2 * lookahead
+            && MeanLagError(segments, errors, lookahead,
+                matched + kLagStep) <= mean)
+            matched += kLagStep;
+
+        printf("%9.0f %7zu %15.2f %15.2f %6.2f %6.2f %9.0f\n",
+            lookahead / 1000.0, all.size(),
+            MeanLagError(segments, errors, lookahead, lookahead), mean,
+            Percentile(all, 95), Percentile(all, 100),
+            (lookahead - matched) / 1000.0);
+    }
+    return 0;
+}
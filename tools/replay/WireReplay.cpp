@@ -0,0 +1,783 @@
+// Replays a capture of what a softKM server received (Settings'
+// capturePath, see network/WireCapture.h) to reproduce a session: against
+// a running server over TCP, one connection per captured client, or
+// in-process through libsoftkm_core's input pipeline with a counting
+// injection sink.
+//
+//   WireReplay [--tcp host:port | --in-process] [--speed factor]
+//              [--flat-out] [--max-gap ms] [--screen WxH] capture
+//   WireReplay --dump capture
+//
+// Records go out at the pace they came in, --speed times faster, or with
+// --flat-out as fast as the target takes them. In-process, InputCore's
+// clock follows the capture's, so dwell times and game mode detection see
+// the original timing at any speed.
+
+#include "input/InputCore.h"
+#include "network/InputDispatcher.h"
+#include "network/MessageFramer.h"
+#include "network/Protocol.h"
+#include "network/WireCapture.h"
+
+#include "Deframer.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <vector>
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;
+#endif
+
+static bigtime_t Now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (bigtime_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Sleeps the bulk of the time and spins the last stretch, scheduler
+// wake-ups are too coarse for a 1 kHz mouse
+static void SleepUntil(bigtime_t until)
+{
+    for (;;) {
+        bigtime_t remaining = until - Now();
+        if (remaining <= 0)
+            return;
+        if (remaining > 2000) {
+            struct timespec delay;
+            delay.tv_sec = (remaining - 1000) / 1000000;
+            delay.tv_nsec = (remaining - 1000) % 1000000 * 1000;
+            nanosleep(&delay, nullptr);
+        }
+    }
+}
+
+// Messages per event type in a stream of captured chunks
+class MessageCounter {
+public:
+    MessageCounter() : fMessages(0) { memset(fCounts, 0, sizeof(fCounts)); }
+
+    void Add(const uint8* message, size_t length)
+    {
+        fMessages++;
+        fCounts[((const ProtocolHeader*)message)->eventType]++;
+    }
+
+    uint64 Messages() const { return fMessages; }
+
+    void Print() const
+    {
+        for (int type = 0; type < 256; type++) {
+            if (fCounts[type] > 0) {
+                printf("  %-20s %10llu\n", EventTypeName((uint8)type),
+                    (unsigned long long)fCounts[type]);
+            }
+        }
+    }
+
+private:
+    uint64 fMessages;
+    uint64 fCounts[256];
+};
+
+// Where the records go
+class ReplayTarget {
+public:
+    virtual ~ReplayTarget() {}
+
+    virtual void Connect(int32 client) = 0;
+    virtual void Data(int32 client, const uint8* data, size_t length) = 0;
+    virtual void Disconnect(int32 client) = 0;
+    // A new server run in the capture: its clients are all gone
+    virtual void EndSession() = 0;
+
+    // Until then, at when on the capture's timeline
+    virtual void Wait(bigtime_t until, bigtime_t when) { SleepUntil(until); }
+
+    virtual void Report() = 0;
+
+    MessageCounter& Counter() { return fCounter; }
+
+protected:
+    MessageCounter fCounter;
+};
+
+// #pragma mark - TCP
+
+class TcpTarget : public ReplayTarget {
+public:
+    TcpTarget()
+        : fBytesSent(0),
+          fBytesReceived(0),
+          fRefused(0),
+          fClosedByServer(0),
+          fSkipped(0),
+          fWaits(0)
+    {
+    }
+
+    ~TcpTarget() { EndSession(); }
+
+    bool Init(const char* host, uint16 port)
+    {
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+
+        struct addrinfo* result;
+        if (getaddrinfo(host, nullptr, &hints, &result) != 0)
+            return false;
+
+        memcpy(&fAddress, result->ai_addr, sizeof(fAddress));
+        fAddress.sin_port = htons(port);
+        freeaddrinfo(result);
+
+        // Fail early rather than on the first record
+        int socket = Open();
+        if (socket < 0)
+            return false;
+        close(socket);
+        return true;
+    }
+
+    virtual void Connect(int32 client)
+    {
+        Disconnect(client);
+        int socket = Open();
+        if (socket < 0) {
+            fRefused++;
+            return;
+        }
+        fSockets[client] = socket;
+    }
+
+    virtual void Data(int32 client, const uint8* data, size_t length)
+    {
+        // The capture began while this client was connected
+        if (fSockets.find(client) == fSockets.end()
+            && fGone.find(client) == fGone.end())
+            Connect(client);
+
+        fDeframer.Feed(client, data, length,
+            [this](const uint8* message, size_t messageLength) {
+                fCounter.Add(message, messageLength);
+            });
+
+        std::map<int32, int>::iterator it = fSockets.find(client);
+        if (it == fSockets.end()) {
+            fSkipped += length;
+            return;
+        }
+
+        while (length > 0) {
+            ssize_t sent = send(it->second, data, length, kSendFlags);
+            if (sent < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    Closed(client);
+                    fSkipped += length;
+                    return;
+                }
+                Service(it->second, 10);
+                if (fSockets.find(client) == fSockets.end())
+                    return;
+                continue;
+            }
+            fBytesSent += sent;
+            data += sent;
+            length -= sent;
+        }
+    }
+
+    virtual void Disconnect(int32 client)
+    {
+        fDeframer.Remove(client);
+        fGone.erase(client);
+
+        std::map<int32, int>::iterator it = fSockets.find(client);
+        if (it != fSockets.end()) {
+            close(it->second);
+            fSockets.erase(it);
+        }
+    }
+
+    virtual void EndSession()
+    {
+        for (std::map<int32, int>::iterator it = fSockets.begin();
+                it != fSockets.end(); ++it)
+            close(it->second);
+        fSockets.clear();
+        fGone.clear();
+        fDeframer.Reset();
+    }
+
+    virtual void Wait(bigtime_t until, bigtime_t when)
+    {
+        // Keep reading what the server sends meanwhile (heartbeats,
+        // clipboard), it must never block on us. Flat out, only every so
+        // often.
+        bigtime_t remaining = until - Now();
+        if (remaining <= 0) {
+            if ((++fWaits & 255) == 0)
+                Service(-1, 0);
+            return;
+        }
+        while (remaining > 0) {
+            Service(-1, remaining > 2000 ? (int)((remaining - 1000) / 1000) : 0);
+            remaining = until - Now();
+        }
+    }
+
+    virtual void Report()
+    {
+        printf("sent %llu bytes, received %llu", (unsigned long long)fBytesSent,
+            (unsigned long long)fBytesReceived);
+        if (fSkipped > 0)
+            printf(", %llu not sent", (unsigned long long)fSkipped);
+        printf("\n");
+        if (fRefused > 0 || fClosedByServer > 0) {
+            printf("%d connection(s) refused, %d closed by the server\n",
+                fRefused, fClosedByServer);
+        }
+    }
+
+private:
+    int Open()
+    {
+        int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (socket < 0)
+            return -1;
+
+        if (connect(socket, (struct sockaddr*)&fAddress, sizeof(fAddress)) < 0) {
+            close(socket);
+            return -1;
+        }
+
+        int opt = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+        return socket;
+    }
+
+    // Reads from every connection for up to timeout ms, or until writing
+    // is wanted and socket can take more
+    void Service(int writing, int timeout)
+    {
+        std::vector<struct pollfd> fds;
+        std::vector<int32> clients;
+        for (std::map<int32, int>::iterator it = fSockets.begin();
+                it != fSockets.end(); ++it) {
+            struct pollfd pfd;
+            pfd.fd = it->second;
+            pfd.events = POLLIN | (it->second == writing ? POLLOUT : 0);
+            pfd.revents = 0;
+            fds.push_back(pfd);
+            clients.push_back(it->first);
+        }
+
+        if (fds.empty()) {
+            if (timeout > 0)
+                SleepUntil(Now() + timeout * 1000);
+            return;
+        }
+
+        if (poll(fds.data(), fds.size(), timeout) <= 0)
+            return;
+
+        for (size_t i = 0; i < fds.size(); i++) {
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+                continue;
+
+            uint8 buffer[16384];
+            ssize_t bytesRead;
+            while ((bytesRead = recv(fds[i].fd, buffer, sizeof(buffer), 0)) > 0)
+                fBytesReceived += bytesRead;
+            if (bytesRead == 0 || (errno != EAGAIN && errno != EWOULDBLOCK
+                    && errno != EINTR))
+                Closed(clients[i]);
+        }
+    }
+
+    void Closed(int32 client)
+    {
+        std::map<int32, int>::iterator it = fSockets.find(client);
+        if (it == fSockets.end())
+            return;
+
+        close(it->second);
+        fSockets.erase(it);
+        fGone.insert(client);
+        fClosedByServer++;
+    }
+
+    struct sockaddr_in fAddress;
+    std::map<int32, int> fSockets;  // by captured client
+    std::set<int32> fGone;          // closed by the server, not reopened
+    Deframer fDeframer;
+
+    uint64 fBytesSent;
+    uint64 fBytesReceived;
+    int32 fRefused;
+    int32 fClosedByServer;
+    uint64 fSkipped;
+    uint32 fWaits;
+};
+
+// #pragma mark - In-process
+
+class ReplayClock : public Clock {
+public:
+    ReplayClock() : fNow(0) {}
+
+    virtual bigtime_t Now() { return fNow; }
+    void Set(bigtime_t now) { fNow = now; }
+
+private:
+    bigtime_t fNow;
+};
+
+class ReplayScreen : public ScreenGeometry {
+public:
+    ReplayScreen(float width, float height) : fWidth(width), fHeight(height) {}
+
+    virtual void GetScreenSize(float* width, float* height)
+    {
+        *width = fWidth;
+        *height = fHeight;
+    }
+
+private:
+    float fWidth;
+    float fHeight;
+};
+
+// Counts what would have been injected; the cursor follows it like the
+// system one does
+class CountingSink : public InjectionSink {
+public:
+    CountingSink() : fX(0), fY(0)
+    {
+        memset(&fCounts, 0, sizeof(fCounts));
+    }
+
+    virtual bool KeyDown(bigtime_t, uint32, uint32, const char*, uint8)
+        { fCounts.keys++; return true; }
+    virtual bool KeyUp(bigtime_t, uint32, uint32)
+        { fCounts.keys++; return true; }
+    virtual bool MouseMoved(bigtime_t, float, float, uint32, uint32)
+        { fCounts.moves++; return true; }
+    virtual bool MouseDown(bigtime_t, float, float, uint32, uint32, uint32)
+        { fCounts.buttons++; return true; }
+    virtual bool MouseUp(bigtime_t, float, float, uint32, uint32)
+        { fCounts.buttons++; return true; }
+    virtual bool MouseWheel(bigtime_t, float, float, uint32)
+        { fCounts.wheels++; return true; }
+
+    virtual void SetCursor(float x, float y)
+    {
+        fX = x;
+        fY = y;
+    }
+
+    virtual bool GetCursor(float* x, float* y)
+    {
+        *x = fX;
+        *y = fY;
+        return true;
+    }
+
+    struct Counts {
+        uint64 keys;
+        uint64 moves;
+        uint64 buttons;
+        uint64 wheels;
+    } fCounts;
+
+private:
+    float fX;
+    float fY;
+};
+
+class ReplayLink : public PeerLink {
+public:
+    ReplayLink() : fSwitches(0) {}
+
+    virtual bool HasNeighbour(uint8) const { return false; }
+    virtual void SendControlSwitch(uint8, float) { fSwitches++; }
+    virtual status_t ForwardControl(uint8, float) { return B_ERROR; }
+
+    int32 fSwitches;
+};
+
+class CoreTarget : public ReplayTarget, private InputCoreListener {
+public:
+    CoreTarget(float width, float height)
+        : fScreen(width, height),
+          fCore(&fClock, &fScreen, &fSink),
+          fGameModeChanges(0),
+          fProcessTime(0),
+          fSlowest(0),
+          fSlowestType(0)
+    {
+        fCore.SetPeerLink(&fLink);
+        fCore.SetListener(this);
+    }
+
+    virtual void Connect(int32 client)
+    {
+        fDeframer.Remove(client);
+    }
+
+    virtual void Data(int32 client, const uint8* data, size_t length)
+    {
+        fDeframer.Feed(client, data, length,
+            [this](const uint8* message, size_t messageLength) {
+                Process(message, messageLength);
+            });
+    }
+
+    virtual void Disconnect(int32 client)
+    {
+        fDeframer.Remove(client);
+        fCore.ReleaseAll();
+    }
+
+    virtual void EndSession()
+    {
+        fDeframer.Reset();
+        fCore.ReleaseAll();
+        fCore.SetActive(false);
+    }
+
+    virtual void Wait(bigtime_t until, bigtime_t when)
+    {
+        SleepUntil(until);
+        fClock.Set(when);
+    }
+
+    virtual void Report()
+    {
+        printf("injected %llu key, %llu move, %llu button and %llu wheel "
+            "events\n", (unsigned long long)fSink.fCounts.keys,
+            (unsigned long long)fSink.fCounts.moves,
+            (unsigned long long)fSink.fCounts.buttons,
+            (unsigned long long)fSink.fCounts.wheels);
+        printf("%d switch(es) back to the client, %d game mode change(s)\n",
+            fLink.fSwitches, fGameModeChanges);
+        if (fCounter.Messages() > 0) {
+            printf("processing %.0f ns/message, slowest %.1f µs (%s)\n",
+                (double)fProcessTime / fCounter.Messages(), fSlowest / 1000.0,
+                EventTypeName(fSlowestType));
+        }
+    }
+
+private:
+    // What NetworkServer does with these, less the ownership rules: every
+    // captured client feeds the same core
+    void Process(const uint8* message, size_t length)
+    {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        fCounter.Add(message, length);
+        const ProtocolHeader* header = (const ProtocolHeader*)message;
+        const uint8* payload = message + sizeof(ProtocolHeader);
+
+        if (!DispatchInputEvent(message, length, &fCore)) {
+            switch (header->eventType) {
+                case EVENT_CONTROL_SWITCH:
+                    if (header->length >= sizeof(ControlSwitchPayload)) {
+                        const ControlSwitchPayload* control
+                            = (const ControlSwitchPayload*)payload;
+                        if (control->direction == 0)
+                            fCore.SetActive(true, control->yRatio);
+                        else {
+                            fCore.ReleaseAll();
+                            fCore.SetActive(false);
+                        }
+                    }
+                    break;
+
+                case EVENT_SETTINGS_SYNC:
+                    if (header->length >= sizeof(SettingsSyncPayload)) {
+                        const SettingsSyncPayload* settings
+                            = (const SettingsSyncPayload*)payload;
+                        fCore.SetDwellTime(
+                            (bigtime_t)(settings->edgeDwellTime * 1000000));
+                        fCore.SetReturnEdge(settings->haikuReturnEdge);
+                    }
+                    break;
+            }
+        }
+
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        bigtime_t elapsed = (end.tv_sec - start.tv_sec) * 1000000000LL
+            + end.tv_nsec - start.tv_nsec;
+        fProcessTime += elapsed;
+        if (elapsed > fSlowest) {
+            fSlowest = elapsed;
+            fSlowestType = header->eventType;
+        }
+    }
+
+    // InputCoreListener
+    virtual void GameModeChanged(bool gameMode, float spread)
+    {
+        fGameModeChanges++;
+    }
+
+    ReplayClock fClock;
+    ReplayScreen fScreen;
+    CountingSink fSink;
+    ReplayLink fLink;
+    InputCore fCore;
+    Deframer fDeframer;
+
+    int32 fGameModeChanges;
+    bigtime_t fProcessTime;     // ns
+    bigtime_t fSlowest;         // ns
+    uint8 fSlowestType;
+};
+
+// #pragma mark -
+
+static const char* RecordTypeName(uint8 type)
+{
+    switch (type) {
+        case WIRE_SESSION:      return "session";
+        case WIRE_CONNECT:      return "connect";
+        case WIRE_CONNECT_OUT:  return "connect_out";
+        case WIRE_DATA:         return "data";
+        case WIRE_DISCONNECT:   return "disconnect";
+        default:                return "unknown";
+    }
+}
+
+// One line per record, the messages framed from data records below it
+static int Dump(WireReader& reader)
+{
+    Deframer deframer;
+    WireRecord record;
+    bigtime_t wallTime;
+    bigtime_t sessionStart = 0;
+    status_t status;
+    while ((status = reader.Next(&record, &wallTime)) == B_OK) {
+        if (record.type == WIRE_SESSION) {
+            sessionStart = record.when;
+            time_t seconds = (time_t)(wallTime / 1000000);
+            printf("session started %s", ctime(&seconds));
+            deframer.Reset();
+            continue;
+        }
+
+        printf("%12.6f  client %-3d %-11s", (record.when - sessionStart)
+            / 1000000.0, record.client, RecordTypeName(record.type));
+        if (record.type == WIRE_DATA) {
+            printf(" %zu bytes\n", record.length);
+            deframer.Feed(record.client, record.data, record.length,
+                [](const uint8* message, size_t length) {
+                    printf("%30s%s, %zu bytes\n", "",
+                        EventTypeName(((const ProtocolHeader*)message)->eventType),
+                        length);
+                });
+        } else {
+            printf(" %.*s\n", (int)record.length, (const char*)record.data);
+            if (record.type == WIRE_DISCONNECT)
+                deframer.Remove(record.client);
+        }
+    }
+
+    if (status == B_BAD_DATA) {
+        fprintf(stderr, "The capture ends in a damaged record\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void Usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [--tcp host:port | --in-process] "
+        "[--speed factor] [--flat-out]\n"
+        "           [--max-gap ms] [--screen WxH] capture\n"
+        "       %s --dump capture\n", name, name);
+}
+
+int main(int argc, char** argv)
+{
+    const char* host = "127.0.0.1";
+    uint16 port = 31337;
+    bool inProcess = false;
+    bool dump = false;
+    double speed = 1;
+    bool flatOut = false;
+    bigtime_t maxGap = 0;
+    float width = 1920;
+    float height = 1080;
+    const char* path = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tcp") == 0 && i + 1 < argc) {
+            static char hostBuffer[256];
+            strlcpy(hostBuffer, argv[++i], sizeof(hostBuffer));
+            char* colon = strrchr(hostBuffer, ':');
+            if (colon != nullptr) {
+                *colon = '\0';
+                port = (uint16)atoi(colon + 1);
+            }
+            host = hostBuffer;
+        } else if (strcmp(argv[i], "--in-process") == 0)
+            inProcess = true;
+        else if (strcmp(argv[i], "--dump") == 0)
+            dump = true;
+        else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+            speed = atof(argv[++i]);
+        else if (strcmp(argv[i], "--flat-out") == 0)
+            flatOut = true;
+        else if (strcmp(argv[i], "--max-gap") == 0 && i + 1 < argc)
+            maxGap = (bigtime_t)(atof(argv[++i]) * 1000);
+        else if (strcmp(argv[i], "--screen") == 0 && i + 1 < argc
+            && sscanf(argv[i + 1], "%fx%f", &width, &height) == 2)
+            i++;
+        else if (argv[i][0] != '-' && path == nullptr)
+            path = argv[i];
+        else {
+            Usage(argv[0]);
+            return 2;
+        }
+    }
+    if (path == nullptr || speed <= 0) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    WireReader reader;
+    status_t status = reader.Open(path);
+    if (status != B_OK) {
+        fprintf(stderr, "%s: %s\n", path, status == B_BAD_DATA
+            ? "not a softKM capture" : strerror(errno));
+        return 2;
+    }
+
+    if (dump)
+        return Dump(reader);
+
+    ReplayTarget* target;
+    if (inProcess)
+        target = new CoreTarget(width, height);
+    else {
+        TcpTarget* tcp = new TcpTarget;
+        if (!tcp->Init(host, port)) {
+            fprintf(stderr, "Cannot connect to %s:%d\n", host, port);
+            delete tcp;
+            return 2;
+        }
+        target = tcp;
+    }
+
+    // The capture's timeline runs on across sessions, less the time the
+    // server was down and the gaps cut short by --max-gap
+    std::set<int32> outgoing;
+    bigtime_t offset = 0;
+    bigtime_t timeline = -1;
+    bigtime_t start = Now();
+    bigtime_t lateSum = 0;
+    bigtime_t lateMax = 0;
+    uint64 late = 0;            // records sent more than 1 ms late
+    uint64 records = 0;
+    uint64 bytes = 0;
+
+    WireRecord record;
+    while ((status = reader.Next(&record)) == B_OK) {
+        if (record.type == WIRE_SESSION) {
+            offset = (timeline < 0 ? 0 : timeline) - record.when;
+            target->EndSession();
+            outgoing.clear();
+        }
+
+        bigtime_t when = record.when + offset;
+        if (timeline < 0)
+            timeline = when;
+        if (maxGap > 0 && when - timeline > maxGap) {
+            offset -= when - timeline - maxGap;
+            when = timeline + maxGap;
+        }
+        timeline = when;
+
+        if (flatOut)
+            target->Wait(0, timeline);
+        else {
+            bigtime_t due = start + (bigtime_t)(timeline / speed);
+            target->Wait(due, timeline);
+            bigtime_t lateness = Now() - due;
+            lateSum += lateness;
+            if (lateness > lateMax)
+                lateMax = lateness;
+            if (lateness > 1000)
+                late++;
+        }
+
+        records++;
+        switch (record.type) {
+            case WIRE_CONNECT:
+                target->Connect(record.client);
+                break;
+            case WIRE_CONNECT_OUT:
+                // A neighbour server's replies, not the client's input
+                outgoing.insert(record.client);
+                break;
+            case WIRE_DATA:
+                if (outgoing.find(record.client) == outgoing.end()) {
+                    bytes += record.length;
+                    target->Data(record.client, record.data, record.length);
+                }
+                break;
+            case WIRE_DISCONNECT:
+                if (outgoing.erase(record.client) == 0)
+                    target->Disconnect(record.client);
+                break;
+        }
+    }
+    target->EndSession();
+
+    bigtime_t elapsed = Now() - start;
+    if (status == B_BAD_DATA)
+        fprintf(stderr, "The capture ends in a damaged record\n");
+
+    // The timeline starts at 0 with the first record
+    double captured = timeline > 0 ? timeline / 1000000.0 : 0;
+    uint64 messages = target->Counter().Messages();
+    printf("%llu records, %llu bytes, %llu messages over %.3f s of capture\n",
+        (unsigned long long)records, (unsigned long long)bytes,
+        (unsigned long long)messages, captured);
+    printf("replayed in %.3f s (%.1fx), %.0f messages/s\n", elapsed / 1000000.0,
+        elapsed > 0 ? captured * 1000000.0 / elapsed : 0,
+        elapsed > 0 ? messages * 1000000.0 / elapsed : 0);
+    if (!flatOut && records > 0) {
+        printf("behind schedule: mean %.0f µs, max %.1f ms, %llu record(s) "
+            "over 1 ms\n", (double)lateSum / records, lateMax / 1000.0,
+            (unsigned long long)late);
+    }
+    target->Counter().Print();
+    target->Report();
+
+    delete target;
+    return status == B_BAD_DATA ? 1 : 0;
+}